@@ -0,0 +1,48 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : bench.h
+#   Last Modified : 2024-07-20
+#   Describe      : Microbenchmark harness with JSON output
+#
+# ====================================================*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_PARAMS_SIZE 160
+
+// One timed operation; returns 0 on success
+typedef int (*bench_fn_t)(void *arg);
+
+// Options shared by every suite
+struct bench_options_t {
+    const char *filter;     // Run only cases whose name contains this (NULL - all)
+    double scale;           // Multiplier for every case's iteration count
+};
+
+extern struct bench_options_t bench_options;
+
+// Start the JSON document on out
+void bench_begin(FILE *out);
+
+/*
+ * Time iterations calls of op (after a warm-up of a tenth as many) and emit one result.
+ * params is the body of a JSON object, e.g. "\"key_size\":32"; bytes is the payload each
+ * call processes (0 - no throughput figure). Returns 0, or -1 if op failed.
+ */
+int bench_run(const char *name, const char *params, bench_fn_t op, void *arg, int iterations, size_t bytes);
+
+// Close the JSON document; returns the number of failed cases
+int bench_end(void);
+
+// Suites (bench_core.c, bench_io.c)
+void bench_core(void);
+void bench_io(void);
+
+#endif // BENCH_H
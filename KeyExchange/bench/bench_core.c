@@ -0,0 +1,189 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : bench_core.c
+#   Last Modified : 2024-07-20
+#   Describe      : Benchmarks for key generation, secret sharing, checksums and encryption
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_session.h"
+#include "bench.h"
+
+// Layouts every sharing benchmark runs over
+static const int key_sizes[] = { 32, 256 };
+static const struct { int total, threshold; } layouts[] = { { 5, 3 }, { 32, 16 }, { 255, 128 } };
+static const int batch_counts[] = { 1, 32, 255 };
+static const int session_counts[] = { 0, 200000 };
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+struct core_arg_t {
+    struct rke_ctx_t ctx;
+    struct rke_key_metadata_t metadata;
+    struct rke_fragment_t fragments[RKE_MAX_FRAGMENTS];
+    unsigned char key[RKE_MAX_KEY_SIZE];
+    unsigned char aes_key[16];
+    unsigned char nonce[16];
+    int key_size;
+    int count;
+};
+
+static struct core_arg_t core;
+
+static int op_generate(void *arg) {
+    struct core_arg_t *a = (struct core_arg_t *)arg;
+
+    return rke_generate_key(a->key, (uint16_t)a->key_size);
+}
+
+static int op_split(void *arg) {
+    struct core_arg_t *a = (struct core_arg_t *)arg;
+
+    return rke_split_key(&a->ctx, a->key, (uint16_t)a->key_size, &a->metadata, a->fragments);
+}
+
+static int op_reconstruct(void *arg) {
+    struct core_arg_t *a = (struct core_arg_t *)arg;
+    unsigned char key[RKE_MAX_KEY_SIZE];
+
+    return rke_reconstruct_key(&a->ctx, key, (uint16_t)a->key_size, &a->metadata, a->fragments,
+                               a->metadata.threshold);
+}
+
+static int op_checksum(void *arg) {
+    struct core_arg_t *a = (struct core_arg_t *)arg;
+
+    return rke_calculate_checksums(a->fragments, a->count);
+}
+
+static int op_verify(void *arg) {
+    struct core_arg_t *a = (struct core_arg_t *)arg;
+    int bad_index;
+
+    return rke_verify_checksums(a->fragments, a->count, &bad_index);
+}
+
+static int op_encrypt(void *arg) {
+    struct core_arg_t *a = (struct core_arg_t *)arg;
+
+    return rke_encrypt_fragments(a->fragments, a->count, a->aes_key, a->nonce);
+}
+
+static int op_decrypt(void *arg) {
+    struct core_arg_t *a = (struct core_arg_t *)arg;
+
+    return rke_decrypt_fragments(a->fragments, a->count, a->aes_key, a->nonce);
+}
+
+/*
+ * Open a session, move it through its states and close it
+ */
+static int op_session(void *arg) {
+    struct rke_session_t session;
+    int rv;
+
+    (void)arg;
+    memset(&session, 0, sizeof(session));
+    rke_generate_key(session.session_id, RKE_SESSION_ID_SIZE);
+    session.timeout = rke_session_now() + RKE_SESSION_DEFAULT_TIMEOUT;
+
+    rv = rke_session_insert(&session);
+    if (rv == RKE_SUCCESS) {
+        rv = rke_session_set_state(session.session_id, RKE_SESSION_STATE_ACTIVE);
+    }
+    if (rv == RKE_SUCCESS) {
+        rv = rke_session_remove(session.session_id);
+    }
+
+    return rv;
+}
+
+/*
+ * Prepare a split key with the given layout in the shared argument
+ */
+static int prepare_split(int key_size, int total, int threshold) {
+    memset(&core.metadata, 0, sizeof(core.metadata));
+    rke_generate_key(core.metadata.key_id, RKE_KEY_ID_SIZE);
+    core.metadata.key_type = RKE_KEY_TYPE_SYMMETRIC;
+    core.metadata.total_fragments = (uint8_t)total;
+    core.metadata.threshold = (uint8_t)threshold;
+    core.key_size = key_size;
+    core.count = total;
+
+    if (rke_generate_key(core.key, (uint16_t)key_size) != RKE_SUCCESS) {
+        return -1;
+    }
+
+    return (op_split(&core) == RKE_SUCCESS) ? 0 : -1;
+}
+
+void bench_core(void) {
+    char params[BENCH_PARAMS_SIZE];
+
+    rke_ctx_init(&core.ctx);
+    rke_generate_key(core.aes_key, sizeof(core.aes_key));
+    rke_generate_key(core.nonce, sizeof(core.nonce));
+
+    for (int k = 0; k < COUNT(key_sizes); k++) {
+        core.key_size = key_sizes[k];
+        snprintf(params, sizeof(params), "\"key_size\":%d", key_sizes[k]);
+        bench_run("generate", params, op_generate, &core, 20000, (size_t)key_sizes[k]);
+    }
+
+    for (int k = 0; k < COUNT(key_sizes); k++) {
+        for (int l = 0; l < COUNT(layouts); l++) {
+            int iterations = 200000 / (layouts[l].total * key_sizes[k] / 32 + 1);
+
+            if (prepare_split(key_sizes[k], layouts[l].total, layouts[l].threshold) != 0) {
+                fprintf(stderr, "Failed to prepare a %d-byte %d/%d split\n",
+                        key_sizes[k], layouts[l].threshold, layouts[l].total);
+                continue;
+            }
+
+            snprintf(params, sizeof(params), "\"key_size\":%d,\"fragments\":%d,\"threshold\":%d",
+                     key_sizes[k], layouts[l].total, layouts[l].threshold);
+            bench_run("split", params, op_split, &core, iterations, (size_t)key_sizes[k]);
+            bench_run("reconstruct", params, op_reconstruct, &core, iterations, (size_t)key_sizes[k]);
+        }
+    }
+
+    // Checksums and encryption always cover the full fragment payload
+    prepare_split(RKE_FRAGMENT_DATA_SIZE, RKE_MAX_FRAGMENTS, RKE_MAX_FRAGMENTS / 2);
+    for (int c = 0; c < COUNT(batch_counts); c++) {
+        size_t bytes = (size_t)batch_counts[c] * RKE_FRAGMENT_DATA_SIZE;
+        int iterations = 20000 / batch_counts[c] + 100;
+
+        core.count = batch_counts[c];
+        snprintf(params, sizeof(params), "\"fragments\":%d", batch_counts[c]);
+        bench_run("checksum", params, op_checksum, &core, iterations, bytes);
+        bench_run("verify", params, op_verify, &core, iterations, bytes);
+        bench_run("encrypt", params, op_encrypt, &core, iterations, bytes);
+        bench_run("decrypt", params, op_decrypt, &core, iterations, bytes);
+    }
+
+    // Sessions, with the table already holding a number of live ones
+    for (int c = 0; c < COUNT(session_counts); c++) {
+        struct rke_session_t session;
+
+        rke_session_set_capacity(RKE_SESSION_DEFAULT_CAPACITY);
+        memset(&session, 0, sizeof(session));
+        session.timeout = rke_session_now() + RKE_SESSION_DEFAULT_TIMEOUT;
+        for (int i = 0; i < session_counts[c]; i++) {
+            rke_generate_key(session.session_id, RKE_SESSION_ID_SIZE);
+            rke_session_insert(&session);
+        }
+
+        snprintf(params, sizeof(params), "\"live_sessions\":%d", session_counts[c]);
+        bench_run("session", params, op_session, NULL, 100000, 0);
+    }
+    rke_session_set_capacity(RKE_SESSION_DEFAULT_CAPACITY);
+
+    rke_ctx_cleanup(&core.ctx);
+}
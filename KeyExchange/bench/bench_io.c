@@ -0,0 +1,198 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : bench_io.c
+#   Last Modified : 2024-07-20
+#   Describe      : Benchmarks for fragment storage and the cmd_rke_* handlers
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_cache.h"
+#include "../src/common/protocol.h"
+#include "bench.h"
+
+#define EOF_SIZE 2
+#define BATCH_KEYS 16
+
+static const struct { int total, threshold; } layouts[] = { { 5, 3 }, { 255, 128 } };
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+struct io_arg_t {
+    struct rke_key_metadata_t metadata;
+    struct rke_fragment_t fragments[RKE_MAX_FRAGMENTS];
+    unsigned char body[5 + BATCH_KEYS * RKE_KEY_ID_SIZE + EOF_SIZE];  // Also fits an exchange multi bitmap
+    uint32_t body_size;
+    void (*command)(conn_info_t *ci);
+    int fresh_key_id;       // 1-based body offset of a key id to change per request (0 - none)
+    int fresh_keys;         // Number of consecutive key ids from there to change
+    uint32_t sequence;
+};
+
+static struct io_arg_t io;
+
+static int op_store(void *arg) {
+    struct io_arg_t *a = (struct io_arg_t *)arg;
+
+    return rke_store_fragments(a->metadata.key_id, &a->metadata, a->fragments, a->metadata.total_fragments);
+}
+
+static int op_load(void *arg) {
+    struct io_arg_t *a = (struct io_arg_t *)arg;
+    int count = a->metadata.total_fragments;
+
+    return (rke_load_fragments(a->metadata.key_id, NULL, a->fragments, count) == count) ? 0 : -1;
+}
+
+/*
+ * Run one protocol request and release its response
+ */
+static int op_command(void *arg) {
+    struct io_arg_t *a = (struct io_arg_t *)arg;
+    conn_info_t ci;
+    int status;
+
+    if (a->fresh_key_id) {
+        a->sequence++;
+        for (int k = 0; k < a->fresh_keys; k++) {
+            memcpy(a->body + a->fresh_key_id - 1 + k * RKE_KEY_ID_SIZE, &a->sequence, sizeof(a->sequence));
+        }
+    }
+
+    memset(&ci, 0, sizeof(ci));
+    ci.body = a->body;
+    ci.body_size = a->body_size;
+    a->command(&ci);
+    status = ci.command_status;
+    release_output(&ci);
+
+    return (status == STATUS_SUCCESS) ? 0 : -1;
+}
+
+/*
+ * Store a fresh key with the given layout in the shared argument
+ */
+static int prepare_key(int total, int threshold) {
+    memset(&io.metadata, 0, sizeof(io.metadata));
+    rke_generate_key(io.metadata.key_id, RKE_KEY_ID_SIZE);
+    io.metadata.key_type = RKE_KEY_TYPE_SYMMETRIC;
+    io.metadata.total_fragments = (uint8_t)total;
+    io.metadata.threshold = (uint8_t)threshold;
+
+    memset(io.fragments, 0, sizeof(io.fragments));
+    for (int i = 0; i < total; i++) {
+        io.fragments[i].fragment_id = (uint8_t)(i + 1);
+        io.fragments[i].total_fragments = (uint8_t)total;
+        io.fragments[i].threshold = (uint8_t)threshold;
+        io.fragments[i].fragment_size = RKE_FRAGMENT_DATA_SIZE;
+        rke_generate_key(io.fragments[i].data, RKE_FRAGMENT_DATA_SIZE);
+    }
+    if (rke_calculate_checksums(io.fragments, total) != RKE_SUCCESS) {
+        return -1;
+    }
+
+    return op_store(&io);
+}
+
+static void set_request(void (*command)(conn_info_t *ci), const unsigned char *key_id, int fragment_id) {
+    io.command = command;
+    io.fresh_key_id = 0;
+    memcpy(io.body, key_id, RKE_KEY_ID_SIZE);
+    io.body_size = RKE_KEY_ID_SIZE + EOF_SIZE;
+    if (fragment_id > 0) {
+        io.body[RKE_KEY_ID_SIZE] = (uint8_t)fragment_id;
+        io.body_size++;
+    }
+    memset(io.body + io.body_size - EOF_SIZE, 0x3E, EOF_SIZE);
+}
+
+static void set_generate(const unsigned char *key_id, int total, int threshold) {
+    set_request(cmd_rke_generate, key_id, 0);
+    io.body[16] = RKE_KEY_TYPE_SYMMETRIC;
+    io.body[17] = (uint8_t)total;
+    io.body[18] = (uint8_t)threshold;
+    io.body_size = 19 + EOF_SIZE;
+    memset(io.body + 19, 0x3E, EOF_SIZE);
+}
+
+static void bench_handlers(int total, int threshold, const char *params) {
+    char batch_params[BENCH_PARAMS_SIZE + 16];
+    struct rke_session_t session;
+    int iterations = (total > 32) ? 200 : 1000;
+
+    // Generate: a new key id per request, so every request writes a new container
+    set_generate(io.metadata.key_id, total, threshold);
+    io.fresh_key_id = 1;
+    io.fresh_keys = 1;
+    bench_run("cmd_rke_generate", params, op_command, &io, iterations, 0);
+
+    set_request(cmd_rke_exchange, io.metadata.key_id, total);
+    bench_run("cmd_rke_exchange", params, op_command, &io, 50000, sizeof(struct rke_fragment_t));
+
+    // Exchange multi: a threshold of fragments in one encrypted response
+    if (rke_init_session(&session, io.metadata.key_id, io.metadata.key_id) == RKE_SUCCESS) {
+        set_request(cmd_rke_exchange_multi, io.metadata.key_id, 0);
+        memset(io.body + RKE_KEY_ID_SIZE, 0, RKE_FRAGMENT_BITMAP_SIZE);
+        for (int id = 1; id <= threshold; id++) {
+            RKE_BITMAP_SET(io.body + RKE_KEY_ID_SIZE, id);
+        }
+        memcpy(io.body + RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE, session.session_id, RKE_SESSION_ID_SIZE);
+        io.body_size = RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE + RKE_SESSION_ID_SIZE + EOF_SIZE;
+        memset(io.body + io.body_size - EOF_SIZE, 0x3E, EOF_SIZE);
+        bench_run("cmd_rke_exchange_multi", params, op_command, &io, 50000 / threshold,
+                  (size_t)threshold * sizeof(struct rke_fragment_t));
+        rke_cleanup_session(&session);
+    }
+
+    set_request(cmd_rke_query, io.metadata.key_id, 0);
+    bench_run("cmd_rke_query", params, op_command, &io, 50000, 0);
+
+    // Reconstruct needs a key that generate actually split
+    set_generate(io.metadata.key_id, total, threshold);
+    if (op_command(&io) == 0) {
+        set_request(cmd_rke_reconstruct, io.metadata.key_id, 0);
+        bench_run("cmd_rke_reconstruct", params, op_command, &io, iterations * 5, 0);
+    }
+
+    // Generate batch: every key id is new per request, as a batch never overwrites a stored key
+    io.command = cmd_rke_generate_batch;
+    io.body[0] = RKE_KEY_TYPE_SYMMETRIC;
+    io.body[1] = (uint8_t)total;
+    io.body[2] = (uint8_t)threshold;
+    io.body[3] = 0;
+    io.body[4] = BATCH_KEYS;
+    for (int k = 0; k < BATCH_KEYS; k++) {
+        rke_generate_key(io.body + 5 + k * RKE_KEY_ID_SIZE, RKE_KEY_ID_SIZE);
+    }
+    io.body_size = 5 + BATCH_KEYS * RKE_KEY_ID_SIZE + EOF_SIZE;
+    memset(io.body + io.body_size - EOF_SIZE, 0x3E, EOF_SIZE);
+    io.fresh_key_id = 6;
+    io.fresh_keys = BATCH_KEYS;
+    snprintf(batch_params, sizeof(batch_params), "%s,\"keys\":%d", params, BATCH_KEYS);
+    bench_run("cmd_rke_generate_batch", batch_params, op_command, &io, iterations / 4, 0);
+}
+
+void bench_io(void) {
+    char params[BENCH_PARAMS_SIZE];
+
+    for (int l = 0; l < COUNT(layouts); l++) {
+        size_t bytes = (size_t)layouts[l].total * sizeof(struct rke_fragment_t);
+        int iterations = (layouts[l].total > 32) ? 200 : 1000;
+
+        if (prepare_key(layouts[l].total, layouts[l].threshold) != RKE_SUCCESS) {
+            fprintf(stderr, "Failed to store a %d-fragment key\n", layouts[l].total);
+            continue;
+        }
+
+        snprintf(params, sizeof(params), "\"fragments\":%d,\"threshold\":%d", layouts[l].total, layouts[l].threshold);
+        bench_run("store", params, op_store, &io, iterations, bytes);
+        bench_run("load", params, op_load, &io, iterations * 20, bytes);
+        bench_handlers(layouts[l].total, layouts[l].threshold, params);
+    }
+}
@@ -0,0 +1,65 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : bench_main.c
+#   Last Modified : 2024-07-20
+#   Describe      : Entry point of the RKE microbenchmark suite
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "bench.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_ERROR;
+struct config_s config = {
+    .cwd = "/tmp/rke_bench",
+    .coin_id = 1
+};
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-o file.json] [-f name-filter] [-s iteration-scale]\n", program);
+}
+
+int main(int argc, char **argv) {
+    FILE *out = stdout;
+    int failures;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = fopen(argv[++i], "w");
+            if (out == NULL) {
+                perror(argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            bench_options.filter = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            bench_options.scale = atof(argv[++i]);
+            if (bench_options.scale <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    bench_begin(out);
+    bench_core();
+    bench_io();
+    failures = bench_end();
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,432 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_load.c
+#   Last Modified : 2024-07-20
+#   Describe      : Multi-threaded load generator for the cmd_rke_* handlers
+#
+# ====================================================*/
+
+// clock_gettime() is POSIX, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../src/rke/rke.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "../src/common/protocol.h"
+
+/*
+ * Each thread replays a random mix of generate, exchange, query and reconstruct requests
+ * against keys preloaded under a temporary storage root, timing every request.
+ * System calls and allocations are counted by wrapping their libc entry points at link
+ * time (-Wl,--wrap, see the Makefile), so only calls made from the RKE library and this
+ * tool are seen: futex waits inside pthread and I/O done inside stdio are not.
+ */
+#define MAX_THREADS 64
+#define EOF_SIZE 2
+
+enum { OP_GENERATE, OP_EXCHANGE, OP_QUERY, OP_RECONSTRUCT, OP_TYPES };
+
+static const char *op_names[OP_TYPES] = { "generate", "exchange", "query", "reconstruct" };
+static void (*const op_commands[OP_TYPES])(conn_info_t *ci) = {
+    cmd_rke_generate, cmd_rke_exchange, cmd_rke_query, cmd_rke_reconstruct
+};
+
+// Define global variables
+int current_log_level = LOG_LEVEL_ERROR;
+struct config_s config = {
+    .cwd = "/tmp/rke_load",
+    .coin_id = 1
+};
+
+static struct {
+    int threads;
+    int ops;                // Requests per thread
+    int keys;               // Keys preloaded before the run
+    int total, threshold;
+    int mix[OP_TYPES];      // Relative weights
+} options = { 4, 20000, 256, 5, 3, { 5, 70, 20, 5 } };
+
+static unsigned char (*key_ids)[RKE_KEY_ID_SIZE];
+static uint64_t syscalls, allocations;
+
+struct worker_t {
+    pthread_t thread;
+    int id;
+    uint64_t seed;
+    uint64_t *latencies[OP_TYPES];
+    int counts[OP_TYPES];
+    int failures[OP_TYPES];
+};
+
+/* Link-time wrappers counting system calls and allocations */
+
+#define COUNT_SYSCALL() __atomic_add_fetch(&syscalls, 1, __ATOMIC_RELAXED)
+#define COUNT_ALLOCATION() __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED)
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t alignment, size_t size);
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+ssize_t __real_pread(int fd, void *buf, size_t count, off_t offset);
+int __real_fstat(int fd, struct stat *st);
+int __real_ftruncate(int fd, off_t length);
+int __real_fdatasync(int fd);
+int __real_syncfs(int fd);
+ssize_t __real_getrandom(void *buf, size_t count, unsigned int flags);
+int __real_rename(const char *from, const char *to);
+int __real_unlink(const char *path);
+int __real_mkdir(const char *path, mode_t mode);
+void *__real_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+int __real_munmap(void *addr, size_t length);
+long __real_syscall(long number, ...);
+
+void *__wrap_malloc(size_t size) { COUNT_ALLOCATION(); return __real_malloc(size); }
+void *__wrap_calloc(size_t count, size_t size) { COUNT_ALLOCATION(); return __real_calloc(count, size); }
+void *__wrap_realloc(void *ptr, size_t size) { COUNT_ALLOCATION(); return __real_realloc(ptr, size); }
+int __wrap_posix_memalign(void **ptr, size_t alignment, size_t size) {
+    COUNT_ALLOCATION();
+    return __real_posix_memalign(ptr, alignment, size);
+}
+
+int __wrap_open(const char *path, int flags, ...) {
+    mode_t mode = 0;
+    va_list args;
+
+    if (flags & O_CREAT) {
+        va_start(args, flags);
+        mode = (mode_t)va_arg(args, int);
+        va_end(args);
+    }
+    COUNT_SYSCALL();
+    return __real_open(path, flags, mode);
+}
+
+int __wrap_close(int fd) { COUNT_SYSCALL(); return __real_close(fd); }
+ssize_t __wrap_read(int fd, void *buf, size_t count) { COUNT_SYSCALL(); return __real_read(fd, buf, count); }
+ssize_t __wrap_write(int fd, const void *buf, size_t count) { COUNT_SYSCALL(); return __real_write(fd, buf, count); }
+ssize_t __wrap_pread(int fd, void *buf, size_t count, off_t offset) {
+    COUNT_SYSCALL();
+    return __real_pread(fd, buf, count, offset);
+}
+int __wrap_fstat(int fd, struct stat *st) { COUNT_SYSCALL(); return __real_fstat(fd, st); }
+int __wrap_ftruncate(int fd, off_t length) { COUNT_SYSCALL(); return __real_ftruncate(fd, length); }
+int __wrap_fdatasync(int fd) { COUNT_SYSCALL(); return __real_fdatasync(fd); }
+int __wrap_syncfs(int fd) { COUNT_SYSCALL(); return __real_syncfs(fd); }
+ssize_t __wrap_getrandom(void *buf, size_t count, unsigned int flags) {
+    COUNT_SYSCALL();
+    return __real_getrandom(buf, count, flags);
+}
+int __wrap_rename(const char *from, const char *to) { COUNT_SYSCALL(); return __real_rename(from, to); }
+int __wrap_unlink(const char *path) { COUNT_SYSCALL(); return __real_unlink(path); }
+int __wrap_mkdir(const char *path, mode_t mode) { COUNT_SYSCALL(); return __real_mkdir(path, mode); }
+void *__wrap_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    COUNT_SYSCALL();
+    return __real_mmap(addr, length, prot, flags, fd, offset);
+}
+int __wrap_munmap(void *addr, size_t length) { COUNT_SYSCALL(); return __real_munmap(addr, length); }
+
+// io_uring calls pass at most six arguments
+long __wrap_syscall(long number, ...) {
+    long a[6];
+    va_list args;
+
+    va_start(args, number);
+    for (int i = 0; i < 6; i++) {
+        a[i] = va_arg(args, long);
+    }
+    va_end(args);
+    COUNT_SYSCALL();
+    return __real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+/* Request generation */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int pick_op(uint64_t *seed) {
+    int sum = 0, pick;
+
+    for (int i = 0; i < OP_TYPES; i++) {
+        sum += options.mix[i];
+    }
+    pick = (int)(next_random(seed) % (uint64_t)sum);
+    for (int i = 0; i < OP_TYPES; i++) {
+        if (pick < options.mix[i]) {
+            return i;
+        }
+        pick -= options.mix[i];
+    }
+
+    return OP_QUERY;
+}
+
+/*
+ * Build the request body for one operation; returns its size
+ */
+static uint32_t build_request(int op, unsigned char *body, uint64_t *seed, int worker, int sequence) {
+    uint32_t size = RKE_KEY_ID_SIZE;
+
+    if (op == OP_GENERATE) {
+        // Keys of the run never collide with preloaded ones or each other
+        memset(body, 0xA5, RKE_KEY_ID_SIZE);
+        memcpy(body, &worker, sizeof(worker));
+        memcpy(body + sizeof(worker), &sequence, sizeof(sequence));
+        body[size++] = RKE_KEY_TYPE_SYMMETRIC;
+        body[size++] = (uint8_t)options.total;
+        body[size++] = (uint8_t)options.threshold;
+    } else {
+        memcpy(body, key_ids[next_random(seed) % (uint64_t)options.keys], RKE_KEY_ID_SIZE);
+        if (op == OP_EXCHANGE) {
+            body[size++] = (uint8_t)(1 + next_random(seed) % (uint64_t)options.total);
+        }
+    }
+
+    memset(body + size, 0x3E, EOF_SIZE);
+    return size + EOF_SIZE;
+}
+
+static int run_request(int op, unsigned char *body, uint32_t body_size) {
+    conn_info_t ci;
+    int status;
+
+    memset(&ci, 0, sizeof(ci));
+    ci.body = body;
+    ci.body_size = body_size;
+    op_commands[op](&ci);
+    status = ci.command_status;
+    release_output(&ci);
+
+    return status;
+}
+
+static void *worker_thread(void *arg) {
+    struct worker_t *w = (struct worker_t *)arg;
+    unsigned char body[64];
+
+    for (int i = 0; i < options.ops; i++) {
+        int op = pick_op(&w->seed);
+        uint32_t size = build_request(op, body, &w->seed, w->id, i);
+        uint64_t start = now_ns();
+        int status = run_request(op, body, size);
+
+        w->latencies[op][w->counts[op]++] = now_ns() - start;
+        w->failures[op] += (status != STATUS_SUCCESS);
+    }
+
+    return NULL;
+}
+
+/* Reporting */
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, int count, double p) {
+    return count ? sorted[(int)(p * (count - 1) + 0.5)] : 0;
+}
+
+static void print_latencies(const char *name, uint64_t *samples, int count, int failures, int last) {
+    qsort(samples, (size_t)count, sizeof(uint64_t), compare_u64);
+    printf("    \"%s\": {\"count\": %d, \"failures\": %d, \"latency_ns\": {\"p50\": %llu, \"p99\": %llu, "
+           "\"p999\": %llu, \"max\": %llu}}%s\n", name, count, failures,
+           (unsigned long long)percentile(samples, count, 0.5), (unsigned long long)percentile(samples, count, 0.99),
+           (unsigned long long)percentile(samples, count, 0.999),
+           (unsigned long long)(count ? samples[count - 1] : 0), last ? "" : ",");
+}
+
+static void report(struct worker_t *workers, double seconds, uint64_t run_syscalls, uint64_t run_allocations) {
+    uint64_t *all = (uint64_t *) malloc((size_t)options.threads * options.ops * sizeof(uint64_t));
+    int total = 0, failures = 0;
+
+    printf("{\n  \"threads\": %d,\n  \"ops\": %d,\n  \"keys\": %d,\n  \"fragments\": %d,\n  \"threshold\": %d,\n",
+           options.threads, options.threads * options.ops, options.keys, options.total, options.threshold);
+    printf("  \"ops_per_sec\": %.1f,\n", options.threads * options.ops / seconds);
+    printf("  \"syscalls_per_op\": %.2f,\n", (double)run_syscalls / (options.threads * options.ops));
+    printf("  \"allocations_per_op\": %.2f,\n", (double)run_allocations / (options.threads * options.ops));
+    printf("  \"operations\": {\n");
+
+    for (int op = 0; op < OP_TYPES; op++) {
+        int count = 0, op_failures = 0;
+
+        for (int t = 0; t < options.threads; t++) {
+            memcpy(all + total + count, workers[t].latencies[op], (size_t)workers[t].counts[op] * sizeof(uint64_t));
+            count += workers[t].counts[op];
+            op_failures += workers[t].failures[op];
+        }
+        print_latencies(op_names[op], all + total, count, op_failures, 0);
+        total += count;
+        failures += op_failures;
+    }
+    print_latencies("all", all, total, failures, 1);
+    printf("  }\n}\n");
+
+    free(all);
+}
+
+/* Setup */
+
+static int parse_mix(const char *text) {
+    int mix[OP_TYPES];
+
+    if (sscanf(text, "%d,%d,%d,%d", &mix[0], &mix[1], &mix[2], &mix[3]) != OP_TYPES) {
+        return -1;
+    }
+    for (int i = 0; i < OP_TYPES; i++) {
+        if (mix[i] < 0) {
+            return -1;
+        }
+    }
+    if (mix[0] + mix[1] + mix[2] + mix[3] == 0) {
+        return -1;
+    }
+
+    memcpy(options.mix, mix, sizeof(mix));
+    return 0;
+}
+
+static int parse_options(int argc, char **argv) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char *value = argv[i + 1];
+
+        if (strcmp(argv[i], "-t") == 0) {
+            options.threads = atoi(value);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            options.ops = atoi(value);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            options.keys = atoi(value);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            if (sscanf(value, "%d/%d", &options.threshold, &options.total) != 2) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            if (parse_mix(value) != 0) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0) {
+            snprintf(config.cwd, sizeof(config.cwd), "%s", value);
+        } else {
+            return -1;
+        }
+    }
+
+    if (argc % 2 == 0 || options.threads < 1 || options.threads > MAX_THREADS || options.ops < 1 ||
+        options.keys < 1 || options.threshold < RKE_MIN_THRESHOLD || options.total > RKE_MAX_FRAGMENTS ||
+        options.threshold > options.total) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Generate the keys the run exchanges, queries and reconstructs
+ */
+static int preload_keys(void) {
+    unsigned char body[RKE_KEY_ID_SIZE + 3 + EOF_SIZE];
+
+    key_ids = malloc((size_t)options.keys * RKE_KEY_ID_SIZE);
+    if (key_ids == NULL) {
+        return -1;
+    }
+
+    for (int k = 0; k < options.keys; k++) {
+        rke_generate_key(key_ids[k], RKE_KEY_ID_SIZE);
+        memcpy(body, key_ids[k], RKE_KEY_ID_SIZE);
+        body[RKE_KEY_ID_SIZE] = RKE_KEY_TYPE_SYMMETRIC;
+        body[RKE_KEY_ID_SIZE + 1] = (uint8_t)options.total;
+        body[RKE_KEY_ID_SIZE + 2] = (uint8_t)options.threshold;
+        memset(body + RKE_KEY_ID_SIZE + 3, 0x3E, EOF_SIZE);
+        if (run_request(OP_GENERATE, body, sizeof(body)) != STATUS_SUCCESS) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static struct worker_t workers[MAX_THREADS];
+    uint64_t start, syscalls_before, allocations_before;
+
+    if (parse_options(argc, argv) != 0) {
+        fprintf(stderr, "Usage: %s [-t threads] [-n ops-per-thread] [-k keys] [-l threshold/total]\n"
+                "       [-m generate,exchange,query,reconstruct weights] [-r storage-root]\n", argv[0]);
+        return 1;
+    }
+
+    if (preload_keys() != 0) {
+        fprintf(stderr, "Failed to preload %d keys under %s\n", options.keys, config.cwd);
+        return 1;
+    }
+
+    for (int t = 0; t < options.threads; t++) {
+        workers[t].id = t;
+        workers[t].seed = 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1);
+        for (int op = 0; op < OP_TYPES; op++) {
+            workers[t].latencies[op] = (uint64_t *) malloc((size_t)options.ops * sizeof(uint64_t));
+            if (workers[t].latencies[op] == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+        }
+    }
+
+    syscalls_before = __atomic_load_n(&syscalls, __ATOMIC_RELAXED);
+    allocations_before = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    start = now_ns();
+
+    for (int t = 0; t < options.threads; t++) {
+        if (pthread_create(&workers[t].thread, NULL, worker_thread, &workers[t]) != 0) {
+            fprintf(stderr, "Failed to start thread %d\n", t);
+            return 1;
+        }
+    }
+    for (int t = 0; t < options.threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    report(workers, (double)(now_ns() - start) / 1e9,
+           __atomic_load_n(&syscalls, __ATOMIC_RELAXED) - syscalls_before,
+           __atomic_load_n(&allocations, __ATOMIC_RELAXED) - allocations_before);
+
+    for (int t = 0; t < options.threads; t++) {
+        for (int op = 0; op < OP_TYPES; op++) {
+            free(workers[t].latencies[op]);
+        }
+    }
+    free(key_ids);
+
+    return 0;
+}
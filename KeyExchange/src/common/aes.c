@@ -0,0 +1,320 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : aes.c
+#   Last Modified : 2024-07-20
+#   Describe      : AES key schedule, portable table-free cipher, CTR mode and backend dispatch
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "utils.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_X86 1
+#endif
+
+struct aes_backend_t {
+    const char *name;
+    aes_ctr_kernel_t ctr;
+};
+
+static void aes_ctr_portable(const struct aes_key_t *key, const unsigned char *ctr, unsigned char *data,
+                             size_t len);
+
+static const struct aes_backend_t backends[] = {
+#ifdef AES_X86
+    { "vaes", aes_ctr_vaes },
+    { "aesni", aes_ctr_aesni },
+#endif
+    { "portable", aes_ctr_portable },
+};
+
+#define AES_BACKEND_COUNT ((int)(sizeof(backends) / sizeof(backends[0])))
+
+static const struct aes_backend_t *active_backend = NULL;
+
+/*
+ * The portable cipher processes eight bytes at a time in a uint64_t and computes the
+ * S-box arithmetically (inversion as x^254 followed by the affine map), so no lookup
+ * depends on key or data.
+ */
+static uint64_t xtime64(uint64_t x) {
+    uint64_t high = (x >> 7) & 0x0101010101010101ULL;
+    return ((x & 0x7f7f7f7f7f7f7f7fULL) << 1) ^ (high * 0x1b);
+}
+
+static uint64_t gf_mul64(uint64_t a, uint64_t b) {
+    uint64_t result = 0;
+
+    for (int i = 0; i < 8; i++) {
+        uint64_t mask = ((b >> i) & 0x0101010101010101ULL) * 0xff;
+        result ^= a & mask;
+        a = xtime64(a);
+    }
+
+    return result;
+}
+
+static uint64_t rotl8_64(uint64_t x, int n) {
+    uint64_t low = 0x0101010101010101ULL * (0xffu >> (8 - n));
+    return ((x << n) & ~low) | ((x >> (8 - n)) & low);
+}
+
+static uint64_t sbox64(uint64_t x) {
+    uint64_t x2 = gf_mul64(x, x);
+    uint64_t x3 = gf_mul64(x2, x);
+    uint64_t x6 = gf_mul64(x3, x3);
+    uint64_t x12 = gf_mul64(x6, x6);
+    uint64_t x15 = gf_mul64(x12, x3);
+    uint64_t x30 = gf_mul64(x15, x15);
+    uint64_t x60 = gf_mul64(x30, x30);
+    uint64_t x120 = gf_mul64(x60, x60);
+    uint64_t x240 = gf_mul64(x120, x120);
+    uint64_t inv = gf_mul64(gf_mul64(x240, x12), x2);
+
+    return inv ^ rotl8_64(inv, 1) ^ rotl8_64(inv, 2) ^ rotl8_64(inv, 3) ^ rotl8_64(inv, 4) ^
+           0x6363636363636363ULL;
+}
+
+static uint32_t sub_word(uint32_t word) {
+    return (uint32_t)sbox64(word);
+}
+
+/*
+ * Expand a 128 or 256-bit key into the encryption round keys
+ */
+int aes_set_key(struct aes_key_t *key, const unsigned char *raw_key, int key_bits) {
+    uint32_t words[(AES_MAX_ROUNDS + 1) * 4];
+    uint32_t rcon = 0x01;
+    int nk;
+
+    if (key == NULL || raw_key == NULL || (key_bits != 128 && key_bits != 256)) {
+        return -1;
+    }
+
+    nk = key_bits / 32;
+    key->rounds = nk + 6;
+
+    // Words hold the key bytes in memory order (byte 0 in the low bits)
+    for (int i = 0; i < nk; i++) {
+        words[i] = (uint32_t)raw_key[4 * i] | ((uint32_t)raw_key[4 * i + 1] << 8) |
+                   ((uint32_t)raw_key[4 * i + 2] << 16) | ((uint32_t)raw_key[4 * i + 3] << 24);
+    }
+
+    for (int i = nk; i < (key->rounds + 1) * 4; i++) {
+        uint32_t temp = words[i - 1];
+
+        if (i % nk == 0) {
+            temp = sub_word((temp >> 8) | (temp << 24)) ^ rcon;
+            rcon = (rcon << 1) ^ ((rcon >> 7) * 0x11b);
+        } else if (nk > 6 && i % nk == 4) {
+            temp = sub_word(temp);
+        }
+        words[i] = words[i - nk] ^ temp;
+    }
+
+    for (int i = 0; i < (key->rounds + 1) * 4; i++) {
+        key->round_keys[4 * i] = (unsigned char)words[i];
+        key->round_keys[4 * i + 1] = (unsigned char)(words[i] >> 8);
+        key->round_keys[4 * i + 2] = (unsigned char)(words[i] >> 16);
+        key->round_keys[4 * i + 3] = (unsigned char)(words[i] >> 24);
+    }
+
+    secure_wipe(words, sizeof(words));
+    return 0;
+}
+
+static void shift_rows(unsigned char *state) {
+    unsigned char temp[AES_BLOCK_SIZE];
+
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            temp[4 * c + r] = state[4 * ((c + r) % 4) + r];
+        }
+    }
+    memcpy(state, temp, AES_BLOCK_SIZE);
+}
+
+// Rotate every 32-bit column so that row i receives row i + n
+static uint64_t rotate_columns(uint64_t x, int n) {
+    uint64_t keep = 0x00000000ffffffffULL >> (8 * n);
+    keep |= keep << 32;
+    return ((x >> (8 * n)) & keep) | ((x << (32 - 8 * n)) & ~keep);
+}
+
+static uint64_t mix_columns64(uint64_t a) {
+    uint64_t r1 = rotate_columns(a, 1);
+    uint64_t r2 = rotate_columns(a, 2);
+    uint64_t r3 = rotate_columns(a, 3);
+
+    return xtime64(a ^ r1) ^ r1 ^ r2 ^ r3;
+}
+
+static void encrypt_block_portable(const struct aes_key_t *key, const unsigned char *in, unsigned char *out) {
+    unsigned char state[AES_BLOCK_SIZE];
+    uint64_t half[2];
+    uint64_t round_key[2];
+
+    memcpy(half, in, AES_BLOCK_SIZE);
+    memcpy(round_key, key->round_keys, AES_BLOCK_SIZE);
+    half[0] ^= round_key[0];
+    half[1] ^= round_key[1];
+
+    for (int round = 1; round <= key->rounds; round++) {
+        half[0] = sbox64(half[0]);
+        half[1] = sbox64(half[1]);
+        memcpy(state, half, AES_BLOCK_SIZE);
+        shift_rows(state);
+        memcpy(half, state, AES_BLOCK_SIZE);
+
+        if (round != key->rounds) {
+            half[0] = mix_columns64(half[0]);
+            half[1] = mix_columns64(half[1]);
+        }
+
+        memcpy(round_key, key->round_keys + round * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        half[0] ^= round_key[0];
+        half[1] ^= round_key[1];
+    }
+
+    memcpy(out, half, AES_BLOCK_SIZE);
+    secure_wipe(state, sizeof(state));
+    secure_wipe(half, sizeof(half));
+    secure_wipe(round_key, sizeof(round_key));
+}
+
+/*
+ * Add a block count to a big-endian 128-bit counter
+ */
+void aes_ctr_increment(unsigned char *ctr, uint64_t blocks) {
+    unsigned int carry = 0;
+
+    for (int i = AES_BLOCK_SIZE - 1; i >= 0; i--) {
+        unsigned int sum = ctr[i] + (unsigned int)(blocks & 0xff) + carry;
+        ctr[i] = (unsigned char)sum;
+        carry = sum >> 8;
+        blocks >>= 8;
+    }
+}
+
+static void aes_ctr_portable(const struct aes_key_t *key, const unsigned char *ctr, unsigned char *data,
+                             size_t len) {
+    unsigned char counter[AES_BLOCK_SIZE];
+    unsigned char stream[AES_BLOCK_SIZE];
+
+    memcpy(counter, ctr, AES_BLOCK_SIZE);
+    while (len > 0) {
+        size_t chunk = (len < AES_BLOCK_SIZE) ? len : AES_BLOCK_SIZE;
+
+        encrypt_block_portable(key, counter, stream);
+        for (size_t i = 0; i < chunk; i++) {
+            data[i] ^= stream[i];
+        }
+        aes_ctr_increment(counter, 1);
+        data += chunk;
+        len -= chunk;
+    }
+
+    secure_wipe(stream, sizeof(stream));
+}
+
+static int backend_supported(const struct aes_backend_t *backend) {
+#ifdef AES_X86
+    if (strcmp(backend->name, "vaes") == 0) {
+        return aes_vaes_supported();
+    }
+    if (strcmp(backend->name, "aesni") == 0) {
+        return aes_ni_supported();
+    }
+#endif
+    return strcmp(backend->name, "portable") == 0;
+}
+
+static const struct aes_backend_t *get_backend(void) {
+    if (active_backend == NULL) {
+        for (int i = 0; i < AES_BACKEND_COUNT; i++) {
+            if (backend_supported(&backends[i])) {
+                active_backend = &backends[i];
+                break;
+            }
+        }
+    }
+
+    return active_backend;
+}
+
+/*
+ * Encrypt one block
+ */
+void aes_encrypt_block(const struct aes_key_t *key, const unsigned char *in, unsigned char *out) {
+    encrypt_block_portable(key, in, out);
+}
+
+/*
+ * XOR data with the keystream that starts block_offset blocks after the nonce
+ */
+void aes_ctr(const struct aes_key_t *key, const unsigned char *nonce, uint64_t block_offset,
+             unsigned char *data, size_t len) {
+    unsigned char counter[AES_BLOCK_SIZE];
+
+    if (key == NULL || nonce == NULL || data == NULL || len == 0) {
+        return;
+    }
+
+    memcpy(counter, nonce, AES_BLOCK_SIZE);
+    if (block_offset != 0) {
+        aes_ctr_increment(counter, block_offset);
+    }
+    get_backend()->ctr(key, counter, data, len);
+}
+
+/*
+ * AES-128-CTR over a buffer
+ */
+void crypt_ctr(const unsigned char *key, unsigned char *data, size_t length, const unsigned char *nonce) {
+    struct aes_key_t schedule;
+
+    if (aes_set_key(&schedule, key, 128) == 0) {
+        aes_ctr(&schedule, nonce, 0, data, length);
+    }
+    secure_wipe(&schedule, sizeof(schedule));
+}
+
+/*
+ * AES-256-CTR over a buffer
+ */
+void crypt_ctr256(const unsigned char *key, unsigned char *data, size_t length, const unsigned char *nonce) {
+    struct aes_key_t schedule;
+
+    if (aes_set_key(&schedule, key, 256) == 0) {
+        aes_ctr(&schedule, nonce, 0, data, length);
+    }
+    secure_wipe(&schedule, sizeof(schedule));
+}
+
+int aes_force_backend(const char *name) {
+    if (name == NULL) {
+        active_backend = NULL;
+        return 0;
+    }
+
+    for (int i = 0; i < AES_BACKEND_COUNT; i++) {
+        if (strcmp(backends[i].name, name) == 0 && backend_supported(&backends[i])) {
+            active_backend = &backends[i];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+const char *aes_backend_name(void) {
+    return get_backend()->name;
+}
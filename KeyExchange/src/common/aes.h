@@ -12,15 +12,50 @@
 #define AES_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 
-// Simple XOR-based encryption for testing (replace with real AES in production)
-static inline void crypt_ctr(const unsigned char *key, unsigned char *data, size_t length, const unsigned char *nonce) {
-    // This is a placeholder implementation
-    // In production, this should use proper AES-CTR encryption
-    for (size_t i = 0; i < length; i++) {
-        data[i] ^= key[i % 16] ^ nonce[i % 16];
-    }
-}
+#define AES_BLOCK_SIZE 16
+#define AES_MAX_ROUNDS 14
 
-#endif // AES_H
\ No newline at end of file
+// Expanded encryption key schedule (AES-128: 10 rounds, AES-256: 14 rounds)
+struct aes_key_t {
+    unsigned char round_keys[(AES_MAX_ROUNDS + 1) * AES_BLOCK_SIZE];
+    int rounds;
+};
+
+// Counter mode kernel: XOR len bytes of data with the keystream starting at counter block ctr
+typedef void (*aes_ctr_kernel_t)(const struct aes_key_t *key, const unsigned char *ctr, unsigned char *data,
+                                 size_t len);
+
+// Key schedule (key_bits is 128 or 256); callers wipe the schedule when done
+int aes_set_key(struct aes_key_t *key, const unsigned char *raw_key, int key_bits);
+
+// Single block encryption
+void aes_encrypt_block(const struct aes_key_t *key, const unsigned char *in, unsigned char *out);
+
+/*
+ * CTR mode. The nonce is the initial 128-bit big-endian counter block; block_offset
+ * advances it so a stream can be processed in independent pieces.
+ */
+void aes_ctr(const struct aes_key_t *key, const unsigned char *nonce, uint64_t block_offset,
+             unsigned char *data, size_t len);
+
+// AES-128-CTR with a 16-byte key, the schedule is expanded on the stack and wiped on return
+void crypt_ctr(const unsigned char *key, unsigned char *data, size_t length, const unsigned char *nonce);
+
+// AES-256-CTR with a 32-byte key, the schedule is expanded on the stack and wiped on return
+void crypt_ctr256(const unsigned char *key, unsigned char *data, size_t length, const unsigned char *nonce);
+
+// Backend selection (vaes, aesni, portable), NULL restores auto-selection
+int aes_force_backend(const char *name);
+const char *aes_backend_name(void);
+
+// Backend internals shared by aes.c and aes_ni.c
+void aes_ctr_increment(unsigned char *ctr, uint64_t blocks);
+int aes_ni_supported(void);
+int aes_vaes_supported(void);
+void aes_ctr_aesni(const struct aes_key_t *key, const unsigned char *ctr, unsigned char *data, size_t len);
+void aes_ctr_vaes(const struct aes_key_t *key, const unsigned char *ctr, unsigned char *data, size_t len);
+
+#endif // AES_H
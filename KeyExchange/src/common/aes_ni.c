@@ -0,0 +1,226 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : aes_ni.c
+#   Last Modified : 2024-07-20
+#   Describe      : AES-CTR kernels using AES-NI (8 blocks interleaved) and VAES/AVX-512 (16 blocks)
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "utils.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define AESNI_PARALLEL 8
+#define VAES_PARALLEL 16
+
+int aes_ni_supported(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3");
+}
+
+int aes_vaes_supported(void) {
+    __builtin_cpu_init();
+    return aes_ni_supported() && __builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+}
+
+/*
+ * Counters are kept as two host-order halves; a block is built by byte-reversing them.
+ * Blocks inside a group are derived with a 64-bit add unless the low half could wrap.
+ */
+__attribute__((target("aes,ssse3")))
+static __m128i counter_block(uint64_t high, uint64_t low, uint64_t add, __m128i reverse) {
+    uint64_t sum = low + add;
+    return _mm_shuffle_epi8(_mm_set_epi64x((long long)(high + (sum < low)), (long long)sum), reverse);
+}
+
+__attribute__((target("aes,ssse3")))
+static void load_counter(const unsigned char *ctr, uint64_t *high, uint64_t *low) {
+    uint64_t h = 0;
+    uint64_t l = 0;
+
+    for (int i = 0; i < 8; i++) {
+        h = (h << 8) | ctr[i];
+        l = (l << 8) | ctr[8 + i];
+    }
+    *high = h;
+    *low = l;
+}
+
+#define AES_ROUND8(op, round_key) do { \
+    b0 = op(b0, round_key); b1 = op(b1, round_key); b2 = op(b2, round_key); b3 = op(b3, round_key); \
+    b4 = op(b4, round_key); b5 = op(b5, round_key); b6 = op(b6, round_key); b7 = op(b7, round_key); \
+} while (0)
+
+#define XOR_STORE(data, index, block) \
+    _mm_storeu_si128((__m128i *)((data) + (index) * AES_BLOCK_SIZE), \
+                     _mm_xor_si128(_mm_loadu_si128((const __m128i *)((data) + (index) * AES_BLOCK_SIZE)), block))
+
+__attribute__((target("aes,ssse3")))
+void aes_ctr_aesni(const struct aes_key_t *key, const unsigned char *ctr, unsigned char *data, size_t len) {
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i round_keys[AES_MAX_ROUNDS + 1];
+    unsigned char stream[AES_BLOCK_SIZE];
+    uint64_t high, low;
+    int rounds = key->rounds;
+
+    for (int r = 0; r <= rounds; r++) {
+        round_keys[r] = _mm_loadu_si128((const __m128i *)(key->round_keys + r * AES_BLOCK_SIZE));
+    }
+    load_counter(ctr, &high, &low);
+
+    while (len >= AESNI_PARALLEL * AES_BLOCK_SIZE) {
+        __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+
+        if (low <= UINT64_MAX - AESNI_PARALLEL) {
+            __m128i base = _mm_set_epi64x((long long)high, (long long)low);
+            b0 = _mm_shuffle_epi8(base, reverse);
+            b1 = _mm_shuffle_epi8(_mm_add_epi64(base, _mm_set_epi64x(0, 1)), reverse);
+            b2 = _mm_shuffle_epi8(_mm_add_epi64(base, _mm_set_epi64x(0, 2)), reverse);
+            b3 = _mm_shuffle_epi8(_mm_add_epi64(base, _mm_set_epi64x(0, 3)), reverse);
+            b4 = _mm_shuffle_epi8(_mm_add_epi64(base, _mm_set_epi64x(0, 4)), reverse);
+            b5 = _mm_shuffle_epi8(_mm_add_epi64(base, _mm_set_epi64x(0, 5)), reverse);
+            b6 = _mm_shuffle_epi8(_mm_add_epi64(base, _mm_set_epi64x(0, 6)), reverse);
+            b7 = _mm_shuffle_epi8(_mm_add_epi64(base, _mm_set_epi64x(0, 7)), reverse);
+        } else {
+            b0 = counter_block(high, low, 0, reverse);
+            b1 = counter_block(high, low, 1, reverse);
+            b2 = counter_block(high, low, 2, reverse);
+            b3 = counter_block(high, low, 3, reverse);
+            b4 = counter_block(high, low, 4, reverse);
+            b5 = counter_block(high, low, 5, reverse);
+            b6 = counter_block(high, low, 6, reverse);
+            b7 = counter_block(high, low, 7, reverse);
+        }
+
+        // Eight independent blocks in named locals keep the pipeline in registers
+        AES_ROUND8(_mm_xor_si128, round_keys[0]);
+        for (int r = 1; r < rounds; r++) {
+            AES_ROUND8(_mm_aesenc_si128, round_keys[r]);
+        }
+        AES_ROUND8(_mm_aesenclast_si128, round_keys[rounds]);
+
+        XOR_STORE(data, 0, b0);
+        XOR_STORE(data, 1, b1);
+        XOR_STORE(data, 2, b2);
+        XOR_STORE(data, 3, b3);
+        XOR_STORE(data, 4, b4);
+        XOR_STORE(data, 5, b5);
+        XOR_STORE(data, 6, b6);
+        XOR_STORE(data, 7, b7);
+
+        high += (low + AESNI_PARALLEL < low);
+        low += AESNI_PARALLEL;
+        data += AESNI_PARALLEL * AES_BLOCK_SIZE;
+        len -= AESNI_PARALLEL * AES_BLOCK_SIZE;
+    }
+
+    // Remaining whole blocks and the partial tail, one block at a time
+    while (len > 0) {
+        size_t chunk = (len < AES_BLOCK_SIZE) ? len : AES_BLOCK_SIZE;
+        __m128i block = _mm_xor_si128(counter_block(high, low, 0, reverse), round_keys[0]);
+
+        for (int r = 1; r < rounds; r++) {
+            block = _mm_aesenc_si128(block, round_keys[r]);
+        }
+        block = _mm_aesenclast_si128(block, round_keys[rounds]);
+
+        if (chunk == AES_BLOCK_SIZE) {
+            _mm_storeu_si128((__m128i *)data, _mm_xor_si128(_mm_loadu_si128((const __m128i *)data), block));
+        } else {
+            _mm_storeu_si128((__m128i *)stream, block);
+            for (size_t i = 0; i < chunk; i++) {
+                data[i] ^= stream[i];
+            }
+            secure_wipe(stream, sizeof(stream));
+        }
+
+        high += (low + 1 < low);
+        low++;
+        data += chunk;
+        len -= chunk;
+    }
+
+    secure_wipe(round_keys, sizeof(round_keys));
+}
+
+#define AES_ROUND4(op, round_key) do { \
+    b0 = op(b0, round_key); b1 = op(b1, round_key); b2 = op(b2, round_key); b3 = op(b3, round_key); \
+} while (0)
+
+__attribute__((target("aes,ssse3,vaes,avx512f,avx512bw")))
+void aes_ctr_vaes(const struct aes_key_t *key, const unsigned char *ctr, unsigned char *data, size_t len) {
+    const __m512i reverse = _mm512_broadcast_i32x4(
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    const __m512i lane_offsets = _mm512_set_epi64(0, 3, 0, 2, 0, 1, 0, 0);
+    const __m512i step = _mm512_set_epi64(0, 4, 0, 4, 0, 4, 0, 4);
+    __m512i round_keys[AES_MAX_ROUNDS + 1];
+    unsigned char counter[AES_BLOCK_SIZE];
+    uint64_t high, low;
+    size_t done = 0;
+    int rounds = key->rounds;
+
+    for (int r = 0; r <= rounds; r++) {
+        round_keys[r] = _mm512_broadcast_i32x4(
+            _mm_loadu_si128((const __m128i *)(key->round_keys + r * AES_BLOCK_SIZE)));
+    }
+    load_counter(ctr, &high, &low);
+
+    // The 64-bit lane adds cannot carry, so stop before the low half could wrap
+    while (len - done >= VAES_PARALLEL * AES_BLOCK_SIZE && low <= UINT64_MAX - VAES_PARALLEL) {
+        __m512i c0 = _mm512_add_epi64(
+            _mm512_broadcast_i32x4(_mm_set_epi64x((long long)high, (long long)low)), lane_offsets);
+        __m512i c1 = _mm512_add_epi64(c0, step);
+        __m512i c2 = _mm512_add_epi64(c1, step);
+        __m512i c3 = _mm512_add_epi64(c2, step);
+        __m512i b0 = _mm512_shuffle_epi8(c0, reverse);
+        __m512i b1 = _mm512_shuffle_epi8(c1, reverse);
+        __m512i b2 = _mm512_shuffle_epi8(c2, reverse);
+        __m512i b3 = _mm512_shuffle_epi8(c3, reverse);
+        unsigned char *chunk = data + done;
+
+        AES_ROUND4(_mm512_xor_si512, round_keys[0]);
+        for (int r = 1; r < rounds; r++) {
+            AES_ROUND4(_mm512_aesenc_epi128, round_keys[r]);
+        }
+        AES_ROUND4(_mm512_aesenclast_epi128, round_keys[rounds]);
+
+        _mm512_storeu_si512(chunk, _mm512_xor_si512(_mm512_loadu_si512(chunk), b0));
+        _mm512_storeu_si512(chunk + 64, _mm512_xor_si512(_mm512_loadu_si512(chunk + 64), b1));
+        _mm512_storeu_si512(chunk + 128, _mm512_xor_si512(_mm512_loadu_si512(chunk + 128), b2));
+        _mm512_storeu_si512(chunk + 192, _mm512_xor_si512(_mm512_loadu_si512(chunk + 192), b3));
+
+        low += VAES_PARALLEL;
+        done += VAES_PARALLEL * AES_BLOCK_SIZE;
+    }
+
+    if (done < len) {
+        memcpy(counter, ctr, AES_BLOCK_SIZE);
+        aes_ctr_increment(counter, done / AES_BLOCK_SIZE);
+        aes_ctr_aesni(key, counter, data + done, len - done);
+    }
+
+    secure_wipe(round_keys, sizeof(round_keys));
+}
+
+#else
+
+int aes_ni_supported(void) {
+    return 0;
+}
+
+int aes_vaes_supported(void) {
+    return 0;
+}
+
+#endif
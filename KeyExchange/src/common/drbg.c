@@ -0,0 +1,310 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : drbg.c
+#   Last Modified : 2024-07-20
+#   Describe      : Per-thread ChaCha20 random generator seeded from the kernel
+#
+# ====================================================*/
+
+// syscall() and getrandom() are not part of -std=c99
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__has_include)
+#if __has_include(<sys/random.h>)
+#include <sys/random.h>
+#define DRBG_HAVE_GETRANDOM 1
+#endif
+#endif
+
+#include "drbg.h"
+
+/*
+ * Each thread runs ChaCha20 under its own key, filling a buffer of DRBG_BUFFER_BLOCKS blocks at a
+ * time. The first 32 bytes of every refill become the next key and served bytes are wiped, so a
+ * captured state cannot reproduce earlier output. Requests of a whole buffer or more are generated
+ * straight into the caller's memory and followed by a rekey.
+ * Fresh kernel entropy is mixed in on first use, every DRBG_RESEED_BYTES and in a forked child,
+ * which would otherwise replay its parent's stream.
+ */
+#define DRBG_KEY_WORDS 8
+#define DRBG_NONCE_WORDS 3
+#define DRBG_SEED_SIZE ((DRBG_KEY_WORDS + DRBG_NONCE_WORDS) * 4)
+#define DRBG_BULK_BLOCKS 1024   // Blocks generated under one key by a bulk request
+
+struct drbg_state_t {
+    uint32_t key[DRBG_KEY_WORDS];
+    uint32_t nonce[DRBG_NONCE_WORDS];
+    unsigned char buffer[DRBG_BUFFER_SIZE];
+    size_t available;           // Unserved bytes at the end of the buffer
+    size_t since_reseed;
+    unsigned fork_generation;
+    int seeded;
+};
+
+static pthread_key_t drbg_key;
+static pthread_once_t drbg_once = PTHREAD_ONCE_INIT;
+static unsigned fork_generation;
+
+// memset followed by a compiler barrier, so the clearing of dead key material is not optimized out
+static void wipe(void *ptr, size_t length) {
+    memset(ptr, 0, length);
+    __asm__ __volatile__("" : : "r"(ptr) : "memory");
+}
+
+static void free_state(void *ptr) {
+    wipe(ptr, sizeof(struct drbg_state_t));
+    free(ptr);
+}
+
+static void bump_fork_generation(void) {
+    __atomic_add_fetch(&fork_generation, 1, __ATOMIC_RELAXED);
+}
+
+static void init_drbg(void) {
+    if (pthread_key_create(&drbg_key, free_state) != 0) {
+        fprintf(stderr, "Failed to create random generator key\n");
+    }
+    pthread_atfork(NULL, NULL, bump_fork_generation);
+}
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTER_ROUND(a, b, c, d) do { \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8); \
+    c += d; b ^= c; b = ROTL32(b, 7); \
+} while (0)
+
+static uint32_t load32_le(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store32_le(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+void drbg_chacha20_block(const uint32_t key[8], uint32_t counter, const uint32_t nonce[3],
+                         unsigned char out[DRBG_BLOCK_SIZE]) {
+    uint32_t input[16], x[16];
+
+    input[0] = 0x61707865;
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    memcpy(&input[4], key, 8 * sizeof(uint32_t));
+    input[12] = counter;
+    memcpy(&input[13], nonce, 3 * sizeof(uint32_t));
+    memcpy(x, input, sizeof(x));
+
+    for (int i = 0; i < 10; i++) {
+        QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        store32_le(out + 4 * i, x[i] + input[i]);
+    }
+}
+
+/*
+ * Read seed material from the kernel, falling back to /dev/urandom without getrandom()
+ */
+static int entropy_bytes(unsigned char *buffer, size_t length) {
+    size_t done = 0;
+    int fd;
+
+#ifdef DRBG_HAVE_GETRANDOM
+    while (done < length) {
+        ssize_t rv = getrandom(buffer + done, length - done, 0);
+
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOSYS) {
+                break;
+            }
+            return -1;
+        }
+        done += (size_t)rv;
+    }
+    if (done == length) {
+        return 0;
+    }
+#endif
+
+    fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    while (done < length) {
+        ssize_t rv = read(fd, buffer + done, length - done);
+
+        if (rv <= 0) {
+            if (rv < 0 && errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return -1;
+        }
+        done += (size_t)rv;
+    }
+    close(fd);
+
+    return 0;
+}
+
+/*
+ * Generate blocks under the current key, then take the next key from their first 32 bytes
+ */
+static void rekey(struct drbg_state_t *state, unsigned char *out, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        drbg_chacha20_block(state->key, (uint32_t)i, state->nonce, out + i * DRBG_BLOCK_SIZE);
+    }
+    for (int i = 0; i < DRBG_KEY_WORDS; i++) {
+        state->key[i] = load32_le(out + 4 * i);
+    }
+    wipe(out, DRBG_KEY_WORDS * 4);
+}
+
+static void refill(struct drbg_state_t *state) {
+    rekey(state, state->buffer, DRBG_BUFFER_BLOCKS);
+    state->available = DRBG_BUFFER_SIZE - DRBG_KEY_WORDS * 4;
+}
+
+static int reseed(struct drbg_state_t *state) {
+    unsigned char seed[DRBG_SEED_SIZE];
+
+    if (entropy_bytes(seed, sizeof(seed)) != 0) {
+        wipe(seed, sizeof(seed));
+        return -1;
+    }
+
+    // XOR keeps whatever entropy the old key had
+    for (int i = 0; i < DRBG_KEY_WORDS; i++) {
+        state->key[i] ^= load32_le(seed + 4 * i);
+    }
+    for (int i = 0; i < DRBG_NONCE_WORDS; i++) {
+        state->nonce[i] ^= load32_le(seed + 4 * (DRBG_KEY_WORDS + i));
+    }
+    wipe(seed, sizeof(seed));
+
+    state->fork_generation = __atomic_load_n(&fork_generation, __ATOMIC_RELAXED);
+    state->since_reseed = 0;
+    state->seeded = 1;
+    refill(state);
+    return 0;
+}
+
+/*
+ * Get the calling thread's generator, reseeding it when due
+ */
+static struct drbg_state_t *get_state(void) {
+    struct drbg_state_t *state;
+
+    pthread_once(&drbg_once, init_drbg);
+
+    state = (struct drbg_state_t *) pthread_getspecific(drbg_key);
+    if (state == NULL) {
+        state = (struct drbg_state_t *) calloc(1, sizeof(struct drbg_state_t));
+        if (state == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(drbg_key, state) != 0) {
+            free(state);
+            return NULL;
+        }
+    }
+
+    if (!state->seeded || state->since_reseed >= DRBG_RESEED_BYTES ||
+        state->fork_generation != __atomic_load_n(&fork_generation, __ATOMIC_RELAXED)) {
+        if (reseed(state) != 0) {
+            return NULL;
+        }
+    }
+
+    return state;
+}
+
+static void serve(struct drbg_state_t *state, unsigned char *out, size_t length) {
+    unsigned char *from = state->buffer + DRBG_BUFFER_SIZE - state->available;
+
+    memcpy(out, from, length);
+    wipe(from, length);
+    state->available -= length;
+}
+
+int drbg_random_bytes(unsigned char *buffer, size_t length) {
+    struct drbg_state_t *state;
+
+    if (buffer == NULL && length > 0) {
+        return -1;
+    }
+
+    state = get_state();
+    if (state == NULL) {
+        return -1;
+    }
+    state->since_reseed += length;
+
+    // Bulk: whole blocks go straight to the caller, each run ends with a rekey
+    while (length >= DRBG_BUFFER_SIZE) {
+        size_t blocks = length / DRBG_BLOCK_SIZE;
+
+        if (blocks > DRBG_BULK_BLOCKS) {
+            blocks = DRBG_BULK_BLOCKS;
+        }
+        rekey(state, buffer, blocks);
+        // The first 32 bytes became the key; overwrite them from the buffered stream
+        if (state->available < DRBG_KEY_WORDS * 4) {
+            refill(state);
+        }
+        serve(state, buffer, DRBG_KEY_WORDS * 4);
+        buffer += blocks * DRBG_BLOCK_SIZE;
+        length -= blocks * DRBG_BLOCK_SIZE;
+    }
+
+    while (length > 0) {
+        size_t chunk;
+
+        if (state->available == 0) {
+            refill(state);
+        }
+        chunk = (length < state->available) ? length : state->available;
+        serve(state, buffer, chunk);
+        buffer += chunk;
+        length -= chunk;
+    }
+
+    return 0;
+}
+
+int drbg_reseed(void) {
+    struct drbg_state_t *state = get_state();
+
+    if (state == NULL) {
+        return -1;
+    }
+
+    return reseed(state);
+}
@@ -0,0 +1,34 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : drbg.h
+#   Last Modified : 2024-07-20
+#   Describe      : Per-thread ChaCha20 random generator seeded from the kernel
+#
+# ====================================================*/
+
+#ifndef DRBG_H
+#define DRBG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DRBG_BLOCK_SIZE 64
+#define DRBG_BUFFER_BLOCKS 16
+#define DRBG_BUFFER_SIZE (DRBG_BLOCK_SIZE * DRBG_BUFFER_BLOCKS)
+
+// Bytes a thread produces before it mixes in fresh kernel entropy
+#define DRBG_RESEED_BYTES (1024 * 1024)
+
+// Fill buffer with random bytes from the calling thread's generator; 0 on success, -1 if no entropy
+int drbg_random_bytes(unsigned char *buffer, size_t length);
+
+// Mix fresh kernel entropy into the calling thread's generator now
+int drbg_reseed(void);
+
+// ChaCha20 block function (RFC 8439), exposed for known-answer tests
+void drbg_chacha20_block(const uint32_t key[8], uint32_t counter, const uint32_t nonce[3],
+                         unsigned char out[DRBG_BLOCK_SIZE]);
+
+#endif // DRBG_H
@@ -0,0 +1,291 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : log.c
+#   Last Modified : 2024-07-20
+#   Describe      : Asynchronous logging backend with per-thread rings and a drain thread
+#
+# ====================================================*/
+
+// clock_gettime() and localtime_r() are POSIX, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "log.h"
+
+/*
+ * Every thread that logs owns a single-producer ring of LOG_RING_SLOTS records. Producing a
+ * record is a vsnprintf into the next slot and a release store of the head; there is no lock
+ * and no I/O on the caller's path. A full ring drops the record and counts it, except for
+ * warnings and errors: those drain the rings themselves and are never lost.
+ * One drain thread (or log_flush) consumes all rings under drain_lock, formats whole lines
+ * into a batch buffer and writes each batch with one fwrite, so lines never interleave.
+ * A ring outlives its thread until the drain has emptied it.
+ */
+#define LOG_BATCH_SIZE (64 * 1024)
+#define LOG_LINE_SIZE (LOG_TEXT_SIZE + 1280)    // Timestamp, file:line and level around the text
+#define LOG_IDLE_WAIT_MS 10
+
+struct log_record_t {
+    struct timespec time;
+    const char *file;
+    int line;
+    int level;
+    char text[LOG_TEXT_SIZE];
+};
+
+struct log_ring_t {
+    struct log_record_t slots[LOG_RING_SLOTS];
+    unsigned head;              // Written by the owning thread
+    unsigned tail;              // Written by the drain
+    uint64_t dropped;
+    uint64_t dropped_seen;      // Drops already reported by the drain
+    int orphaned;               // Owning thread has exited
+    struct log_ring_t *next;
+};
+
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static struct log_ring_t *rings;
+static int drain_running;
+static FILE *log_stream;
+static uint64_t written, dropped_total;
+static char batch[LOG_BATCH_SIZE];
+
+static void orphan_ring(void *ptr) {
+    struct log_ring_t *ring = (struct log_ring_t *)ptr;
+
+    __atomic_store_n(&ring->orphaned, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&drain_wakeup);
+}
+
+/*
+ * The child of a fork has no drain thread, and its copy of pending records belongs to the parent
+ */
+static void reset_after_fork(void) {
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+    drain_lock = lock;
+    drain_wakeup = cond;
+    drain_running = 0;
+    for (struct log_ring_t *ring = rings; ring != NULL; ring = ring->next) {
+        ring->tail = ring->head;
+    }
+}
+
+static void init_log(void) {
+    pthread_key_create(&ring_key, orphan_ring);
+    pthread_atfork(NULL, NULL, reset_after_fork);
+    atexit(log_flush);
+}
+
+static size_t format_record(char *out, size_t size, const struct log_record_t *record) {
+    static const char *level_str[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+    char time_str[32];
+    struct tm tm;
+    int n;
+
+    localtime_r(&record->time.tv_sec, &tm);
+    strftime(time_str, sizeof(time_str), "%a %b %e %H:%M:%S %Y", &tm);
+
+    n = snprintf(out, size, "[%s] %s:%d [%s] %s\n", time_str, record->file, record->line,
+                 level_str[record->level & 3], record->text);
+    if (n < 0) {
+        return 0;
+    }
+    return ((size_t)n < size) ? (size_t)n : size - 1;
+}
+
+/*
+ * Write every pending record; called with drain_lock held. Returns the number written.
+ */
+static size_t drain_rings(void) {
+    struct log_ring_t **link = &rings;
+    FILE *stream = log_stream ? log_stream : stdout;
+    uint64_t dropped = 0, ring_dropped;
+    size_t used = 0, count = 0;
+
+    while (*link != NULL) {
+        struct log_ring_t *ring = *link;
+        int orphaned = __atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE);
+        unsigned head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        for (; ring->tail != head; ring->tail++, count++) {
+            if (LOG_BATCH_SIZE - used < LOG_LINE_SIZE) {
+                fwrite(batch, 1, used, stream);
+                used = 0;
+            }
+            used += format_record(batch + used, LOG_BATCH_SIZE - used, &ring->slots[ring->tail % LOG_RING_SLOTS]);
+        }
+        __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+        ring_dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        dropped += ring_dropped - ring->dropped_seen;
+        ring->dropped_seen = ring_dropped;
+
+        // An orphan's head can no longer move, so an empty orphan is done
+        if (orphaned) {
+            *link = ring->next;
+            free(ring);
+        } else {
+            link = &ring->next;
+        }
+    }
+
+    if (dropped > 0) {
+        used += (size_t)snprintf(batch + used, LOG_BATCH_SIZE - used,
+                                 "[log] %llu messages dropped\n", (unsigned long long)dropped);
+        dropped_total += dropped;
+    }
+
+    if (used > 0) {
+        fwrite(batch, 1, used, stream);
+        fflush(stream);
+    }
+    written += count;
+
+    return count;
+}
+
+static void *drain_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&drain_lock);
+    for (;;) {
+        if (drain_rings() == 0) {
+            struct timespec deadline;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOG_IDLE_WAIT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&drain_wakeup, &drain_lock, &deadline);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Get the calling thread's ring, registering it (and starting the drain) on first use
+ */
+static struct log_ring_t *get_ring(void) {
+    struct log_ring_t *ring;
+
+    pthread_once(&log_once, init_log);
+
+    ring = (struct log_ring_t *) pthread_getspecific(ring_key);
+    if (ring == NULL) {
+        ring = (struct log_ring_t *) calloc(1, sizeof(struct log_ring_t));
+        if (ring == NULL) {
+            return NULL;
+        }
+        pthread_setspecific(ring_key, ring);
+
+        pthread_mutex_lock(&drain_lock);
+        ring->next = rings;
+        rings = ring;
+        pthread_mutex_unlock(&drain_lock);
+    }
+
+    if (!__atomic_load_n(&drain_running, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&drain_lock);
+        if (!drain_running) {
+            pthread_t thread;
+
+            if (pthread_create(&thread, NULL, drain_thread, NULL) == 0) {
+                pthread_detach(thread);
+                __atomic_store_n(&drain_running, 1, __ATOMIC_RELEASE);
+            }
+        }
+        pthread_mutex_unlock(&drain_lock);
+    }
+
+    return ring;
+}
+
+void log_message(int level, const char *file, int line, const char *format, ...) {
+    struct log_ring_t *ring;
+    struct log_record_t *record;
+    unsigned head;
+    int saved_errno = errno;
+    va_list args;
+
+    if (level < current_log_level) {
+        return;
+    }
+
+    ring = get_ring();
+    if (ring == NULL) {
+        errno = saved_errno;
+        return;
+    }
+
+    head = ring->head;
+    // Warnings and errors wait for a synchronous drain, which empties this ring, rather than drop
+    if (level >= LOG_LEVEL_WARN && head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SLOTS) {
+        pthread_mutex_lock(&drain_lock);
+        drain_rings();
+        pthread_mutex_unlock(&drain_lock);
+    }
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SLOTS) {
+        __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+        pthread_cond_signal(&drain_wakeup);
+        errno = saved_errno;
+        return;
+    }
+
+    record = &ring->slots[head % LOG_RING_SLOTS];
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    record->file = file;
+    record->line = line;
+    record->level = level;
+
+    va_start(args, format);
+    vsnprintf(record->text, sizeof(record->text), format, args);
+    va_end(args);
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    // Wake the drain early for errors and before the ring fills up
+    if (level >= LOG_LEVEL_ERROR || head - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) == LOG_RING_SLOTS / 2) {
+        pthread_cond_signal(&drain_wakeup);
+    }
+
+    errno = saved_errno;
+}
+
+void log_flush(void) {
+    pthread_mutex_lock(&drain_lock);
+    drain_rings();
+    pthread_mutex_unlock(&drain_lock);
+}
+
+void log_set_stream(FILE *stream) {
+    pthread_mutex_lock(&drain_lock);
+    drain_rings();
+    log_stream = stream;
+    pthread_mutex_unlock(&drain_lock);
+}
+
+void log_get_stats(struct log_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&drain_lock);
+    stats->written = written;
+    stats->dropped = dropped_total;
+    pthread_mutex_unlock(&drain_lock);
+}
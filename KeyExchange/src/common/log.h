@@ -12,6 +12,7 @@
 #define LOG_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <time.h>
 #include <stdarg.h>
 
@@ -24,33 +25,47 @@
 // Current log level (can be configured)
 extern int current_log_level;
 
+// Lowest level compiled in; calls below it are dead code (build with -DRKE_MIN_LOG_LEVEL=...)
+#ifndef RKE_MIN_LOG_LEVEL
+#define RKE_MIN_LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Whether a level is compiled in and active; the runtime test is predicted to fail
+#define LOG_ENABLED(level) \
+    ((level) >= RKE_MIN_LOG_LEVEL && __builtin_expect((level) >= current_log_level, 0))
+
 // Convenience macros for logging
-#define debug(fmt, ...) log_message(LOG_LEVEL_DEBUG, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define info(fmt, ...)  log_message(LOG_LEVEL_INFO, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define warn(fmt, ...)  log_message(LOG_LEVEL_WARN, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define error(fmt, ...) log_message(LOG_LEVEL_ERROR, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-
-// Simple inline implementation for basic logging
-static inline void log_message(int level, const char *file, int line, const char *format, ...) {
-    const char *level_str[] = {"DEBUG", "INFO", "WARN", "ERROR"};
-    
-    if (level < current_log_level) return;
-    
-    time_t now;
-    time(&now);
-    char *time_str = ctime(&now);
-    time_str[strlen(time_str) - 1] = 0; // Remove newline
-    
-    printf("[%s] %s:%d [%s] ", time_str, file, line, level_str[level]);
-    
-    va_list args;
-    va_start(args, format);
-    vprintf(format, args);
-    va_end(args);
-    
-    printf("\n");
-    fflush(stdout);
-}
+// Messages below current_log_level return before their arguments are evaluated
+#define LOG_AT(level, fmt, ...) do { \
+    if (LOG_ENABLED(level)) { \
+        log_message((level), __FILE__, __LINE__, fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+#define debug(fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define info(fmt, ...)  LOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define warn(fmt, ...)  LOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define error(fmt, ...) LOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+
+// Asynchronous backend (log.c): the message is formatted into the calling thread's ring and
+// a drain thread adds the timestamp and writes whole lines in batches
+#define LOG_RING_SLOTS 512
+#define LOG_TEXT_SIZE 224
+
+struct log_stats_t {
+    uint64_t written;
+    uint64_t dropped;       // Messages lost to a full ring
+};
+
+void log_message(int level, const char *file, int line, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+// Write out everything logged so far; also runs at exit
+void log_flush(void);
+
+// Send log lines to stream instead of stdout (NULL restores stdout)
+void log_set_stream(FILE *stream);
+void log_get_stats(struct log_stats_t *stats);
 
 // Global log level variable (define in one source file only)
 
@@ -12,6 +12,7 @@
 #define PROTOCOL_H
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <sys/types.h>
 
 // Connection info structure for protocol handling
@@ -22,6 +23,9 @@ typedef struct conn_info_s {
     uint32_t output_size;
     int command_status;
     unsigned char nonce[16];
+    // Set by commands whose output is not malloc'd (e.g. points into a mapped container)
+    void (*output_release)(struct conn_info_s *ci);
+    void *output_ref;
 } conn_info_t;
 
 // Error codes
@@ -39,12 +43,27 @@ typedef struct conn_info_s {
 #define ERROR_INVALID_KEY_START       -10
 #define ERROR_KEY_GENERATION          -11
 #define ERROR_KEY_SPLITTING           -12
+#define ERROR_SESSION_EXPIRED         -13
+#define ERROR_ENCRYPTION              -14
 
 // Function to get body payload from connection info
 static inline unsigned char *get_body_payload(conn_info_t *ci) {
     return ci->body;
 }
 
+// Function to release the output once it has been sent
+static inline void release_output(conn_info_t *ci) {
+    if (ci->output_release != NULL) {
+        ci->output_release(ci);
+    } else {
+        free(ci->output);
+    }
+    ci->output = NULL;
+    ci->output_size = 0;
+    ci->output_release = NULL;
+    ci->output_ref = NULL;
+}
+
 // Function to extract serial number from payload
 static inline uint32_t get_sn(unsigned char *payload) {
     return *((uint32_t *)payload);
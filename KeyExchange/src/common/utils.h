@@ -18,6 +18,8 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include "drbg.h"
+
 // Configuration structure
 struct config_s {
     char cwd[1024];        // Current working directory
@@ -55,17 +57,27 @@ static inline int create_directory_recursive(const char *path) {
     return 0;
 }
 
-// Simple implementation of secure random (should use proper crypto in production)
+// Cryptographically secure random bytes from the calling thread's ChaCha20 generator
 static inline int secure_random_bytes(unsigned char *buffer, size_t length) {
-    FILE *fp = fopen("/dev/urandom", "rb");
-    if (fp == NULL) {
-        return -1;
-    }
+    return drbg_random_bytes(buffer, length);
+}
+
+// Constant-time comparison: returns 0 if equal
+// Reason: the running time must not reveal how many leading bytes of a checksum matched
+static inline int secure_compare(const unsigned char *a, const unsigned char *b, size_t length) {
+    unsigned char diff = 0;
     
-    size_t read_bytes = fread(buffer, 1, length, fp);
-    fclose(fp);
+    for (size_t i = 0; i < length; i++) {
+        diff |= a[i] ^ b[i];
+    }
     
-    return (read_bytes == length) ? 0 : -1;
+    return diff != 0;
+}
+
+// memset followed by a compiler barrier, so clearing dead key material is not optimized out
+static inline void secure_wipe(void *ptr, size_t length) {
+    memset(ptr, 0, length);
+    __asm__ __volatile__("" : : "r"(ptr) : "memory");
 }
 
 // Global config instance (define in one source file only)
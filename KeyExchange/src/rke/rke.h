@@ -11,6 +11,7 @@
 #ifndef RKE_H
 #define RKE_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -19,9 +20,17 @@
 #define RKE_MAX_FRAGMENTS 255
 #define RKE_MIN_THRESHOLD 2
 #define RKE_FRAGMENT_DATA_SIZE 256
+#define RKE_FRAGMENT_ALIGN 64
+#define RKE_FRAGMENT_HEADER_SIZE 64
 #define RKE_CHECKSUM_SIZE 32
+#define RKE_CHECKSUM_HEADER_SIZE 5
 #define RKE_KEY_ID_SIZE 16
 #define RKE_SESSION_ID_SIZE 16
+#define RKE_SESSION_KEY_SIZE 16
+#define RKE_MAX_BATCH_KEYS 16
+#define RKE_FRAGMENT_BITMAP_SIZE 32
+#define RKE_DEFAULT_FANOUT_DEPTH 2
+#define RKE_MAX_FANOUT_DEPTH 4
 
 // RKE key types
 #define RKE_KEY_TYPE_SYMMETRIC 0x01
@@ -42,20 +51,47 @@
 #define RKE_ERROR_FRAGMENT_CORRUPT -5
 #define RKE_ERROR_INSUFFICIENT_FRAGMENTS -6
 #define RKE_ERROR_SESSION_EXPIRED -7
+#define RKE_ERROR_SESSION_LIMIT   -8
+#define RKE_ERROR_KEY_EXISTS      -9
 
 // Forward declaration for conn_info_t (from protocol.h)
 typedef struct conn_info_s conn_info_t;
 
-// RKE key fragment structure
+// RKE key fragment structure: a compact header, then the payload on its own 64-byte boundary
+// Stored and sent as its first RKE_FRAGMENT_WIRE_SIZE(fragment_size) bytes; data past that is zero
 struct rke_fragment_t {
     uint8_t fragment_id;         // Fragment identifier (0-255)
     uint8_t total_fragments;     // Total number of fragments
     uint8_t threshold;           // Minimum fragments needed for reconstruction
+    uint8_t reserved;
     uint16_t fragment_size;      // Size of this fragment
-    unsigned char data[RKE_FRAGMENT_DATA_SIZE];     // Fragment data
     unsigned char checksum[RKE_CHECKSUM_SIZE];  // SHA-256 checksum for integrity
+    uint8_t padding[RKE_FRAGMENT_HEADER_SIZE - 38];
+    unsigned char data[RKE_FRAGMENT_DATA_SIZE] __attribute__((aligned(RKE_FRAGMENT_ALIGN))); // Fragment data
 };
 
+// The header fills exactly the bytes in front of the payload
+typedef char rke_fragment_header_fits[(offsetof(struct rke_fragment_t, data) == RKE_FRAGMENT_HEADER_SIZE) ? 1 : -1];
+
+// Header plus the payload rounded up to whole 64-byte lines
+#define RKE_FRAGMENT_WIRE_SIZE(fragment_size) \
+    ((size_t)RKE_FRAGMENT_HEADER_SIZE + \
+     (((size_t)(fragment_size) + RKE_FRAGMENT_ALIGN - 1) & ~(size_t)(RKE_FRAGMENT_ALIGN - 1)))
+
+// Structure-of-arrays fragment buffer for a batch of keys sharing one layout
+// Fragment f (1-based) of key k has index k * total_fragments + (f - 1)
+struct rke_fragment_batch_t {
+    uint16_t key_count;          // Keys in the batch
+    uint8_t total_fragments;     // Fragments per key
+    uint8_t threshold;           // Minimum fragments needed for reconstruction
+    uint16_t fragment_size;      // Payload bytes per fragment (key size)
+    unsigned char *data;         // Payloads, fragment_size bytes each
+    unsigned char *checksums;    // Checksums, RKE_CHECKSUM_SIZE bytes each
+};
+
+#define RKE_BATCH_DATA(batch, index) ((batch)->data + (size_t)(index) * (batch)->fragment_size)
+#define RKE_BATCH_CHECKSUM(batch, index) ((batch)->checksums + (size_t)(index) * RKE_CHECKSUM_SIZE)
+
 // RKE key metadata
 struct rke_key_metadata_t {
     unsigned char key_id[RKE_KEY_ID_SIZE];    // Unique key identifier
@@ -64,6 +100,7 @@ struct rke_key_metadata_t {
     uint8_t threshold;          // Minimum fragments for reconstruction
     uint32_t timestamp;         // Creation timestamp
     uint8_t den;                // Denomination of owning coin
+    uint16_t key_size;          // Key length in bytes (0 - RKE_MAX_KEY_SIZE)
     uint32_t sn;                // Serial number of owning coin
 };
 
@@ -74,36 +111,83 @@ struct rke_session_t {
     unsigned char receiver_id[RKE_KEY_ID_SIZE]; // Receiver identity
     uint8_t state;               // Session state
     uint32_t timeout;            // Session timeout
+    unsigned char session_key[RKE_SESSION_KEY_SIZE]; // AES-128 key responses in the session are encrypted under
+};
+
+// RKE working context - owned by one thread at a time, no shared state
+struct rke_ctx_t {
+    unsigned char coefficients[(RKE_MAX_FRAGMENTS - 1) * RKE_MAX_KEY_SIZE]; // Polynomial scratch for splitting
+    uint8_t lagrange_x[RKE_MAX_FRAGMENTS];            // Fragment ids of the cached Lagrange basis
+    uint8_t lagrange_coefficients[RKE_MAX_FRAGMENTS]; // Cached Lagrange basis at x = 0
+    int lagrange_count;                               // Size of the cached basis (0 - none)
 };
 
 // Core RKE functions
+void rke_ctx_init(struct rke_ctx_t *ctx);
+void rke_ctx_cleanup(struct rke_ctx_t *ctx);
 int rke_generate_key(unsigned char *key, uint16_t key_size);
-int rke_split_key(const unsigned char *key, uint16_t key_size, struct rke_key_metadata_t *metadata);
-int rke_reconstruct_key(unsigned char *key, uint16_t key_size, const struct rke_key_metadata_t *metadata);
+int rke_split_key(struct rke_ctx_t *ctx, const unsigned char *key, uint16_t key_size,
+                  const struct rke_key_metadata_t *metadata, struct rke_fragment_t *fragments);
+int rke_reconstruct_key(struct rke_ctx_t *ctx, unsigned char *key, uint16_t key_size,
+                        const struct rke_key_metadata_t *metadata,
+                        const struct rke_fragment_t *fragments, int fragment_count);
+
+// Batch key generation
+int rke_fragment_batch_alloc(struct rke_fragment_batch_t *batch, uint16_t key_count,
+                             uint8_t total_fragments, uint8_t threshold, uint16_t fragment_size);
+void rke_fragment_batch_free(struct rke_fragment_batch_t *batch);
+int rke_fragment_batch_get(const struct rke_fragment_batch_t *batch, int key_index, uint8_t fragment_id,
+                           struct rke_fragment_t *fragment);
+int rke_generate_and_split_batch(struct rke_ctx_t *ctx, struct rke_fragment_batch_t *batch, unsigned char *keys);
 
 // Storage functions
 int rke_store_fragment(const struct rke_fragment_t *fragment, const unsigned char *key_id);
 int rke_load_fragment(struct rke_fragment_t *fragment, const unsigned char *key_id, uint8_t fragment_id);
 int rke_store_metadata(const struct rke_key_metadata_t *metadata);
 int rke_load_metadata(struct rke_key_metadata_t *metadata, const unsigned char *key_id);
+int rke_store_fragments(const unsigned char *key_id, const struct rke_key_metadata_t *metadata,
+                        const struct rke_fragment_t *fragments, int count);
+int rke_replace_key(const struct rke_key_metadata_t *metadata, const struct rke_fragment_t *fragments, int count);
+int rke_create_key(const struct rke_key_metadata_t *metadata, const struct rke_fragment_t *fragments, int count);
+int rke_load_fragments(const unsigned char *key_id, struct rke_key_metadata_t *metadata,
+                       struct rke_fragment_t *fragments, int max_fragments);
+int rke_container_path(const unsigned char *key_id, char *path, size_t path_size);
+int rke_storage_set_fanout(int depth);
+int rke_storage_get_fanout(void);
+int rke_storage_force_backend(const char *name);
+const char *rke_storage_backend_name(void);
 
 // Crypto functions
 int rke_encrypt_fragment(struct rke_fragment_t *fragment, const unsigned char *key, const unsigned char *nonce);
 int rke_decrypt_fragment(struct rke_fragment_t *fragment, const unsigned char *key, const unsigned char *nonce);
+int rke_encrypt_fragments(struct rke_fragment_t *fragments, int count, const unsigned char *key,
+                          const unsigned char *nonce);
+int rke_decrypt_fragments(struct rke_fragment_t *fragments, int count, const unsigned char *key,
+                          const unsigned char *nonce);
 int rke_calculate_checksum(struct rke_fragment_t *fragment);
 int rke_verify_checksum(const struct rke_fragment_t *fragment);
+int rke_verify_checksums(const struct rke_fragment_t *fragments, int count, int *bad_index);
+int rke_calculate_checksums(struct rke_fragment_t *fragments, int count);
+int rke_calculate_batch_checksums(struct rke_fragment_batch_t *batch);
 
 // Protocol commands
 void cmd_rke_generate(conn_info_t *ci);
 void cmd_rke_exchange(conn_info_t *ci);
 void cmd_rke_reconstruct(conn_info_t *ci);
 void cmd_rke_query(conn_info_t *ci);
+void cmd_rke_generate_batch(conn_info_t *ci);
+void cmd_rke_exchange_multi(conn_info_t *ci);
+void cmd_rke_session_open(conn_info_t *ci);
 
 // Utility functions
 int rke_init_session(struct rke_session_t *session, const unsigned char *sender_id, const unsigned char *receiver_id);
 int rke_validate_fragment(const struct rke_fragment_t *fragment);
+int rke_fragment_unpack(struct rke_fragment_t *fragment, const unsigned char *record, size_t available);
 void rke_cleanup_session(struct rke_session_t *session);
 int rke_fragment_exists(const unsigned char *key_id, uint8_t fragment_id);
 int rke_count_fragments(const unsigned char *key_id);
+int rke_fragment_bitmap(const unsigned char *key_id, unsigned char *bitmap);
+int rke_delete_fragment(const unsigned char *key_id, uint8_t fragment_id);
+int rke_delete_key(const unsigned char *key_id);
 
 #endif // RKE_H
\ No newline at end of file
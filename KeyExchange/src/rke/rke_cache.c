@@ -0,0 +1,439 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_cache.c
+#   Last Modified : 2024-07-20
+#   Describe      : Sharded LRU cache of per-key container headers (metadata and presence bitmap)
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../common/log.h"
+#include "rke.h"
+#include "rke_cache.h"
+
+/*
+ * Each shard owns a fixed pool of entries, a chained hash index into the pool and an LRU list.
+ * A key always maps to the same shard, so one shard lock covers every operation on it.
+ * Writers update the cache after renaming a container into place and bump the shard's
+ * generation. Readers take the generation before reading a container and only fill the
+ * cache when it is unchanged, so a header read before a concurrent update (or a missing
+ * file just before a first write) never replaces what the writer cached.
+ */
+#define NIL -1
+
+struct rke_cache_entry_t {
+    unsigned char key_id[RKE_KEY_ID_SIZE];
+    unsigned char bitmap[RKE_FRAGMENT_BITMAP_SIZE];
+    struct rke_key_metadata_t metadata;
+    uint8_t state;              // RKE_CACHE_HIT or RKE_CACHE_ABSENT
+    uint8_t has_metadata;
+    int32_t chain;              // Next entry in the hash bucket
+    int32_t prev, next;         // LRU neighbours, head is most recent
+};
+
+struct rke_cache_shard_t {
+    pthread_mutex_t lock;
+    struct rke_cache_entry_t *entries;
+    int32_t *buckets;
+    uint32_t bucket_mask;
+    int32_t capacity;
+    int32_t used;
+    int32_t head, tail;
+    uint64_t generation;        // Bumped by every write-through
+    uint64_t hits, misses, evictions;
+};
+
+static struct rke_cache_shard_t shards[RKE_CACHE_SHARDS];
+static size_t total_capacity = RKE_CACHE_DEFAULT_CAPACITY;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+static uint64_t hash_key(const unsigned char *key_id) {
+    uint64_t a, b;
+
+    memcpy(&a, key_id, sizeof(a));
+    memcpy(&b, key_id + sizeof(a), sizeof(b));
+    return (a ^ (b * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+}
+
+/*
+ * (Re)allocate the pool of one shard; called with the shard locked or before first use
+ */
+static void setup_shard(struct rke_cache_shard_t *shard, int32_t capacity) {
+    uint32_t buckets = 1;
+
+    free(shard->entries);
+    free(shard->buckets);
+    shard->entries = NULL;
+    shard->buckets = NULL;
+    shard->capacity = 0;
+    shard->used = 0;
+    shard->head = shard->tail = NIL;
+    shard->hits = shard->misses = shard->evictions = 0;
+
+    if (capacity == 0) {
+        return;
+    }
+
+    while (buckets < (uint32_t)capacity) {
+        buckets <<= 1;
+    }
+
+    shard->entries = (struct rke_cache_entry_t *) calloc((size_t)capacity, sizeof(struct rke_cache_entry_t));
+    shard->buckets = (int32_t *) malloc(buckets * sizeof(int32_t));
+    if (shard->entries == NULL || shard->buckets == NULL) {
+        error("Can't alloc RKE cache shard, caching disabled for it");
+        free(shard->entries);
+        free(shard->buckets);
+        shard->entries = NULL;
+        shard->buckets = NULL;
+        return;
+    }
+
+    for (uint32_t i = 0; i < buckets; i++) {
+        shard->buckets[i] = NIL;
+    }
+    shard->bucket_mask = buckets - 1;
+    shard->capacity = capacity;
+}
+
+static int32_t shard_capacity(int index) {
+    return (int32_t)(total_capacity / RKE_CACHE_SHARDS + ((size_t)index < total_capacity % RKE_CACHE_SHARDS));
+}
+
+static void init_cache(void) {
+    for (int i = 0; i < RKE_CACHE_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        setup_shard(&shards[i], shard_capacity(i));
+    }
+}
+
+static struct rke_cache_shard_t *get_shard(uint64_t hash) {
+    pthread_once(&cache_once, init_cache);
+    return &shards[hash % RKE_CACHE_SHARDS];
+}
+
+static void lru_unlink(struct rke_cache_shard_t *shard, int32_t index) {
+    struct rke_cache_entry_t *entry = &shard->entries[index];
+
+    if (entry->prev != NIL) {
+        shard->entries[entry->prev].next = entry->next;
+    } else {
+        shard->head = entry->next;
+    }
+    if (entry->next != NIL) {
+        shard->entries[entry->next].prev = entry->prev;
+    } else {
+        shard->tail = entry->prev;
+    }
+}
+
+static void lru_push_front(struct rke_cache_shard_t *shard, int32_t index) {
+    struct rke_cache_entry_t *entry = &shard->entries[index];
+
+    entry->prev = NIL;
+    entry->next = shard->head;
+    if (shard->head != NIL) {
+        shard->entries[shard->head].prev = index;
+    }
+    shard->head = index;
+    if (shard->tail == NIL) {
+        shard->tail = index;
+    }
+}
+
+/*
+ * Find a key in its shard and mark it most recently used
+ */
+static struct rke_cache_entry_t *find_entry(struct rke_cache_shard_t *shard, uint64_t hash,
+                                            const unsigned char *key_id) {
+    int32_t index;
+
+    if (shard->capacity == 0) {
+        return NULL;
+    }
+
+    for (index = shard->buckets[(hash >> 32) & shard->bucket_mask]; index != NIL; index = shard->entries[index].chain) {
+        if (memcmp(shard->entries[index].key_id, key_id, RKE_KEY_ID_SIZE) == 0) {
+            if (shard->head != index) {
+                lru_unlink(shard, index);
+                lru_push_front(shard, index);
+            }
+            return &shard->entries[index];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Remove an entry from its hash chain
+ */
+static void unchain_entry(struct rke_cache_shard_t *shard, int32_t index) {
+    int32_t *link = &shard->buckets[(hash_key(shard->entries[index].key_id) >> 32) & shard->bucket_mask];
+
+    while (*link != index) {
+        link = &shard->entries[*link].chain;
+    }
+    *link = shard->entries[index].chain;
+}
+
+/*
+ * Find or insert a key, evicting the least recently used entry when the shard is full
+ */
+static struct rke_cache_entry_t *claim_entry(struct rke_cache_shard_t *shard, uint64_t hash,
+                                             const unsigned char *key_id) {
+    struct rke_cache_entry_t *entry = find_entry(shard, hash, key_id);
+    uint32_t bucket;
+    int32_t index;
+
+    if (entry != NULL || shard->capacity == 0) {
+        return entry;
+    }
+
+    if (shard->used < shard->capacity) {
+        index = shard->used++;
+    } else {
+        index = shard->tail;
+        unchain_entry(shard, index);
+        lru_unlink(shard, index);
+        shard->evictions++;
+    }
+
+    entry = &shard->entries[index];
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->key_id, key_id, RKE_KEY_ID_SIZE);
+
+    bucket = (uint32_t)(hash >> 32) & shard->bucket_mask;
+    entry->chain = shard->buckets[bucket];
+    shard->buckets[bucket] = index;
+    lru_push_front(shard, index);
+
+    return entry;
+}
+
+/*
+ * Look up a key's presence bitmap
+ * Returns RKE_CACHE_HIT (bitmap filled in), RKE_CACHE_ABSENT or RKE_CACHE_MISS
+ */
+int rke_cache_lookup(const unsigned char *key_id, unsigned char *bitmap) {
+    uint64_t hash = hash_key(key_id);
+    struct rke_cache_shard_t *shard = get_shard(hash);
+    struct rke_cache_entry_t *entry;
+    int state = RKE_CACHE_MISS;
+
+    pthread_mutex_lock(&shard->lock);
+    entry = find_entry(shard, hash, key_id);
+    if (entry != NULL) {
+        state = entry->state;
+        if (state == RKE_CACHE_HIT && bitmap != NULL) {
+            memcpy(bitmap, entry->bitmap, RKE_FRAGMENT_BITMAP_SIZE);
+        }
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return state;
+}
+
+/*
+ * Look up a key's metadata
+ * A cached container without metadata counts as a miss so the caller re-reads it
+ */
+int rke_cache_lookup_metadata(const unsigned char *key_id, struct rke_key_metadata_t *metadata) {
+    uint64_t hash = hash_key(key_id);
+    struct rke_cache_shard_t *shard = get_shard(hash);
+    struct rke_cache_entry_t *entry;
+    int state = RKE_CACHE_MISS;
+
+    pthread_mutex_lock(&shard->lock);
+    entry = find_entry(shard, hash, key_id);
+    if (entry != NULL && (entry->state == RKE_CACHE_ABSENT || entry->has_metadata)) {
+        state = entry->state;
+        if (state == RKE_CACHE_HIT && metadata != NULL) {
+            memcpy(metadata, &entry->metadata, sizeof(*metadata));
+        }
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return state;
+}
+
+/*
+ * Set a key's entry; called with the shard locked. bitmap is NULL for a key without a container
+ */
+static void store_entry(struct rke_cache_shard_t *shard, uint64_t hash, const unsigned char *key_id,
+                        const unsigned char *bitmap, const struct rke_key_metadata_t *metadata) {
+    struct rke_cache_entry_t *entry = claim_entry(shard, hash, key_id);
+
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->state = (bitmap != NULL) ? RKE_CACHE_HIT : RKE_CACHE_ABSENT;
+    entry->has_metadata = (metadata != NULL);
+    if (bitmap != NULL) {
+        memcpy(entry->bitmap, bitmap, RKE_FRAGMENT_BITMAP_SIZE);
+    } else {
+        memset(entry->bitmap, 0, RKE_FRAGMENT_BITMAP_SIZE);
+    }
+    if (metadata != NULL) {
+        memcpy(&entry->metadata, metadata, sizeof(entry->metadata));
+    }
+}
+
+/*
+ * Record the current header contents of a key; called by writers with the key locked
+ */
+void rke_cache_update(const unsigned char *key_id, const unsigned char *bitmap,
+                      const struct rke_key_metadata_t *metadata) {
+    uint64_t hash = hash_key(key_id);
+    struct rke_cache_shard_t *shard = get_shard(hash);
+
+    pthread_mutex_lock(&shard->lock);
+    shard->generation++;
+    store_entry(shard, hash, key_id, bitmap, metadata);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/*
+ * Remember that a key has no container; called by writers with the key locked
+ */
+void rke_cache_mark_absent(const unsigned char *key_id) {
+    uint64_t hash = hash_key(key_id);
+    struct rke_cache_shard_t *shard = get_shard(hash);
+
+    pthread_mutex_lock(&shard->lock);
+    shard->generation++;
+    store_entry(shard, hash, key_id, NULL, NULL);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/*
+ * Generation of a key's shard; readers take it before reading the container they will fill from
+ */
+uint64_t rke_cache_generation(const unsigned char *key_id) {
+    uint64_t hash = hash_key(key_id);
+    struct rke_cache_shard_t *shard = get_shard(hash);
+    uint64_t generation;
+
+    pthread_mutex_lock(&shard->lock);
+    generation = shard->generation;
+    pthread_mutex_unlock(&shard->lock);
+
+    return generation;
+}
+
+/*
+ * Fill the cache from a read, dropped when a writer updated the shard since generation was taken
+ * bitmap is NULL when the container was missing; that never replaces a cached container
+ */
+void rke_cache_fill(const unsigned char *key_id, uint64_t generation, const unsigned char *bitmap,
+                    const struct rke_key_metadata_t *metadata) {
+    uint64_t hash = hash_key(key_id);
+    struct rke_cache_shard_t *shard = get_shard(hash);
+    struct rke_cache_entry_t *entry;
+
+    pthread_mutex_lock(&shard->lock);
+    if (generation == shard->generation) {
+        entry = (bitmap == NULL) ? find_entry(shard, hash, key_id) : NULL;
+        if (entry == NULL || entry->state != RKE_CACHE_HIT) {
+            store_entry(shard, hash, key_id, bitmap, metadata);
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/*
+ * Resize the cache to hold about capacity keys, dropping its contents and counters
+ */
+int rke_cache_set_capacity(size_t capacity) {
+    if (capacity > (size_t)INT32_MAX) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    pthread_once(&cache_once, init_cache);
+    for (int i = 0; i < RKE_CACHE_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+    }
+
+    total_capacity = capacity;
+    for (int i = 0; i < RKE_CACHE_SHARDS; i++) {
+        shards[i].generation++;
+        setup_shard(&shards[i], shard_capacity(i));
+    }
+
+    for (int i = RKE_CACHE_SHARDS - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+
+    return RKE_SUCCESS;
+}
+
+/*
+ * Drop every cached entry and reset the counters
+ */
+void rke_cache_clear(void) {
+    pthread_once(&cache_once, init_cache);
+    for (int i = 0; i < RKE_CACHE_SHARDS; i++) {
+        struct rke_cache_shard_t *shard = &shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        shard->generation++;
+        if (shard->capacity > 0) {
+            memset(shard->entries, 0, (size_t)shard->capacity * sizeof(struct rke_cache_entry_t));
+            for (uint32_t b = 0; b <= shard->bucket_mask; b++) {
+                shard->buckets[b] = NIL;
+            }
+        }
+        shard->used = 0;
+        shard->head = shard->tail = NIL;
+        shard->hits = shard->misses = shard->evictions = 0;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/*
+ * Sum the counters of every shard
+ */
+void rke_cache_get_stats(struct rke_cache_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_once(&cache_once, init_cache);
+    for (int i = 0; i < RKE_CACHE_SHARDS; i++) {
+        struct rke_cache_shard_t *shard = &shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->entries += (size_t)shard->used;
+        stats->capacity += (size_t)shard->capacity;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/*
+ * Number of fragments present in a bitmap
+ */
+int rke_bitmap_count(const unsigned char *bitmap) {
+    int count = 0;
+
+    for (int i = 0; i < RKE_FRAGMENT_BITMAP_SIZE; i += 8) {
+        uint64_t word;
+        memcpy(&word, bitmap + i, sizeof(word));
+        count += __builtin_popcountll(word);
+    }
+
+    return count;
+}
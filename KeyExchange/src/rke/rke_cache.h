@@ -0,0 +1,62 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_cache.h
+#   Last Modified : 2024-07-20
+#   Describe      : Sharded LRU cache of per-key container headers (metadata and presence bitmap)
+#
+# ====================================================*/
+
+#ifndef RKE_CACHE_H
+#define RKE_CACHE_H
+
+#include <stddef.h>
+
+#include "rke.h"
+
+// Lookup results
+#define RKE_CACHE_MISS    0   // Not cached, read the container
+#define RKE_CACHE_HIT     1   // Container exists, requested data returned
+#define RKE_CACHE_ABSENT  2   // Known to have no container
+
+#define RKE_CACHE_SHARDS 16
+#define RKE_CACHE_DEFAULT_CAPACITY 16384
+
+// Presence bitmap: bit (id - 1) % 8 of byte (id - 1) / 8 is set when fragment id is stored
+#define RKE_BITMAP_TEST(bitmap, id) (((bitmap)[((id) - 1) / 8] >> (((id) - 1) % 8)) & 1)
+#define RKE_BITMAP_SET(bitmap, id) ((bitmap)[((id) - 1) / 8] |= (unsigned char)(1 << (((id) - 1) % 8)))
+#define RKE_BITMAP_CLEAR(bitmap, id) ((bitmap)[((id) - 1) / 8] &= (unsigned char)~(1 << (((id) - 1) % 8)))
+
+// Cache counters, summed over all shards
+struct rke_cache_stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t capacity;
+};
+
+// Lookups (bitmap / metadata may be NULL when only the state is wanted)
+int rke_cache_lookup(const unsigned char *key_id, unsigned char *bitmap);
+int rke_cache_lookup_metadata(const unsigned char *key_id, struct rke_key_metadata_t *metadata);
+
+// Write-through of a container header by its writer; metadata is NULL when the header holds none
+void rke_cache_update(const unsigned char *key_id, const unsigned char *bitmap,
+                      const struct rke_key_metadata_t *metadata);
+void rke_cache_mark_absent(const unsigned char *key_id);
+
+// Read-path fills: take the generation before reading the container, then pass the header's
+// bitmap (NULL when the container is missing); the fill is dropped if a writer got in between
+uint64_t rke_cache_generation(const unsigned char *key_id);
+void rke_cache_fill(const unsigned char *key_id, uint64_t generation, const unsigned char *bitmap,
+                    const struct rke_key_metadata_t *metadata);
+
+// Management (capacity 0 disables caching)
+int rke_cache_set_capacity(size_t capacity);
+void rke_cache_clear(void);
+void rke_cache_get_stats(struct rke_cache_stats_t *stats);
+
+int rke_bitmap_count(const unsigned char *bitmap);
+
+#endif // RKE_CACHE_H
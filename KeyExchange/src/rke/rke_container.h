@@ -0,0 +1,67 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_container.h
+#   Last Modified : 2024-07-20
+#   Describe      : Per-key container file layout shared by the storage read and write paths
+#
+# ====================================================*/
+
+#ifndef RKE_CONTAINER_H
+#define RKE_CONTAINER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "rke.h"
+#include "rke_wal.h"
+
+/*
+ * Container layout: one file per key
+ *   [0, RKE_CONTAINER_HEADER_SIZE)  header - magic, version, metadata, presence bitmap, slot offset table
+ *   then RKE_MAX_FRAGMENTS slots of slot_size bytes, slot N holds fragment N + 1 in its wire form
+ *   (RKE_FRAGMENT_WIRE_SIZE bytes, so payloads stay 64-byte aligned and small keys take small slots)
+ * slot_size is fixed while the container holds fragments; it is chosen by the first fragments stored.
+ * Every update is made durable in the WAL (rke_wal.c) first, so a crash is repaired by replaying
+ * the log. Fragments going into slots the header does not list are written in place, followed by
+ * the header in one write; other updates rename a whole new image over the container. Either way
+ * a slot the header lists is never rewritten, so a reader of listed slots sees whole fragments.
+ */
+#define RKE_CONTAINER_MAGIC "RKEC"
+#define RKE_CONTAINER_VERSION 2
+#define RKE_CONTAINER_HEADER_SIZE 4096
+#define RKE_CONTAINER_MIN_SLOT_SIZE RKE_FRAGMENT_WIRE_SIZE(1)
+#define RKE_CONTAINER_MAX_SLOT_SIZE RKE_FRAGMENT_WIRE_SIZE(RKE_FRAGMENT_DATA_SIZE)
+
+#define SLOT_OFFSET(fragment_id, slot_size) \
+    ((off_t)RKE_CONTAINER_HEADER_SIZE + (off_t)((fragment_id) - 1) * (off_t)(slot_size))
+#define RKE_CONTAINER_MAX_SIZE ((size_t)SLOT_OFFSET(RKE_MAX_FRAGMENTS + 1, RKE_CONTAINER_MAX_SLOT_SIZE))
+
+struct rke_container_header_t {
+    char magic[4];
+    uint16_t version;
+    uint16_t slot_size;
+    uint8_t has_metadata;
+    uint8_t reserved[7];
+    unsigned char presence[RKE_FRAGMENT_BITMAP_SIZE];   // Bit per stored fragment id
+    struct rke_key_metadata_t metadata;
+    uint32_t offsets[RKE_MAX_FRAGMENTS];    // File offset of each fragment slot, 0 - absent
+};
+
+// The header must fit in front of the first slot
+typedef char rke_container_header_fits[(sizeof(struct rke_container_header_t) <= RKE_CONTAINER_HEADER_SIZE) ? 1 : -1];
+
+// rke_container.c
+uint64_t rke_container_hash(const unsigned char *key_id);
+int rke_container_check_header(const struct rke_container_header_t *header);
+int rke_container_replace(const unsigned char *key_id, const unsigned char *image, size_t length);
+int rke_container_write_slots(const unsigned char *key_id, const struct rke_wal_write_t *writes, int count);
+
+// rke_storage.c
+int rke_container_open(const unsigned char *key_id, int flags);
+
+// rke_storage_write.c
+void rke_storage_open_wal(void);
+
+#endif // RKE_CONTAINER_H
@@ -18,10 +18,30 @@
 #include "../common/log.h"
 #include "../common/utils.h"
 #include "rke.h"
+#include "rke_gf256.h"
 
-// Global storage for key fragments (in production, use proper storage)
-static struct rke_fragment_t fragment_storage[256];
-static int fragment_count = 0;
+/*
+ * Initialize an RKE working context
+ */
+void rke_ctx_init(struct rke_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+
+    ctx->lagrange_count = 0;
+}
+
+/*
+ * Wipe an RKE working context
+ */
+void rke_ctx_cleanup(struct rke_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+
+    // Clear sensitive data
+    memset(ctx, 0, sizeof(struct rke_ctx_t));
+}
 
 /*
  * Generate a quantum-safe cryptographic key
@@ -44,86 +64,95 @@ int rke_generate_key(unsigned char *key, uint16_t key_size) {
 }
 
 /*
- * Simple polynomial evaluation for Shamir's secret sharing
- * This is a simplified implementation - production should use proper GF(256) arithmetic
+ * Validate split parameters shared by the single and batch entry points
  */
-static uint8_t evaluate_polynomial(uint8_t x, uint8_t *coefficients, uint8_t degree) {
-    uint8_t result = 0;
-    uint8_t x_power = 1;
+static int validate_split_params(uint16_t key_size, uint8_t total_fragments, uint8_t threshold) {
+    if (key_size == 0 || key_size > RKE_MAX_KEY_SIZE) {
+        error("Invalid key size %d", key_size);
+        return RKE_ERROR_INVALID_PARAM;
+    }
     
-    for (int i = 0; i <= degree; i++) {
-        result ^= (coefficients[i] * x_power) & 0xFF;
-        x_power = (x_power * x) & 0xFF;
+    if (threshold > total_fragments) {
+        error("Threshold %d cannot exceed total fragments %d", threshold, total_fragments);
+        return RKE_ERROR_INVALID_PARAM;
     }
     
-    return result;
+    if (threshold < RKE_MIN_THRESHOLD) {
+        error("Threshold %d too low, minimum is %d", threshold, RKE_MIN_THRESHOLD);
+        return RKE_ERROR_INVALID_PARAM;
+    }
+    
+    return RKE_SUCCESS;
 }
 
 /*
- * Split a key into fragments using simplified Shamir's secret sharing
+ * Compute the shares of one key: share N (x = N) is written to out + (N - 1) * stride
+ * Every key byte is the constant term of its own random polynomial of degree threshold-1
  */
-int rke_split_key(const unsigned char *key, uint16_t key_size, struct rke_key_metadata_t *metadata) {
-    // Validate input parameters
-    if (key == NULL || metadata == NULL || key_size == 0 || key_size > RKE_MAX_KEY_SIZE) {
-        error("Invalid key splitting parameters");
-        return RKE_ERROR_INVALID_PARAM;
+static int split_shares(struct rke_ctx_t *ctx, const unsigned char *key, uint16_t key_size,
+                        uint8_t total_fragments, uint8_t threshold, unsigned char *out, size_t stride) {
+    int degree = threshold - 1;
+    
+    // Draw all random coefficients at once: row j-1 holds c_j for every key byte
+    if (secure_random_bytes(ctx->coefficients, (size_t)degree * key_size) != 0) {
+        error("Failed to generate random polynomial coefficients");
+        return RKE_ERROR_CRYPTO_FAIL;
+    }
+    
+    for (int frag_id = 1; frag_id <= total_fragments; frag_id++) {
+        rke_gf256_eval_region(out + (size_t)(frag_id - 1) * stride, key, ctx->coefficients,
+                              degree, (uint8_t)frag_id, key_size);
     }
     
-    if (metadata->threshold > metadata->total_fragments) {
-        error("Threshold %d cannot exceed total fragments %d", 
-              metadata->threshold, metadata->total_fragments);
+    // Coefficients determine the key - do not leave them around
+    memset(ctx->coefficients, 0, (size_t)degree * key_size);
+    return RKE_SUCCESS;
+}
+
+/*
+ * Split a key into fragments using Shamir's secret sharing over GF(256)
+ * Fragment N holds the polynomial values at x = N
+ * fragments must have room for metadata->total_fragments entries
+ */
+int rke_split_key(struct rke_ctx_t *ctx, const unsigned char *key, uint16_t key_size,
+                  const struct rke_key_metadata_t *metadata, struct rke_fragment_t *fragments) {
+    int rv;
+
+    // Validate input parameters
+    if (ctx == NULL || key == NULL || metadata == NULL || fragments == NULL) {
+        error("Invalid key splitting parameters");
         return RKE_ERROR_INVALID_PARAM;
     }
     
-    if (metadata->threshold < RKE_MIN_THRESHOLD) {
-        error("Threshold %d too low, minimum is %d", metadata->threshold, RKE_MIN_THRESHOLD);
+    if (validate_split_params(key_size, metadata->total_fragments, metadata->threshold) != RKE_SUCCESS) {
         return RKE_ERROR_INVALID_PARAM;
     }
     
     debug("Splitting %d-byte key into %d fragments (threshold=%d)", 
           key_size, metadata->total_fragments, metadata->threshold);
     
-    // Clear existing fragments
-    fragment_count = 0;
-    memset(fragment_storage, 0, sizeof(fragment_storage));
-    
-    // Simplified secret sharing for demonstration
-    // Fragment 0 contains the original key, other fragments contain XOR masks
     for (int frag_id = 1; frag_id <= metadata->total_fragments; frag_id++) {
-        struct rke_fragment_t *fragment = &fragment_storage[frag_id - 1];
+        struct rke_fragment_t *fragment = &fragments[frag_id - 1];
         
         // Initialize fragment metadata
+        memset(fragment, 0, RKE_FRAGMENT_HEADER_SIZE);
         fragment->fragment_id = frag_id;
         fragment->total_fragments = metadata->total_fragments;
         fragment->threshold = metadata->threshold;
         fragment->fragment_size = key_size;
-        memset(fragment->data, 0, RKE_FRAGMENT_DATA_SIZE);
-        
-        if (frag_id == 1) {
-            // First fragment gets the original key
-            memcpy(fragment->data, key, key_size);
-        } else {
-            // Other fragments get random XOR masks
-            if (secure_random_bytes(fragment->data, key_size) != 0) {
-                error("Failed to generate random mask for fragment");
-                return RKE_ERROR_CRYPTO_FAIL;
-            }
-            
-            // XOR the first fragment with this mask
-            for (int i = 0; i < key_size; i++) {
-                fragment_storage[0].data[i] ^= fragment->data[i];
-            }
-        }
+        memset(fragment->data + key_size, 0, RKE_FRAGMENT_DATA_SIZE - key_size);
     }
     
-    fragment_count = metadata->total_fragments;
+    rv = split_shares(ctx, key, key_size, metadata->total_fragments, metadata->threshold,
+                      fragments[0].data, sizeof(struct rke_fragment_t));
+    if (rv != RKE_SUCCESS) {
+        return rv;
+    }
     
-    // Calculate checksums for all fragments
-    for (int i = 0; i < metadata->total_fragments; i++) {
-        if (rke_calculate_checksum(&fragment_storage[i]) != RKE_SUCCESS) {
-            error("Failed to calculate checksum for fragment %d", i);
-            return RKE_ERROR_CRYPTO_FAIL;
-        }
+    // Calculate checksums for all fragments in one batched call
+    if (rke_calculate_checksums(fragments, metadata->total_fragments) != RKE_SUCCESS) {
+        error("Failed to calculate fragment checksums");
+        return RKE_ERROR_CRYPTO_FAIL;
     }
     
     debug("Successfully split key into %d fragments", metadata->total_fragments);
@@ -131,69 +160,211 @@ int rke_split_key(const unsigned char *key, uint16_t key_size, struct rke_key_me
 }
 
 /*
- * Lagrange interpolation for secret reconstruction
- * Simplified implementation for demonstration
+ * Allocate a structure-of-arrays fragment buffer for key_count keys
+ * Payloads and checksums each live in one contiguous block
  */
-static uint8_t lagrange_interpolate(uint8_t *x_coords, uint8_t *y_coords, int count) {
-    uint16_t result = 0;
+int rke_fragment_batch_alloc(struct rke_fragment_batch_t *batch, uint16_t key_count,
+                             uint8_t total_fragments, uint8_t threshold, uint16_t fragment_size) {
+    size_t fragments;
+
+    if (batch == NULL || key_count == 0 || key_count > RKE_MAX_BATCH_KEYS || total_fragments == 0) {
+        error("Invalid fragment batch parameters");
+        return RKE_ERROR_INVALID_PARAM;
+    }
     
-    for (int i = 0; i < count; i++) {
-        uint16_t numerator = 1;
-        uint16_t denominator = 1;
-        
-        for (int j = 0; j < count; j++) {
-            if (i != j) {
-                numerator = (numerator * (256 - x_coords[j])) & 0xFFFF;
-                denominator = (denominator * (x_coords[i] ^ x_coords[j])) & 0xFFFF;
-            }
+    if (validate_split_params(fragment_size, total_fragments, threshold) != RKE_SUCCESS) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+    
+    fragments = (size_t)key_count * total_fragments;
+    
+    memset(batch, 0, sizeof(struct rke_fragment_batch_t));
+    batch->data = (unsigned char *) malloc(fragments * (fragment_size + RKE_CHECKSUM_SIZE));
+    if (batch->data == NULL) {
+        error("Can't alloc fragment batch for %d keys", key_count);
+        return RKE_ERROR_MEMORY_ALLOC;
+    }
+    
+    batch->checksums = batch->data + fragments * fragment_size;
+    batch->key_count = key_count;
+    batch->total_fragments = total_fragments;
+    batch->threshold = threshold;
+    batch->fragment_size = fragment_size;
+    
+    return RKE_SUCCESS;
+}
+
+/*
+ * Wipe and release a fragment batch
+ */
+void rke_fragment_batch_free(struct rke_fragment_batch_t *batch) {
+    if (batch == NULL || batch->data == NULL) {
+        return;
+    }
+    
+    memset(batch->data, 0, (size_t)batch->key_count * batch->total_fragments *
+           (batch->fragment_size + RKE_CHECKSUM_SIZE));
+    free(batch->data);
+    memset(batch, 0, sizeof(struct rke_fragment_batch_t));
+}
+
+/*
+ * Copy one fragment of a batch into the regular fragment structure
+ */
+int rke_fragment_batch_get(const struct rke_fragment_batch_t *batch, int key_index, uint8_t fragment_id,
+                           struct rke_fragment_t *fragment) {
+    size_t index;
+
+    if (batch == NULL || fragment == NULL || key_index < 0 || key_index >= batch->key_count ||
+        fragment_id == 0 || fragment_id > batch->total_fragments) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+    
+    index = (size_t)key_index * batch->total_fragments + (fragment_id - 1);
+    
+    memset(fragment, 0, RKE_FRAGMENT_HEADER_SIZE);
+    fragment->fragment_id = fragment_id;
+    fragment->total_fragments = batch->total_fragments;
+    fragment->threshold = batch->threshold;
+    fragment->fragment_size = batch->fragment_size;
+    memcpy(fragment->data, RKE_BATCH_DATA(batch, index), batch->fragment_size);
+    memset(fragment->data + batch->fragment_size, 0, RKE_FRAGMENT_DATA_SIZE - batch->fragment_size);
+    memcpy(fragment->checksum, RKE_BATCH_CHECKSUM(batch, index), RKE_CHECKSUM_SIZE);
+    
+    return RKE_SUCCESS;
+}
+
+/*
+ * Generate batch->key_count keys and split all of them into batch
+ * Keys come from one bulk random draw; keys may be NULL if the caller does not need them
+ */
+int rke_generate_and_split_batch(struct rke_ctx_t *ctx, struct rke_fragment_batch_t *batch, unsigned char *keys) {
+    unsigned char *key_buffer = keys;
+    size_t per_key;
+    int rv = RKE_SUCCESS;
+
+    if (ctx == NULL || batch == NULL || batch->data == NULL) {
+        error("Invalid batch generation parameters");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+    
+    debug("Generating batch of %d keys (%d bytes, %d fragments, threshold=%d)", batch->key_count,
+          batch->fragment_size, batch->total_fragments, batch->threshold);
+    
+    if (key_buffer == NULL) {
+        key_buffer = (unsigned char *) malloc((size_t)batch->key_count * batch->fragment_size);
+        if (key_buffer == NULL) {
+            error("Can't alloc key buffer for batch");
+            return RKE_ERROR_MEMORY_ALLOC;
         }
-        
-        // Simplified division (proper implementation needs modular inverse)
-        if (denominator != 0) {
-            uint16_t term = (y_coords[i] * numerator / denominator) & 0xFF;
-            result ^= term;
+    }
+    
+    if (secure_random_bytes(key_buffer, (size_t)batch->key_count * batch->fragment_size) != 0) {
+        error("Failed to generate %d secure random keys", batch->key_count);
+        rv = RKE_ERROR_CRYPTO_FAIL;
+        goto cleanup;
+    }
+    
+    per_key = (size_t)batch->total_fragments * batch->fragment_size;
+    for (int k = 0; k < batch->key_count; k++) {
+        rv = split_shares(ctx, key_buffer + (size_t)k * batch->fragment_size, batch->fragment_size,
+                          batch->total_fragments, batch->threshold, batch->data + k * per_key, batch->fragment_size);
+        if (rv != RKE_SUCCESS) {
+            goto cleanup;
         }
     }
     
-    return result & 0xFF;
+    if (rke_calculate_batch_checksums(batch) != RKE_SUCCESS) {
+        error("Failed to calculate batch checksums");
+        rv = RKE_ERROR_CRYPTO_FAIL;
+    }
+    
+cleanup:
+    if (key_buffer != keys) {
+        memset(key_buffer, 0, (size_t)batch->key_count * batch->fragment_size);
+        free(key_buffer);
+    }
+    
+    return rv;
+}
+
+/*
+ * Lagrange basis at x = 0 for the given fragment ids
+ * The last basis is kept in the context - callers usually reuse the same fragment subset
+ */
+static int get_lagrange_coefficients(struct rke_ctx_t *ctx, const uint8_t *x_coords, int count) {
+    if (ctx->lagrange_count == count && memcmp(ctx->lagrange_x, x_coords, count) == 0) {
+        return 0;
+    }
+
+    ctx->lagrange_count = 0;
+    if (rke_gf256_lagrange_coefficients(x_coords, count, ctx->lagrange_coefficients) != 0) {
+        return -1;
+    }
+
+    memcpy(ctx->lagrange_x, x_coords, count);
+    ctx->lagrange_count = count;
+
+    return 0;
 }
 
 /*
  * Reconstruct a key from sufficient fragments
+ * Uses the first threshold entries of fragments and Lagrange interpolation at x = 0
  */
-int rke_reconstruct_key(unsigned char *key, uint16_t key_size, const struct rke_key_metadata_t *metadata) {
+int rke_reconstruct_key(struct rke_ctx_t *ctx, unsigned char *key, uint16_t key_size,
+                        const struct rke_key_metadata_t *metadata,
+                        const struct rke_fragment_t *fragments, int fragment_count) {
+    const unsigned char *shares[RKE_MAX_FRAGMENTS];
+    uint8_t x_coords[RKE_MAX_FRAGMENTS];
+    int bad_index = 0;
+    int threshold;
+
     // Validate input parameters
-    if (key == NULL || metadata == NULL || key_size == 0) {
+    if (ctx == NULL || key == NULL || metadata == NULL || fragments == NULL ||
+        key_size == 0 || key_size > RKE_MAX_KEY_SIZE) {
         error("Invalid key reconstruction parameters");
         return RKE_ERROR_INVALID_PARAM;
     }
     
-    if (fragment_count < metadata->threshold) {
-        error("Insufficient fragments: have %d, need %d", fragment_count, metadata->threshold);
+    threshold = metadata->threshold;
+    if (threshold < RKE_MIN_THRESHOLD) {
+        error("Threshold %d too low, minimum is %d", threshold, RKE_MIN_THRESHOLD);
+        return RKE_ERROR_INVALID_PARAM;
+    }
+    
+    if (fragment_count < threshold) {
+        error("Insufficient fragments: have %d, need %d", fragment_count, threshold);
         return RKE_ERROR_INSUFFICIENT_FRAGMENTS;
     }
     
     debug("Reconstructing %d-byte key from %d fragments (threshold=%d)", 
-          key_size, fragment_count, metadata->threshold);
+          key_size, fragment_count, threshold);
     
-    // Verify fragment integrity
-    for (int i = 0; i < metadata->threshold; i++) {
-        if (rke_verify_checksum(&fragment_storage[i]) != RKE_SUCCESS) {
-            error("Fragment %d failed integrity check", i);
-            return RKE_ERROR_FRAGMENT_CORRUPT;
-        }
+    // Verify fragment integrity in one batched pass
+    if (rke_verify_checksums(fragments, threshold, &bad_index) != RKE_SUCCESS) {
+        error("Fragment %d failed integrity check", fragments[bad_index].fragment_id);
+        return RKE_ERROR_FRAGMENT_CORRUPT;
     }
     
-    // Simplified reconstruction - XOR all fragments together
-    memcpy(key, fragment_storage[0].data, key_size);  // Start with first fragment
-    
-    // XOR with all other fragments to undo the masks
-    for (int frag_idx = 1; frag_idx < fragment_count; frag_idx++) {
-        for (int byte_idx = 0; byte_idx < key_size; byte_idx++) {
-            key[byte_idx] ^= fragment_storage[frag_idx].data[byte_idx];
+    for (int i = 0; i < threshold; i++) {
+        if (fragments[i].fragment_size < key_size) {
+            error("Fragment %d too short: %d < %d", fragments[i].fragment_id, fragments[i].fragment_size, key_size);
+            return RKE_ERROR_INVALID_PARAM;
         }
+        
+        x_coords[i] = fragments[i].fragment_id;
+        shares[i] = fragments[i].data;
+    }
+    
+    // Lagrange basis at x = 0 for this fragment subset
+    if (get_lagrange_coefficients(ctx, x_coords, threshold) != 0) {
+        error("Fragment set is not suitable for interpolation");
+        return RKE_ERROR_FRAGMENT_CORRUPT;
     }
     
+    rke_gf256_combine_region(key, shares, ctx->lagrange_coefficients, threshold, key_size);
+    
     debug("Successfully reconstructed %d-byte key", key_size);
     return RKE_SUCCESS;
 }
@@ -222,4 +393,30 @@ int rke_validate_fragment(const struct rke_fragment_t *fragment) {
     }
     
     return RKE_SUCCESS;
+}
+
+/*
+ * Copy a fragment out of its stored or wire form (header plus padded payload)
+ * record may overlap fragment; data past the payload is zeroed
+ * Returns the bytes the record takes or RKE_ERROR_FRAGMENT_CORRUPT when it does not fit in available
+ */
+int rke_fragment_unpack(struct rke_fragment_t *fragment, const unsigned char *record, size_t available) {
+    uint16_t fragment_size;
+    size_t length;
+    
+    if (available < RKE_FRAGMENT_HEADER_SIZE) {
+        error("Fragment record too short: %zu bytes", available);
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+    
+    memcpy(&fragment_size, record + offsetof(struct rke_fragment_t, fragment_size), sizeof(fragment_size));
+    length = RKE_FRAGMENT_WIRE_SIZE(fragment_size);
+    if (fragment_size > RKE_FRAGMENT_DATA_SIZE || length > available) {
+        error("Fragment of %d bytes does not fit its %zu-byte record", fragment_size, available);
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+    
+    memmove(fragment, record, length);
+    memset((unsigned char *)fragment + length, 0, sizeof(struct rke_fragment_t) - length);
+    return (int)length;
 }
\ No newline at end of file
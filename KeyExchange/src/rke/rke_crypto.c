@@ -18,250 +18,248 @@
 #include "../common/utils.h"
 #include "../common/aes.h"
 #include "rke.h"
+#include "rke_sha256.h"
+
+// Counter blocks reserved per fragment id, so every fragment of a key set gets its own keystream
+#define RKE_FRAGMENT_CTR_BLOCKS (RKE_FRAGMENT_DATA_SIZE / AES_BLOCK_SIZE)
 
 /*
- * Simple SHA-256 implementation for checksums
- * Note: This is a simplified implementation for demonstration
- * Production should use a proper cryptographic library
+ * Apply the AES-128-CTR keystream of each fragment to its payload
+ * Callers validate every fragment first: an id of 0 would wrap into the blocks of fragment 255
+ * Returns RKE_ERROR_CRYPTO_FAIL without touching the payloads when the key cannot be expanded
  */
+static int crypt_fragments(struct rke_fragment_t *fragments, int count, const unsigned char *key,
+                           const unsigned char *nonce) {
+    struct aes_key_t schedule;
 
-// SHA-256 constants
-static const uint32_t k[64] = {
-    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-};
-
-static uint32_t rotr(uint32_t x, int n) {
-    return (x >> n) | (x << (32 - n));
-}
-
-static uint32_t ch(uint32_t x, uint32_t y, uint32_t z) {
-    return (x & y) ^ (~x & z);
-}
-
-static uint32_t maj(uint32_t x, uint32_t y, uint32_t z) {
-    return (x & y) ^ (x & z) ^ (y & z);
-}
-
-static uint32_t ep0(uint32_t x) {
-    return rotr(x, 2) ^ rotr(x, 13) ^ rotr(x, 22);
-}
+    if (aes_set_key(&schedule, key, 128) != 0) {
+        error("Failed to expand the fragment encryption key");
+        return RKE_ERROR_CRYPTO_FAIL;
+    }
 
-static uint32_t ep1(uint32_t x) {
-    return rotr(x, 6) ^ rotr(x, 11) ^ rotr(x, 25);
-}
+    for (int i = 0; i < count; i++) {
+        uint64_t offset = (uint64_t)(fragments[i].fragment_id - 1) * RKE_FRAGMENT_CTR_BLOCKS;
+        aes_ctr(&schedule, nonce, offset, fragments[i].data, fragments[i].fragment_size);
+    }
 
-static uint32_t sig0(uint32_t x) {
-    return rotr(x, 7) ^ rotr(x, 18) ^ (x >> 3);
+    secure_wipe(&schedule, sizeof(schedule));
+    return RKE_SUCCESS;
 }
 
-static uint32_t sig1(uint32_t x) {
-    return rotr(x, 17) ^ rotr(x, 19) ^ (x >> 10);
+/*
+ * Encrypt a fragment in place with AES-128-CTR
+ */
+int rke_encrypt_fragment(struct rke_fragment_t *fragment, const unsigned char *key, const unsigned char *nonce) {
+    return rke_encrypt_fragments(fragment, 1, key, nonce);
 }
 
 /*
- * Simplified SHA-256 implementation
+ * Decrypt a fragment in place with AES-128-CTR
  */
-static void simple_sha256(const unsigned char *data, size_t len, unsigned char hash[32]) {
-    uint32_t h[8] = {
-        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
-        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
-    };
-    
-    unsigned char padded[512];  // Increased buffer size to handle larger inputs
-    size_t padded_len = len;
-    
-    // Simple padding for small inputs
-    memcpy(padded, data, len);
-    padded[len] = 0x80;
-    padded_len++;
-    
-    while (padded_len % 64 != 56) {
-        padded[padded_len++] = 0;
-    }
-    
-    // Length in bits
-    uint64_t bit_len = len * 8;
-    for (int i = 0; i < 8; i++) {
-        padded[padded_len++] = (bit_len >> (56 - i * 8)) & 0xff;
-    }
-    
-    // Process in 64-byte chunks
-    for (size_t chunk = 0; chunk < padded_len; chunk += 64) {
-        uint32_t w[64];
-        
-        // Prepare message schedule
-        for (int i = 0; i < 16; i++) {
-            w[i] = (padded[chunk + i * 4] << 24) | (padded[chunk + i * 4 + 1] << 16) |
-                   (padded[chunk + i * 4 + 2] << 8) | padded[chunk + i * 4 + 3];
-        }
-        
-        for (int i = 16; i < 64; i++) {
-            w[i] = sig1(w[i - 2]) + w[i - 7] + sig0(w[i - 15]) + w[i - 16];
-        }
-        
-        // Initialize working variables
-        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
-        uint32_t e = h[4], f = h[5], g = h[6], h_var = h[7];
-        
-        // Main loop
-        for (int i = 0; i < 64; i++) {
-            uint32_t t1 = h_var + ep1(e) + ch(e, f, g) + k[i] + w[i];
-            uint32_t t2 = ep0(a) + maj(a, b, c);
-            h_var = g;
-            g = f;
-            f = e;
-            e = d + t1;
-            d = c;
-            c = b;
-            b = a;
-            a = t1 + t2;
-        }
-        
-        // Update hash values
-        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
-        h[4] += e; h[5] += f; h[6] += g; h[7] += h_var;
-    }
-    
-    // Produce final hash
-    for (int i = 0; i < 8; i++) {
-        hash[i * 4] = (h[i] >> 24) & 0xff;
-        hash[i * 4 + 1] = (h[i] >> 16) & 0xff;
-        hash[i * 4 + 2] = (h[i] >> 8) & 0xff;
-        hash[i * 4 + 3] = h[i] & 0xff;
-    }
+int rke_decrypt_fragment(struct rke_fragment_t *fragment, const unsigned char *key, const unsigned char *nonce) {
+    return rke_decrypt_fragments(fragment, 1, key, nonce);
 }
 
 /*
- * Encrypt a fragment using the existing crypt_ctr function
+ * Encrypt an array of fragments in place and checksum the ciphertexts in one batch
+ * Fragment i uses the keystream starting (fragment_id - 1) * 16 blocks after the nonce
  */
-int rke_encrypt_fragment(struct rke_fragment_t *fragment, const unsigned char *key, const unsigned char *nonce) {
+int rke_encrypt_fragments(struct rke_fragment_t *fragments, int count, const unsigned char *key,
+                          const unsigned char *nonce) {
     // Validate input parameters
-    if (fragment == NULL || key == NULL || nonce == NULL) {
+    if (fragments == NULL || key == NULL || nonce == NULL || count < 0 || count > RKE_MAX_FRAGMENTS) {
         error("Invalid parameters for fragment encryption");
         return RKE_ERROR_INVALID_PARAM;
     }
     
-    // Validate fragment
-    if (rke_validate_fragment(fragment) != RKE_SUCCESS) {
-        error("Fragment validation failed before encryption");
-        return RKE_ERROR_INVALID_PARAM;
+    for (int i = 0; i < count; i++) {
+        if (rke_validate_fragment(&fragments[i]) != RKE_SUCCESS) {
+            error("Fragment validation failed before encryption");
+            return RKE_ERROR_INVALID_PARAM;
+        }
     }
     
-    debug("Encrypting fragment %d (size: %d bytes)", fragment->fragment_id, fragment->fragment_size);
-    
-    // Encrypt the fragment data using existing crypt_ctr function
-    crypt_ctr(key, fragment->data, fragment->fragment_size, nonce);
+    if (crypt_fragments(fragments, count, key, nonce) != RKE_SUCCESS) {
+        return RKE_ERROR_CRYPTO_FAIL;
+    }
     
-    // Recalculate checksum after encryption
-    if (rke_calculate_checksum(fragment) != RKE_SUCCESS) {
-        error("Failed to calculate checksum after encryption");
+    // Recalculate checksums after encryption
+    if (rke_calculate_checksums(fragments, count) != RKE_SUCCESS) {
+        error("Failed to calculate checksums after encryption");
         return RKE_ERROR_CRYPTO_FAIL;
     }
     
-    debug("Successfully encrypted fragment %d", fragment->fragment_id);
+    debug("Successfully encrypted %d fragments", count);
     return RKE_SUCCESS;
 }
 
 /*
- * Decrypt a fragment using the existing crypt_ctr function
+ * Decrypt an array of fragments in place and checksum the plaintexts in one batch
  */
-int rke_decrypt_fragment(struct rke_fragment_t *fragment, const unsigned char *key, const unsigned char *nonce) {
+int rke_decrypt_fragments(struct rke_fragment_t *fragments, int count, const unsigned char *key,
+                          const unsigned char *nonce) {
     // Validate input parameters
-    if (fragment == NULL || key == NULL || nonce == NULL) {
+    if (fragments == NULL || key == NULL || nonce == NULL || count < 0 || count > RKE_MAX_FRAGMENTS) {
         error("Invalid parameters for fragment decryption");
         return RKE_ERROR_INVALID_PARAM;
     }
     
-    debug("Decrypting fragment %d (size: %d bytes)", fragment->fragment_id, fragment->fragment_size);
-    
-    // Store original checksum for verification
-    unsigned char original_checksum[RKE_CHECKSUM_SIZE];
-    memcpy(original_checksum, fragment->checksum, RKE_CHECKSUM_SIZE);
-    
-    // Decrypt the fragment data using existing crypt_ctr function
-    // Note: CTR mode encryption/decryption is the same operation
-    crypt_ctr(key, fragment->data, fragment->fragment_size, nonce);
+    for (int i = 0; i < count; i++) {
+        if (rke_validate_fragment(&fragments[i]) != RKE_SUCCESS) {
+            error("Fragment validation failed before decryption");
+            return RKE_ERROR_INVALID_PARAM;
+        }
+    }
     
-    // Recalculate checksum after decryption
-    if (rke_calculate_checksum(fragment) != RKE_SUCCESS) {
-        error("Failed to calculate checksum after decryption");
+    // CTR mode encryption/decryption is the same operation
+    if (crypt_fragments(fragments, count, key, nonce) != RKE_SUCCESS) {
         return RKE_ERROR_CRYPTO_FAIL;
     }
     
-    // Verify decryption was successful by checking if checksums differ
-    // (This is a simplified check - proper implementation should verify against known plaintext patterns)
+    // Recalculate checksums after decryption
+    if (rke_calculate_checksums(fragments, count) != RKE_SUCCESS) {
+        error("Failed to calculate checksums after decryption");
+        return RKE_ERROR_CRYPTO_FAIL;
+    }
     
-    debug("Successfully decrypted fragment %d", fragment->fragment_id);
+    debug("Successfully decrypted %d fragments", count);
     return RKE_SUCCESS;
 }
 
+/*
+ * Serialize the checksummed header fields of a fragment
+ */
+static void fragment_header(unsigned char *header, uint8_t fragment_id, uint8_t total_fragments,
+                            uint8_t threshold, uint16_t fragment_size) {
+    header[0] = fragment_id;
+    header[1] = total_fragments;
+    header[2] = threshold;
+    header[3] = (fragment_size >> 8) & 0xFF;
+    header[4] = fragment_size & 0xFF;
+}
+
+/*
+ * Hash the header fields and the payload of a fragment in place
+ */
+static void fragment_digest(const struct rke_fragment_t *fragment, unsigned char *digest) {
+    unsigned char header[RKE_CHECKSUM_HEADER_SIZE];
+    struct rke_sha256_ctx_t ctx;
+
+    fragment_header(header, fragment->fragment_id, fragment->total_fragments, fragment->threshold,
+                    fragment->fragment_size);
+    rke_sha256_init(&ctx);
+    rke_sha256_update(&ctx, header, RKE_CHECKSUM_HEADER_SIZE);
+    rke_sha256_update(&ctx, fragment->data, fragment->fragment_size);
+    rke_sha256_final(&ctx, digest);
+}
+
 /*
  * Calculate SHA-256 checksum for a fragment
  */
 int rke_calculate_checksum(struct rke_fragment_t *fragment) {
     // Validate input parameters
-    if (fragment == NULL) {
+    if (fragment == NULL || fragment->fragment_size > RKE_FRAGMENT_DATA_SIZE) {
         error("Invalid parameters for checksum calculation");
         return RKE_ERROR_INVALID_PARAM;
     }
     
-    // Create data to hash: fragment metadata + data
-    unsigned char hash_input[1024];
-    size_t hash_input_len = 0;
+    fragment_digest(fragment, fragment->checksum);
     
-    // Add fragment metadata to hash input
-    hash_input[hash_input_len++] = fragment->fragment_id;
-    hash_input[hash_input_len++] = fragment->total_fragments;
-    hash_input[hash_input_len++] = fragment->threshold;
-    hash_input[hash_input_len++] = (fragment->fragment_size >> 8) & 0xFF;
-    hash_input[hash_input_len++] = fragment->fragment_size & 0xFF;
+    debug("Calculated checksum for fragment %d", fragment->fragment_id);
+    return RKE_SUCCESS;
+}
+
+/*
+ * Calculate checksums for an array of fragments with the multi-buffer hasher
+ * Consecutive fragments of equal size are hashed together
+ */
+int rke_calculate_checksums(struct rke_fragment_t *fragments, int count) {
+    struct rke_sha256_lane_t lanes[RKE_MAX_FRAGMENTS];
+    unsigned char headers[RKE_MAX_FRAGMENTS][RKE_CHECKSUM_HEADER_SIZE];
+    int start = 0;
+
+    if (fragments == NULL || count < 0 || count > RKE_MAX_FRAGMENTS) {
+        error("Invalid parameters for checksum calculation");
+        return RKE_ERROR_INVALID_PARAM;
+    }
     
-    // Add fragment data
-    memcpy(&hash_input[hash_input_len], fragment->data, fragment->fragment_size);
-    hash_input_len += fragment->fragment_size;
+    for (int i = 0; i < count; i++) {
+        if (fragments[i].fragment_size > RKE_FRAGMENT_DATA_SIZE) {
+            error("Invalid fragment size %d", fragments[i].fragment_size);
+            return RKE_ERROR_INVALID_PARAM;
+        }
+        
+        fragment_header(headers[i], fragments[i].fragment_id, fragments[i].total_fragments,
+                        fragments[i].threshold, fragments[i].fragment_size);
+        lanes[i].prefix = headers[i];
+        lanes[i].body = fragments[i].data;
+        lanes[i].digest = fragments[i].checksum;
+        
+        if (i + 1 == count || fragments[i + 1].fragment_size != fragments[start].fragment_size) {
+            rke_sha256_multi(&lanes[start], i + 1 - start, RKE_CHECKSUM_HEADER_SIZE, fragments[start].fragment_size);
+            start = i + 1;
+        }
+    }
     
-    // Calculate SHA-256 checksum
-    simple_sha256(hash_input, hash_input_len, fragment->checksum);
+    debug("Calculated checksums for %d fragments", count);
+    return RKE_SUCCESS;
+}
+
+/*
+ * Calculate the checksums of every fragment in a batch
+ * Produces the same checksum as rke_calculate_checksum on the equivalent fragment
+ */
+int rke_calculate_batch_checksums(struct rke_fragment_batch_t *batch) {
+    struct rke_sha256_lane_t lanes[RKE_MAX_FRAGMENTS];
+    unsigned char headers[RKE_MAX_FRAGMENTS][RKE_CHECKSUM_HEADER_SIZE];
+
+    if (batch == NULL || batch->data == NULL || batch->fragment_size > RKE_FRAGMENT_DATA_SIZE) {
+        error("Invalid parameters for batch checksum calculation");
+        return RKE_ERROR_INVALID_PARAM;
+    }
     
-    debug("Calculated checksum for fragment %d", fragment->fragment_id);
+    // Headers only depend on the fragment id, so they are shared by every key
+    for (int f = 0; f < batch->total_fragments; f++) {
+        fragment_header(headers[f], (uint8_t)(f + 1), batch->total_fragments, batch->threshold, batch->fragment_size);
+    }
+    
+    for (int k = 0; k < batch->key_count; k++) {
+        for (int f = 0; f < batch->total_fragments; f++) {
+            size_t index = (size_t)k * batch->total_fragments + f;
+            lanes[f].prefix = headers[f];
+            lanes[f].body = RKE_BATCH_DATA(batch, index);
+            lanes[f].digest = RKE_BATCH_CHECKSUM(batch, index);
+        }
+        rke_sha256_multi(lanes, batch->total_fragments, RKE_CHECKSUM_HEADER_SIZE, batch->fragment_size);
+    }
+    
+    debug("Calculated checksums for %d batched fragments", batch->key_count * batch->total_fragments);
     return RKE_SUCCESS;
 }
 
 /*
  * Verify the integrity of a fragment using its checksum
+ * The fragment is hashed where it lies and compared in constant time
  */
 int rke_verify_checksum(const struct rke_fragment_t *fragment) {
+    unsigned char expected[RKE_CHECKSUM_SIZE];
+
     // Validate input parameters
     if (fragment == NULL) {
         error("Invalid parameters for checksum verification");
         return RKE_ERROR_INVALID_PARAM;
     }
     
-    // Create a copy of the fragment to calculate expected checksum
-    struct rke_fragment_t temp_fragment;
-    memcpy(&temp_fragment, fragment, sizeof(struct rke_fragment_t));
-    
-    // Clear checksum field and recalculate
-    memset(temp_fragment.checksum, 0, RKE_CHECKSUM_SIZE);
-    if (rke_calculate_checksum(&temp_fragment) != RKE_SUCCESS) {
-        error("Failed to calculate expected checksum");
-        return RKE_ERROR_CRYPTO_FAIL;
+    if (fragment->fragment_size > RKE_FRAGMENT_DATA_SIZE) {
+        error("Invalid size %d for fragment %d", fragment->fragment_size, fragment->fragment_id);
+        return RKE_ERROR_FRAGMENT_CORRUPT;
     }
     
+    fragment_digest(fragment, expected);
+    
     // Compare checksums
-    if (memcmp(fragment->checksum, temp_fragment.checksum, RKE_CHECKSUM_SIZE) != 0) {
+    if (secure_compare(fragment->checksum, expected, RKE_CHECKSUM_SIZE) != 0) {
         error("Checksum mismatch for fragment %d", fragment->fragment_id);
-        debug("Expected: %02x%02x%02x%02x...", temp_fragment.checksum[0], temp_fragment.checksum[1], 
-              temp_fragment.checksum[2], temp_fragment.checksum[3]);
-        debug("Actual:   %02x%02x%02x%02x...", fragment->checksum[0], fragment->checksum[1], 
-              fragment->checksum[2], fragment->checksum[3]);
         return RKE_ERROR_FRAGMENT_CORRUPT;
     }
     
@@ -269,6 +267,56 @@ int rke_verify_checksum(const struct rke_fragment_t *fragment) {
     return RKE_SUCCESS;
 }
 
+/*
+ * Verify an array of fragments with the multi-buffer hasher
+ * On mismatch the position of the first corrupt fragment is stored in bad_index (if not NULL)
+ */
+int rke_verify_checksums(const struct rke_fragment_t *fragments, int count, int *bad_index) {
+    struct rke_sha256_lane_t lanes[RKE_MAX_FRAGMENTS];
+    unsigned char headers[RKE_MAX_FRAGMENTS][RKE_CHECKSUM_HEADER_SIZE];
+    unsigned char expected[RKE_MAX_FRAGMENTS][RKE_CHECKSUM_SIZE];
+    int start = 0;
+
+    if (fragments == NULL || count < 0 || count > RKE_MAX_FRAGMENTS) {
+        error("Invalid parameters for checksum verification");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (fragments[i].fragment_size > RKE_FRAGMENT_DATA_SIZE) {
+            error("Invalid size %d for fragment %d", fragments[i].fragment_size, fragments[i].fragment_id);
+            if (bad_index != NULL) {
+                *bad_index = i;
+            }
+            return RKE_ERROR_FRAGMENT_CORRUPT;
+        }
+        
+        fragment_header(headers[i], fragments[i].fragment_id, fragments[i].total_fragments,
+                        fragments[i].threshold, fragments[i].fragment_size);
+        lanes[i].prefix = headers[i];
+        lanes[i].body = fragments[i].data;
+        lanes[i].digest = expected[i];
+        
+        if (i + 1 == count || fragments[i + 1].fragment_size != fragments[start].fragment_size) {
+            rke_sha256_multi(&lanes[start], i + 1 - start, RKE_CHECKSUM_HEADER_SIZE, fragments[start].fragment_size);
+            start = i + 1;
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (secure_compare(fragments[i].checksum, expected[i], RKE_CHECKSUM_SIZE) != 0) {
+            error("Checksum mismatch for fragment %d", fragments[i].fragment_id);
+            if (bad_index != NULL) {
+                *bad_index = i;
+            }
+            return RKE_ERROR_FRAGMENT_CORRUPT;
+        }
+    }
+    
+    debug("Checksum verification passed for %d fragments", count);
+    return RKE_SUCCESS;
+}
+
 /*
  * Generate a cryptographically secure nonce
  */
@@ -0,0 +1,411 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_gf256.c
+#   Last Modified : 2024-07-20
+#   Describe      : GF(256) arithmetic and SIMD region kernels for Shamir secret sharing
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RKE_GF256_X86 1
+#include <immintrin.h>
+#endif
+
+#include "rke_gf256.h"
+
+// Region kernel: evaluation of a whole polynomial and multiply-accumulate
+struct gf256_kernel_t {
+    const char *name;
+    void (*eval)(unsigned char *out, const unsigned char *secret, const unsigned char *coefficients,
+                 int degree, const uint8_t *lo, const uint8_t *hi, size_t len);
+    void (*mul_add)(unsigned char *dst, const unsigned char *src, const uint8_t *lo, const uint8_t *hi, size_t len);
+};
+
+// exp table for generator 0x03, doubled so that log[a] + log[b] never needs a modulo
+static const uint8_t gf_exp[512] = {
+    0x01, 0x03, 0x05, 0x0f, 0x11, 0x33, 0x55, 0xff, 0x1a, 0x2e, 0x72, 0x96, 0xa1, 0xf8, 0x13, 0x35,
+    0x5f, 0xe1, 0x38, 0x48, 0xd8, 0x73, 0x95, 0xa4, 0xf7, 0x02, 0x06, 0x0a, 0x1e, 0x22, 0x66, 0xaa,
+    0xe5, 0x34, 0x5c, 0xe4, 0x37, 0x59, 0xeb, 0x26, 0x6a, 0xbe, 0xd9, 0x70, 0x90, 0xab, 0xe6, 0x31,
+    0x53, 0xf5, 0x04, 0x0c, 0x14, 0x3c, 0x44, 0xcc, 0x4f, 0xd1, 0x68, 0xb8, 0xd3, 0x6e, 0xb2, 0xcd,
+    0x4c, 0xd4, 0x67, 0xa9, 0xe0, 0x3b, 0x4d, 0xd7, 0x62, 0xa6, 0xf1, 0x08, 0x18, 0x28, 0x78, 0x88,
+    0x83, 0x9e, 0xb9, 0xd0, 0x6b, 0xbd, 0xdc, 0x7f, 0x81, 0x98, 0xb3, 0xce, 0x49, 0xdb, 0x76, 0x9a,
+    0xb5, 0xc4, 0x57, 0xf9, 0x10, 0x30, 0x50, 0xf0, 0x0b, 0x1d, 0x27, 0x69, 0xbb, 0xd6, 0x61, 0xa3,
+    0xfe, 0x19, 0x2b, 0x7d, 0x87, 0x92, 0xad, 0xec, 0x2f, 0x71, 0x93, 0xae, 0xe9, 0x20, 0x60, 0xa0,
+    0xfb, 0x16, 0x3a, 0x4e, 0xd2, 0x6d, 0xb7, 0xc2, 0x5d, 0xe7, 0x32, 0x56, 0xfa, 0x15, 0x3f, 0x41,
+    0xc3, 0x5e, 0xe2, 0x3d, 0x47, 0xc9, 0x40, 0xc0, 0x5b, 0xed, 0x2c, 0x74, 0x9c, 0xbf, 0xda, 0x75,
+    0x9f, 0xba, 0xd5, 0x64, 0xac, 0xef, 0x2a, 0x7e, 0x82, 0x9d, 0xbc, 0xdf, 0x7a, 0x8e, 0x89, 0x80,
+    0x9b, 0xb6, 0xc1, 0x58, 0xe8, 0x23, 0x65, 0xaf, 0xea, 0x25, 0x6f, 0xb1, 0xc8, 0x43, 0xc5, 0x54,
+    0xfc, 0x1f, 0x21, 0x63, 0xa5, 0xf4, 0x07, 0x09, 0x1b, 0x2d, 0x77, 0x99, 0xb0, 0xcb, 0x46, 0xca,
+    0x45, 0xcf, 0x4a, 0xde, 0x79, 0x8b, 0x86, 0x91, 0xa8, 0xe3, 0x3e, 0x42, 0xc6, 0x51, 0xf3, 0x0e,
+    0x12, 0x36, 0x5a, 0xee, 0x29, 0x7b, 0x8d, 0x8c, 0x8f, 0x8a, 0x85, 0x94, 0xa7, 0xf2, 0x0d, 0x17,
+    0x39, 0x4b, 0xdd, 0x7c, 0x84, 0x97, 0xa2, 0xfd, 0x1c, 0x24, 0x6c, 0xb4, 0xc7, 0x52, 0xf6, 0x01,
+    0x03, 0x05, 0x0f, 0x11, 0x33, 0x55, 0xff, 0x1a, 0x2e, 0x72, 0x96, 0xa1, 0xf8, 0x13, 0x35, 0x5f,
+    0xe1, 0x38, 0x48, 0xd8, 0x73, 0x95, 0xa4, 0xf7, 0x02, 0x06, 0x0a, 0x1e, 0x22, 0x66, 0xaa, 0xe5,
+    0x34, 0x5c, 0xe4, 0x37, 0x59, 0xeb, 0x26, 0x6a, 0xbe, 0xd9, 0x70, 0x90, 0xab, 0xe6, 0x31, 0x53,
+    0xf5, 0x04, 0x0c, 0x14, 0x3c, 0x44, 0xcc, 0x4f, 0xd1, 0x68, 0xb8, 0xd3, 0x6e, 0xb2, 0xcd, 0x4c,
+    0xd4, 0x67, 0xa9, 0xe0, 0x3b, 0x4d, 0xd7, 0x62, 0xa6, 0xf1, 0x08, 0x18, 0x28, 0x78, 0x88, 0x83,
+    0x9e, 0xb9, 0xd0, 0x6b, 0xbd, 0xdc, 0x7f, 0x81, 0x98, 0xb3, 0xce, 0x49, 0xdb, 0x76, 0x9a, 0xb5,
+    0xc4, 0x57, 0xf9, 0x10, 0x30, 0x50, 0xf0, 0x0b, 0x1d, 0x27, 0x69, 0xbb, 0xd6, 0x61, 0xa3, 0xfe,
+    0x19, 0x2b, 0x7d, 0x87, 0x92, 0xad, 0xec, 0x2f, 0x71, 0x93, 0xae, 0xe9, 0x20, 0x60, 0xa0, 0xfb,
+    0x16, 0x3a, 0x4e, 0xd2, 0x6d, 0xb7, 0xc2, 0x5d, 0xe7, 0x32, 0x56, 0xfa, 0x15, 0x3f, 0x41, 0xc3,
+    0x5e, 0xe2, 0x3d, 0x47, 0xc9, 0x40, 0xc0, 0x5b, 0xed, 0x2c, 0x74, 0x9c, 0xbf, 0xda, 0x75, 0x9f,
+    0xba, 0xd5, 0x64, 0xac, 0xef, 0x2a, 0x7e, 0x82, 0x9d, 0xbc, 0xdf, 0x7a, 0x8e, 0x89, 0x80, 0x9b,
+    0xb6, 0xc1, 0x58, 0xe8, 0x23, 0x65, 0xaf, 0xea, 0x25, 0x6f, 0xb1, 0xc8, 0x43, 0xc5, 0x54, 0xfc,
+    0x1f, 0x21, 0x63, 0xa5, 0xf4, 0x07, 0x09, 0x1b, 0x2d, 0x77, 0x99, 0xb0, 0xcb, 0x46, 0xca, 0x45,
+    0xcf, 0x4a, 0xde, 0x79, 0x8b, 0x86, 0x91, 0xa8, 0xe3, 0x3e, 0x42, 0xc6, 0x51, 0xf3, 0x0e, 0x12,
+    0x36, 0x5a, 0xee, 0x29, 0x7b, 0x8d, 0x8c, 0x8f, 0x8a, 0x85, 0x94, 0xa7, 0xf2, 0x0d, 0x17, 0x39,
+    0x4b, 0xdd, 0x7c, 0x84, 0x97, 0xa2, 0xfd, 0x1c, 0x24, 0x6c, 0xb4, 0xc7, 0x52, 0xf6, 0x01, 0x03
+};
+
+static const uint8_t gf_log[256] = {
+    0x00, 0x00, 0x19, 0x01, 0x32, 0x02, 0x1a, 0xc6, 0x4b, 0xc7, 0x1b, 0x68, 0x33, 0xee, 0xdf, 0x03,
+    0x64, 0x04, 0xe0, 0x0e, 0x34, 0x8d, 0x81, 0xef, 0x4c, 0x71, 0x08, 0xc8, 0xf8, 0x69, 0x1c, 0xc1,
+    0x7d, 0xc2, 0x1d, 0xb5, 0xf9, 0xb9, 0x27, 0x6a, 0x4d, 0xe4, 0xa6, 0x72, 0x9a, 0xc9, 0x09, 0x78,
+    0x65, 0x2f, 0x8a, 0x05, 0x21, 0x0f, 0xe1, 0x24, 0x12, 0xf0, 0x82, 0x45, 0x35, 0x93, 0xda, 0x8e,
+    0x96, 0x8f, 0xdb, 0xbd, 0x36, 0xd0, 0xce, 0x94, 0x13, 0x5c, 0xd2, 0xf1, 0x40, 0x46, 0x83, 0x38,
+    0x66, 0xdd, 0xfd, 0x30, 0xbf, 0x06, 0x8b, 0x62, 0xb3, 0x25, 0xe2, 0x98, 0x22, 0x88, 0x91, 0x10,
+    0x7e, 0x6e, 0x48, 0xc3, 0xa3, 0xb6, 0x1e, 0x42, 0x3a, 0x6b, 0x28, 0x54, 0xfa, 0x85, 0x3d, 0xba,
+    0x2b, 0x79, 0x0a, 0x15, 0x9b, 0x9f, 0x5e, 0xca, 0x4e, 0xd4, 0xac, 0xe5, 0xf3, 0x73, 0xa7, 0x57,
+    0xaf, 0x58, 0xa8, 0x50, 0xf4, 0xea, 0xd6, 0x74, 0x4f, 0xae, 0xe9, 0xd5, 0xe7, 0xe6, 0xad, 0xe8,
+    0x2c, 0xd7, 0x75, 0x7a, 0xeb, 0x16, 0x0b, 0xf5, 0x59, 0xcb, 0x5f, 0xb0, 0x9c, 0xa9, 0x51, 0xa0,
+    0x7f, 0x0c, 0xf6, 0x6f, 0x17, 0xc4, 0x49, 0xec, 0xd8, 0x43, 0x1f, 0x2d, 0xa4, 0x76, 0x7b, 0xb7,
+    0xcc, 0xbb, 0x3e, 0x5a, 0xfb, 0x60, 0xb1, 0x86, 0x3b, 0x52, 0xa1, 0x6c, 0xaa, 0x55, 0x29, 0x9d,
+    0x97, 0xb2, 0x87, 0x90, 0x61, 0xbe, 0xdc, 0xfc, 0xbc, 0x95, 0xcf, 0xcd, 0x37, 0x3f, 0x5b, 0xd1,
+    0x53, 0x39, 0x84, 0x3c, 0x41, 0xa2, 0x6d, 0x47, 0x14, 0x2a, 0x9e, 0x5d, 0x56, 0xf2, 0xd3, 0xab,
+    0x44, 0x11, 0x92, 0xd9, 0x23, 0x20, 0x2e, 0x89, 0xb4, 0x7c, 0xb8, 0x26, 0x77, 0x99, 0xe3, 0xa5,
+    0x67, 0x4a, 0xed, 0xde, 0xc5, 0x31, 0xfe, 0x18, 0x0d, 0x63, 0x8c, 0x80, 0xc0, 0xf7, 0x70, 0x07
+};
+
+static const struct gf256_kernel_t *active_kernel = NULL;
+
+/*
+ * Multiply two field elements using the log/exp tables
+ * Only used on public values (x coordinates, Lagrange coefficients)
+ */
+uint8_t rke_gf256_mul(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+/*
+ * Multiplicative inverse of a field element (inverse of 0 is defined as 0)
+ */
+uint8_t rke_gf256_inv(uint8_t a) {
+    if (a == 0) {
+        return 0;
+    }
+
+    return gf_exp[255 - gf_log[a]];
+}
+
+/*
+ * Compute Lagrange basis coefficients L_i(0) = prod_{j!=i} x_j / (x_j ^ x_i)
+ * Works in the log domain so the O(count^2) part is integer additions only
+ */
+int rke_gf256_lagrange_coefficients(const uint8_t *x_coords, int count, uint8_t *coefficients) {
+    int log_sum = 0;
+
+    if (x_coords == NULL || coefficients == NULL || count <= 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (x_coords[i] == 0) {
+            return -1;
+        }
+        log_sum += gf_log[x_coords[i]];
+    }
+
+    for (int i = 0; i < count; i++) {
+        int log_numerator = log_sum - gf_log[x_coords[i]];
+        int log_denominator = 0;
+
+        for (int j = 0; j < count; j++) {
+            if (i == j) {
+                continue;
+            }
+
+            // Reason: equal x coordinates make the system singular
+            if (x_coords[i] == x_coords[j]) {
+                return -1;
+            }
+            log_denominator += gf_log[x_coords[i] ^ x_coords[j]];
+        }
+
+        coefficients[i] = gf_exp[(log_numerator % 255 - log_denominator % 255 + 255) % 255];
+    }
+
+    return 0;
+}
+
+/*
+ * Build the two 16-entry nibble tables for multiplication by a constant:
+ * c * v == lo[v & 0x0f] ^ hi[v >> 4]
+ * Reason: tiny tables fit a single SIMD register (PSHUFB) and a single cache line,
+ * so multiplying secret bytes never produces data-dependent memory accesses
+ */
+static void build_nibble_tables(uint8_t c, uint8_t *lo, uint8_t *hi) {
+    uint8_t powers[8];
+
+    // powers[k] = c * 2^k
+    powers[0] = c;
+    for (int k = 1; k < 8; k++) {
+        uint8_t prev = powers[k - 1];
+        powers[k] = (uint8_t)((prev << 1) ^ ((prev & 0x80) ? (RKE_GF256_POLY & 0xff) : 0));
+    }
+
+    lo[0] = 0;
+    hi[0] = 0;
+    for (int bit = 0; bit < 4; bit++) {
+        int span = 1 << bit;
+        for (int i = 0; i < span; i++) {
+            lo[span + i] = lo[i] ^ powers[bit];
+            hi[span + i] = hi[i] ^ powers[bit + 4];
+        }
+    }
+}
+
+static inline uint8_t mul_nibble(uint8_t v, const uint8_t *lo, const uint8_t *hi) {
+    return lo[v & 0x0f] ^ hi[v >> 4];
+}
+
+/*
+ * Portable Horner evaluation for bytes [from, len)
+ */
+static void eval_range_scalar(unsigned char *out, const unsigned char *secret, const unsigned char *coefficients,
+                              int degree, const uint8_t *lo, const uint8_t *hi, size_t len, size_t from) {
+    for (size_t p = from; p < len; p++) {
+        uint8_t acc = coefficients[(size_t)(degree - 1) * len + p];
+
+        for (int j = degree - 2; j >= 0; j--) {
+            acc = mul_nibble(acc, lo, hi) ^ coefficients[(size_t)j * len + p];
+        }
+        out[p] = mul_nibble(acc, lo, hi) ^ secret[p];
+    }
+}
+
+static void mul_add_range_scalar(unsigned char *dst, const unsigned char *src, const uint8_t *lo, const uint8_t *hi,
+                                 size_t len, size_t from) {
+    for (size_t p = from; p < len; p++) {
+        dst[p] ^= mul_nibble(src[p], lo, hi);
+    }
+}
+
+static void eval_scalar(unsigned char *out, const unsigned char *secret, const unsigned char *coefficients,
+                        int degree, const uint8_t *lo, const uint8_t *hi, size_t len) {
+    eval_range_scalar(out, secret, coefficients, degree, lo, hi, len, 0);
+}
+
+static void mul_add_scalar(unsigned char *dst, const unsigned char *src, const uint8_t *lo, const uint8_t *hi, size_t len) {
+    mul_add_range_scalar(dst, src, lo, hi, len, 0);
+}
+
+#ifdef RKE_GF256_X86
+/*
+ * SSSE3 kernels: 16 bytes per step using PSHUFB nibble lookups
+ */
+__attribute__((target("ssse3")))
+static inline __m128i mul_ssse3(__m128i v, __m128i tlo, __m128i thi, __m128i mask) {
+    __m128i l = _mm_and_si128(v, mask);
+    __m128i h = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    return _mm_xor_si128(_mm_shuffle_epi8(tlo, l), _mm_shuffle_epi8(thi, h));
+}
+
+__attribute__((target("ssse3")))
+static void eval_ssse3(unsigned char *out, const unsigned char *secret, const unsigned char *coefficients,
+                       int degree, const uint8_t *lo, const uint8_t *hi, size_t len) {
+    __m128i tlo = _mm_loadu_si128((const __m128i *)lo);
+    __m128i thi = _mm_loadu_si128((const __m128i *)hi);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    size_t p = 0;
+
+    for (; p + 16 <= len; p += 16) {
+        __m128i acc = _mm_loadu_si128((const __m128i *)(coefficients + (size_t)(degree - 1) * len + p));
+
+        for (int j = degree - 2; j >= 0; j--) {
+            __m128i c = _mm_loadu_si128((const __m128i *)(coefficients + (size_t)j * len + p));
+            acc = _mm_xor_si128(mul_ssse3(acc, tlo, thi, mask), c);
+        }
+        acc = _mm_xor_si128(mul_ssse3(acc, tlo, thi, mask), _mm_loadu_si128((const __m128i *)(secret + p)));
+        _mm_storeu_si128((__m128i *)(out + p), acc);
+    }
+
+    eval_range_scalar(out, secret, coefficients, degree, lo, hi, len, p);
+}
+
+__attribute__((target("ssse3")))
+static void mul_add_ssse3(unsigned char *dst, const unsigned char *src, const uint8_t *lo, const uint8_t *hi, size_t len) {
+    __m128i tlo = _mm_loadu_si128((const __m128i *)lo);
+    __m128i thi = _mm_loadu_si128((const __m128i *)hi);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    size_t p = 0;
+
+    for (; p + 16 <= len; p += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + p));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + p));
+        _mm_storeu_si128((__m128i *)(dst + p), _mm_xor_si128(d, mul_ssse3(s, tlo, thi, mask)));
+    }
+
+    mul_add_range_scalar(dst, src, lo, hi, len, p);
+}
+
+/*
+ * AVX2 kernels: 32 bytes per step, same nibble tables broadcast to both lanes
+ */
+__attribute__((target("avx2")))
+static inline __m256i mul_avx2(__m256i v, __m256i tlo, __m256i thi, __m256i mask) {
+    __m256i l = _mm256_and_si256(v, mask);
+    __m256i h = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+    return _mm256_xor_si256(_mm256_shuffle_epi8(tlo, l), _mm256_shuffle_epi8(thi, h));
+}
+
+__attribute__((target("avx2")))
+static void eval_avx2(unsigned char *out, const unsigned char *secret, const unsigned char *coefficients,
+                      int degree, const uint8_t *lo, const uint8_t *hi, size_t len) {
+    __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo));
+    __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t p = 0;
+
+    for (; p + 32 <= len; p += 32) {
+        __m256i acc = _mm256_loadu_si256((const __m256i *)(coefficients + (size_t)(degree - 1) * len + p));
+
+        for (int j = degree - 2; j >= 0; j--) {
+            __m256i c = _mm256_loadu_si256((const __m256i *)(coefficients + (size_t)j * len + p));
+            acc = _mm256_xor_si256(mul_avx2(acc, tlo, thi, mask), c);
+        }
+        acc = _mm256_xor_si256(mul_avx2(acc, tlo, thi, mask), _mm256_loadu_si256((const __m256i *)(secret + p)));
+        _mm256_storeu_si256((__m256i *)(out + p), acc);
+    }
+
+    eval_range_scalar(out, secret, coefficients, degree, lo, hi, len, p);
+}
+
+__attribute__((target("avx2")))
+static void mul_add_avx2(unsigned char *dst, const unsigned char *src, const uint8_t *lo, const uint8_t *hi, size_t len) {
+    __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo));
+    __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t p = 0;
+
+    for (; p + 32 <= len; p += 32) {
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + p));
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + p));
+        _mm256_storeu_si256((__m256i *)(dst + p), _mm256_xor_si256(d, mul_avx2(s, tlo, thi, mask)));
+    }
+
+    mul_add_range_scalar(dst, src, lo, hi, len, p);
+}
+#endif
+
+static const struct gf256_kernel_t kernels[] = {
+#ifdef RKE_GF256_X86
+    { "avx2", eval_avx2, mul_add_avx2 },
+    { "ssse3", eval_ssse3, mul_add_ssse3 },
+#endif
+    { "scalar", eval_scalar, mul_add_scalar },
+};
+
+#define GF256_KERNEL_COUNT ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+/*
+ * Check whether the CPU can run the named kernel
+ */
+static int kernel_supported(const struct gf256_kernel_t *kernel) {
+#ifdef RKE_GF256_X86
+    __builtin_cpu_init();
+    if (strcmp(kernel->name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(kernel->name, "ssse3") == 0) {
+        return __builtin_cpu_supports("ssse3");
+    }
+#endif
+    return strcmp(kernel->name, "scalar") == 0;
+}
+
+/*
+ * Pick the fastest kernel on first use
+ * Reason: the race on first use is benign - every thread stores the same pointer
+ */
+static const struct gf256_kernel_t *get_kernel(void) {
+    if (active_kernel == NULL) {
+        for (int i = 0; i < GF256_KERNEL_COUNT; i++) {
+            if (kernel_supported(&kernels[i])) {
+                active_kernel = &kernels[i];
+                break;
+            }
+        }
+    }
+
+    return active_kernel;
+}
+
+/*
+ * Force a specific kernel (used by tests and benchmarks), NULL restores auto-selection
+ */
+int rke_gf256_force_kernel(const char *name) {
+    if (name == NULL) {
+        active_kernel = NULL;
+        return 0;
+    }
+
+    for (int i = 0; i < GF256_KERNEL_COUNT; i++) {
+        if (strcmp(kernels[i].name, name) == 0 && kernel_supported(&kernels[i])) {
+            active_kernel = &kernels[i];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+const char *rke_gf256_kernel_name(void) {
+    return get_kernel()->name;
+}
+
+/*
+ * Evaluate f(x) = secret + c_1*x + ... + c_degree*x^degree for every byte of the region
+ * coefficients holds degree rows of len bytes, row j-1 is c_j
+ */
+void rke_gf256_eval_region(unsigned char *out, const unsigned char *secret, const unsigned char *coefficients,
+                           int degree, uint8_t x, size_t len) {
+    uint8_t lo[16], hi[16];
+
+    if (degree <= 0) {
+        memmove(out, secret, len);
+        return;
+    }
+
+    build_nibble_tables(x, lo, hi);
+    get_kernel()->eval(out, secret, coefficients, degree, lo, hi, len);
+}
+
+/*
+ * out = sum coefficients[i] * shares[i] over the region
+ */
+void rke_gf256_combine_region(unsigned char *out, const unsigned char *const *shares,
+                              const uint8_t *coefficients, int count, size_t len) {
+    const struct gf256_kernel_t *kernel = get_kernel();
+    uint8_t lo[16], hi[16];
+
+    memset(out, 0, len);
+    for (int i = 0; i < count; i++) {
+        if (coefficients[i] == 0) {
+            continue;
+        }
+
+        build_nibble_tables(coefficients[i], lo, hi);
+        kernel->mul_add(out, shares[i], lo, hi, len);
+    }
+}
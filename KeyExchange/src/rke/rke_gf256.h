@@ -0,0 +1,37 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_gf256.h
+#   Last Modified : 2024-07-20
+#   Describe      : GF(256) arithmetic for Shamir secret sharing
+#
+# ====================================================*/
+
+#ifndef RKE_GF256_H
+#define RKE_GF256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Field polynomial x^8 + x^4 + x^3 + x + 1 (same as AES), generator 0x03
+#define RKE_GF256_POLY 0x11b
+
+// Scalar field operations (public values only - they use log/exp tables)
+uint8_t rke_gf256_mul(uint8_t a, uint8_t b);
+uint8_t rke_gf256_inv(uint8_t a);
+
+// Lagrange basis coefficients L_i(0) for the given x coordinates
+int rke_gf256_lagrange_coefficients(const uint8_t *x_coords, int count, uint8_t *coefficients);
+
+// Region kernels (constant-time with respect to the region contents)
+void rke_gf256_eval_region(unsigned char *out, const unsigned char *secret, const unsigned char *coefficients,
+                           int degree, uint8_t x, size_t len);
+void rke_gf256_combine_region(unsigned char *out, const unsigned char *const *shares,
+                              const uint8_t *coefficients, int count, size_t len);
+
+// Kernel selection (avx2, ssse3, scalar)
+int rke_gf256_force_kernel(const char *name);
+const char *rke_gf256_kernel_name(void);
+
+#endif // RKE_GF256_H
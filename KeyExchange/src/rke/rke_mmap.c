@@ -0,0 +1,426 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_mmap.c
+#   Last Modified : 2024-07-20
+#   Describe      : Bounded cache of read-only container mappings for zero-copy fragment serving
+#
+# ====================================================*/
+
+// mmap/fstat are POSIX, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/log.h"
+#include "rke.h"
+#include "rke_cache.h"
+#include "rke_container.h"
+#include "rke_mmap.h"
+
+/*
+ * Each shard indexes up to its capacity of mappings in a chained hash and an LRU list.
+ * A mapping is reference counted: the index holds one reference and every response that
+ * points into it holds another, so eviction and invalidation only unlink it and the last
+ * release unmaps it. Containers are replaced by rename and never truncated in place,
+ * so a mapping stays readable after its key is rewritten - it is merely stale.
+ */
+#define MMAP_BUCKETS 64
+
+struct rke_mmap_ref_t {
+    unsigned char key_id[RKE_KEY_ID_SIZE];
+    const unsigned char *base;
+    size_t length;
+    int refs;
+    struct rke_mmap_ref_t *chain;       // Next in the hash bucket, or in a list of mappings to unmap
+    struct rke_mmap_ref_t *prev, *next; // LRU neighbours, head is most recent
+    struct mmap_shard_t *shard;
+};
+
+struct mmap_shard_t {
+    pthread_mutex_t lock;
+    struct rke_mmap_ref_t *buckets[MMAP_BUCKETS];
+    struct rke_mmap_ref_t *head, *tail;
+    size_t count;
+    size_t capacity;
+    uint64_t generation;        // Bumped by every invalidation
+    uint64_t hits, misses, evictions;
+};
+
+static struct mmap_shard_t shards[RKE_MMAP_SHARDS];
+static size_t total_capacity = RKE_MMAP_DEFAULT_CAPACITY;
+static pthread_once_t mmap_once = PTHREAD_ONCE_INIT;
+
+static size_t shard_capacity(int index) {
+    return total_capacity / RKE_MMAP_SHARDS + ((size_t)index < total_capacity % RKE_MMAP_SHARDS);
+}
+
+static void init_mmap_cache(void) {
+    for (int i = 0; i < RKE_MMAP_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].capacity = shard_capacity(i);
+    }
+}
+
+static struct rke_mmap_ref_t **bucket_of(struct mmap_shard_t *shard, uint64_t hash) {
+    return &shard->buckets[(hash >> 32) % MMAP_BUCKETS];
+}
+
+static void unmap_list(struct rke_mmap_ref_t *list) {
+    while (list != NULL) {
+        struct rke_mmap_ref_t *next = list->chain;
+
+        munmap((void *)list->base, list->length);
+        free(list);
+        list = next;
+    }
+}
+
+static struct rke_mmap_ref_t *find_mapping(struct mmap_shard_t *shard, uint64_t hash, const unsigned char *key_id) {
+    struct rke_mmap_ref_t *ref;
+
+    for (ref = *bucket_of(shard, hash); ref != NULL; ref = ref->chain) {
+        if (memcmp(ref->key_id, key_id, RKE_KEY_ID_SIZE) == 0) {
+            return ref;
+        }
+    }
+
+    return NULL;
+}
+
+static void lru_unlink(struct mmap_shard_t *shard, struct rke_mmap_ref_t *ref) {
+    if (ref->prev != NULL) {
+        ref->prev->next = ref->next;
+    } else {
+        shard->head = ref->next;
+    }
+    if (ref->next != NULL) {
+        ref->next->prev = ref->prev;
+    } else {
+        shard->tail = ref->prev;
+    }
+}
+
+static void lru_push_front(struct mmap_shard_t *shard, struct rke_mmap_ref_t *ref) {
+    ref->prev = NULL;
+    ref->next = shard->head;
+    if (shard->head != NULL) {
+        shard->head->prev = ref;
+    }
+    shard->head = ref;
+    if (shard->tail == NULL) {
+        shard->tail = ref;
+    }
+}
+
+/*
+ * Remove a mapping from the index and drop the index's reference
+ * A mapping nobody else holds is moved to *unmap for the caller to release after unlocking
+ */
+static void unindex_mapping(struct mmap_shard_t *shard, struct rke_mmap_ref_t *ref, struct rke_mmap_ref_t **unmap) {
+    struct rke_mmap_ref_t **link = bucket_of(shard, rke_container_hash(ref->key_id));
+
+    while (*link != ref) {
+        link = &(*link)->chain;
+    }
+    *link = ref->chain;
+    lru_unlink(shard, ref);
+    shard->count--;
+
+    if (--ref->refs == 0) {
+        ref->chain = *unmap;
+        *unmap = ref;
+    }
+}
+
+static void evict_to_capacity(struct mmap_shard_t *shard, struct rke_mmap_ref_t **unmap) {
+    while (shard->count > shard->capacity) {
+        unindex_mapping(shard, shard->tail, unmap);
+        shard->evictions++;
+    }
+}
+
+/*
+ * Map a key's container read-only and check its header
+ */
+static int map_container(const unsigned char *key_id, struct mmap_shard_t *shard, struct rke_mmap_ref_t **mapped) {
+    struct rke_mmap_ref_t *ref;
+    struct stat st;
+    void *base;
+    int fd, rv;
+
+    fd = rke_container_open(key_id, O_RDONLY);
+    if (fd < 0) {
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct rke_container_header_t)) {
+        error("Container too short to map");
+        close(fd);
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        error("Failed to map container: %s", strerror(errno));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    rv = rke_container_check_header((const struct rke_container_header_t *)base);
+    ref = (rv == RKE_SUCCESS) ? (struct rke_mmap_ref_t *) calloc(1, sizeof(struct rke_mmap_ref_t)) : NULL;
+    if (ref == NULL) {
+        munmap(base, (size_t)st.st_size);
+        return (rv == RKE_SUCCESS) ? RKE_ERROR_MEMORY_ALLOC : rv;
+    }
+
+    memcpy(ref->key_id, key_id, RKE_KEY_ID_SIZE);
+    ref->base = (const unsigned char *)base;
+    ref->length = (size_t)st.st_size;
+    ref->refs = 1;
+    ref->shard = shard;
+    *mapped = ref;
+    return RKE_SUCCESS;
+}
+
+/*
+ * Get a referenced mapping of a key's container, mapping it on a miss
+ */
+static int acquire_mapping(const unsigned char *key_id, struct rke_mmap_ref_t **acquired) {
+    uint64_t hash = rke_container_hash(key_id);
+    struct mmap_shard_t *shard = &shards[hash % RKE_MMAP_SHARDS];
+    struct rke_mmap_ref_t *ref, *mapped = NULL, *unmap = NULL;
+    uint64_t generation;
+    int rv;
+
+    pthread_mutex_lock(&shard->lock);
+    ref = find_mapping(shard, hash, key_id);
+    if (ref != NULL) {
+        ref->refs++;
+        if (shard->head != ref) {
+            lru_unlink(shard, ref);
+            lru_push_front(shard, ref);
+        }
+        shard->hits++;
+        pthread_mutex_unlock(&shard->lock);
+        *acquired = ref;
+        return RKE_SUCCESS;
+    }
+    shard->misses++;
+    generation = shard->generation;
+    pthread_mutex_unlock(&shard->lock);
+
+    // Mapping happens outside the lock; the generation tells whether the key was rewritten meanwhile
+    rv = map_container(key_id, shard, &mapped);
+    if (rv != RKE_SUCCESS) {
+        return rv;
+    }
+
+    pthread_mutex_lock(&shard->lock);
+    ref = find_mapping(shard, hash, key_id);
+    if (ref != NULL) {
+        ref->refs++;
+        mapped->chain = unmap;
+        unmap = mapped;
+    } else {
+        ref = mapped;
+        if (generation == shard->generation && shard->capacity > 0) {
+            ref->refs++;
+            ref->chain = *bucket_of(shard, hash);
+            *bucket_of(shard, hash) = ref;
+            lru_push_front(shard, ref);
+            shard->count++;
+            evict_to_capacity(shard, &unmap);
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    unmap_list(unmap);
+    *acquired = ref;
+    return RKE_SUCCESS;
+}
+
+/*
+ * Locate a stored fragment inside a mapping; RKE_ERROR_STORAGE_FAIL when it is not stored
+ */
+static int mapped_slot(const struct rke_mmap_ref_t *mapping, uint8_t fragment_id, const struct rke_fragment_t **slot) {
+    const struct rke_container_header_t *header = (const struct rke_container_header_t *)mapping->base;
+    uint32_t offset = header->offsets[fragment_id - 1];
+
+    if (!RKE_BITMAP_TEST(header->presence, fragment_id) || offset == 0) {
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    if ((size_t)offset + header->slot_size > mapping->length) {
+        error("Fragment %d lies past the end of its container", fragment_id);
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+
+    // Only the slot's bytes are mapped, which may be less than the whole structure
+    *slot = (const struct rke_fragment_t *)(mapping->base + offset);
+    if (rke_validate_fragment(*slot) != RKE_SUCCESS || (*slot)->fragment_id != fragment_id ||
+        RKE_FRAGMENT_WIRE_SIZE((*slot)->fragment_size) > header->slot_size) {
+        error("Mapped fragment %d failed validation", fragment_id);
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+
+    return RKE_SUCCESS;
+}
+
+int rke_mmap_fragment(const unsigned char *key_id, uint8_t fragment_id,
+                      const struct rke_fragment_t **fragment, struct rke_mmap_ref_t **ref) {
+    const struct rke_fragment_t *slot;
+    struct rke_mmap_ref_t *mapping;
+    int rv;
+
+    if (key_id == NULL || fragment == NULL || ref == NULL || fragment_id == 0) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    pthread_once(&mmap_once, init_mmap_cache);
+
+    rv = acquire_mapping(key_id, &mapping);
+    if (rv != RKE_SUCCESS) {
+        return rv;
+    }
+
+    rv = mapped_slot(mapping, fragment_id, &slot);
+    if (rv != RKE_SUCCESS) {
+        rke_mmap_release(mapping);
+        return rv;
+    }
+
+    *fragment = slot;
+    *ref = mapping;
+    return RKE_SUCCESS;
+}
+
+int rke_mmap_load_fragments(const unsigned char *key_id, const unsigned char *wanted,
+                            struct rke_fragment_t *fragments, int max_fragments) {
+    const struct rke_container_header_t *header;
+    const struct rke_fragment_t *slot;
+    struct rke_mmap_ref_t *mapping;
+    int copied = 0, rv;
+
+    if (key_id == NULL || fragments == NULL || max_fragments <= 0) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    pthread_once(&mmap_once, init_mmap_cache);
+
+    rv = acquire_mapping(key_id, &mapping);
+    if (rv != RKE_SUCCESS) {
+        return rv;
+    }
+
+    header = (const struct rke_container_header_t *)mapping->base;
+    for (int id = 1; id <= RKE_MAX_FRAGMENTS && copied < max_fragments && rv == RKE_SUCCESS; id++) {
+        if ((wanted != NULL && !RKE_BITMAP_TEST(wanted, id)) || !RKE_BITMAP_TEST(header->presence, id)) {
+            continue;
+        }
+        rv = mapped_slot(mapping, (uint8_t)id, &slot);
+        if (rv == RKE_SUCCESS) {
+            rke_fragment_unpack(&fragments[copied++], (const unsigned char *)slot, header->slot_size);
+        }
+    }
+
+    rke_mmap_release(mapping);
+    return (rv == RKE_SUCCESS) ? copied : rv;
+}
+
+void rke_mmap_release(struct rke_mmap_ref_t *ref) {
+    struct mmap_shard_t *shard;
+    int last;
+
+    if (ref == NULL) {
+        return;
+    }
+
+    shard = ref->shard;
+    pthread_mutex_lock(&shard->lock);
+    last = (--ref->refs == 0);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (last) {
+        ref->chain = NULL;
+        unmap_list(ref);
+    }
+}
+
+void rke_mmap_invalidate(const unsigned char *key_id) {
+    uint64_t hash;
+    struct mmap_shard_t *shard;
+    struct rke_mmap_ref_t *ref, *unmap = NULL;
+
+    if (key_id == NULL) {
+        return;
+    }
+
+    pthread_once(&mmap_once, init_mmap_cache);
+    hash = rke_container_hash(key_id);
+    shard = &shards[hash % RKE_MMAP_SHARDS];
+
+    pthread_mutex_lock(&shard->lock);
+    shard->generation++;
+    ref = find_mapping(shard, hash, key_id);
+    if (ref != NULL) {
+        unindex_mapping(shard, ref, &unmap);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    unmap_list(unmap);
+}
+
+int rke_mmap_enabled(void) {
+    return total_capacity > 0;
+}
+
+/*
+ * Resize the cache (0 disables mapped serving) and reset its counters
+ */
+int rke_mmap_set_capacity(size_t capacity) {
+    pthread_once(&mmap_once, init_mmap_cache);
+    total_capacity = capacity;
+
+    for (int i = 0; i < RKE_MMAP_SHARDS; i++) {
+        struct rke_mmap_ref_t *unmap = NULL;
+
+        pthread_mutex_lock(&shards[i].lock);
+        shards[i].capacity = shard_capacity(i);
+        evict_to_capacity(&shards[i], &unmap);
+        shards[i].hits = shards[i].misses = shards[i].evictions = 0;
+        pthread_mutex_unlock(&shards[i].lock);
+
+        unmap_list(unmap);
+    }
+
+    return RKE_SUCCESS;
+}
+
+void rke_mmap_get_stats(struct rke_mmap_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    pthread_once(&mmap_once, init_mmap_cache);
+    memset(stats, 0, sizeof(*stats));
+
+    for (int i = 0; i < RKE_MMAP_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        stats->hits += shards[i].hits;
+        stats->misses += shards[i].misses;
+        stats->evictions += shards[i].evictions;
+        stats->mappings += shards[i].count;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    stats->capacity = total_capacity;
+}
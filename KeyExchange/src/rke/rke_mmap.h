@@ -0,0 +1,56 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_mmap.h
+#   Last Modified : 2024-07-20
+#   Describe      : Bounded cache of read-only container mappings for zero-copy fragment serving
+#
+# ====================================================*/
+
+#ifndef RKE_MMAP_H
+#define RKE_MMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rke.h"
+
+#define RKE_MMAP_SHARDS 16
+#define RKE_MMAP_DEFAULT_CAPACITY 1024
+
+// A mapped container kept alive by the holder of the reference
+struct rke_mmap_ref_t;
+
+// Mapping counters, summed over all shards
+struct rke_mmap_stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t mappings;        // Mappings in the cache
+    size_t capacity;
+};
+
+// Point *fragment at a stored fragment inside its mapped container; only its
+// RKE_FRAGMENT_WIRE_SIZE(fragment_size) leading bytes are there
+// The bytes stay valid until rke_mmap_release(*ref) unless the fragment is deleted and its slot refilled
+// Returns RKE_ERROR_STORAGE_FAIL when the fragment is not stored
+int rke_mmap_fragment(const unsigned char *key_id, uint8_t fragment_id,
+                      const struct rke_fragment_t **fragment, struct rke_mmap_ref_t **ref);
+void rke_mmap_release(struct rke_mmap_ref_t *ref);
+
+// Copy up to max_fragments stored fragments in ascending id order under a single mapping lookup,
+// like rke_load_fragments; wanted (NULL - any) is a bitmap of the fragment ids to consider
+// Returns the number copied or a negative error code
+int rke_mmap_load_fragments(const unsigned char *key_id, const unsigned char *wanted,
+                            struct rke_fragment_t *fragments, int max_fragments);
+
+// Drop the cached mapping of a rewritten container
+void rke_mmap_invalidate(const unsigned char *key_id);
+
+// Management (capacity 0 disables mapped serving)
+int rke_mmap_enabled(void);
+int rke_mmap_set_capacity(size_t capacity);
+void rke_mmap_get_stats(struct rke_mmap_stats_t *stats);
+
+#endif // RKE_MMAP_H
@@ -15,25 +15,32 @@
 #include <errno.h>
 
 #include "../common/protocol.h"
+#include "../common/aes.h"
 #include "../common/log.h"
 #include "../common/utils.h"
 #include "rke.h"
+#include "rke_worker.h"
+#include "rke_cache.h"
+#include "rke_mmap.h"
+#include "rke_session.h"
 
 /*
  * RKE Generate Command
  * Generates a new key and splits it into fragments
- * Packet format: 16-byte key_id + 1-byte key_type + 1-byte total_fragments + 1-byte threshold + 2-byte EOF = 21 bytes
+ * Packet format: 16-byte key_id + 1-byte key_type + 1-byte total_fragments + 1-byte threshold
+ *                [+ 2-byte key_size, big-endian] + 2-byte EOF = 21 or 23 bytes (256-byte key without key_size)
  */
 void cmd_rke_generate(conn_info_t *ci) {
     unsigned char *payload = get_body_payload(ci);
     struct rke_key_metadata_t metadata;
     unsigned char key[RKE_MAX_KEY_SIZE];
+    struct rke_worker_t *worker;
     
     debug("CMD RKE Generate");
     
     // Validate packet size first
-    if (ci->body_size != 21) {
-        error("Invalid command length: %d. Need 21", ci->body_size);
+    if (ci->body_size != 21 && ci->body_size != 23) {
+        error("Invalid command length: %d. Need 21 or 23", ci->body_size);
         ci->command_status = ERROR_INVALID_PACKET_LENGTH;
         return;
     }
@@ -43,6 +50,7 @@ void cmd_rke_generate(conn_info_t *ci) {
     metadata.key_type = payload[16];
     metadata.total_fragments = payload[17];
     metadata.threshold = payload[18];
+    metadata.key_size = (ci->body_size == 23) ? (uint16_t)((payload[19] << 8) | payload[20]) : RKE_MAX_KEY_SIZE;
     
     // Set additional metadata
     metadata.timestamp = (uint32_t)time(NULL);
@@ -69,31 +77,43 @@ void cmd_rke_generate(conn_info_t *ci) {
         return;
     }
     
+    if (metadata.key_size == 0 || metadata.key_size > RKE_MAX_KEY_SIZE) {
+        error("Invalid key size %d", metadata.key_size);
+        ci->command_status = ERROR_INVALID_PARAMETER;
+        return;
+    }
+    
+    worker = rke_get_worker();
+    if (worker == NULL) {
+        ci->command_status = ERROR_MEMORY_ALLOC;
+        return;
+    }
+    
     // Generate key
-    if (rke_generate_key(key, 256) != RKE_SUCCESS) {
+    if (rke_generate_key(key, metadata.key_size) != RKE_SUCCESS) {
         error("Failed to generate key");
         ci->command_status = ERROR_KEY_GENERATION;
         return;
     }
     
     // Split key into fragments
-    if (rke_split_key(key, 256, &metadata) != RKE_SUCCESS) {
+    if (rke_split_key(&worker->ctx, key, metadata.key_size, &metadata, worker->fragments) != RKE_SUCCESS) {
         error("Failed to split key");
+        memset(key, 0, sizeof(key));
         ci->command_status = ERROR_KEY_SPLITTING;
         return;
     }
+    memset(key, 0, sizeof(key));
     
-    // Store metadata
-    if (rke_store_metadata(&metadata) != RKE_SUCCESS) {
-        error("Failed to store metadata");
+    // The new key replaces whatever the container held for this key_id
+    if (rke_replace_key(&metadata, worker->fragments, metadata.total_fragments) != RKE_SUCCESS) {
+        error("Failed to store fragments");
         ci->command_status = ERROR_FILESYSTEM;
         return;
     }
     
-    // Prepare response
-    ci->output_size = 1;  // Success indicator
-    ci->output = (unsigned char *) malloc(1);
-    if (ci->output == NULL) {
+    // Prepare response: 1-byte success indicator
+    if (rke_alloc_output(ci, 1) == NULL) {
         error("Can't alloc buffer for the response");
         ci->command_status = ERROR_MEMORY_ALLOC;
         return;
@@ -105,6 +125,43 @@ void cmd_rke_generate(conn_info_t *ci) {
     debug("CMD RKE Generate finished - generated key with %d fragments", metadata.total_fragments);
 }
 
+/*
+ * Release an exchange response that points into a mapped container
+ */
+static void release_mapped_output(conn_info_t *ci) {
+    rke_mmap_release((struct rke_mmap_ref_t *)ci->output_ref);
+}
+
+/*
+ * Serve a fragment straight from its mapped container, without copying it
+ */
+static void exchange_mapped(conn_info_t *ci, const unsigned char *key_id, uint8_t fragment_id) {
+    const struct rke_fragment_t *fragment;
+    struct rke_mmap_ref_t *ref;
+    int rv;
+
+    rv = rke_mmap_fragment(key_id, fragment_id, &fragment, &ref);
+    if (rv == RKE_ERROR_STORAGE_FAIL || rv == RKE_ERROR_INVALID_PARAM) {
+        error("Fragment %d not found for key", fragment_id);
+        ci->command_status = ERROR_INVALID_PARAMETER;
+        return;
+    }
+    if (rv != RKE_SUCCESS) {
+        error("Failed to map fragment %d: %d", fragment_id, rv);
+        ci->command_status = ERROR_FILESYSTEM;
+        return;
+    }
+
+    // The mapping is read-only; the output is only ever sent, never written
+    ci->output = (unsigned char *)fragment;
+    ci->output_size = RKE_FRAGMENT_WIRE_SIZE(fragment->fragment_size);
+    ci->output_release = release_mapped_output;
+    ci->output_ref = ref;
+    ci->command_status = STATUS_SUCCESS;
+
+    debug("Returned mapped fragment %d (%u bytes)", fragment_id, ci->output_size);
+}
+
 /*
  * RKE Exchange Command
  * Exchanges key fragments with a peer
@@ -132,6 +189,12 @@ void cmd_rke_exchange(conn_info_t *ci) {
     debug("Exchanging fragment %d for key %02x%02x%02x%02x...", 
           fragment_id, key_id[0], key_id[1], key_id[2], key_id[3]);
     
+    if (rke_mmap_enabled()) {
+        exchange_mapped(ci, key_id, fragment_id);
+        debug("CMD RKE Exchange finished");
+        return;
+    }
+    
     // Check if we have this fragment
     if (rke_fragment_exists(key_id, fragment_id)) {
         // Load and return the requested fragment
@@ -141,19 +204,17 @@ void cmd_rke_exchange(conn_info_t *ci) {
             return;
         }
         
-        // Prepare response with fragment data
-        ci->output_size = sizeof(struct rke_fragment_t);
-        ci->output = (unsigned char *) malloc(ci->output_size);
-        if (ci->output == NULL) {
+        // Prepare response with fragment data: the header and the padded payload
+        if (rke_alloc_output(ci, RKE_FRAGMENT_WIRE_SIZE(fragment.fragment_size)) == NULL) {
             error("Can't alloc buffer for the response");
             ci->command_status = ERROR_MEMORY_ALLOC;
             return;
         }
         
-        memcpy(ci->output, &fragment, sizeof(struct rke_fragment_t));
+        memcpy(ci->output, &fragment, ci->output_size);
         ci->command_status = STATUS_SUCCESS;
         
-        debug("Returned fragment %d (%zu bytes)", fragment_id, sizeof(struct rke_fragment_t));
+        debug("Returned fragment %d (%u bytes)", fragment_id, ci->output_size);
     } else {
         // Fragment not found
         error("Fragment %d not found for key", fragment_id);
@@ -164,6 +225,63 @@ void cmd_rke_exchange(conn_info_t *ci) {
     debug("CMD RKE Exchange finished");
 }
 
+/*
+ * Reconstruct a stored key from the first threshold fragments present
+ * Returns the key size, or 0 with ci->command_status set
+ */
+static uint16_t reconstruct_stored_key(conn_info_t *ci, const unsigned char *key_id, unsigned char *key) {
+    struct rke_key_metadata_t metadata;
+    struct rke_worker_t *worker;
+    uint16_t key_size;
+    int loaded;
+    
+    debug("Reconstructing key %02x%02x%02x%02x...", 
+          key_id[0], key_id[1], key_id[2], key_id[3]);
+    
+    // Load metadata
+    if (rke_load_metadata(&metadata, key_id) != RKE_SUCCESS) {
+        error("Failed to load metadata for key");
+        ci->command_status = ERROR_FILESYSTEM;
+        return 0;
+    }
+    
+    worker = rke_get_worker();
+    if (worker == NULL) {
+        ci->command_status = ERROR_MEMORY_ALLOC;
+        return 0;
+    }
+    
+    // The first threshold present fragments, in one pass over the mapped or read container;
+    // rke_reconstruct_key verifies them as a batch and interpolates straight from the buffer
+    if (rke_mmap_enabled()) {
+        loaded = rke_mmap_load_fragments(key_id, NULL, worker->fragments, metadata.threshold);
+    } else {
+        loaded = rke_load_fragments(key_id, NULL, worker->fragments, metadata.threshold);
+    }
+    if (loaded < 0) {
+        error("Failed to load fragments");
+        ci->command_status = ERROR_FILESYSTEM;
+        return 0;
+    }
+    
+    // Check if we have sufficient fragments
+    if (loaded < metadata.threshold) {
+        error("Insufficient fragments: have %d, need %d", loaded, metadata.threshold);
+        ci->command_status = ERROR_INVALID_PARAMETER;
+        return 0;
+    }
+    
+    // Reconstruct the key
+    key_size = (metadata.key_size != 0) ? metadata.key_size : RKE_MAX_KEY_SIZE;
+    if (rke_reconstruct_key(&worker->ctx, key, key_size, &metadata, worker->fragments, loaded) != RKE_SUCCESS) {
+        error("Failed to reconstruct key");
+        ci->command_status = ERROR_KEY_GENERATION;
+        return 0;
+    }
+    
+    return key_size;
+}
+
 /*
  * RKE Reconstruct Command
  * Reconstructs a key from available fragments
@@ -171,9 +289,8 @@ void cmd_rke_exchange(conn_info_t *ci) {
  */
 void cmd_rke_reconstruct(conn_info_t *ci) {
     unsigned char *payload = get_body_payload(ci);
-    unsigned char key_id[RKE_KEY_ID_SIZE];
-    struct rke_key_metadata_t metadata;
     unsigned char reconstructed_key[RKE_MAX_KEY_SIZE];
+    uint16_t key_size;
     
     debug("CMD RKE Reconstruct");
     
@@ -184,59 +301,85 @@ void cmd_rke_reconstruct(conn_info_t *ci) {
         return;
     }
     
-    // Extract key_id
-    memcpy(key_id, payload, RKE_KEY_ID_SIZE);
-    
-    debug("Reconstructing key %02x%02x%02x%02x...", 
-          key_id[0], key_id[1], key_id[2], key_id[3]);
+    key_size = reconstruct_stored_key(ci, payload, reconstructed_key);
+    if (key_size == 0) {
+        return;
+    }
     
-    // Load metadata
-    if (rke_load_metadata(&metadata, key_id) != RKE_SUCCESS) {
-        error("Failed to load metadata for key");
-        ci->command_status = ERROR_FILESYSTEM;
+    // Prepare response with reconstructed key
+    if (rke_alloc_output(ci, key_size) == NULL) {
+        error("Can't alloc buffer for the response");
+        secure_wipe(reconstructed_key, sizeof(reconstructed_key));
+        ci->command_status = ERROR_MEMORY_ALLOC;
         return;
     }
     
-    // Check if we have sufficient fragments
-    int available_fragments = rke_count_fragments(key_id);
-    if (available_fragments < metadata.threshold) {
-        error("Insufficient fragments: have %d, need %d", available_fragments, metadata.threshold);
-        ci->command_status = ERROR_INVALID_PARAMETER;
+    memcpy(ci->output, reconstructed_key, key_size);
+    memset(reconstructed_key, 0, sizeof(reconstructed_key));
+    ci->command_status = STATUS_SUCCESS;
+    
+    debug("CMD RKE Reconstruct finished - reconstructed %d-byte key", key_size);
+}
+
+/*
+ * RKE Session Open Command
+ * Opens a session for encrypted exchanges and hands its key to the peer under a key both sides
+ * already hold: a stored key of at least 16 bytes, reconstructed here
+ * Packet format: 16-byte key_id + 2-byte EOF = 18 bytes
+ * Response: 16-byte session_id + 16-byte session_key, the session_key encrypted with AES-128-CTR
+ *           under the first 16 bytes of the stored key and the connection's nonce
+ */
+void cmd_rke_session_open(conn_info_t *ci) {
+    unsigned char *payload = get_body_payload(ci);
+    unsigned char key[RKE_MAX_KEY_SIZE];
+    struct rke_session_t session;
+    uint16_t key_size;
+    int rv;
+    
+    debug("CMD RKE Session Open");
+    
+    if (ci->body_size != 18) {
+        error("Invalid command length: %d. Need 18", ci->body_size);
+        ci->command_status = ERROR_INVALID_PACKET_LENGTH;
         return;
     }
     
-    // Load required fragments
-    for (int i = 1; i <= metadata.threshold; i++) {
-        if (rke_fragment_exists(key_id, i)) {
-            struct rke_fragment_t fragment;
-            if (rke_load_fragment(&fragment, key_id, i) != RKE_SUCCESS) {
-                error("Failed to load fragment %d", i);
-                ci->command_status = ERROR_FILESYSTEM;
-                return;
-            }
-        }
+    key_size = reconstruct_stored_key(ci, payload, key);
+    if (key_size == 0) {
+        return;
+    }
+    if (key_size < RKE_SESSION_KEY_SIZE) {
+        error("A %d-byte key can't carry a session key", key_size);
+        secure_wipe(key, sizeof(key));
+        ci->command_status = ERROR_INVALID_PARAMETER;
+        return;
     }
     
-    // Reconstruct the key
-    if (rke_reconstruct_key(reconstructed_key, 256, &metadata) != RKE_SUCCESS) {
-        error("Failed to reconstruct key");
-        ci->command_status = ERROR_KEY_GENERATION;
+    // The session belongs to the key it was opened under
+    rv = rke_init_session(&session, payload, payload);
+    if (rv != RKE_SUCCESS) {
+        error("Failed to open a session: %d", rv);
+        secure_wipe(key, sizeof(key));
+        ci->command_status = (rv == RKE_ERROR_SESSION_LIMIT) ? ERROR_MEMORY_ALLOC : ERROR_ENCRYPTION;
         return;
     }
     
-    // Prepare response with reconstructed key
-    ci->output_size = 256;  // Key size
-    ci->output = (unsigned char *) malloc(ci->output_size);
-    if (ci->output == NULL) {
+    if (rke_alloc_output(ci, RKE_SESSION_ID_SIZE + RKE_SESSION_KEY_SIZE) == NULL) {
         error("Can't alloc buffer for the response");
+        rke_cleanup_session(&session);
+        secure_wipe(key, sizeof(key));
         ci->command_status = ERROR_MEMORY_ALLOC;
         return;
     }
     
-    memcpy(ci->output, reconstructed_key, 256);
+    memcpy(ci->output, session.session_id, RKE_SESSION_ID_SIZE);
+    memcpy(ci->output + RKE_SESSION_ID_SIZE, session.session_key, RKE_SESSION_KEY_SIZE);
+    crypt_ctr(key, ci->output + RKE_SESSION_ID_SIZE, RKE_SESSION_KEY_SIZE, ci->nonce);
+    secure_wipe(key, sizeof(key));
+    secure_wipe(&session, sizeof(session));
     ci->command_status = STATUS_SUCCESS;
     
-    debug("CMD RKE Reconstruct finished - reconstructed 256-byte key");
+    debug("CMD RKE Session Open finished");
 }
 
 /*
@@ -248,7 +391,7 @@ void cmd_rke_query(conn_info_t *ci) {
     unsigned char *payload = get_body_payload(ci);
     unsigned char key_id[RKE_KEY_ID_SIZE];
     struct rke_key_metadata_t metadata;
-    unsigned char fragment_map[32]; // Bitmap for up to 256 fragments
+    unsigned char fragment_map[RKE_FRAGMENT_BITMAP_SIZE]; // Bitmap for up to 256 fragments
     
     debug("CMD RKE Query");
     
@@ -272,25 +415,16 @@ void cmd_rke_query(conn_info_t *ci) {
         return;
     }
     
-    // Initialize fragment bitmap
-    memset(fragment_map, 0, sizeof(fragment_map));
-    
-    // Check which fragments are available
-    int available_count = 0;
-    for (int i = 1; i <= metadata.total_fragments; i++) {
-        if (rke_fragment_exists(key_id, i)) {
-            // Set bit in bitmap
-            int byte_index = (i - 1) / 8;
-            int bit_index = (i - 1) % 8;
-            fragment_map[byte_index] |= (1 << bit_index);
-            available_count++;
-        }
+    // The presence bitmap uses the wire layout (bit (id - 1) % 8 of byte (id - 1) / 8)
+    if (rke_fragment_bitmap(key_id, fragment_map) != RKE_SUCCESS) {
+        error("Failed to load fragment bitmap for key");
+        ci->command_status = ERROR_FILESYSTEM;
+        return;
     }
+    int available_count = rke_bitmap_count(fragment_map);
     
     // Prepare response: metadata + fragment bitmap
-    ci->output_size = sizeof(struct rke_key_metadata_t) + sizeof(fragment_map);
-    ci->output = (unsigned char *) malloc(ci->output_size);
-    if (ci->output == NULL) {
+    if (rke_alloc_output(ci, sizeof(struct rke_key_metadata_t) + sizeof(fragment_map)) == NULL) {
         error("Can't alloc buffer for the response");
         ci->command_status = ERROR_MEMORY_ALLOC;
         return;
@@ -306,16 +440,19 @@ void cmd_rke_query(conn_info_t *ci) {
 }
 
 /*
- * Initialize an RKE session
+ * Initialize an RKE session and register it in the session table
  */
 int rke_init_session(struct rke_session_t *session, const unsigned char *sender_id, const unsigned char *receiver_id) {
+    int rv;
+    
     if (session == NULL || sender_id == NULL || receiver_id == NULL) {
         error("Invalid parameters for session initialization");
         return RKE_ERROR_INVALID_PARAM;
     }
     
-    // Generate random session ID
-    if (secure_random_bytes(session->session_id, RKE_SESSION_ID_SIZE) != 0) {
+    // Generate random session ID and key
+    if (secure_random_bytes(session->session_id, RKE_SESSION_ID_SIZE) != 0 ||
+        secure_random_bytes(session->session_key, RKE_SESSION_KEY_SIZE) != 0) {
         error("Failed to generate session ID");
         return RKE_ERROR_CRYPTO_FAIL;
     }
@@ -323,7 +460,13 @@ int rke_init_session(struct rke_session_t *session, const unsigned char *sender_
     memcpy(session->sender_id, sender_id, RKE_KEY_ID_SIZE);
     memcpy(session->receiver_id, receiver_id, RKE_KEY_ID_SIZE);
     session->state = RKE_SESSION_STATE_INIT;
-    session->timeout = (uint32_t)time(NULL) + 3600; // 1 hour timeout
+    session->timeout = rke_session_now() + RKE_SESSION_DEFAULT_TIMEOUT;
+    
+    rv = rke_session_insert(session);
+    if (rv != RKE_SUCCESS) {
+        memset(session, 0, sizeof(struct rke_session_t));
+        return rv;
+    }
     
     debug("Initialized RKE session %02x%02x%02x%02x...", 
           session->session_id[0], session->session_id[1], 
@@ -333,7 +476,7 @@ int rke_init_session(struct rke_session_t *session, const unsigned char *sender_
 }
 
 /*
- * Cleanup an RKE session
+ * Cleanup an RKE session and drop it from the session table
  */
 void rke_cleanup_session(struct rke_session_t *session) {
     if (session == NULL) {
@@ -344,6 +487,8 @@ void rke_cleanup_session(struct rke_session_t *session) {
           session->session_id[0], session->session_id[1], 
           session->session_id[2], session->session_id[3]);
     
+    rke_session_remove(session->session_id);
+    
     // Clear sensitive data
     memset(session, 0, sizeof(struct rke_session_t));
 }
\ No newline at end of file
@@ -0,0 +1,275 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_protocol_batch.c
+#   Last Modified : 2024-07-20
+#   Describe      : RKE protocol commands operating on many keys or fragments at once
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/protocol.h"
+#include "../common/log.h"
+#include "../common/utils.h"
+#include "rke.h"
+#include "rke_worker.h"
+#include "rke_cache.h"
+#include "rke_mmap.h"
+#include "rke_session.h"
+
+/*
+ * Store every fragment of one batched key plus its metadata in one container write
+ * Refused with RKE_ERROR_KEY_EXISTS when a key is already stored under its key_id
+ */
+static int store_batch_key(const struct rke_fragment_batch_t *batch, int key_index,
+                           const struct rke_key_metadata_t *metadata, struct rke_fragment_t *fragments) {
+    for (int f = 1; f <= batch->total_fragments; f++) {
+        rke_fragment_batch_get(batch, key_index, (uint8_t)f, &fragments[f - 1]);
+    }
+    
+    return rke_create_key(metadata, fragments, batch->total_fragments);
+}
+
+/*
+ * Remove the keys a failed batch request has already stored, so it leaves none behind
+ * Every one of them was created by the request, so no key stored before it is touched
+ */
+static void drop_batch_keys(const unsigned char *key_ids, int count) {
+    for (int k = 0; k < count; k++) {
+        if (rke_delete_key(key_ids + (size_t)k * RKE_KEY_ID_SIZE) != RKE_SUCCESS) {
+            error("Failed to remove batched key %d of a failed request", k);
+        }
+    }
+}
+
+/*
+ * RKE Generate Batch Command
+ * Generates and splits one key per supplied key_id in a single request
+ * Packet format: 1-byte key_type + 1-byte total_fragments + 1-byte threshold + 2-byte key_count
+ *                + key_count * 16-byte key_id [+ 2-byte key_size, big-endian] + 2-byte EOF
+ *                (256-byte keys without key_size)
+ * Either every key is stored or, when one fails, none of the request's keys is left stored
+ * A key_id that already holds a key fails the request and that key is kept as it was
+ */
+void cmd_rke_generate_batch(conn_info_t *ci) {
+    unsigned char *payload = get_body_payload(ci);
+    struct rke_fragment_batch_t batch;
+    struct rke_key_metadata_t metadata;
+    struct rke_worker_t *worker;
+    unsigned char *key_ids;
+    uint16_t key_count, key_size = RKE_MAX_KEY_SIZE;
+    int done = 0, rv;
+    
+    debug("CMD RKE Generate Batch");
+    
+    // Minimum packet size: 5-byte header + 2-byte EOF
+    if (ci->body_size < 7) {
+        error("Invalid command length: %d. Need at least 7", ci->body_size);
+        ci->command_status = ERROR_INVALID_PACKET_LENGTH;
+        return;
+    }
+    
+    key_count = (uint16_t)((payload[3] << 8) | payload[4]);
+    if (key_count == 0 || (ci->body_size != 7 + (uint32_t)key_count * RKE_KEY_ID_SIZE &&
+                           ci->body_size != 9 + (uint32_t)key_count * RKE_KEY_ID_SIZE)) {
+        error("Invalid command length: %d for %d keys", ci->body_size, key_count);
+        ci->command_status = ERROR_INVALID_PACKET_LENGTH;
+        return;
+    }
+    key_ids = payload + 5;
+    if (ci->body_size == 9 + (uint32_t)key_count * RKE_KEY_ID_SIZE) {
+        unsigned char *size_field = key_ids + (size_t)key_count * RKE_KEY_ID_SIZE;
+        key_size = (uint16_t)((size_field[0] << 8) | size_field[1]);
+    }
+    
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.key_type = payload[0];
+    metadata.total_fragments = payload[1];
+    metadata.threshold = payload[2];
+    metadata.timestamp = (uint32_t)time(NULL);
+    metadata.key_size = key_size;
+    
+    if (metadata.total_fragments == 0 || metadata.threshold > metadata.total_fragments ||
+        metadata.threshold < RKE_MIN_THRESHOLD || key_size == 0 || key_size > RKE_MAX_KEY_SIZE) {
+        error("Invalid fragment parameters: total %d, threshold %d, key size %d",
+              metadata.total_fragments, metadata.threshold, key_size);
+        ci->command_status = ERROR_INVALID_PARAMETER;
+        return;
+    }
+    
+    worker = rke_get_worker();
+    if (worker == NULL) {
+        ci->command_status = ERROR_MEMORY_ALLOC;
+        return;
+    }
+    
+    // Reason: batches are bounded so a huge request does not pin a huge buffer
+    while (done < key_count) {
+        uint16_t chunk = key_count - done;
+        if (chunk > RKE_MAX_BATCH_KEYS) {
+            chunk = RKE_MAX_BATCH_KEYS;
+        }
+        
+        if (rke_fragment_batch_alloc(&batch, chunk, metadata.total_fragments, metadata.threshold, key_size) != RKE_SUCCESS) {
+            drop_batch_keys(key_ids, done);
+            ci->command_status = ERROR_MEMORY_ALLOC;
+            return;
+        }
+        
+        if (rke_generate_and_split_batch(&worker->ctx, &batch, NULL) != RKE_SUCCESS) {
+            error("Failed to generate key batch");
+            rke_fragment_batch_free(&batch);
+            drop_batch_keys(key_ids, done);
+            ci->command_status = ERROR_KEY_GENERATION;
+            return;
+        }
+        
+        for (int k = 0; k < chunk; k++) {
+            memcpy(metadata.key_id, key_ids + (size_t)(done + k) * RKE_KEY_ID_SIZE, RKE_KEY_ID_SIZE);
+            rv = store_batch_key(&batch, k, &metadata, worker->fragments);
+            if (rv != RKE_SUCCESS) {
+                error("Failed to store batched key %d: %d", done + k, rv);
+                rke_fragment_batch_free(&batch);
+                drop_batch_keys(key_ids, done + k);
+                ci->command_status = (rv == RKE_ERROR_KEY_EXISTS) ? ERROR_INVALID_PARAMETER : ERROR_FILESYSTEM;
+                return;
+            }
+        }
+        
+        rke_fragment_batch_free(&batch);
+        done += chunk;
+    }
+    
+    // Prepare response: 1-byte success indicator
+    if (rke_alloc_output(ci, 1) == NULL) {
+        error("Can't alloc buffer for the response");
+        ci->command_status = ERROR_MEMORY_ALLOC;
+        return;
+    }
+    
+    ci->output[0] = 0x01;  // Success
+    ci->command_status = STATUS_SUCCESS;
+    
+    debug("CMD RKE Generate Batch finished - generated %d keys", key_count);
+}
+
+/*
+ * Collect the requested fragments of a key into the worker buffer with one container lookup
+ * Returns the number collected or a negative error code
+ */
+static int collect_fragments(const unsigned char *key_id, const unsigned char *wanted, struct rke_fragment_t *fragments) {
+    int loaded, collected = 0;
+    
+    if (rke_mmap_enabled()) {
+        return rke_mmap_load_fragments(key_id, wanted, fragments, RKE_MAX_FRAGMENTS);
+    }
+    
+    // One read of every present fragment, then keep the requested ones
+    loaded = rke_load_fragments(key_id, NULL, fragments, RKE_MAX_FRAGMENTS);
+    for (int i = 0; i < loaded; i++) {
+        if (RKE_BITMAP_TEST(wanted, fragments[i].fragment_id)) {
+            if (i != collected) {
+                memcpy(&fragments[collected], &fragments[i], sizeof(struct rke_fragment_t));
+            }
+            collected++;
+        }
+    }
+    
+    return (loaded < 0) ? loaded : collected;
+}
+
+/*
+ * RKE Exchange Multi Command
+ * Returns every requested fragment of a key that is stored, in one response
+ * Packet format: 16-byte key_id + 32-byte fragment bitmap [+ 16-byte session_id] + 2-byte EOF = 50 or 66 bytes
+ *                (bit (id - 1) % 8 of byte (id - 1) / 8 requests fragment id)
+ * Response: 2-byte fragment count + count fragments in ascending id order, each as its
+ *           RKE_FRAGMENT_WIRE_SIZE(fragment_size)-byte header and padded payload
+ *           With a session_id (cmd_rke_session_open) the fragments are encrypted with the session's
+ *           key and the connection's nonce; without one they go out as stored, like cmd_rke_exchange
+ */
+void cmd_rke_exchange_multi(conn_info_t *ci) {
+    unsigned char *payload = get_body_payload(ci);
+    struct rke_session_t session;
+    struct rke_worker_t *worker;
+    unsigned char *record;
+    uint32_t length = 2;
+    int count, encrypted, rv = RKE_SUCCESS;
+    
+    debug("CMD RKE Exchange Multi");
+    
+    encrypted = (ci->body_size == RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE + RKE_SESSION_ID_SIZE + 2);
+    if (ci->body_size != RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE + 2 && !encrypted) {
+        error("Invalid command length: %d. Need %d or %d", ci->body_size, RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE + 2,
+              RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE + RKE_SESSION_ID_SIZE + 2);
+        ci->command_status = ERROR_INVALID_PACKET_LENGTH;
+        return;
+    }
+    
+    // A session_id asks for the fragments under the key of that live session
+    if (encrypted &&
+        rke_session_lookup(payload + RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE, &session) != RKE_SUCCESS) {
+        error("Exchange multi outside of a live session");
+        ci->command_status = ERROR_SESSION_EXPIRED;
+        return;
+    }
+    
+    worker = rke_get_worker();
+    if (worker == NULL) {
+        secure_wipe(&session, sizeof(session));
+        ci->command_status = ERROR_MEMORY_ALLOC;
+        return;
+    }
+    
+    count = collect_fragments(payload, payload + RKE_KEY_ID_SIZE, worker->fragments);
+    
+    // The whole set is encrypted in one pass over the worker buffer
+    if (count > 0 && encrypted) {
+        rv = rke_encrypt_fragments(worker->fragments, count, session.session_key, ci->nonce);
+    }
+    secure_wipe(&session, sizeof(session));
+    
+    if (count == RKE_ERROR_STORAGE_FAIL) {
+        error("Key not found");
+        ci->command_status = ERROR_INVALID_PARAMETER;
+        return;
+    }
+    if (count < 0) {
+        error("Failed to load fragments: %d", count);
+        ci->command_status = ERROR_FILESYSTEM;
+        return;
+    }
+    if (rv != RKE_SUCCESS) {
+        error("Failed to encrypt %d fragments: %d", count, rv);
+        ci->command_status = ERROR_ENCRYPTION;
+        return;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        length += (uint32_t)RKE_FRAGMENT_WIRE_SIZE(worker->fragments[i].fragment_size);
+    }
+    
+    if (rke_alloc_output(ci, length) == NULL) {
+        error("Can't alloc buffer for the response");
+        ci->command_status = ERROR_MEMORY_ALLOC;
+        return;
+    }
+    
+    ci->output[0] = (unsigned char)(count >> 8);
+    ci->output[1] = (unsigned char)count;
+    record = ci->output + 2;
+    for (int i = 0; i < count; i++) {
+        size_t size = RKE_FRAGMENT_WIRE_SIZE(worker->fragments[i].fragment_size);
+        
+        memcpy(record, &worker->fragments[i], size);
+        record += size;
+    }
+    ci->command_status = STATUS_SUCCESS;
+    
+    debug("CMD RKE Exchange Multi finished - returned %d fragments", count);
+}
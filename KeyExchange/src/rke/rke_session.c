@@ -0,0 +1,469 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_session.c
+#   Last Modified : 2024-07-20
+#   Describe      : Bounded, lock-striped table of live RKE sessions with timer-wheel expiry
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../common/log.h"
+#include "rke.h"
+#include "rke_session.h"
+
+/*
+ * A session id always maps to the same shard, and one shard lock covers every operation on
+ * it, so opens, lookups and state changes on different shards never contend.
+ *
+ * Each shard owns a fixed open-addressed array, linear probed and kept at most two thirds
+ * full. Removal shifts the following run back instead of leaving tombstones.
+ *
+ * Expiry uses a hierarchical timer wheel per shard: three levels of 64 one-second,
+ * 64-second and 4096-second slots, each a doubly linked list threaded through the entries.
+ * The wheel is advanced lazily to the current second whenever the shard lock is taken. An
+ * entry is cascaded at most twice before its level-0 slot expires it, so expiry costs O(1)
+ * amortized per session and never scans the table.
+ */
+#define NIL -1
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 3
+
+struct session_entry_t {
+    struct rke_session_t session;   // timeout holds the absolute expiry second
+    uint64_t hash;
+    int32_t prev, next;             // Neighbours in the wheel slot list
+    int16_t list;                   // Wheel slot list: level * WHEEL_SLOTS + slot
+    uint8_t used;
+};
+
+struct session_shard_t {
+    pthread_mutex_t lock;
+    struct session_entry_t *entries;
+    uint32_t mask;                  // Table size - 1
+    int32_t limit;                  // Sessions the shard accepts
+    int32_t count;
+    uint32_t now;                   // Last second the wheel has processed
+    int32_t wheel[WHEEL_LEVELS * WHEEL_SLOTS];
+    uint64_t opened, closed, expired, rejected;
+};
+
+static struct session_shard_t shards[RKE_SESSION_SHARDS];
+static size_t total_capacity = RKE_SESSION_DEFAULT_CAPACITY;
+static uint32_t (*session_clock)(void);
+static pthread_once_t session_once = PTHREAD_ONCE_INIT;
+
+static uint32_t clock_now(void) {
+    uint32_t (*clock)(void) = __atomic_load_n(&session_clock, __ATOMIC_ACQUIRE);
+
+    return (clock != NULL) ? clock() : (uint32_t)time(NULL);
+}
+
+static uint64_t hash_session(const unsigned char *session_id) {
+    uint64_t a, b;
+
+    memcpy(&a, session_id, sizeof(a));
+    memcpy(&b, session_id + sizeof(a), sizeof(b));
+    return (a ^ (b * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+}
+
+// The low bits pick the shard, the high bits the home slot within it
+static uint32_t home_slot(const struct session_shard_t *shard, uint64_t hash) {
+    return (uint32_t)(hash >> 32) & shard->mask;
+}
+
+/*
+ * (Re)allocate the table of one shard; called with the shard locked or before first use
+ */
+static void setup_shard(struct session_shard_t *shard, int32_t limit) {
+    uint32_t size = 1;
+
+    if (shard->entries != NULL) {
+        memset(shard->entries, 0, ((size_t)shard->mask + 1) * sizeof(struct session_entry_t));
+        free(shard->entries);
+    }
+    shard->entries = NULL;
+    shard->mask = 0;
+    shard->limit = 0;
+    shard->count = 0;
+    shard->now = clock_now();
+    shard->opened = shard->closed = shard->expired = shard->rejected = 0;
+    for (int i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++) {
+        shard->wheel[i] = NIL;
+    }
+
+    if (limit == 0) {
+        return;
+    }
+
+    while (size < (uint32_t)limit + (uint32_t)limit / 2 + 1) {
+        size <<= 1;
+    }
+
+    shard->entries = (struct session_entry_t *) calloc(size, sizeof(struct session_entry_t));
+    if (shard->entries == NULL) {
+        error("Can't alloc RKE session shard, it accepts no sessions");
+        return;
+    }
+    shard->mask = size - 1;
+    shard->limit = limit;
+}
+
+static int32_t shard_limit(int index) {
+    return (int32_t)(total_capacity / RKE_SESSION_SHARDS + ((size_t)index < total_capacity % RKE_SESSION_SHARDS));
+}
+
+static void init_sessions(void) {
+    for (int i = 0; i < RKE_SESSION_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        setup_shard(&shards[i], shard_limit(i));
+    }
+}
+
+static struct session_shard_t *get_shard(uint64_t hash) {
+    pthread_once(&session_once, init_sessions);
+    return &shards[hash % RKE_SESSION_SHARDS];
+}
+
+static void wheel_unlink(struct session_shard_t *shard, int32_t index) {
+    struct session_entry_t *entry = &shard->entries[index];
+
+    if (entry->prev != NIL) {
+        shard->entries[entry->prev].next = entry->next;
+    } else {
+        shard->wheel[entry->list] = entry->next;
+    }
+    if (entry->next != NIL) {
+        shard->entries[entry->next].prev = entry->prev;
+    }
+}
+
+/*
+ * Link an entry into the wheel slot its expiry falls in, relative to the shard's current second
+ */
+static void wheel_schedule(struct session_shard_t *shard, int32_t index) {
+    struct session_entry_t *entry = &shard->entries[index];
+    uint32_t expiry = entry->session.timeout;
+    int64_t delta = (int64_t)expiry - (int64_t)shard->now;
+
+    if (delta < WHEEL_SLOTS) {
+        entry->list = (int16_t)(expiry & WHEEL_MASK);
+    } else if (delta < WHEEL_SLOTS * WHEEL_SLOTS) {
+        entry->list = (int16_t)(WHEEL_SLOTS + ((expiry >> WHEEL_BITS) & WHEEL_MASK));
+    } else {
+        entry->list = (int16_t)(2 * WHEEL_SLOTS + ((expiry >> (2 * WHEEL_BITS)) & WHEEL_MASK));
+    }
+
+    entry->prev = NIL;
+    entry->next = shard->wheel[entry->list];
+    if (entry->next != NIL) {
+        shard->entries[entry->next].prev = index;
+    }
+    shard->wheel[entry->list] = index;
+}
+
+/*
+ * Move every entry of a higher-level slot down to the slot it now falls in
+ */
+static void wheel_cascade(struct session_shard_t *shard, int list) {
+    int32_t index = shard->wheel[list];
+
+    shard->wheel[list] = NIL;
+    while (index != NIL) {
+        int32_t next = shard->entries[index].next;
+
+        wheel_schedule(shard, index);
+        index = next;
+    }
+}
+
+static int32_t find_entry(const struct session_shard_t *shard, uint64_t hash, const unsigned char *session_id) {
+    uint32_t i;
+
+    if (shard->limit == 0) {
+        return NIL;
+    }
+
+    for (i = home_slot(shard, hash); shard->entries[i].used; i = (i + 1) & shard->mask) {
+        if (shard->entries[i].hash == hash &&
+            memcmp(shard->entries[i].session.session_id, session_id, RKE_SESSION_ID_SIZE) == 0) {
+            return (int32_t)i;
+        }
+    }
+
+    return NIL;
+}
+
+/*
+ * Move an entry to another table slot, keeping its wheel list intact
+ */
+static void move_entry(struct session_shard_t *shard, int32_t from, int32_t to) {
+    struct session_entry_t *entry = &shard->entries[to];
+
+    memcpy(entry, &shard->entries[from], sizeof(*entry));
+    if (entry->prev != NIL) {
+        shard->entries[entry->prev].next = to;
+    } else {
+        shard->wheel[entry->list] = to;
+    }
+    if (entry->next != NIL) {
+        shard->entries[entry->next].prev = to;
+    }
+}
+
+/*
+ * Drop an entry and shift back the entries of its probe run that may fill the hole
+ */
+static void remove_entry(struct session_shard_t *shard, int32_t index) {
+    uint32_t hole = (uint32_t)index, j = (uint32_t)index;
+
+    wheel_unlink(shard, index);
+
+    for (;;) {
+        j = (j + 1) & shard->mask;
+        if (!shard->entries[j].used) {
+            break;
+        }
+        // An entry may move back unless its home lies cyclically after the hole
+        if (((j - home_slot(shard, shard->entries[j].hash)) & shard->mask) >= ((j - hole) & shard->mask)) {
+            move_entry(shard, (int32_t)j, (int32_t)hole);
+            hole = j;
+        }
+    }
+
+    memset(&shard->entries[hole], 0, sizeof(struct session_entry_t));
+    shard->count--;
+}
+
+/*
+ * Run the wheel of a locked shard up to the given second; returns the number of sessions expired
+ */
+static int advance_shard(struct session_shard_t *shard, uint32_t target) {
+    int expired = 0;
+
+    while ((int32_t)(target - shard->now) > 0 && shard->count > 0) {
+        uint32_t tick = ++shard->now;
+        int32_t index;
+
+        if ((tick & WHEEL_MASK) == 0) {
+            if (((tick >> WHEEL_BITS) & WHEEL_MASK) == 0) {
+                wheel_cascade(shard, 2 * WHEEL_SLOTS + ((tick >> (2 * WHEEL_BITS)) & WHEEL_MASK));
+            }
+            wheel_cascade(shard, WHEEL_SLOTS + ((tick >> WHEEL_BITS) & WHEEL_MASK));
+        }
+
+        while ((index = shard->wheel[tick & WHEEL_MASK]) != NIL) {
+            remove_entry(shard, index);
+            expired++;
+        }
+    }
+
+    // With nothing scheduled the wheel can jump straight to the target
+    if ((int32_t)(target - shard->now) > 0) {
+        shard->now = target;
+    }
+
+    shard->expired += (uint64_t)expired;
+    return expired;
+}
+
+/*
+ * Lock the shard of a session id with its wheel brought up to date
+ */
+static struct session_shard_t *lock_shard(uint64_t hash) {
+    struct session_shard_t *shard = get_shard(hash);
+    uint32_t now = clock_now();
+
+    pthread_mutex_lock(&shard->lock);
+    advance_shard(shard, now);
+    return shard;
+}
+
+int rke_session_insert(const struct rke_session_t *session) {
+    struct session_shard_t *shard;
+    uint64_t hash;
+    int64_t delta;
+    uint32_t i;
+
+    if (session == NULL) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    hash = hash_session(session->session_id);
+    shard = lock_shard(hash);
+
+    delta = (int64_t)session->timeout - (int64_t)shard->now;
+    if (delta <= 0 || delta > RKE_SESSION_MAX_TIMEOUT) {
+        pthread_mutex_unlock(&shard->lock);
+        error("Session timeout %lld seconds out of range", (long long)delta);
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    if (shard->count >= shard->limit) {
+        shard->rejected++;
+        pthread_mutex_unlock(&shard->lock);
+        warn("Session table full, refusing a new session");
+        return RKE_ERROR_SESSION_LIMIT;
+    }
+
+    if (find_entry(shard, hash, session->session_id) != NIL) {
+        pthread_mutex_unlock(&shard->lock);
+        error("Session id already registered");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    for (i = home_slot(shard, hash); shard->entries[i].used; i = (i + 1) & shard->mask) {
+    }
+
+    memcpy(&shard->entries[i].session, session, sizeof(*session));
+    shard->entries[i].hash = hash;
+    shard->entries[i].used = 1;
+    wheel_schedule(shard, (int32_t)i);
+    shard->count++;
+    shard->opened++;
+    pthread_mutex_unlock(&shard->lock);
+
+    return RKE_SUCCESS;
+}
+
+int rke_session_lookup(const unsigned char *session_id, struct rke_session_t *session) {
+    struct session_shard_t *shard;
+    uint64_t hash;
+    int32_t index;
+
+    if (session_id == NULL || session == NULL) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    hash = hash_session(session_id);
+    shard = lock_shard(hash);
+    index = find_entry(shard, hash, session_id);
+    if (index != NIL) {
+        memcpy(session, &shard->entries[index].session, sizeof(*session));
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return (index != NIL) ? RKE_SUCCESS : RKE_ERROR_SESSION_EXPIRED;
+}
+
+int rke_session_set_state(const unsigned char *session_id, uint8_t state) {
+    struct session_shard_t *shard;
+    uint64_t hash;
+    int32_t index;
+
+    // Expiry is the wheel's job, not the caller's
+    if (session_id == NULL || state > RKE_SESSION_STATE_COMPLETE) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    hash = hash_session(session_id);
+    shard = lock_shard(hash);
+    index = find_entry(shard, hash, session_id);
+    if (index != NIL) {
+        shard->entries[index].session.state = state;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return (index != NIL) ? RKE_SUCCESS : RKE_ERROR_SESSION_EXPIRED;
+}
+
+int rke_session_remove(const unsigned char *session_id) {
+    struct session_shard_t *shard;
+    uint64_t hash;
+    int32_t index;
+
+    if (session_id == NULL) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    hash = hash_session(session_id);
+    shard = lock_shard(hash);
+    index = find_entry(shard, hash, session_id);
+    if (index != NIL) {
+        remove_entry(shard, index);
+        shard->closed++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return (index != NIL) ? RKE_SUCCESS : RKE_ERROR_SESSION_EXPIRED;
+}
+
+int rke_session_expire(void) {
+    uint32_t now = clock_now();
+    int expired = 0;
+
+    pthread_once(&session_once, init_sessions);
+    for (int i = 0; i < RKE_SESSION_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        expired += advance_shard(&shards[i], now);
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+
+    return expired;
+}
+
+/*
+ * Resize the table to hold about capacity sessions, dropping its contents and counters
+ */
+int rke_session_set_capacity(size_t capacity) {
+    if (capacity > (size_t)INT32_MAX / 2) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    pthread_once(&session_once, init_sessions);
+    for (int i = 0; i < RKE_SESSION_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+    }
+
+    total_capacity = capacity;
+    for (int i = 0; i < RKE_SESSION_SHARDS; i++) {
+        setup_shard(&shards[i], shard_limit(i));
+    }
+
+    for (int i = RKE_SESSION_SHARDS - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+
+    return RKE_SUCCESS;
+}
+
+/*
+ * Replace the time source; the wheels restart from its current second, so every session is dropped
+ */
+void rke_session_set_clock(uint32_t (*clock)(void)) {
+    __atomic_store_n(&session_clock, clock, __ATOMIC_RELEASE);
+    rke_session_set_capacity(total_capacity);
+}
+
+uint32_t rke_session_now(void) {
+    return clock_now();
+}
+
+/*
+ * Sum the counters of every shard
+ */
+void rke_session_get_stats(struct rke_session_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_once(&session_once, init_sessions);
+    for (int i = 0; i < RKE_SESSION_SHARDS; i++) {
+        struct session_shard_t *shard = &shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        stats->opened += shard->opened;
+        stats->closed += shard->closed;
+        stats->expired += shard->expired;
+        stats->rejected += shard->rejected;
+        stats->active += (size_t)shard->count;
+        stats->capacity += (size_t)shard->limit;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
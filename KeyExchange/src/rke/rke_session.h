@@ -0,0 +1,54 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_session.h
+#   Last Modified : 2024-07-20
+#   Describe      : Bounded, lock-striped table of live RKE sessions with timer-wheel expiry
+#
+# ====================================================*/
+
+#ifndef RKE_SESSION_H
+#define RKE_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rke.h"
+
+#define RKE_SESSION_SHARDS 64
+#define RKE_SESSION_DEFAULT_CAPACITY 262144
+#define RKE_SESSION_DEFAULT_TIMEOUT 3600          // Seconds
+#define RKE_SESSION_MAX_TIMEOUT (64 * 64 * 64 - 1) // Longest timeout the wheel holds (about 3 days)
+
+// Session table counters, summed over all shards
+struct rke_session_stats_t {
+    uint64_t opened;
+    uint64_t closed;
+    uint64_t expired;
+    uint64_t rejected;      // Opens refused because the shard was full
+    size_t active;
+    size_t capacity;
+};
+
+// Register a copy of a session under its session_id, expiring at session->timeout
+// (a second of the session clock, at most RKE_SESSION_MAX_TIMEOUT ahead)
+// Returns RKE_ERROR_SESSION_LIMIT when the table is full
+int rke_session_insert(const struct rke_session_t *session);
+
+// Copy out or update a live session; RKE_ERROR_SESSION_EXPIRED when it is unknown or has expired
+int rke_session_lookup(const unsigned char *session_id, struct rke_session_t *session);
+int rke_session_set_state(const unsigned char *session_id, uint8_t state);
+int rke_session_remove(const unsigned char *session_id);
+
+// Expire every session that is due in all shards; returns the number expired
+// Shards also expire lazily whenever they are touched
+int rke_session_expire(void);
+
+// Management (changing the capacity or the clock drops every session and counter)
+int rke_session_set_capacity(size_t capacity);
+void rke_session_set_clock(uint32_t (*clock)(void));    // NULL - time(NULL)
+uint32_t rke_session_now(void);
+void rke_session_get_stats(struct rke_session_stats_t *stats);
+
+#endif // RKE_SESSION_H
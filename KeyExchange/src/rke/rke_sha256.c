@@ -0,0 +1,411 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_sha256.c
+#   Last Modified : 2024-07-20
+#   Describe      : SHA-256 single-buffer backends (SHA-NI, scalar) and backend dispatch
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RKE_SHA256_X86 1
+#include <immintrin.h>
+#endif
+
+#include "rke_sha256.h"
+
+// Single-buffer compression function and multi-buffer policy of a backend
+struct sha256_backend_t {
+    const char *name;
+    void (*compress)(uint32_t *state, const unsigned char *data, size_t blocks);
+    int use_x8;
+};
+
+// SHA-256 constants
+const uint32_t rke_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t rke_sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const struct sha256_backend_t *active_backend = NULL;
+
+static uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static uint32_t ch(uint32_t x, uint32_t y, uint32_t z) {
+    return (x & y) ^ (~x & z);
+}
+
+static uint32_t maj(uint32_t x, uint32_t y, uint32_t z) {
+    return (x & y) ^ (x & z) ^ (y & z);
+}
+
+static uint32_t ep0(uint32_t x) {
+    return rotr(x, 2) ^ rotr(x, 13) ^ rotr(x, 22);
+}
+
+static uint32_t ep1(uint32_t x) {
+    return rotr(x, 6) ^ rotr(x, 11) ^ rotr(x, 25);
+}
+
+static uint32_t sig0(uint32_t x) {
+    return rotr(x, 7) ^ rotr(x, 18) ^ (x >> 3);
+}
+
+static uint32_t sig1(uint32_t x) {
+    return rotr(x, 17) ^ rotr(x, 19) ^ (x >> 10);
+}
+
+/*
+ * Portable compression of whole 64-byte blocks
+ */
+static void compress_scalar(uint32_t *h, const unsigned char *data, size_t blocks) {
+    for (size_t chunk = 0; chunk < blocks; chunk++, data += RKE_SHA256_BLOCK_SIZE) {
+        uint32_t w[64];
+        
+        // Prepare message schedule
+        for (int i = 0; i < 16; i++) {
+            w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+                   ((uint32_t)data[i * 4 + 2] << 8) | data[i * 4 + 3];
+        }
+        
+        for (int i = 16; i < 64; i++) {
+            w[i] = sig1(w[i - 2]) + w[i - 7] + sig0(w[i - 15]) + w[i - 16];
+        }
+        
+        // Initialize working variables
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        uint32_t e = h[4], f = h[5], g = h[6], h_var = h[7];
+        
+        // Main loop
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h_var + ep1(e) + ch(e, f, g) + rke_sha256_k[i] + w[i];
+            uint32_t t2 = ep0(a) + maj(a, b, c);
+            h_var = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        
+        // Update hash values
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += h_var;
+    }
+}
+
+#ifdef RKE_SHA256_X86
+/*
+ * Four rounds of the Intel SHA extensions pipeline
+ * Group g uses schedule words m[g % 4]; the next words are derived with msg2/msg1
+ * Reason: msg2 must run before msg1 - it still reads the slot msg1 overwrites
+ */
+#define SHANI_ROUNDS(g) do { \
+    msg = _mm_add_epi32(m[(g) % 4], _mm_loadu_si128((const __m128i *)&rke_sha256_k[(g) * 4])); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    if ((g) >= 3 && (g) <= 14) { \
+        tmp = _mm_alignr_epi8(m[(g) % 4], m[((g) + 3) % 4], 4); \
+        m[((g) + 1) % 4] = _mm_add_epi32(m[((g) + 1) % 4], tmp); \
+        m[((g) + 1) % 4] = _mm_sha256msg2_epu32(m[((g) + 1) % 4], m[(g) % 4]); \
+    } \
+    msg = _mm_shuffle_epi32(msg, 0x0E); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+    if ((g) >= 1 && (g) <= 12) { \
+        m[((g) + 3) % 4] = _mm_sha256msg1_epu32(m[((g) + 3) % 4], m[(g) % 4]); \
+    } \
+} while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void compress_shani(uint32_t *h, const unsigned char *data, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, msg, tmp, abef_save, cdgh_save;
+    __m128i m[4];
+
+    // Rearrange the state into the ABEF/CDGH layout the instructions expect
+    tmp = _mm_loadu_si128((const __m128i *)&h[0]);
+    state1 = _mm_loadu_si128((const __m128i *)&h[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks > 0; blocks--, data += RKE_SHA256_BLOCK_SIZE) {
+        abef_save = state0;
+        cdgh_save = state1;
+
+        for (int i = 0; i < 4; i++) {
+            m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), mask);
+        }
+
+        SHANI_ROUNDS(0);  SHANI_ROUNDS(1);  SHANI_ROUNDS(2);  SHANI_ROUNDS(3);
+        SHANI_ROUNDS(4);  SHANI_ROUNDS(5);  SHANI_ROUNDS(6);  SHANI_ROUNDS(7);
+        SHANI_ROUNDS(8);  SHANI_ROUNDS(9);  SHANI_ROUNDS(10); SHANI_ROUNDS(11);
+        SHANI_ROUNDS(12); SHANI_ROUNDS(13); SHANI_ROUNDS(14); SHANI_ROUNDS(15);
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128((__m128i *)&h[0], state0);
+    _mm_storeu_si128((__m128i *)&h[4], state1);
+}
+#endif
+
+// Backends in preference order
+// Reason: one SHA-NI stream beats the 8-lane AVX2 kernel per message, so multi-buffer AVX2
+// is only picked on CPUs without the SHA extensions
+static const struct sha256_backend_t backends[] = {
+#ifdef RKE_SHA256_X86
+    { "shani", compress_shani, 0 },
+    { "avx2", compress_scalar, 1 },
+#endif
+    { "scalar", compress_scalar, 0 },
+};
+
+#define SHA256_BACKEND_COUNT ((int)(sizeof(backends) / sizeof(backends[0])))
+
+/*
+ * Check whether the CPU can run the named backend
+ */
+static int backend_supported(const struct sha256_backend_t *backend) {
+#ifdef RKE_SHA256_X86
+    __builtin_cpu_init();
+    if (strcmp(backend->name, "shani") == 0) {
+        return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+    }
+    if (strcmp(backend->name, "avx2") == 0) {
+        return rke_sha256_x8_supported();
+    }
+#endif
+    return strcmp(backend->name, "scalar") == 0;
+}
+
+/*
+ * Pick the fastest backend on first use
+ * Reason: the race on first use is benign - every thread stores the same pointer
+ */
+static const struct sha256_backend_t *get_backend(void) {
+    if (active_backend == NULL) {
+        for (int i = 0; i < SHA256_BACKEND_COUNT; i++) {
+            if (backend_supported(&backends[i])) {
+                active_backend = &backends[i];
+                break;
+            }
+        }
+    }
+
+    return active_backend;
+}
+
+/*
+ * Force a specific backend (used by tests and benchmarks), NULL restores auto-selection
+ */
+int rke_sha256_force_backend(const char *name) {
+    if (name == NULL) {
+        active_backend = NULL;
+        return 0;
+    }
+
+    for (int i = 0; i < SHA256_BACKEND_COUNT; i++) {
+        if (strcmp(backends[i].name, name) == 0 && backend_supported(&backends[i])) {
+            active_backend = &backends[i];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+const char *rke_sha256_backend_name(void) {
+    return get_backend()->name;
+}
+
+static void store_digest(const uint32_t *h, unsigned char *digest) {
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (h[i] >> 24) & 0xff;
+        digest[i * 4 + 1] = (h[i] >> 16) & 0xff;
+        digest[i * 4 + 2] = (h[i] >> 8) & 0xff;
+        digest[i * 4 + 3] = h[i] & 0xff;
+    }
+}
+
+/*
+ * Block number `block` of the padded message prefix || body
+ * Returns a pointer into body when the block lies entirely inside it, otherwise assembles it in scratch
+ */
+const unsigned char *rke_sha256_lane_block(const struct rke_sha256_lane_t *lane, size_t prefix_len,
+                                           size_t body_len, size_t block, unsigned char *scratch) {
+    size_t total = prefix_len + body_len;
+    size_t start = block * RKE_SHA256_BLOCK_SIZE;
+    size_t end = start + RKE_SHA256_BLOCK_SIZE;
+    size_t pos = start;
+    size_t last_block = (total + 8) / RKE_SHA256_BLOCK_SIZE;
+
+    if (start >= prefix_len && end <= total) {
+        return lane->body + (start - prefix_len);
+    }
+
+    memset(scratch, 0, RKE_SHA256_BLOCK_SIZE);
+
+    if (pos < prefix_len) {
+        size_t n = (prefix_len < end ? prefix_len : end) - pos;
+        memcpy(scratch, lane->prefix + pos, n);
+        pos += n;
+    }
+
+    if (pos < total && pos < end) {
+        size_t n = (total < end ? total : end) - pos;
+        memcpy(scratch + (pos - start), lane->body + (pos - prefix_len), n);
+        pos += n;
+    }
+
+    if (total >= start && total < end) {
+        scratch[total - start] = 0x80;
+    }
+
+    // Message length in bits closes the final block
+    if (block == last_block) {
+        uint64_t bit_len = (uint64_t)total * 8;
+        for (int i = 0; i < 8; i++) {
+            scratch[56 + i] = (bit_len >> (56 - i * 8)) & 0xff;
+        }
+    }
+
+    return scratch;
+}
+
+/*
+ * Start an incremental hash
+ */
+void rke_sha256_init(struct rke_sha256_ctx_t *ctx) {
+    memcpy(ctx->state, rke_sha256_iv, sizeof(ctx->state));
+    ctx->length = 0;
+    ctx->buffered = 0;
+}
+
+/*
+ * Feed more message bytes
+ * Whole blocks are compressed straight from the caller's memory; only a partial block is buffered
+ */
+void rke_sha256_update(struct rke_sha256_ctx_t *ctx, const unsigned char *data, size_t len) {
+    const struct sha256_backend_t *backend = get_backend();
+    size_t blocks;
+
+    ctx->length += len;
+
+    if (ctx->buffered > 0) {
+        size_t n = RKE_SHA256_BLOCK_SIZE - ctx->buffered;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(ctx->buffer + ctx->buffered, data, n);
+        ctx->buffered += n;
+        data += n;
+        len -= n;
+
+        if (ctx->buffered < RKE_SHA256_BLOCK_SIZE) {
+            return;
+        }
+
+        backend->compress(ctx->state, ctx->buffer, 1);
+        ctx->buffered = 0;
+    }
+
+    blocks = len / RKE_SHA256_BLOCK_SIZE;
+    if (blocks > 0) {
+        backend->compress(ctx->state, data, blocks);
+        data += blocks * RKE_SHA256_BLOCK_SIZE;
+        len -= blocks * RKE_SHA256_BLOCK_SIZE;
+    }
+
+    if (len > 0) {
+        memcpy(ctx->buffer, data, len);
+        ctx->buffered = len;
+    }
+}
+
+/*
+ * Pad, produce the digest and wipe the context
+ */
+void rke_sha256_final(struct rke_sha256_ctx_t *ctx, unsigned char *digest) {
+    const struct sha256_backend_t *backend = get_backend();
+    uint64_t bit_len = ctx->length * 8;
+
+    ctx->buffer[ctx->buffered++] = 0x80;
+    if (ctx->buffered > RKE_SHA256_BLOCK_SIZE - 8) {
+        memset(ctx->buffer + ctx->buffered, 0, RKE_SHA256_BLOCK_SIZE - ctx->buffered);
+        backend->compress(ctx->state, ctx->buffer, 1);
+        ctx->buffered = 0;
+    }
+
+    memset(ctx->buffer + ctx->buffered, 0, RKE_SHA256_BLOCK_SIZE - 8 - ctx->buffered);
+    for (int i = 0; i < 8; i++) {
+        ctx->buffer[RKE_SHA256_BLOCK_SIZE - 8 + i] = (bit_len >> (56 - i * 8)) & 0xff;
+    }
+    backend->compress(ctx->state, ctx->buffer, 1);
+
+    store_digest(ctx->state, digest);
+    memset(ctx, 0, sizeof(struct rke_sha256_ctx_t));
+}
+
+/*
+ * One-shot SHA-256
+ */
+void rke_sha256(const unsigned char *data, size_t len, unsigned char *digest) {
+    struct rke_sha256_ctx_t ctx;
+
+    rke_sha256_init(&ctx);
+    rke_sha256_update(&ctx, data, len);
+    rke_sha256_final(&ctx, digest);
+}
+
+/*
+ * Hash count messages of identical length in one call
+ * Full groups of RKE_SHA256_LANES go through the AVX2 8-lane kernel when the backend uses it
+ */
+void rke_sha256_multi(const struct rke_sha256_lane_t *lanes, int count, size_t prefix_len, size_t body_len) {
+    const struct sha256_backend_t *backend = get_backend();
+    int i = 0;
+
+    if (backend->use_x8) {
+        for (; i + RKE_SHA256_LANES <= count; i += RKE_SHA256_LANES) {
+            rke_sha256_x8(&lanes[i], prefix_len, body_len);
+        }
+    }
+
+    for (; i < count; i++) {
+        struct rke_sha256_ctx_t ctx;
+
+        rke_sha256_init(&ctx);
+        rke_sha256_update(&ctx, lanes[i].prefix, prefix_len);
+        rke_sha256_update(&ctx, lanes[i].body, body_len);
+        rke_sha256_final(&ctx, lanes[i].digest);
+    }
+}
@@ -0,0 +1,55 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_sha256.h
+#   Last Modified : 2024-07-20
+#   Describe      : SHA-256 with runtime selected SHA-NI, AVX2 multi-buffer and scalar backends
+#
+# ====================================================*/
+
+#ifndef RKE_SHA256_H
+#define RKE_SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RKE_SHA256_DIGEST_SIZE 32
+#define RKE_SHA256_BLOCK_SIZE 64
+#define RKE_SHA256_LANES 8
+
+// Incremental hashing state
+struct rke_sha256_ctx_t {
+    uint32_t state[8];                             // Chaining value
+    uint64_t length;                               // Bytes hashed so far
+    unsigned char buffer[RKE_SHA256_BLOCK_SIZE];   // Pending partial block
+    size_t buffered;                               // Bytes in buffer
+};
+
+// One message of a multi-buffer hash: prefix || body
+struct rke_sha256_lane_t {
+    const unsigned char *prefix;  // First prefix_len bytes of the message
+    const unsigned char *body;    // Next body_len bytes of the message
+    unsigned char *digest;        // Output, RKE_SHA256_DIGEST_SIZE bytes
+};
+
+// Backend internals shared by rke_sha256.c and rke_sha256_x8.c
+extern const uint32_t rke_sha256_k[64];
+extern const uint32_t rke_sha256_iv[8];
+const unsigned char *rke_sha256_lane_block(const struct rke_sha256_lane_t *lane, size_t prefix_len,
+                                           size_t body_len, size_t block, unsigned char *scratch);
+int rke_sha256_x8_supported(void);
+void rke_sha256_x8(const struct rke_sha256_lane_t *lanes, size_t prefix_len, size_t body_len);
+
+// Hashing
+void rke_sha256_init(struct rke_sha256_ctx_t *ctx);
+void rke_sha256_update(struct rke_sha256_ctx_t *ctx, const unsigned char *data, size_t len);
+void rke_sha256_final(struct rke_sha256_ctx_t *ctx, unsigned char *digest);
+void rke_sha256(const unsigned char *data, size_t len, unsigned char *digest);
+void rke_sha256_multi(const struct rke_sha256_lane_t *lanes, int count, size_t prefix_len, size_t body_len);
+
+// Backend selection (shani, avx2, scalar), NULL restores auto-selection
+int rke_sha256_force_backend(const char *name);
+const char *rke_sha256_backend_name(void);
+
+#endif // RKE_SHA256_H
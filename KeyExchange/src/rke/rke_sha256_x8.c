@@ -0,0 +1,174 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_sha256_x8.c
+#   Last Modified : 2024-07-20
+#   Describe      : AVX2 multi-buffer SHA-256 - eight equal-length messages per pass
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RKE_SHA256_X86 1
+#include <immintrin.h>
+#endif
+
+#include "rke_sha256.h"
+
+#ifdef RKE_SHA256_X86
+
+#define ROTR8(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+/*
+ * Transpose eight rows of eight 32-bit words (row i = lane i) so that row j holds word j of every lane
+ */
+__attribute__((target("avx2")))
+static inline void transpose8(__m256i *r) {
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/*
+ * Compress one block of each lane; s[0..7] hold the transposed state a..h
+ */
+__attribute__((target("avx2")))
+static void compress_x8(__m256i *s, const unsigned char *const *blocks) {
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i w[16];
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3];
+    __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+
+    // Load words 0-7 and 8-15 of every lane and turn them into per-word vectors
+    for (int half = 0; half < 2; half++) {
+        for (int lane = 0; lane < RKE_SHA256_LANES; lane++) {
+            w[half * 8 + lane] = _mm256_loadu_si256((const __m256i *)(blocks[lane] + half * 32));
+        }
+        transpose8(&w[half * 8]);
+        for (int i = 0; i < 8; i++) {
+            w[half * 8 + i] = _mm256_shuffle_epi8(w[half * 8 + i], bswap);
+        }
+    }
+
+    for (int t = 0; t < 64; t++) {
+        __m256i t1, t2, wt;
+
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            __m256i w2 = w[(t - 2) & 15];
+            __m256i w15 = w[(t - 15) & 15];
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w2, 17), ROTR8(w2, 19)), _mm256_srli_epi32(w2, 10));
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w15, 7), ROTR8(w15, 18)), _mm256_srli_epi32(w15, 3));
+            wt = _mm256_add_epi32(_mm256_add_epi32(s1, w[(t - 7) & 15]), _mm256_add_epi32(s0, w[t & 15]));
+            w[t & 15] = wt;
+        }
+
+        t1 = _mm256_add_epi32(h, _mm256_xor_si256(_mm256_xor_si256(ROTR8(e, 6), ROTR8(e, 11)), ROTR8(e, 25)));
+        t1 = _mm256_add_epi32(t1, _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)));
+        t1 = _mm256_add_epi32(t1, _mm256_add_epi32(_mm256_set1_epi32((int)rke_sha256_k[t]), wt));
+        t2 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(a, 2), ROTR8(a, 13)), ROTR8(a, 22));
+        t2 = _mm256_add_epi32(t2, _mm256_xor_si256(_mm256_and_si256(a, b),
+                                                   _mm256_and_si256(c, _mm256_xor_si256(a, b))));
+
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+    s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+    s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+    s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+}
+
+__attribute__((target("avx2")))
+static void hash_x8(const struct rke_sha256_lane_t *lanes, size_t prefix_len, size_t body_len) {
+    unsigned char scratch[RKE_SHA256_LANES][RKE_SHA256_BLOCK_SIZE];
+    const unsigned char *blocks[RKE_SHA256_LANES];
+    size_t block_count = (prefix_len + body_len + 8) / RKE_SHA256_BLOCK_SIZE + 1;
+    uint32_t words[RKE_SHA256_LANES];
+    __m256i s[8];
+
+    for (int i = 0; i < 8; i++) {
+        s[i] = _mm256_set1_epi32((int)rke_sha256_iv[i]);
+    }
+
+    for (size_t b = 0; b < block_count; b++) {
+        for (int lane = 0; lane < RKE_SHA256_LANES; lane++) {
+            blocks[lane] = rke_sha256_lane_block(&lanes[lane], prefix_len, body_len, b, scratch[lane]);
+        }
+        compress_x8(s, blocks);
+    }
+
+    // Word i of every lane sits in s[i]
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i *)words, s[i]);
+        for (int lane = 0; lane < RKE_SHA256_LANES; lane++) {
+            unsigned char *digest = lanes[lane].digest + i * 4;
+            digest[0] = (words[lane] >> 24) & 0xff;
+            digest[1] = (words[lane] >> 16) & 0xff;
+            digest[2] = (words[lane] >> 8) & 0xff;
+            digest[3] = words[lane] & 0xff;
+        }
+    }
+}
+
+int rke_sha256_x8_supported(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+/*
+ * Hash exactly RKE_SHA256_LANES messages of identical length
+ */
+void rke_sha256_x8(const struct rke_sha256_lane_t *lanes, size_t prefix_len, size_t body_len) {
+    hash_x8(lanes, prefix_len, body_len);
+}
+
+#else
+
+int rke_sha256_x8_supported(void) {
+    return 0;
+}
+
+void rke_sha256_x8(const struct rke_sha256_lane_t *lanes, size_t prefix_len, size_t body_len) {
+    (void) lanes;
+    (void) prefix_len;
+    (void) body_len;
+}
+
+#endif
@@ -4,10 +4,13 @@
 #   Author        : RKE Implementation Team
 #   File Name     : rke_storage.c
 #   Last Modified : 2024-07-20
-#   Describe      : RKE storage functions - fragment and metadata persistence
+#   Describe      : RKE storage functions - container paths and the read side of packed per-key fragment containers
 #
 # ====================================================*/
 
+// pread/pwrite are POSIX.1-2008, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,207 +23,432 @@
 #include "../common/log.h"
 #include "../common/utils.h"
 #include "rke.h"
+#include "rke_cache.h"
+#include "rke_container.h"
+#include "rke_uring.h"
+
+// Read backend: 1 - containers through io_uring, 0 - open/pread/close (default)
+static int use_uring = 0;
+
+typedef char rke_container_fits_uring_buffer[(RKE_CONTAINER_MAX_SIZE <= RKE_URING_BUFFER_SIZE) ? 1 : -1];
 
 /*
- * Store a key fragment to the filesystem
- * Path pattern: {config.cwd}/RKE/{key_id_prefix}/fragment_{fragment_id}.bin
+ * Select the read backend ("uring" or "posix"), NULL restores the default
+ * Reason: io_uring is opt-in - with containers in the page cache one pread straight into the
+ * caller's array is as fast, the ring pays off when reads actually wait for the device
  */
-int rke_store_fragment(const struct rke_fragment_t *fragment, const unsigned char *key_id) {
-    char fragment_path[4096];
-    char dir_path[4096];
-    int fd, rv;
-    
-    // Validate input parameters
-    if (fragment == NULL || key_id == NULL) {
-        error("Invalid parameters for fragment storage");
-        return RKE_ERROR_INVALID_PARAM;
-    }
-    
-    // Validate fragment structure
-    if (rke_validate_fragment(fragment) != RKE_SUCCESS) {
-        error("Fragment validation failed");
-        return RKE_ERROR_INVALID_PARAM;
+int rke_storage_force_backend(const char *name) {
+    if (name == NULL || strcmp(name, "posix") == 0) {
+        use_uring = 0;
+        return 0;
     }
-    
-    // Create directory path using first 4 bytes of key_id as prefix
-    snprintf(dir_path, sizeof(dir_path), "%s/RKE/%02x%02x%02x%02x", 
-            config.cwd, key_id[0], key_id[1], key_id[2], key_id[3]);
-    
-    // Create directory structure if it doesn't exist
-    if (create_directory_recursive(dir_path) != 0) {
-        error("Failed to create directory %s: %s", dir_path, strerror(errno));
-        return RKE_ERROR_STORAGE_FAIL;
+
+    if (strcmp(name, "uring") == 0 && rke_uring_supported()) {
+        use_uring = 1;
+        return 0;
     }
-    
-    // Construct full file path
-    snprintf(fragment_path, sizeof(fragment_path), "%s/fragment_%03d.bin", dir_path, fragment->fragment_id);
-    
-    debug("Storing fragment %d to %s", fragment->fragment_id, fragment_path);
-    
-    // Open file for writing with secure permissions
-    fd = open(fragment_path, O_CREAT | O_WRONLY | O_TRUNC, 0640);
-    if (fd < 0) {
-        error("Failed to create fragment file %s: %s", fragment_path, strerror(errno));
-        return RKE_ERROR_STORAGE_FAIL;
+
+    return -1;
+}
+
+const char *rke_storage_backend_name(void) {
+    return use_uring ? "uring" : "posix";
+}
+
+/*
+ * Open the container of a key
+ */
+int rke_container_open(const unsigned char *key_id, int flags) {
+    char path[4096];
+
+    rke_storage_open_wal();
+
+    if (rke_container_path(key_id, path, sizeof(path)) != RKE_SUCCESS) {
+        errno = ENAMETOOLONG;
+        return -1;
     }
-    
-    // Write fragment data
-    rv = write(fd, fragment, sizeof(struct rke_fragment_t));
-    close(fd);
-    
-    if (rv != sizeof(struct rke_fragment_t)) {
-        error("Failed to write fragment data: wrote %d, expected %zu", rv, sizeof(struct rke_fragment_t));
+
+    return open(path, flags);
+}
+
+/*
+ * Read and check the container header
+ */
+static int read_header(int fd, struct rke_container_header_t *header) {
+    ssize_t rv = pread(fd, header, sizeof(*header), 0);
+
+    if (rv != (ssize_t)sizeof(*header)) {
+        error("Failed to read container header: read %zd, expected %zu", rv, sizeof(*header));
         return RKE_ERROR_STORAGE_FAIL;
     }
-    
-    debug("Successfully stored fragment %d (%d bytes)", fragment->fragment_id, rv);
-    return RKE_SUCCESS;
+
+    return rke_container_check_header(header);
 }
 
 /*
- * Load a key fragment from the filesystem
+ * Open a key's existing container and load its header
+ * generation is the cache generation taken before the call, for caching a missing container
+ * Returns the descriptor or a negative RKE error code
  */
-int rke_load_fragment(struct rke_fragment_t *fragment, const unsigned char *key_id, uint8_t fragment_id) {
-    char fragment_path[4096];
-    int fd, rv;
-    
-    // Validate input parameters
-    if (fragment == NULL || key_id == NULL || fragment_id == 0) {
-        error("Invalid parameters for fragment loading");
-        return RKE_ERROR_INVALID_PARAM;
-    }
-    
-    // Construct file path
-    snprintf(fragment_path, sizeof(fragment_path), "%s/RKE/%02x%02x%02x%02x/fragment_%03d.bin",
-            config.cwd, key_id[0], key_id[1], key_id[2], key_id[3], fragment_id);
-    
-    debug("Loading fragment %d from %s", fragment_id, fragment_path);
-    
-    // Open file for reading
-    fd = open(fragment_path, O_RDONLY);
+static int open_existing(const unsigned char *key_id, int flags, struct rke_container_header_t *header, int quiet,
+                         uint64_t generation) {
+    int fd = rke_container_open(key_id, flags);
+    int rv;
+
     if (fd < 0) {
-        error("Failed to open fragment file %s: %s", fragment_path, strerror(errno));
+        if (errno == ENOENT) {
+            rke_cache_fill(key_id, generation, NULL, NULL);
+        }
+        if (!quiet) {
+            error("Failed to open container for key %02x%02x%02x%02x: %s",
+                  key_id[0], key_id[1], key_id[2], key_id[3], strerror(errno));
+        }
         return RKE_ERROR_STORAGE_FAIL;
     }
-    
-    // Read fragment data
-    rv = read(fd, fragment, sizeof(struct rke_fragment_t));
-    close(fd);
-    
-    if (rv != sizeof(struct rke_fragment_t)) {
-        error("Failed to read fragment data: read %d, expected %zu", rv, sizeof(struct rke_fragment_t));
-        return RKE_ERROR_STORAGE_FAIL;
+
+    rv = read_header(fd, header);
+    if (rv != RKE_SUCCESS) {
+        close(fd);
+        return rv;
     }
-    
-    // Validate loaded fragment
+
+    return fd;
+}
+
+/*
+ * Check a fragment read from a slot
+ */
+static int check_loaded_fragment(const struct rke_fragment_t *fragment, uint8_t fragment_id) {
     if (rke_validate_fragment(fragment) != RKE_SUCCESS) {
         error("Loaded fragment failed validation");
         return RKE_ERROR_FRAGMENT_CORRUPT;
     }
-    
-    // Verify fragment ID matches
+
     if (fragment->fragment_id != fragment_id) {
         error("Fragment ID mismatch: expected %d, got %d", fragment_id, fragment->fragment_id);
         return RKE_ERROR_FRAGMENT_CORRUPT;
     }
-    
-    debug("Successfully loaded fragment %d (%d bytes)", fragment_id, rv);
+
     return RKE_SUCCESS;
 }
 
 /*
- * Store key metadata to the filesystem
- * Path pattern: {config.cwd}/RKE/{key_id_prefix}/metadata.bin
+ * Copy a fragment out of its container slot and check it
  */
-int rke_store_metadata(const struct rke_key_metadata_t *metadata) {
-    char metadata_path[4096];
-    char dir_path[4096];
-    int fd, rv;
-    
+static int unpack_slot(struct rke_fragment_t *fragment, const unsigned char *slot,
+                       const struct rke_container_header_t *header, uint8_t fragment_id) {
+    if (rke_fragment_unpack(fragment, slot, header->slot_size) < 0) {
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+
+    return check_loaded_fragment(fragment, fragment_id);
+}
+
+/*
+ * Read the first length bytes of a container through io_uring; *image then points into the
+ * thread's fixed buffer. Returns the bytes read, a negative RKE error code, or 0 when this
+ * thread has no ring
+ */
+static ssize_t read_image_uring(const unsigned char *key_id, size_t length,
+                                struct rke_container_header_t *header, const unsigned char **image) {
+    uint64_t generation = rke_cache_generation(key_id);
+    char path[4096];
+    ssize_t rv;
+
+    rke_storage_open_wal();
+    if (rke_container_path(key_id, path, sizeof(path)) != RKE_SUCCESS) {
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    rv = rke_uring_read_file(path, length, image);
+    if (rv == -ENOSYS) {
+        return 0;
+    }
+
+    if (rv < 0) {
+        if (rv == -ENOENT) {
+            rke_cache_fill(key_id, generation, NULL, NULL);
+        }
+        error("Failed to read container for key %02x%02x%02x%02x: %s",
+              key_id[0], key_id[1], key_id[2], key_id[3], strerror((int)-rv));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    if (rv < (ssize_t)sizeof(*header)) {
+        error("Failed to read container header: read %zd, expected %zu", rv, sizeof(*header));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    memcpy(header, *image, sizeof(*header));
+    if (rke_container_check_header(header) != RKE_SUCCESS) {
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+
+    return rv;
+}
+
+/*
+ * Load up to max_fragments present fragments of a key in ascending id order
+ * Returns the number loaded or a negative error code; metadata is filled in when not NULL
+ */
+int rke_load_fragments(const unsigned char *key_id, struct rke_key_metadata_t *metadata,
+                       struct rke_fragment_t *fragments, int max_fragments) {
+    struct rke_container_header_t header;
+    unsigned char *slots = (unsigned char *)fragments;
+    const unsigned char *image = NULL;
+    ssize_t image_length = 0;
+    int last_id = 0, loaded = 0;
+    int fd = -1, rv = RKE_SUCCESS;
+    size_t length, request = 0;
+
     // Validate input parameters
-    if (metadata == NULL) {
-        error("Invalid parameters for metadata storage");
+    if (key_id == NULL || fragments == NULL || max_fragments <= 0) {
+        error("Invalid parameters for fragment loading");
         return RKE_ERROR_INVALID_PARAM;
     }
-    
-    // Create directory path using first 4 bytes of key_id as prefix
-    snprintf(dir_path, sizeof(dir_path), "%s/RKE/%02x%02x%02x%02x", 
-            config.cwd, metadata->key_id[0], metadata->key_id[1], 
-            metadata->key_id[2], metadata->key_id[3]);
-    
-    // Create directory structure if it doesn't exist
-    if (create_directory_recursive(dir_path) != 0) {
-        error("Failed to create directory %s: %s", dir_path, strerror(errno));
-        return RKE_ERROR_STORAGE_FAIL;
+
+    // Without holes the first max_fragments slots are all that is needed
+    if (use_uring) {
+        request = (max_fragments < RKE_MAX_FRAGMENTS) ?
+                  (size_t)SLOT_OFFSET(max_fragments + 1, RKE_CONTAINER_MAX_SLOT_SIZE) : RKE_CONTAINER_MAX_SIZE;
+        image_length = read_image_uring(key_id, request, &header, &image);
+        if (image_length < 0) {
+            return (int)image_length;
+        }
+    }
+
+    if (image_length == 0) {
+        fd = open_existing(key_id, O_RDONLY, &header, 0, rke_cache_generation(key_id));
+        if (fd < 0) {
+            return fd;
+        }
+    }
+
+    if (metadata != NULL) {
+        if (!header.has_metadata) {
+            error("No metadata stored for key");
+            if (fd >= 0) {
+                close(fd);
+            }
+            return RKE_ERROR_STORAGE_FAIL;
+        }
+        memcpy(metadata, &header.metadata, sizeof(*metadata));
+    }
+
+    for (int id = 1; id <= RKE_MAX_FRAGMENTS && loaded < max_fragments; id++) {
+        if (RKE_BITMAP_TEST(header.presence, id)) {
+            last_id = id;
+            loaded++;
+        }
+    }
+
+    if (loaded == 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+
+    // A sparse container needs a second, full read
+    if (image_length > 0 && image_length == (ssize_t)request &&
+        (size_t)SLOT_OFFSET(last_id + 1, header.slot_size) > request) {
+        image_length = read_image_uring(key_id, RKE_CONTAINER_MAX_SIZE, &header, &image);
+        if (image_length <= 0) {
+            return (image_length < 0) ? (int)image_length : RKE_ERROR_STORAGE_FAIL;
+        }
+    }
+
+    if (image_length > 0) {
+        if ((ssize_t)SLOT_OFFSET(last_id + 1, header.slot_size) > image_length) {
+            error("Container truncated: read %zd bytes, fragment %d needs %zu", image_length, last_id,
+                  (size_t)SLOT_OFFSET(last_id + 1, header.slot_size));
+            return RKE_ERROR_STORAGE_FAIL;
+        }
+
+        loaded = 0;
+        for (int id = 1; id <= last_id && rv == RKE_SUCCESS; id++) {
+            if (RKE_BITMAP_TEST(header.presence, id)) {
+                rv = unpack_slot(&fragments[loaded], image + SLOT_OFFSET(id, header.slot_size), &header, (uint8_t)id);
+                loaded++;
+            }
+        }
+
+        if (rv != RKE_SUCCESS) {
+            return rv;
+        }
+
+        debug("Loaded %d fragments", loaded);
+        return loaded;
+    }
+
+    // Slots 1..last_id are read at once, straight into the caller's array when every fragment
+    // moves towards the front (full-size slots) or when smaller slots have no holes between them
+    if (last_id > max_fragments || (header.slot_size != sizeof(struct rke_fragment_t) && loaded != last_id)) {
+        slots = (unsigned char *) malloc((size_t)last_id * header.slot_size);
+        if (slots == NULL) {
+            close(fd);
+            return RKE_ERROR_MEMORY_ALLOC;
+        }
+    }
+
+    length = (size_t)last_id * header.slot_size;
+    rv = (int)pread(fd, slots, length, SLOT_OFFSET(1, header.slot_size));
+    close(fd);
+
+    if (rv != (int)length) {
+        error("Failed to read fragment slots: read %d, expected %zu", rv, length);
+        rv = RKE_ERROR_STORAGE_FAIL;
+    } else if (slots == (unsigned char *)fragments && header.slot_size != sizeof(struct rke_fragment_t)) {
+        // Reason: fragment N moves from (N - 1) * slot_size up to (N - 1) * sizeof, so spread from the back
+        rv = RKE_SUCCESS;
+        for (int id = last_id; id >= 1 && rv == RKE_SUCCESS; id--) {
+            rv = unpack_slot(&fragments[id - 1], slots + (size_t)(id - 1) * header.slot_size, &header, (uint8_t)id);
+        }
+    } else {
+        loaded = 0;
+        rv = RKE_SUCCESS;
+        for (int id = 1; id <= last_id && rv == RKE_SUCCESS; id++) {
+            if (RKE_BITMAP_TEST(header.presence, id)) {
+                rv = unpack_slot(&fragments[loaded], slots + (size_t)(id - 1) * header.slot_size, &header, (uint8_t)id);
+                loaded++;
+            }
+        }
+    }
+
+    if (slots != (unsigned char *)fragments) {
+        memset(slots, 0, length);
+        free(slots);
+    }
+
+    if (rv != RKE_SUCCESS) {
+        return rv;
+    }
+
+    debug("Loaded %d fragments", loaded);
+    return loaded;
+}
+
+/*
+ * Load a key fragment from the key's container
+ */
+int rke_load_fragment(struct rke_fragment_t *fragment, const unsigned char *key_id, uint8_t fragment_id) {
+    struct rke_container_header_t header;
+    int fd, rv;
+
+    // Validate input parameters
+    if (fragment == NULL || key_id == NULL || fragment_id == 0) {
+        error("Invalid parameters for fragment loading");
+        return RKE_ERROR_INVALID_PARAM;
     }
-    
-    // Construct full file path
-    snprintf(metadata_path, sizeof(metadata_path), "%s/metadata.bin", dir_path);
-    
-    debug("Storing metadata to %s", metadata_path);
-    
-    // Open file for writing with secure permissions
-    fd = open(metadata_path, O_CREAT | O_WRONLY | O_TRUNC, 0640);
+
+    fd = open_existing(key_id, O_RDONLY, &header, 0, rke_cache_generation(key_id));
     if (fd < 0) {
-        error("Failed to create metadata file %s: %s", metadata_path, strerror(errno));
+        return fd;
+    }
+
+    if (header.offsets[fragment_id - 1] == 0) {
+        error("Fragment %d not stored", fragment_id);
+        close(fd);
         return RKE_ERROR_STORAGE_FAIL;
     }
-    
-    // Write metadata
-    rv = write(fd, metadata, sizeof(struct rke_key_metadata_t));
+
+    // Read fragment data
+    rv = (int)pread(fd, fragment, header.slot_size, header.offsets[fragment_id - 1]);
     close(fd);
-    
-    if (rv != sizeof(struct rke_key_metadata_t)) {
-        error("Failed to write metadata: wrote %d, expected %zu", rv, sizeof(struct rke_key_metadata_t));
+
+    if (rv != header.slot_size) {
+        error("Failed to read fragment data: read %d, expected %d", rv, header.slot_size);
         return RKE_ERROR_STORAGE_FAIL;
     }
-    
-    debug("Successfully stored metadata (%d bytes)", rv);
+
+    rv = unpack_slot(fragment, (const unsigned char *)fragment, &header, fragment_id);
+    if (rv != RKE_SUCCESS) {
+        return rv;
+    }
+
+    debug("Successfully loaded fragment %d (%d bytes)", fragment_id, header.slot_size);
     return RKE_SUCCESS;
 }
 
 /*
- * Load key metadata from the filesystem
+ * Load key metadata from the key's container header
  */
 int rke_load_metadata(struct rke_key_metadata_t *metadata, const unsigned char *key_id) {
-    char metadata_path[4096];
-    int fd, rv;
-    
+    struct rke_container_header_t header;
+    uint64_t generation;
+    int fd;
+
     // Validate input parameters
     if (metadata == NULL || key_id == NULL) {
         error("Invalid parameters for metadata loading");
         return RKE_ERROR_INVALID_PARAM;
     }
-    
-    // Construct file path
-    snprintf(metadata_path, sizeof(metadata_path), "%s/RKE/%02x%02x%02x%02x/metadata.bin",
-            config.cwd, key_id[0], key_id[1], key_id[2], key_id[3]);
-    
-    debug("Loading metadata from %s", metadata_path);
-    
-    // Open file for reading
-    fd = open(metadata_path, O_RDONLY);
-    if (fd < 0) {
-        error("Failed to open metadata file %s: %s", metadata_path, strerror(errno));
+
+    switch (rke_cache_lookup_metadata(key_id, metadata)) {
+    case RKE_CACHE_HIT:
+        return RKE_SUCCESS;
+    case RKE_CACHE_ABSENT:
+        error("No container stored for key");
         return RKE_ERROR_STORAGE_FAIL;
+    default:
+        break;
+    }
+
+    generation = rke_cache_generation(key_id);
+    fd = open_existing(key_id, O_RDONLY, &header, 0, generation);
+    if (fd < 0) {
+        return fd;
     }
-    
-    // Read metadata
-    rv = read(fd, metadata, sizeof(struct rke_key_metadata_t));
     close(fd);
-    
-    if (rv != sizeof(struct rke_key_metadata_t)) {
-        error("Failed to read metadata: read %d, expected %zu", rv, sizeof(struct rke_key_metadata_t));
+
+    if (!header.has_metadata) {
+        error("No metadata stored for key");
         return RKE_ERROR_STORAGE_FAIL;
     }
-    
+
     // Verify key_id matches
-    if (memcmp(metadata->key_id, key_id, RKE_KEY_ID_SIZE) != 0) {
+    if (memcmp(header.metadata.key_id, key_id, RKE_KEY_ID_SIZE) != 0) {
         error("Key ID mismatch in loaded metadata");
         return RKE_ERROR_FRAGMENT_CORRUPT;
     }
-    
-    debug("Successfully loaded metadata (%d bytes)", rv);
+
+    memcpy(metadata, &header.metadata, sizeof(*metadata));
+    rke_cache_fill(key_id, generation, header.presence, metadata);
+
+    debug("Successfully loaded metadata (%zu bytes)", sizeof(*metadata));
+    return RKE_SUCCESS;
+}
+
+/*
+ * Get the presence bitmap of a key, from the cache when possible
+ */
+int rke_fragment_bitmap(const unsigned char *key_id, unsigned char *bitmap) {
+    struct rke_container_header_t header;
+    uint64_t generation;
+    int fd;
+
+    if (key_id == NULL || bitmap == NULL) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    switch (rke_cache_lookup(key_id, bitmap)) {
+    case RKE_CACHE_HIT:
+        return RKE_SUCCESS;
+    case RKE_CACHE_ABSENT:
+        return RKE_ERROR_STORAGE_FAIL;
+    default:
+        break;
+    }
+
+    generation = rke_cache_generation(key_id);
+    fd = open_existing(key_id, O_RDONLY, &header, 1, generation);
+    if (fd < 0) {
+        return fd;
+    }
+    close(fd);
+
+    memcpy(bitmap, header.presence, RKE_FRAGMENT_BITMAP_SIZE);
+    rke_cache_fill(key_id, generation, header.presence, header.has_metadata ? &header.metadata : NULL);
     return RKE_SUCCESS;
 }
 
@@ -228,35 +456,31 @@ int rke_load_metadata(struct rke_key_metadata_t *metadata, const unsigned char *
  * Check if a fragment exists in storage
  */
 int rke_fragment_exists(const unsigned char *key_id, uint8_t fragment_id) {
-    char fragment_path[4096];
-    
+    unsigned char bitmap[RKE_FRAGMENT_BITMAP_SIZE];
+
     if (key_id == NULL || fragment_id == 0) {
         return 0;
     }
-    
-    snprintf(fragment_path, sizeof(fragment_path), "%s/RKE/%02x%02x%02x%02x/fragment_%03d.bin",
-            config.cwd, key_id[0], key_id[1], key_id[2], key_id[3], fragment_id);
-    
-    return (access(fragment_path, F_OK) == 0) ? 1 : 0;
+
+    if (rke_fragment_bitmap(key_id, bitmap) != RKE_SUCCESS) {
+        return 0;
+    }
+
+    return RKE_BITMAP_TEST(bitmap, fragment_id);
 }
 
 /*
  * Count available fragments for a key
  */
 int rke_count_fragments(const unsigned char *key_id) {
-    int count = 0;
-    
-    if (key_id == NULL) {
+    unsigned char bitmap[RKE_FRAGMENT_BITMAP_SIZE];
+    int count;
+
+    if (key_id == NULL || rke_fragment_bitmap(key_id, bitmap) != RKE_SUCCESS) {
         return 0;
     }
-    
-    // Check fragments 1-255
-    for (int i = 1; i <= 255; i++) {
-        if (rke_fragment_exists(key_id, i)) {
-            count++;
-        }
-    }
-    
+
+    count = rke_bitmap_count(bitmap);
     debug("Found %d fragments for key", count);
     return count;
-}
\ No newline at end of file
+}
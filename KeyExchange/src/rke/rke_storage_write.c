@@ -0,0 +1,487 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_storage_write.c
+#   Last Modified : 2024-07-20
+#   Describe      : RKE storage functions - crash-consistent container updates through the WAL
+#
+# ====================================================*/
+
+// pread is POSIX.1-2008, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../common/log.h"
+#include "../common/utils.h"
+#include "rke.h"
+#include "rke_cache.h"
+#include "rke_container.h"
+#include "rke_mmap.h"
+#include "rke_wal.h"
+
+#define RKE_KEY_LOCK_STRIPES 64
+
+// How store_key treats what the container already holds
+#define STORE_MERGE   0     // Keep it, adding to or overwriting it
+#define STORE_REPLACE 1     // Drop it, slot size included
+#define STORE_CREATE  2     // Refuse with RKE_ERROR_KEY_EXISTS unless it holds nothing
+
+// Writers of one key are serialized by its stripe; readers never lock since containers are replaced by
+// rename or only gain slots in place (rke_container.h)
+static pthread_mutex_t key_locks[RKE_KEY_LOCK_STRIPES];
+static pthread_once_t key_locks_once = PTHREAD_ONCE_INIT;
+
+static void init_key_locks(void) {
+    for (int i = 0; i < RKE_KEY_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&key_locks[i], NULL);
+    }
+}
+
+static pthread_mutex_t *key_lock(const unsigned char *key_id) {
+    pthread_once(&key_locks_once, init_key_locks);
+    return &key_locks[rke_container_hash(key_id) % RKE_KEY_LOCK_STRIPES];
+}
+
+static int apply_update(const unsigned char *key_id, const struct rke_wal_write_t *writes, int count);
+
+/*
+ * Open the WAL on first use, replaying whatever a crash left in it
+ */
+void rke_storage_open_wal(void) {
+    if (!rke_wal_is_open() && rke_wal_open(apply_update) != RKE_SUCCESS) {
+        error("Storage WAL unavailable, container updates will fail");
+    }
+}
+
+static void init_header(struct rke_container_header_t *header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, RKE_CONTAINER_MAGIC, sizeof(header->magic));
+    header->version = RKE_CONTAINER_VERSION;
+    header->slot_size = RKE_CONTAINER_MIN_SLOT_SIZE;
+}
+
+/*
+ * Make the container's slots fit the fragments about to be stored
+ * Slots only change size while no fragment is stored; a larger fragment is refused otherwise
+ */
+static int fit_slots(struct rke_container_header_t *header, const struct rke_fragment_t *fragments, int count) {
+    size_t need = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (RKE_FRAGMENT_WIRE_SIZE(fragments[i].fragment_size) > need) {
+            need = RKE_FRAGMENT_WIRE_SIZE(fragments[i].fragment_size);
+        }
+    }
+
+    if (need <= header->slot_size) {
+        return RKE_SUCCESS;
+    }
+
+    if (rke_bitmap_count(header->presence) != 0) {
+        error("Fragment of %zu bytes does not fit the container's %d-byte slots", need, header->slot_size);
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    header->slot_size = (uint16_t)need;
+    return RKE_SUCCESS;
+}
+
+/*
+ * Read just the header of a key's container
+ * A missing container yields an empty header with *exists cleared
+ */
+static int load_header(const unsigned char *key_id, struct rke_container_header_t *header, int *exists) {
+    ssize_t rv;
+    int fd = rke_container_open(key_id, O_RDONLY);
+
+    *exists = (fd >= 0);
+    if (fd < 0 && errno == ENOENT) {
+        init_header(header);
+        return RKE_SUCCESS;
+    } else if (fd < 0) {
+        error("Failed to open container for key %02x%02x%02x%02x: %s",
+              key_id[0], key_id[1], key_id[2], key_id[3], strerror(errno));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    rv = pread(fd, header, sizeof(*header), 0);
+    close(fd);
+
+    if (rv != (ssize_t)sizeof(*header)) {
+        error("Failed to read container header: read %zd, expected %zu", rv, sizeof(*header));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    return (rke_container_check_header(header) == RKE_SUCCESS) ? RKE_SUCCESS : RKE_ERROR_FRAGMENT_CORRUPT;
+}
+
+/*
+ * Read an existing container into image (RKE_CONTAINER_MAX_SIZE bytes) for a read-modify-write
+ * Bytes past the end of the file read as zero
+ */
+static int load_image(const unsigned char *key_id, unsigned char *image, size_t *length) {
+    struct rke_container_header_t header;
+    ssize_t rv;
+    int fd = rke_container_open(key_id, O_RDONLY);
+
+    if (fd < 0) {
+        error("Failed to open container for key %02x%02x%02x%02x: %s",
+              key_id[0], key_id[1], key_id[2], key_id[3], strerror(errno));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    rv = pread(fd, image, RKE_CONTAINER_MAX_SIZE, 0);
+    close(fd);
+
+    if (rv < (ssize_t)sizeof(header)) {
+        error("Failed to read container: read %zd, expected at least %zu", rv, sizeof(header));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    memcpy(&header, image, sizeof(header));
+    if (rke_container_check_header(&header) != RKE_SUCCESS) {
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+
+    memset(image + rv, 0, RKE_CONTAINER_MAX_SIZE - (size_t)rv);
+    *length = ((size_t)rv > RKE_CONTAINER_HEADER_SIZE) ? (size_t)rv : RKE_CONTAINER_HEADER_SIZE;
+    return RKE_SUCCESS;
+}
+
+static int apply_writes(const unsigned char *key_id, const struct rke_wal_write_t *writes, int count) {
+    if (writes[0].offset == RKE_WAL_IMAGE) {
+        return rke_container_replace(key_id, writes[0].data, writes[0].length);
+    }
+
+    return rke_container_write_slots(key_id, writes, count);
+}
+
+/*
+ * Write a new header through to the in-memory cache once its container is in place
+ */
+static void cache_header(const unsigned char *key_id, const struct rke_container_header_t *header) {
+    rke_cache_update(key_id, header->presence, header->has_metadata ? &header->metadata : NULL);
+}
+
+/*
+ * Apply an update replayed from the WAL
+ * Every update ends with the container's new header: a whole image, or the header written in place
+ */
+static int apply_update(const unsigned char *key_id, const struct rke_wal_write_t *writes, int count) {
+    const struct rke_wal_write_t *last = &writes[count - 1];
+    struct rke_container_header_t header;
+    int rv;
+
+    for (int i = 0; i < count; i++) {
+        if (writes[i].offset != RKE_WAL_IMAGE && (size_t)writes[i].offset + writes[i].length > RKE_CONTAINER_MAX_SIZE) {
+            error("Container write of %u bytes at %u out of range", writes[i].length, writes[i].offset);
+            return RKE_ERROR_FRAGMENT_CORRUPT;
+        }
+    }
+
+    if (last->length < sizeof(header) || last->length > RKE_CONTAINER_MAX_SIZE ||
+        (last->offset != RKE_WAL_IMAGE && (last->offset != 0 || last->length != sizeof(header)))) {
+        error("Invalid container update of %u bytes at %u", last->length, last->offset);
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+
+    memcpy(&header, last->data, sizeof(header));
+    if (rke_container_check_header(&header) != RKE_SUCCESS) {
+        return RKE_ERROR_FRAGMENT_CORRUPT;
+    }
+
+    rv = apply_writes(key_id, writes, count);
+    rke_mmap_invalidate(key_id);
+    if (rv == RKE_SUCCESS) {
+        cache_header(key_id, &header);
+    }
+    return rv;
+}
+
+/*
+ * Make an update durable in the WAL, then apply it; called with the key locked
+ * A failed write fails the update: the WAL logs it as aborted and the old container stays current
+ */
+static int commit_update(const unsigned char *key_id, const struct rke_wal_write_t *writes, int count,
+                         const struct rke_container_header_t *header) {
+    int rv;
+
+    rke_storage_open_wal();
+    rv = rke_wal_commit(key_id, writes, count);
+    if (rv != RKE_SUCCESS) {
+        return rv;
+    }
+
+    rv = apply_writes(key_id, writes, count);
+    rke_wal_applied(key_id, rv);
+    rke_mmap_invalidate(key_id);
+
+    if (rv == RKE_SUCCESS) {
+        cache_header(key_id, header);
+    }
+    return rv;
+}
+
+static int commit_image(const unsigned char *key_id, const unsigned char *image, size_t length) {
+    struct rke_wal_write_t write = {RKE_WAL_IMAGE, (uint32_t)length, image};
+
+    return commit_update(key_id, &write, 1, (const struct rke_container_header_t *)image);
+}
+
+/*
+ * Check that none of the fragments would overwrite one the container lists
+ */
+static int slots_free(const struct rke_container_header_t *header, const struct rke_fragment_t *fragments, int count) {
+    for (int i = 0; i < count; i++) {
+        if (RKE_BITMAP_TEST(header->presence, fragments[i].fragment_id)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Store fragments and/or metadata of one key as one container update
+ * A new key is written as a whole container; when merging, fragments going into free slots are
+ * written in place with the header
+ */
+static int store_key(const unsigned char *key_id, const struct rke_key_metadata_t *metadata,
+                     const struct rke_fragment_t *fragments, int count, int mode) {
+    struct rke_wal_write_t writes[RKE_WAL_MAX_WRITES];
+    struct rke_container_header_t *header;
+    pthread_mutex_t *lock;
+    unsigned char *image;
+    size_t length = RKE_CONTAINER_HEADER_SIZE;
+    int exists = 0, in_place, written = 0, rv = RKE_SUCCESS;
+
+    // Validate input parameters
+    if (key_id == NULL || count < 0 || count > RKE_MAX_FRAGMENTS || (count > 0 && fragments == NULL)) {
+        error("Invalid parameters for fragment storage");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    if (metadata != NULL && memcmp(metadata->key_id, key_id, RKE_KEY_ID_SIZE) != 0) {
+        error("Metadata belongs to a different key");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (rke_validate_fragment(&fragments[i]) != RKE_SUCCESS) {
+            error("Fragment validation failed");
+            return RKE_ERROR_INVALID_PARAM;
+        }
+    }
+
+    image = (unsigned char *) malloc(RKE_CONTAINER_MAX_SIZE);
+    if (image == NULL) {
+        error("Can't alloc container image");
+        return RKE_ERROR_MEMORY_ALLOC;
+    }
+    header = (struct rke_container_header_t *)image;
+
+    lock = key_lock(key_id);
+    pthread_mutex_lock(lock);
+
+    if (mode != STORE_REPLACE) {
+        rv = load_header(key_id, header, &exists);
+    }
+    if (rv == RKE_SUCCESS && mode == STORE_CREATE &&
+        (header->has_metadata || rke_bitmap_count(header->presence) != 0)) {
+        error("Key %02x%02x%02x%02x is already stored", key_id[0], key_id[1], key_id[2], key_id[3]);
+        rv = RKE_ERROR_KEY_EXISTS;
+    }
+    if (mode != STORE_MERGE) {
+        init_header(header);
+        exists = 0;
+    }
+
+    // Only a fragment that replaces a stored one needs the rest of the container
+    in_place = exists && slots_free(header, fragments, count);
+    if (rv == RKE_SUCCESS && exists && !in_place) {
+        rv = load_image(key_id, image, &length);
+    } else if (rv == RKE_SUCCESS && !in_place) {
+        memset(image + sizeof(*header), 0, RKE_CONTAINER_MAX_SIZE - sizeof(*header));
+    }
+    if (rv == RKE_SUCCESS) {
+        rv = fit_slots(header, fragments, count);
+    }
+    if (rv == RKE_SUCCESS) {
+        for (int i = 0; i < count; i++) {
+            uint8_t id = fragments[i].fragment_id;
+            uint32_t offset = (uint32_t)SLOT_OFFSET(id, header->slot_size);
+            unsigned char *slot = image + offset;
+            size_t used = RKE_FRAGMENT_WIRE_SIZE(fragments[i].fragment_size);
+
+            memcpy(slot, &fragments[i], used);
+            memset(slot + used, 0, header->slot_size - used);
+            header->offsets[id - 1] = offset;
+            RKE_BITMAP_SET(header->presence, id);
+            if ((size_t)SLOT_OFFSET(id + 1, header->slot_size) > length) {
+                length = (size_t)SLOT_OFFSET(id + 1, header->slot_size);
+            }
+
+            // Neighbouring slots go out as one write
+            if (written > 0 && writes[written - 1].offset + writes[written - 1].length == offset) {
+                writes[written - 1].length += header->slot_size;
+            } else {
+                writes[written].offset = offset;
+                writes[written].length = header->slot_size;
+                writes[written].data = slot;
+                written++;
+            }
+        }
+
+        if (metadata != NULL) {
+            memcpy(&header->metadata, metadata, sizeof(header->metadata));
+            header->has_metadata = 1;
+        }
+
+        // The header goes last, so the new slots are in place before it lists them
+        writes[written].offset = 0;
+        writes[written].length = sizeof(*header);
+        writes[written].data = image;
+        written++;
+
+        rv = in_place ? commit_update(key_id, writes, written, header) : commit_image(key_id, image, length);
+    }
+
+    pthread_mutex_unlock(lock);
+    memset(image, 0, RKE_CONTAINER_MAX_SIZE);
+    free(image);
+
+    if (rv == RKE_SUCCESS) {
+        debug("Stored %d fragments%s", count, (metadata != NULL) ? " and metadata" : "");
+    }
+    return rv;
+}
+
+int rke_store_fragments(const unsigned char *key_id, const struct rke_key_metadata_t *metadata,
+                        const struct rke_fragment_t *fragments, int count) {
+    return store_key(key_id, metadata, fragments, count, STORE_MERGE);
+}
+
+/*
+ * Store a freshly generated key, dropping every fragment of the key it replaces
+ */
+int rke_replace_key(const struct rke_key_metadata_t *metadata, const struct rke_fragment_t *fragments, int count) {
+    if (metadata == NULL) {
+        error("Invalid parameters for key replacement");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    return store_key(metadata->key_id, metadata, fragments, count, STORE_REPLACE);
+}
+
+/*
+ * Store a freshly generated key under a key_id that holds nothing yet (a deleted key counts as nothing)
+ * Checked under the key's lock, so a concurrent store of the same key_id is never overwritten
+ */
+int rke_create_key(const struct rke_key_metadata_t *metadata, const struct rke_fragment_t *fragments, int count) {
+    if (metadata == NULL) {
+        error("Invalid parameters for key creation");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    return store_key(metadata->key_id, metadata, fragments, count, STORE_CREATE);
+}
+
+/*
+ * Store a key fragment in the key's container
+ */
+int rke_store_fragment(const struct rke_fragment_t *fragment, const unsigned char *key_id) {
+    if (fragment == NULL) {
+        error("Invalid parameters for fragment storage");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    return rke_store_fragments(key_id, NULL, fragment, 1);
+}
+
+/*
+ * Store key metadata in the key's container header
+ */
+int rke_store_metadata(const struct rke_key_metadata_t *metadata) {
+    // Validate input parameters
+    if (metadata == NULL) {
+        error("Invalid parameters for metadata storage");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    return rke_store_fragments(metadata->key_id, metadata, NULL, 0);
+}
+
+/*
+ * Remove a fragment from a key's container
+ * Only the header changes - the slot is simply no longer published
+ */
+int rke_delete_fragment(const unsigned char *key_id, uint8_t fragment_id) {
+    struct rke_container_header_t header;
+    struct rke_wal_write_t write = {0, sizeof(header), (const unsigned char *)&header};
+    pthread_mutex_t *lock;
+    int exists, rv;
+
+    if (key_id == NULL || fragment_id == 0) {
+        error("Invalid parameters for fragment deletion");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    lock = key_lock(key_id);
+    pthread_mutex_lock(lock);
+
+    rv = load_header(key_id, &header, &exists);
+    if (rv == RKE_SUCCESS && !exists) {
+        rke_cache_mark_absent(key_id);
+        error("Failed to open container for key %02x%02x%02x%02x: %s",
+              key_id[0], key_id[1], key_id[2], key_id[3], strerror(ENOENT));
+        rv = RKE_ERROR_STORAGE_FAIL;
+    }
+    if (rv == RKE_SUCCESS) {
+        header.offsets[fragment_id - 1] = 0;
+        RKE_BITMAP_CLEAR(header.presence, fragment_id);
+        rv = commit_update(key_id, &write, 1, &header);
+    }
+
+    pthread_mutex_unlock(lock);
+
+    if (rv == RKE_SUCCESS) {
+        debug("Deleted fragment %d", fragment_id);
+    }
+    return rv;
+}
+
+/*
+ * Remove a key: its container is replaced by an empty one, which reads as an unknown key
+ * Going through the WAL keeps the removal crash-safe like any other update
+ */
+int rke_delete_key(const unsigned char *key_id) {
+    struct rke_container_header_t header;
+    pthread_mutex_t *lock;
+    int rv;
+
+    if (key_id == NULL) {
+        error("Invalid parameters for key deletion");
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    init_header(&header);
+
+    lock = key_lock(key_id);
+    pthread_mutex_lock(lock);
+    rv = commit_image(key_id, (const unsigned char *)&header, sizeof(header));
+    pthread_mutex_unlock(lock);
+
+    if (rv == RKE_SUCCESS) {
+        debug("Deleted key %02x%02x%02x%02x...", key_id[0], key_id[1], key_id[2], key_id[3]);
+    }
+    return rv;
+}
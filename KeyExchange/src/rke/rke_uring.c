@@ -0,0 +1,298 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_uring.c
+#   Last Modified : 2024-07-20
+#   Describe      : Per-thread io_uring for whole-file container reads
+#
+# ====================================================*/
+
+// syscall() and MAP_POPULATE are not part of -std=c99
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../common/log.h"
+#include "rke_uring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RKE_HAVE_URING 1
+#endif
+#endif
+
+#ifdef RKE_HAVE_URING
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/*
+ * A read is three linked requests: OPENAT into direct descriptor slot 0, READ_FIXED into the
+ * registered buffer and CLOSE of the slot. One io_uring_enter submits them and waits for all
+ * three, so a container costs one syscall instead of open/pread/close.
+ * The read is hard-linked to the close so the slot is released even after a short read.
+ * Direct descriptors and sparse file tables need Linux 5.19; older kernels fail the probe.
+ */
+#define RING_ENTRIES 4
+#define RING_OPS 3
+
+struct rke_uring_t {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size, sqes_size;
+    unsigned char *buffer;
+};
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_once_t probe_once = PTHREAD_ONCE_INIT;
+static int uring_supported;
+
+static void free_ring(void *ptr) {
+    struct rke_uring_t *ring = (struct rke_uring_t *) ptr;
+
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_map != NULL && ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map != NULL && ring->sq_map != MAP_FAILED) {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    free(ring->buffer);
+    free(ring);
+}
+
+static void create_ring_key(void) {
+    if (pthread_key_create(&ring_key, free_ring) != 0) {
+        error("Failed to create io_uring key");
+    }
+}
+
+/*
+ * Create a ring with its mappings, fixed buffer and a one-slot sparse file table
+ */
+static struct rke_uring_t *setup_ring(void) {
+    struct io_uring_params params;
+    struct io_uring_rsrc_register files;
+    struct rke_uring_t *ring;
+    struct iovec iov;
+    unsigned char *sq, *cq;
+
+    ring = (struct rke_uring_t *) calloc(1, sizeof(struct rke_uring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size) {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = ring->sq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_map = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_map :
+                   mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        free_ring(ring);
+        return NULL;
+    }
+
+    sq = (unsigned char *) ring->sq_map;
+    cq = (unsigned char *) ring->cq_map;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    if (posix_memalign((void **)&ring->buffer, 4096, RKE_URING_BUFFER_SIZE) != 0) {
+        ring->buffer = NULL;
+        free_ring(ring);
+        return NULL;
+    }
+
+    iov.iov_base = ring->buffer;
+    iov.iov_len = RKE_URING_BUFFER_SIZE;
+    memset(&files, 0, sizeof(files));
+    files.nr = 1;
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, &iov, 1) != 0 ||
+        syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES2, &files, sizeof(files)) != 0) {
+        free_ring(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+/*
+ * Get the calling thread's ring, creating it on first use
+ */
+static struct rke_uring_t *get_ring(void) {
+    struct rke_uring_t *ring;
+
+    pthread_once(&ring_key_once, create_ring_key);
+
+    ring = (struct rke_uring_t *) pthread_getspecific(ring_key);
+    if (ring != NULL) {
+        return ring;
+    }
+
+    ring = setup_ring();
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    if (pthread_setspecific(ring_key, ring) != 0) {
+        free_ring(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+static void probe_uring(void) {
+    uring_supported = (get_ring() != NULL);
+    debug("io_uring storage reads %s", uring_supported ? "available" : "unavailable");
+}
+
+int rke_uring_supported(void) {
+    pthread_once(&probe_once, probe_uring);
+    return uring_supported;
+}
+
+static struct io_uring_sqe *queue_sqe(struct rke_uring_t *ring, unsigned tail, uint8_t opcode, uint64_t user_data) {
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    return sqe;
+}
+
+ssize_t rke_uring_read_file(const char *path, size_t length, const unsigned char **data) {
+    struct rke_uring_t *ring = get_ring();
+    struct io_uring_sqe *sqe;
+    int results[RING_OPS];
+    unsigned tail, head;
+    int reaped = 0, to_submit = RING_OPS;
+
+    if (ring == NULL) {
+        return -ENOSYS;
+    }
+
+    if (length > RKE_URING_BUFFER_SIZE) {
+        length = RKE_URING_BUFFER_SIZE;
+    }
+
+    tail = *ring->sq_tail;
+
+    sqe = queue_sqe(ring, tail++, IORING_OP_OPENAT, 0);
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->open_flags = O_RDONLY;             // Direct descriptors reject O_CLOEXEC, they are never inherited
+    sqe->file_index = 1;                    // Direct descriptor slot 0
+    sqe->flags = IOSQE_IO_LINK;
+
+    sqe = queue_sqe(ring, tail++, IORING_OP_READ_FIXED, 1);
+    sqe->fd = 0;
+    sqe->addr = (uint64_t)(uintptr_t)ring->buffer;
+    sqe->len = (uint32_t)length;
+    sqe->off = 0;
+    sqe->buf_index = 0;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+    sqe = queue_sqe(ring, tail++, IORING_OP_CLOSE, 2);
+    sqe->file_index = 1;
+
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    while (reaped < RING_OPS) {
+        int rv = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, RING_OPS - reaped,
+                              IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if (rv < 0 && errno != EINTR) {
+            error("io_uring_enter failed: %s", strerror(errno));
+            return -errno;
+        }
+        if (rv > 0) {
+            to_submit = 0;
+        }
+
+        head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+            if (cqe->user_data < RING_OPS) {
+                results[cqe->user_data] = cqe->res;
+            }
+            head++;
+            reaped++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (results[0] < 0) {
+        return results[0];
+    }
+    if (results[2] < 0) {
+        debug("io_uring close of direct descriptor failed: %d", results[2]);
+    }
+
+    *data = ring->buffer;
+    return results[1];
+}
+
+#else
+
+int rke_uring_supported(void) {
+    return 0;
+}
+
+ssize_t rke_uring_read_file(const char *path, size_t length, const unsigned char **data) {
+    (void)path;
+    (void)length;
+    (void)data;
+    return -ENOSYS;
+}
+
+#endif
@@ -0,0 +1,28 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_uring.h
+#   Last Modified : 2024-07-20
+#   Describe      : Per-thread io_uring for whole-file container reads
+#
+# ====================================================*/
+
+#ifndef RKE_URING_H
+#define RKE_URING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Size of each thread's registered read buffer; holds the largest container
+#define RKE_URING_BUFFER_SIZE (128 * 1024)
+
+// Whether rings with direct descriptors and fixed buffers can be created (probed once)
+int rke_uring_supported(void);
+
+// Open, read up to length bytes from the start and close a file with one linked submission
+// on the calling thread's ring; returns the bytes read into *data (valid until the thread's
+// next call) or -errno
+ssize_t rke_uring_read_file(const char *path, size_t length, const unsigned char **data);
+
+#endif // RKE_URING_H
@@ -0,0 +1,438 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_wal.c
+#   Last Modified : 2024-07-20
+#   Describe      : Write-ahead log with group commit for RKE container updates
+#
+# ====================================================*/
+
+// syncfs is a GNU extension
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../common/log.h"
+#include "../common/utils.h"
+#include "rke.h"
+#include "rke_wal.h"
+#include "rke_wal_record.h"
+
+/*
+ * The log is a sequence of records, each a header and the writes of one container update
+ * (rke_wal_record.h): a whole new image, or the slots and header it changes in place.
+ * Writers append to an in-memory group; one of them becomes the leader, writes the whole
+ * group with one write() and makes it durable with one fdatasync(). Everyone else waits on
+ * its own waiter, which the leader marks with the outcome of the group it was in.
+ * Updates are then applied to the containers, by rename or pwrite, without any fsync - a
+ * checkpoint flushes the filesystem once and only then empties the log.
+ * An update that cannot be applied is taken back by an abort record, so replay never brings
+ * back a store that failed.
+ * Replay stops at the first record that fails its checksum: that is a torn tail.
+ */
+
+// One committing thread, on its stack while it waits for its group
+struct wal_waiter_t {
+    int done;
+    int status;
+    struct wal_waiter_t *next;
+};
+
+struct wal_buffer_t {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    struct wal_waiter_t *waiters;   // Commits whose records are in the buffer
+};
+
+struct wal_state_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int fd;
+    int opened;                 // Mirrors fd >= 0 for lock-free checks
+    int flushing;               // A leader is writing a group
+    int checkpointing;          // New commits wait
+    int in_flight;              // Committed records not yet applied
+    unsigned int window_us;
+    size_t size;                // Durable bytes in the log file
+    struct wal_buffer_t pending;        // Group being filled
+    struct wal_buffer_t writing;        // Group being written by the leader
+    struct rke_wal_stats_t stats;
+};
+
+static struct wal_state_t wal = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .fd = -1,
+    .window_us = RKE_WAL_DEFAULT_WINDOW_US,
+};
+
+static int buffer_append(struct wal_buffer_t *buffer, const void *data, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 65536;
+        unsigned char *grown;
+
+        while (capacity < buffer->length + length) {
+            capacity *= 2;
+        }
+
+        grown = (unsigned char *) realloc(buffer->data, capacity);
+        if (grown == NULL) {
+            return RKE_ERROR_MEMORY_ALLOC;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return RKE_SUCCESS;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t rv = write(fd, data, length);
+
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += rv;
+        length -= (size_t)rv;
+    }
+
+    return 0;
+}
+
+/*
+ * Write and sync the pending group as its leader
+ * Called and returns with the lock held; the lock is dropped around the I/O
+ */
+static void flush_group(void) {
+    struct wal_buffer_t batch;
+    struct wal_waiter_t *waiter;
+    int ok;
+
+    wal.flushing = 1;
+
+    // A lone writer does not wait; under load the window lets followers join the group
+    if (wal.window_us > 0 && wal.in_flight > 1) {
+        struct timespec pause = {wal.window_us / 1000000, (long)(wal.window_us % 1000000) * 1000};
+
+        pthread_mutex_unlock(&wal.lock);
+        nanosleep(&pause, NULL);
+        pthread_mutex_lock(&wal.lock);
+    }
+
+    // Swap buffers so followers keep appending while this group is written
+    batch = wal.pending;
+    wal.pending = wal.writing;
+    wal.pending.length = 0;
+    wal.pending.waiters = NULL;
+    wal.writing = batch;
+    pthread_mutex_unlock(&wal.lock);
+
+    ok = write_all(wal.fd, batch.data, batch.length) == 0 && fdatasync(wal.fd) == 0;
+
+    pthread_mutex_lock(&wal.lock);
+    if (ok) {
+        wal.size += batch.length;
+    } else {
+        error("Failed to sync WAL group of %zu bytes: %s", batch.length, strerror(errno));
+        if (ftruncate(wal.fd, (off_t)wal.size) != 0) {
+            error("Failed to drop partial WAL group: %s", strerror(errno));
+        }
+    }
+
+    // Every commit of this group learns its own outcome, whatever later groups do
+    for (waiter = batch.waiters; waiter != NULL; waiter = waiter->next) {
+        waiter->status = ok ? RKE_SUCCESS : RKE_ERROR_STORAGE_FAIL;
+        waiter->done = 1;
+    }
+
+    wal.stats.syncs++;
+    wal.writing.length = 0;
+    wal.writing.waiters = NULL;
+    wal.flushing = 0;
+    pthread_cond_broadcast(&wal.cond);
+}
+
+/*
+ * Checkpoint with the lock held: wait until every logged image is applied, flush the
+ * filesystem holding the containers, then empty the log
+ */
+static int checkpoint_locked(void) {
+    int rv = RKE_SUCCESS;
+
+    wal.checkpointing = 1;
+    while (wal.in_flight > 0 || wal.flushing) {
+        pthread_cond_wait(&wal.cond, &wal.lock);
+    }
+
+    if (wal.size > 0) {
+        if (syncfs(wal.fd) != 0 || ftruncate(wal.fd, 0) != 0) {
+            error("WAL checkpoint failed: %s", strerror(errno));
+            rv = RKE_ERROR_STORAGE_FAIL;
+        } else {
+            wal.size = 0;
+            wal.stats.checkpoints++;
+        }
+    }
+
+    wal.checkpointing = 0;
+    pthread_cond_broadcast(&wal.cond);
+    return rv;
+}
+
+/*
+ * Open the log and recover from it
+ */
+int rke_wal_open(rke_wal_apply_fn apply) {
+    char path[1100], dir[1024];
+    int fd, rv;
+
+    if (apply == NULL) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    pthread_mutex_lock(&wal.lock);
+    if (wal.fd >= 0) {
+        pthread_mutex_unlock(&wal.lock);
+        return RKE_SUCCESS;
+    }
+
+    // create_directory_recursive works in a buffer of this size
+    if ((size_t)snprintf(dir, sizeof(dir), "%s/RKE", config.cwd) >= sizeof(dir)) {
+        error("Working directory path is too long: %s", config.cwd);
+        pthread_mutex_unlock(&wal.lock);
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+    if (create_directory_recursive(dir) != 0) {
+        error("Failed to create directory %s: %s", dir, strerror(errno));
+        pthread_mutex_unlock(&wal.lock);
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    snprintf(path, sizeof(path), "%s/RKE/rke.wal", config.cwd);
+    fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0640);
+    if (fd < 0) {
+        error("Failed to open WAL %s: %s", path, strerror(errno));
+        pthread_mutex_unlock(&wal.lock);
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    memset(&wal.stats, 0, sizeof(wal.stats));
+    rv = rke_wal_replay(fd, apply, &wal.stats.replayed);
+    if (rv != RKE_SUCCESS) {
+        close(fd);
+        pthread_mutex_unlock(&wal.lock);
+        return rv;
+    }
+
+    wal.fd = fd;
+    wal.size = 0;
+    __atomic_store_n(&wal.opened, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&wal.lock);
+
+    debug("WAL opened at %s", path);
+    return RKE_SUCCESS;
+}
+
+int rke_wal_is_open(void) {
+    return __atomic_load_n(&wal.opened, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Close the log without a checkpoint; what it holds is replayed by the next open
+ */
+void rke_wal_close(void) {
+    pthread_mutex_lock(&wal.lock);
+    while (wal.in_flight > 0 || wal.flushing || wal.checkpointing) {
+        pthread_cond_wait(&wal.cond, &wal.lock);
+    }
+
+    if (wal.fd >= 0) {
+        close(wal.fd);
+        wal.fd = -1;
+    }
+    __atomic_store_n(&wal.opened, 0, __ATOMIC_RELEASE);
+
+    free(wal.pending.data);
+    free(wal.writing.data);
+    memset(&wal.pending, 0, sizeof(wal.pending));
+    memset(&wal.writing, 0, sizeof(wal.writing));
+    pthread_mutex_unlock(&wal.lock);
+}
+
+static void make_record(struct rke_wal_record_t *record, uint32_t type, const unsigned char *key_id,
+                        const struct rke_wal_write_t *writes, int count) {
+    size_t length = 0;
+
+    for (int i = 0; i < count; i++) {
+        length += sizeof(struct rke_wal_segment_t) + writes[i].length;
+    }
+
+    memcpy(record->magic, RKE_WAL_MAGIC, sizeof(record->magic));
+    record->length = (uint32_t)length;
+    record->type = type;
+    memcpy(record->key_id, key_id, RKE_KEY_ID_SIZE);
+    rke_wal_record_checksum(record, writes, count, record->checksum);
+}
+
+/*
+ * Add a record to the pending group and wait until the group is durable
+ * Called and returns with the lock held
+ */
+static int log_record(const struct rke_wal_record_t *record, const struct rke_wal_write_t *writes, int count) {
+    struct wal_waiter_t waiter = {0, RKE_ERROR_STORAGE_FAIL, NULL};
+    struct rke_wal_segment_t segment;
+    size_t start = wal.pending.length;
+    int rv;
+
+    rv = buffer_append(&wal.pending, record, sizeof(*record));
+    for (int i = 0; i < count && rv == RKE_SUCCESS; i++) {
+        segment.offset = writes[i].offset;
+        segment.length = writes[i].length;
+        rv = buffer_append(&wal.pending, &segment, sizeof(segment));
+        if (rv == RKE_SUCCESS) {
+            rv = buffer_append(&wal.pending, writes[i].data, writes[i].length);
+        }
+    }
+    if (rv != RKE_SUCCESS) {
+        wal.pending.length = start;
+        error("Can't alloc WAL group buffer");
+        return rv;
+    }
+
+    waiter.next = wal.pending.waiters;
+    wal.pending.waiters = &waiter;
+
+    while (!waiter.done) {
+        if (wal.flushing) {
+            pthread_cond_wait(&wal.cond, &wal.lock);
+        } else {
+            flush_group();
+        }
+    }
+
+    return waiter.status;
+}
+
+/*
+ * Log one container update and wait until its group is durable
+ */
+int rke_wal_commit(const unsigned char *key_id, const struct rke_wal_write_t *writes, int count) {
+    struct rke_wal_record_t record;
+    size_t length = 0;
+    int rv;
+
+    if (key_id == NULL || writes == NULL || count <= 0 || count > RKE_WAL_MAX_WRITES) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (writes[i].data == NULL || writes[i].length == 0 || (writes[i].offset == RKE_WAL_IMAGE && count > 1)) {
+            return RKE_ERROR_INVALID_PARAM;
+        }
+        length += sizeof(struct rke_wal_segment_t) + writes[i].length;
+    }
+    if (length > UINT32_MAX) {
+        return RKE_ERROR_INVALID_PARAM;
+    }
+
+    // The checksum is computed outside the lock
+    make_record(&record, RKE_WAL_UPDATE, key_id, writes, count);
+
+    pthread_mutex_lock(&wal.lock);
+    while (wal.checkpointing) {
+        pthread_cond_wait(&wal.cond, &wal.lock);
+    }
+
+    if (wal.fd < 0) {
+        pthread_mutex_unlock(&wal.lock);
+        error("WAL is not open");
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    // A failed checkpoint is retried by a later commit, the log just keeps growing meanwhile
+    if (wal.size >= RKE_WAL_CHECKPOINT_SIZE) {
+        checkpoint_locked();
+    }
+
+    wal.in_flight++;
+    rv = log_record(&record, writes, count);
+    if (rv != RKE_SUCCESS) {
+        wal.in_flight--;
+        pthread_cond_broadcast(&wal.cond);
+    } else {
+        wal.stats.records++;
+    }
+    pthread_mutex_unlock(&wal.lock);
+
+    return rv;
+}
+
+/*
+ * Mark a committed update as applied to its container, or log that it never was
+ * The abort is logged while the update still counts as in flight, so no checkpoint
+ * can run in between and this never waits for one
+ */
+void rke_wal_applied(const unsigned char *key_id, int status) {
+    struct rke_wal_record_t record;
+
+    if (status != RKE_SUCCESS) {
+        make_record(&record, RKE_WAL_ABORT, key_id, NULL, 0);
+    }
+
+    pthread_mutex_lock(&wal.lock);
+    if (status != RKE_SUCCESS && log_record(&record, NULL, 0) != RKE_SUCCESS) {
+        error("Failed to log the abort of an unapplied update, replay would restore it");
+    }
+    wal.in_flight--;
+    if (wal.in_flight == 0) {
+        pthread_cond_broadcast(&wal.cond);
+    }
+    pthread_mutex_unlock(&wal.lock);
+}
+
+int rke_wal_checkpoint(void) {
+    int rv = RKE_SUCCESS;
+
+    pthread_mutex_lock(&wal.lock);
+    while (wal.checkpointing) {
+        pthread_cond_wait(&wal.cond, &wal.lock);
+    }
+    if (wal.fd >= 0) {
+        rv = checkpoint_locked();
+    }
+    pthread_mutex_unlock(&wal.lock);
+
+    return rv;
+}
+
+void rke_wal_set_window(unsigned int usec) {
+    pthread_mutex_lock(&wal.lock);
+    wal.window_us = usec;
+    pthread_mutex_unlock(&wal.lock);
+}
+
+void rke_wal_get_stats(struct rke_wal_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&wal.lock);
+    memcpy(stats, &wal.stats, sizeof(*stats));
+    pthread_mutex_unlock(&wal.lock);
+}
@@ -0,0 +1,61 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_wal.h
+#   Last Modified : 2024-07-20
+#   Describe      : Write-ahead log with group commit for RKE container updates
+#
+# ====================================================*/
+
+#ifndef RKE_WAL_H
+#define RKE_WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rke.h"
+
+#define RKE_WAL_DEFAULT_WINDOW_US 100
+#define RKE_WAL_CHECKPOINT_SIZE (16 * 1024 * 1024)   // Log size that triggers a checkpoint
+
+#define RKE_WAL_IMAGE UINT32_MAX                      // Offset of a write that is a whole new container
+#define RKE_WAL_MAX_WRITES (RKE_MAX_FRAGMENTS + 1)     // Every slot and the header
+
+// One write of a container update: length bytes at offset, or the whole image at RKE_WAL_IMAGE
+struct rke_wal_write_t {
+    uint32_t offset;
+    uint32_t length;
+    const unsigned char *data;
+};
+
+// Applies a logged container update; used to replay the log on open
+typedef int (*rke_wal_apply_fn)(const unsigned char *key_id, const struct rke_wal_write_t *writes, int count);
+
+// Log counters since the log was opened
+struct rke_wal_stats_t {
+    uint64_t records;       // Records committed
+    uint64_t syncs;         // fdatasync calls, one per group
+    uint64_t checkpoints;   // Log truncations
+    uint64_t replayed;      // Records applied by the last replay
+};
+
+// Open {config.cwd}/RKE/rke.wal, replaying and truncating what it holds; no-op when already open
+int rke_wal_open(rke_wal_apply_fn apply);
+int rke_wal_is_open(void);
+void rke_wal_close(void);
+
+// Log one container update - a whole image, or writes applied in order - and return once it
+// is durable. Every successful commit must be followed by rke_wal_applied() with the outcome
+// of writing the container; an update that failed to reach it is logged as aborted and never replayed.
+int rke_wal_commit(const unsigned char *key_id, const struct rke_wal_write_t *writes, int count);
+void rke_wal_applied(const unsigned char *key_id, int status);
+
+// Flush applied containers to disk and empty the log
+int rke_wal_checkpoint(void);
+
+// Group commit window: how long a leader waits for followers before syncing (0 - never wait)
+void rke_wal_set_window(unsigned int usec);
+void rke_wal_get_stats(struct rke_wal_stats_t *stats);
+
+#endif // RKE_WAL_H
@@ -0,0 +1,47 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_wal_record.h
+#   Last Modified : 2024-07-20
+#   Describe      : Write-ahead log record format shared by the log writer and its replay
+#
+# ====================================================*/
+
+#ifndef RKE_WAL_RECORD_H
+#define RKE_WAL_RECORD_H
+
+#include <stdint.h>
+
+#include "rke.h"
+#include "rke_wal.h"
+
+/*
+ * A record is this header followed by length bytes of data:
+ *   RKE_WAL_UPDATE - the writes of one container update, each a segment header and its bytes
+ *   RKE_WAL_ABORT  - no data; the latest update of the key never reached its container,
+ *                    replay skips it like the store that logged it failed
+ */
+#define RKE_WAL_MAGIC "RKEW"
+#define RKE_WAL_UPDATE 1
+#define RKE_WAL_ABORT 2
+
+struct rke_wal_record_t {
+    char magic[4];
+    uint32_t length;                            // Data bytes after this header
+    uint32_t type;
+    unsigned char key_id[RKE_KEY_ID_SIZE];
+    unsigned char checksum[RKE_CHECKSUM_SIZE];  // SHA-256 of the fields above and the data
+};
+
+struct rke_wal_segment_t {
+    uint32_t offset;                            // Container offset, or RKE_WAL_IMAGE
+    uint32_t length;                            // Bytes after this header
+};
+
+// rke_wal_replay.c
+void rke_wal_record_checksum(const struct rke_wal_record_t *record, const struct rke_wal_write_t *writes,
+                             int count, unsigned char *digest);
+int rke_wal_replay(int fd, rke_wal_apply_fn apply, uint64_t *replayed);
+
+#endif // RKE_WAL_RECORD_H
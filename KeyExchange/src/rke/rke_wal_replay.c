@@ -0,0 +1,204 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_wal_replay.c
+#   Last Modified : 2024-07-20
+#   Describe      : Write-ahead log record checksums and recovery of the log on open
+#
+# ====================================================*/
+
+// syncfs is a GNU extension
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../common/log.h"
+#include "rke.h"
+#include "rke_sha256.h"
+#include "rke_wal.h"
+#include "rke_wal_record.h"
+
+/*
+ * Checksum a record header and its data, given as the writes it holds
+ * The segments are hashed as they are laid out in the log, so replay can check the data as read
+ */
+void rke_wal_record_checksum(const struct rke_wal_record_t *record, const struct rke_wal_write_t *writes,
+                             int count, unsigned char *digest) {
+    struct rke_wal_segment_t segment;
+    struct rke_sha256_ctx_t ctx;
+
+    rke_sha256_init(&ctx);
+    rke_sha256_update(&ctx, (const unsigned char *)record, offsetof(struct rke_wal_record_t, checksum));
+    for (int i = 0; i < count; i++) {
+        segment.offset = writes[i].offset;
+        segment.length = writes[i].length;
+        rke_sha256_update(&ctx, (const unsigned char *)&segment, sizeof(segment));
+        rke_sha256_update(&ctx, writes[i].data, writes[i].length);
+    }
+    rke_sha256_final(&ctx, digest);
+}
+
+/*
+ * Split the data of an update record into its writes
+ * Returns the number of writes, or -1 when the segments do not add up
+ */
+static int parse_writes(const unsigned char *data, uint32_t length, struct rke_wal_write_t *writes) {
+    struct rke_wal_segment_t segment;
+    size_t offset = 0;
+    int count = 0;
+
+    while (offset < length) {
+        if (count == RKE_WAL_MAX_WRITES || length - offset < sizeof(segment)) {
+            return -1;
+        }
+
+        memcpy(&segment, data + offset, sizeof(segment));
+        offset += sizeof(segment);
+        if (segment.length == 0 || segment.length > length - offset) {
+            return -1;
+        }
+
+        writes[count].offset = segment.offset;
+        writes[count].length = segment.length;
+        writes[count].data = data + offset;
+        offset += segment.length;
+        count++;
+    }
+
+    // A whole image is an update of its own
+    for (int i = 0; i < count; i++) {
+        if (writes[i].offset == RKE_WAL_IMAGE && count > 1) {
+            return -1;
+        }
+    }
+
+    return (count > 0) ? count : -1;
+}
+
+/*
+ * Drop the latest update of a key from the records found so far
+ * Writers of a key are serialized until the abort is logged, so that update is the failed one
+ */
+static void cancel_update(const unsigned char *data, size_t *records, int count, const unsigned char *key_id) {
+    const struct rke_wal_record_t *record;
+
+    for (int i = count - 1; i >= 0; i--) {
+        record = (const struct rke_wal_record_t *)(data + records[i]);
+        if (records[i] != SIZE_MAX && memcmp(record->key_id, key_id, RKE_KEY_ID_SIZE) == 0) {
+            records[i] = SIZE_MAX;
+            return;
+        }
+    }
+}
+
+/*
+ * Apply every intact record of an existing log that no abort took back, then empty it
+ */
+int rke_wal_replay(int fd, rke_wal_apply_fn apply, uint64_t *replayed) {
+    struct rke_wal_write_t writes[RKE_WAL_MAX_WRITES];
+    struct rke_wal_record_t record;
+    unsigned char digest[RKE_CHECKSUM_SIZE];
+    unsigned char *data;
+    size_t *records;
+    struct stat st;
+    size_t size, offset = 0;
+    int found = 0, count = 0, written = 0, rv = RKE_SUCCESS;
+
+    if (fstat(fd, &st) != 0) {
+        error("Failed to stat WAL: %s", strerror(errno));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    size = (size_t)st.st_size;
+    if (size == 0) {
+        return RKE_SUCCESS;
+    }
+
+    data = (unsigned char *) malloc(size);
+    records = (size_t *) malloc((size / sizeof(record) + 1) * sizeof(size_t));
+    if (data == NULL || records == NULL) {
+        error("Can't alloc %zu bytes for WAL replay", size);
+        free(data);
+        free(records);
+        return RKE_ERROR_MEMORY_ALLOC;
+    }
+
+    if (pread(fd, data, size, 0) != (ssize_t)size) {
+        error("Failed to read WAL: %s", strerror(errno));
+        free(data);
+        free(records);
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    // First pass: find the intact records, an abort cancels the update it follows
+    while (offset + sizeof(record) <= size) {
+        memcpy(&record, data + offset, sizeof(record));
+        if (memcmp(record.magic, RKE_WAL_MAGIC, sizeof(record.magic)) != 0 ||
+            record.length > size - offset - sizeof(record)) {
+            break;
+        }
+
+        if (record.type == RKE_WAL_UPDATE) {
+            written = parse_writes(data + offset + sizeof(record), record.length, writes);
+        } else {
+            written = (record.type == RKE_WAL_ABORT && record.length == 0) ? 0 : -1;
+        }
+        if (written < 0) {
+            break;
+        }
+
+        rke_wal_record_checksum(&record, writes, written, digest);
+        if (memcmp(digest, record.checksum, RKE_CHECKSUM_SIZE) != 0) {
+            break;
+        }
+
+        if (record.type == RKE_WAL_ABORT) {
+            cancel_update(data, records, found, record.key_id);
+        } else {
+            records[found++] = offset;
+        }
+        offset += sizeof(record) + record.length;
+    }
+
+    if (offset < size) {
+        warn("Discarding %zu bytes of torn WAL tail", size - offset);
+    }
+
+    for (int i = 0; i < found && rv == RKE_SUCCESS; i++) {
+        if (records[i] == SIZE_MAX) {
+            continue;
+        }
+
+        memcpy(&record, data + records[i], sizeof(record));
+        written = parse_writes(data + records[i] + sizeof(record), record.length, writes);
+        rv = apply(record.key_id, writes, written);
+        if (rv != RKE_SUCCESS) {
+            error("Failed to replay WAL record %d, keeping the log", i);
+        }
+        count++;
+    }
+    free(data);
+    free(records);
+
+    if (rv != RKE_SUCCESS) {
+        return rv;
+    }
+
+    // Replayed containers must be on disk before the log that recreates them is dropped
+    if (syncfs(fd) != 0 || ftruncate(fd, 0) != 0) {
+        error("Failed to truncate WAL after replay: %s", strerror(errno));
+        return RKE_ERROR_STORAGE_FAIL;
+    }
+
+    *replayed = (uint64_t)count;
+    info("Replayed %d WAL records", count);
+    return RKE_SUCCESS;
+}
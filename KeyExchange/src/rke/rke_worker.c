@@ -0,0 +1,140 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_worker.c
+#   Last Modified : 2024-07-20
+#   Describe      : Per-thread working memory for RKE protocol commands
+#
+# ====================================================*/
+
+// posix_memalign is POSIX.1-2001, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../common/log.h"
+#include "rke.h"
+#include "rke_worker.h"
+
+/*
+ * A response arena is a bump allocator owned by one worker thread. The owner and every
+ * response handed out hold a reference; only the owner moves the offset, and it rewinds
+ * to the start once its own reference is the only one left, i.e. every response has been
+ * sent and released. Releases may come from any thread, and an arena outlives its thread
+ * until the last outstanding response is released.
+ */
+#define ARENA_ALIGN 16
+
+struct rke_output_arena_t {
+    size_t offset;
+    uint32_t refs;
+    unsigned char data[RKE_OUTPUT_ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static pthread_key_t worker_key;
+static pthread_once_t worker_key_once = PTHREAD_ONCE_INIT;
+
+static void drop_arena(struct rke_output_arena_t *arena) {
+    if (__atomic_sub_fetch(&arena->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(arena);
+    }
+}
+
+/*
+ * Hand a response buffer back to its arena
+ */
+static void release_arena_output(conn_info_t *ci) {
+    drop_arena((struct rke_output_arena_t *)ci->output_ref);
+}
+
+/*
+ * Release worker memory when its thread exits
+ */
+static void free_worker(void *ptr) {
+    struct rke_worker_t *worker = (struct rke_worker_t *) ptr;
+
+    rke_ctx_cleanup(&worker->ctx);
+    memset(worker->fragments, 0, sizeof(worker->fragments));
+    if (worker->arena != NULL) {
+        drop_arena(worker->arena);
+    }
+    free(worker);
+}
+
+static void create_worker_key(void) {
+    if (pthread_key_create(&worker_key, free_worker) != 0) {
+        error("Failed to create RKE worker key");
+    }
+}
+
+/*
+ * Get the calling thread's working memory, allocating it on first use
+ * Reason: every thread-pool worker gets its own context so RKE commands run in parallel
+ */
+struct rke_worker_t *rke_get_worker(void) {
+    struct rke_worker_t *worker;
+
+    pthread_once(&worker_key_once, create_worker_key);
+
+    worker = (struct rke_worker_t *) pthread_getspecific(worker_key);
+    if (worker != NULL) {
+        return worker;
+    }
+
+    // Fragment payloads are 64-byte aligned, which malloc does not guarantee
+    if (posix_memalign((void **)&worker, RKE_FRAGMENT_ALIGN, sizeof(struct rke_worker_t)) != 0) {
+        error("Can't alloc RKE worker context");
+        return NULL;
+    }
+
+    // Without an arena responses are simply malloc'd
+    worker->arena = (struct rke_output_arena_t *) malloc(sizeof(struct rke_output_arena_t));
+    if (worker->arena != NULL) {
+        worker->arena->offset = 0;
+        worker->arena->refs = 1;
+    }
+
+    rke_ctx_init(&worker->ctx);
+    if (pthread_setspecific(worker_key, worker) != 0) {
+        error("Failed to register RKE worker context");
+        free(worker->arena);
+        free(worker);
+        return NULL;
+    }
+
+    return worker;
+}
+
+unsigned char *rke_alloc_output(conn_info_t *ci, uint32_t size) {
+    struct rke_worker_t *worker = rke_get_worker();
+    struct rke_output_arena_t *arena = (worker != NULL) ? worker->arena : NULL;
+    size_t need = ((size_t)size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    ci->output_release = NULL;
+    ci->output_ref = NULL;
+
+    if (arena != NULL && need <= RKE_OUTPUT_ARENA_SIZE) {
+        // Every earlier response has been released, so the whole arena is free again
+        if (__atomic_load_n(&arena->refs, __ATOMIC_ACQUIRE) == 1) {
+            arena->offset = 0;
+        }
+
+        if (arena->offset + need <= RKE_OUTPUT_ARENA_SIZE) {
+            __atomic_add_fetch(&arena->refs, 1, __ATOMIC_RELAXED);
+            ci->output = arena->data + arena->offset;
+            ci->output_size = size;
+            ci->output_release = release_arena_output;
+            ci->output_ref = arena;
+            arena->offset += need;
+            return ci->output;
+        }
+    }
+
+    ci->output = (unsigned char *) malloc(size);
+    ci->output_size = (ci->output != NULL) ? size : 0;
+    return ci->output;
+}
@@ -0,0 +1,35 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : rke_worker.h
+#   Last Modified : 2024-07-20
+#   Describe      : Per-thread working memory for RKE protocol commands
+#
+# ====================================================*/
+
+#ifndef RKE_WORKER_H
+#define RKE_WORKER_H
+
+#include "rke.h"
+#include "../common/protocol.h"
+
+// Responses up to this size come from the worker's output arena, larger ones from malloc
+#define RKE_OUTPUT_ARENA_SIZE (128 * 1024)
+
+struct rke_output_arena_t;
+
+// Per-thread working memory for the RKE commands
+struct rke_worker_t {
+    struct rke_ctx_t ctx;                               // Split/reconstruct context
+    struct rke_fragment_t fragments[RKE_MAX_FRAGMENTS]; // Fragment buffer
+    struct rke_output_arena_t *arena;                   // Response buffers
+};
+
+struct rke_worker_t *rke_get_worker(void);
+
+// Allocate a size-byte response in ci->output from the calling thread's arena
+// release_output() hands it back, from any thread; returns NULL when out of memory
+unsigned char *rke_alloc_output(conn_info_t *ci, uint32_t size);
+
+#endif // RKE_WORKER_H
@@ -0,0 +1,71 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_helpers.c
+#   Last Modified : 2024-07-20
+#   Describe      : Fixtures shared by the RKE test suites
+#
+# ====================================================*/
+
+// nftw is XSI, not part of -std=c99
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <string.h>
+#include <ftw.h>
+
+#include "../src/common/utils.h"
+#include "test_helpers.h"
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+/*
+ * Build a key id and metadata for a fresh key
+ */
+void make_key(struct rke_key_metadata_t *metadata, uint8_t total, uint8_t threshold) {
+    memset(metadata, 0, sizeof(*metadata));
+    rke_generate_key(metadata->key_id, RKE_KEY_ID_SIZE);
+    metadata->key_type = RKE_KEY_TYPE_SYMMETRIC;
+    metadata->total_fragments = total;
+    metadata->threshold = threshold;
+    metadata->timestamp = 1721433600;
+}
+
+/*
+ * Fill a fragment with a recognizable payload; a different seed gives a different payload for the same id
+ */
+void make_fragment(struct rke_fragment_t *fragment, uint8_t id, uint8_t total, uint8_t threshold, uint8_t seed) {
+    memset(fragment, 0, sizeof(*fragment));
+    fragment->fragment_id = id;
+    fragment->total_fragments = total;
+    fragment->threshold = threshold;
+    fragment->fragment_size = RKE_FRAGMENT_DATA_SIZE;
+    for (int i = 0; i < RKE_FRAGMENT_DATA_SIZE; i++) {
+        fragment->data[i] = (unsigned char)(id * 31 + seed + i);
+    }
+    rke_calculate_checksum(fragment);
+}
+
+/*
+ * Start from an empty config.cwd, so nothing stored by an earlier run is read back
+ */
+int test_setup_storage(void) {
+    test_teardown_storage();
+    return create_directory_recursive(config.cwd);
+}
+
+/*
+ * Remove config.cwd and everything stored under it; only scratch directories in /tmp are touched
+ */
+void test_teardown_storage(void) {
+    if (strncmp(config.cwd, "/tmp/rke_test", strlen("/tmp/rke_test")) != 0) {
+        return;
+    }
+    nftw(config.cwd, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
@@ -0,0 +1,28 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_helpers.h
+#   Last Modified : 2024-07-20
+#   Describe      : Fixtures shared by the RKE test suites
+#
+# ====================================================*/
+
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+
+#include <stdint.h>
+
+#include "../src/rke/rke.h"
+
+// Metadata for a fresh random key id
+void make_key(struct rke_key_metadata_t *metadata, uint8_t total, uint8_t threshold);
+
+// Full-size checksummed fragment whose payload depends on id and seed
+void make_fragment(struct rke_fragment_t *fragment, uint8_t id, uint8_t total, uint8_t threshold, uint8_t seed);
+
+// Suites that store keys start from an empty config.cwd and remove it when they pass
+int test_setup_storage(void);
+void test_teardown_storage(void);
+
+#endif // TEST_HELPERS_H
@@ -0,0 +1,144 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_batch.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for RKE batch key generation
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../src/rke/rke.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test",
+    .coin_id = 1
+};
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Shared working context and fragment buffer
+static struct rke_ctx_t test_ctx;
+static struct rke_fragment_t test_fragments[RKE_MAX_FRAGMENTS];
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+/*
+ * Test batch key generation
+ */
+int test_batch_generation() {
+    struct rke_fragment_batch_t batch;
+    struct rke_key_metadata_t metadata;
+    struct rke_fragment_t fragment;
+    unsigned char keys[3 * 32];
+    unsigned char reconstructed_key[32];
+    unsigned char checksum[RKE_CHECKSUM_SIZE];
+    
+    printf("Testing batch key generation...\n");
+    
+    int result = rke_fragment_batch_alloc(&batch, 3, 6, 4, 32);
+    ASSERT(result == RKE_SUCCESS);
+    
+    result = rke_generate_and_split_batch(&test_ctx, &batch, keys);
+    ASSERT(result == RKE_SUCCESS);
+    ASSERT(memcmp(keys, keys + 32, 32) != 0);
+    
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.total_fragments = 6;
+    metadata.threshold = 4;
+    
+    // Every key reconstructs from its own batched fragments
+    for (int k = 0; k < 3; k++) {
+        for (int f = 1; f <= 6; f++) {
+            result = rke_fragment_batch_get(&batch, k, (uint8_t)f, &test_fragments[f - 1]);
+            ASSERT(result == RKE_SUCCESS);
+        }
+        
+        result = rke_reconstruct_key(&test_ctx, reconstructed_key, 32, &metadata, &test_fragments[2], 4);
+        ASSERT(result == RKE_SUCCESS);
+        ASSERT(memcmp(reconstructed_key, keys + k * 32, 32) == 0);
+    }
+    
+    // Batched checksums match the single fragment checksum
+    result = rke_fragment_batch_get(&batch, 1, 5, &fragment);
+    ASSERT(result == RKE_SUCCESS);
+    memcpy(checksum, fragment.checksum, RKE_CHECKSUM_SIZE);
+    ASSERT(rke_calculate_checksum(&fragment) == RKE_SUCCESS);
+    ASSERT(memcmp(checksum, fragment.checksum, RKE_CHECKSUM_SIZE) == 0);
+    
+    // Invalid parameters
+    result = rke_fragment_batch_get(&batch, 3, 1, &fragment);
+    ASSERT(result == RKE_ERROR_INVALID_PARAM);
+    
+    result = rke_fragment_batch_get(&batch, 0, 7, &fragment);
+    ASSERT(result == RKE_ERROR_INVALID_PARAM);
+    
+    rke_fragment_batch_free(&batch);
+    ASSERT(batch.data == NULL);
+    
+    result = rke_fragment_batch_alloc(&batch, RKE_MAX_BATCH_KEYS + 1, 6, 4, 32);
+    ASSERT(result == RKE_ERROR_INVALID_PARAM);
+    
+    result = rke_fragment_batch_alloc(&batch, 2, 6, 7, 32);
+    ASSERT(result == RKE_ERROR_INVALID_PARAM);
+    
+    printf("Batch generation tests passed!\n");
+    return 0;
+}
+
+/*
+ * Main test function
+ */
+int main() {
+    printf("RKE Batch Tests\n");
+    printf("===============\n");
+    
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    rke_ctx_init(&test_ctx);
+    
+    // Run all tests
+    TEST_FUNCTION(test_batch_generation);
+    
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+    
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
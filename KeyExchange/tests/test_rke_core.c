@@ -13,8 +13,10 @@
 #include <string.h>
 #include <assert.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "../src/rke/rke.h"
+#include "../src/rke/rke_gf256.h"
 #include "../src/common/log.h"
 #include "../src/common/utils.h"
 
@@ -29,6 +31,10 @@ struct config_s config = {
 static int tests_run = 0;
 static int tests_passed = 0;
 
+// Shared working context and fragment buffer for single-threaded tests
+static struct rke_ctx_t test_ctx;
+static struct rke_fragment_t test_fragments[RKE_MAX_FRAGMENTS];
+
 // Test macros
 #define ASSERT(condition) do { \
     tests_run++; \
@@ -104,37 +110,141 @@ int test_key_splitting() {
     metadata.sn = 12345;
     
     // Test key splitting
-    result = rke_split_key(original_key, 256, &metadata);
+    result = rke_split_key(&test_ctx, original_key, 256, &metadata, test_fragments);
     ASSERT(result == RKE_SUCCESS);
     
     // Test key reconstruction
-    result = rke_reconstruct_key(reconstructed_key, 256, &metadata);
+    result = rke_reconstruct_key(&test_ctx, reconstructed_key, 256, &metadata, test_fragments, 5);
     ASSERT(result == RKE_SUCCESS);
     
     // Verify keys match
     ASSERT(memcmp(original_key, reconstructed_key, 256) == 0);
     
+    // Any threshold-sized subset works: use fragments 5, 2 and 4
+    struct rke_fragment_t subset[3];
+    subset[0] = test_fragments[4];
+    subset[1] = test_fragments[1];
+    subset[2] = test_fragments[3];
+    memset(reconstructed_key, 0, sizeof(reconstructed_key));
+    result = rke_reconstruct_key(&test_ctx, reconstructed_key, 256, &metadata, subset, 3);
+    ASSERT(result == RKE_SUCCESS);
+    ASSERT(memcmp(original_key, reconstructed_key, 256) == 0);
+    
+    // Fewer than threshold fragments are rejected
+    result = rke_reconstruct_key(&test_ctx, reconstructed_key, 256, &metadata, subset, 2);
+    ASSERT(result == RKE_ERROR_INSUFFICIENT_FRAGMENTS);
+    
+    // Corrupted fragment is detected
+    subset[1].data[7] ^= 0x01;
+    result = rke_reconstruct_key(&test_ctx, reconstructed_key, 256, &metadata, subset, 3);
+    ASSERT(result == RKE_ERROR_FRAGMENT_CORRUPT);
+    
     // Test invalid parameters for splitting
-    result = rke_split_key(NULL, 256, &metadata);
+    result = rke_split_key(&test_ctx, NULL, 256, &metadata, test_fragments);
+    ASSERT(result == RKE_ERROR_INVALID_PARAM);
+    
+    result = rke_split_key(&test_ctx, original_key, 256, NULL, test_fragments);
+    ASSERT(result == RKE_ERROR_INVALID_PARAM);
+    
+    result = rke_split_key(NULL, original_key, 256, &metadata, test_fragments);
     ASSERT(result == RKE_ERROR_INVALID_PARAM);
     
-    result = rke_split_key(original_key, 256, NULL);
+    result = rke_split_key(&test_ctx, original_key, 256, &metadata, NULL);
     ASSERT(result == RKE_ERROR_INVALID_PARAM);
     
     // Test invalid threshold (greater than total fragments)
     metadata.threshold = 6;
-    result = rke_split_key(original_key, 256, &metadata);
+    result = rke_split_key(&test_ctx, original_key, 256, &metadata, test_fragments);
     ASSERT(result == RKE_ERROR_INVALID_PARAM);
     
     // Test threshold too low
     metadata.threshold = 1;
-    result = rke_split_key(original_key, 256, &metadata);
+    result = rke_split_key(&test_ctx, original_key, 256, &metadata, test_fragments);
     ASSERT(result == RKE_ERROR_INVALID_PARAM);
     
     printf("Key splitting tests passed!\n");
     return 0;
 }
 
+/*
+ * Test GF(256) arithmetic and threshold sharing kernels
+ */
+int test_gf256_sharing() {
+    const char *kernel_names[] = {"scalar", "ssse3", "avx2"};
+    unsigned char secret[37];
+    unsigned char coefficients[2 * 37];
+    unsigned char shares[5][37];
+    unsigned char reference[5][37];
+    unsigned char recovered[37];
+    const unsigned char *subset[3];
+    uint8_t x_coords[3];
+    uint8_t lagrange[3];
+    int result;
+    
+    printf("Testing GF(256) threshold sharing...\n");
+    
+    // Every non-zero element has an inverse
+    result = 0;
+    for (int a = 1; a < 256; a++) {
+        if (rke_gf256_mul((uint8_t)a, rke_gf256_inv((uint8_t)a)) != 1) {
+            result = -1;
+        }
+    }
+    ASSERT(result == 0);
+    ASSERT(rke_gf256_mul(0x57, 0x83) == 0xc1);
+    
+    // Odd length exercises the SIMD tail handling
+    for (int i = 0; i < 37; i++) {
+        secret[i] = (unsigned char)(i * 7 + 1);
+    }
+    for (int i = 0; i < 2 * 37; i++) {
+        coefficients[i] = (unsigned char)(i * 13 + 5);
+    }
+    
+    ASSERT(rke_gf256_force_kernel("scalar") == 0);
+    for (int x = 1; x <= 5; x++) {
+        rke_gf256_eval_region(reference[x - 1], secret, coefficients, 2, (uint8_t)x, 37);
+    }
+    
+    // Any 3 of 5 shares recover the secret with every supported kernel
+    for (int k = 0; k < 3; k++) {
+        if (rke_gf256_force_kernel(kernel_names[k]) != 0) {
+            continue;
+        }
+        
+        for (int x = 1; x <= 5; x++) {
+            rke_gf256_eval_region(shares[x - 1], secret, coefficients, 2, (uint8_t)x, 37);
+        }
+        ASSERT(memcmp(shares, reference, sizeof(shares)) == 0);
+        
+        x_coords[0] = 2; x_coords[1] = 4; x_coords[2] = 5;
+        for (int i = 0; i < 3; i++) {
+            subset[i] = shares[x_coords[i] - 1];
+        }
+        ASSERT(rke_gf256_lagrange_coefficients(x_coords, 3, lagrange) == 0);
+        rke_gf256_combine_region(recovered, subset, lagrange, 3, 37);
+        ASSERT(memcmp(recovered, secret, 37) == 0);
+    }
+    
+    // Two shares are not enough for a degree 2 polynomial
+    x_coords[0] = 1; x_coords[1] = 3;
+    subset[0] = shares[0];
+    subset[1] = shares[2];
+    ASSERT(rke_gf256_lagrange_coefficients(x_coords, 2, lagrange) == 0);
+    rke_gf256_combine_region(recovered, subset, lagrange, 2, 37);
+    ASSERT(memcmp(recovered, secret, 37) != 0);
+    
+    // Duplicate or zero x coordinates are rejected
+    x_coords[0] = 3; x_coords[1] = 3;
+    ASSERT(rke_gf256_lagrange_coefficients(x_coords, 2, lagrange) != 0);
+    x_coords[0] = 0;
+    ASSERT(rke_gf256_lagrange_coefficients(x_coords, 2, lagrange) != 0);
+    
+    rke_gf256_force_kernel(NULL);
+    printf("GF(256) sharing tests passed!\n");
+    return 0;
+}
+
 /*
  * Test fragment integrity checking
  */
@@ -262,11 +372,11 @@ int test_key_lifecycle() {
     metadata.sn = 67890;
     
     // Step 3: Split key
-    result = rke_split_key(original_key, 256, &metadata);
+    result = rke_split_key(&test_ctx, original_key, 256, &metadata, test_fragments);
     ASSERT(result == RKE_SUCCESS);
     
-    // Step 4: Reconstruct key
-    result = rke_reconstruct_key(reconstructed_key, 256, &metadata);
+    // Step 4: Reconstruct key from the last threshold fragments
+    result = rke_reconstruct_key(&test_ctx, reconstructed_key, 256, &metadata, &test_fragments[3], 4);
     ASSERT(result == RKE_SUCCESS);
     
     // Step 5: Verify reconstruction
@@ -276,6 +386,60 @@ int test_key_lifecycle() {
     return 0;
 }
 
+/*
+ * Worker for the concurrent context test: split and reconstruct in a loop
+ */
+static void *concurrent_worker(void *arg) {
+    struct rke_ctx_t ctx;
+    struct rke_key_metadata_t metadata;
+    unsigned char key[64];
+    unsigned char reconstructed[64];
+    struct rke_fragment_t fragments[9];
+    long failures = 0;
+    
+    rke_ctx_init(&ctx);
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.total_fragments = 9;
+    metadata.threshold = (uint8_t)(uintptr_t) arg;
+    
+    for (int round = 0; round < 200; round++) {
+        if (rke_generate_key(key, sizeof(key)) != RKE_SUCCESS ||
+            rke_split_key(&ctx, key, sizeof(key), &metadata, fragments) != RKE_SUCCESS ||
+            rke_reconstruct_key(&ctx, reconstructed, sizeof(key), &metadata, fragments + 9 - metadata.threshold,
+                                metadata.threshold) != RKE_SUCCESS ||
+            memcmp(key, reconstructed, sizeof(key)) != 0) {
+            failures++;
+        }
+    }
+    
+    rke_ctx_cleanup(&ctx);
+    return (void *) failures;
+}
+
+/*
+ * Test that independent contexts can be used from several threads at once
+ */
+int test_concurrent_contexts() {
+    pthread_t threads[4];
+    void *failures;
+    long total_failures = 0;
+    
+    printf("Testing concurrent contexts...\n");
+    
+    for (int i = 0; i < 4; i++) {
+        ASSERT(pthread_create(&threads[i], NULL, concurrent_worker, (void *)(uintptr_t)(i + 2)) == 0);
+    }
+    
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], &failures);
+        total_failures += (long) failures;
+    }
+    ASSERT(total_failures == 0);
+    
+    printf("Concurrent context tests passed!\n");
+    return 0;
+}
+
 /*
  * Main test function
  */
@@ -285,13 +449,16 @@ int main() {
     
     // Set log level to reduce noise during testing
     current_log_level = LOG_LEVEL_ERROR;
+    rke_ctx_init(&test_ctx);
     
     // Run all tests
     TEST_FUNCTION(test_key_generation);
     TEST_FUNCTION(test_key_splitting);
+    TEST_FUNCTION(test_gf256_sharing);
     TEST_FUNCTION(test_fragment_integrity);
     TEST_FUNCTION(test_fragment_validation);
     TEST_FUNCTION(test_key_lifecycle);
+    TEST_FUNCTION(test_concurrent_contexts);
     
     // Print results
     printf("\n=== Test Results ===\n");
@@ -0,0 +1,326 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_crypto.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for RKE hashing and checksum backends
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_sha256.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test",
+    .coin_id = 1
+};
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Backends exercised by the tests (unsupported ones are skipped)
+static const char *backend_names[] = {"scalar", "shani", "avx2"};
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+/*
+ * Helper function to decode a hex string
+ */
+static void from_hex(const char *hex, unsigned char *out) {
+    for (size_t i = 0; i < strlen(hex) / 2; i++) {
+        unsigned int byte;
+        sscanf(hex + i * 2, "%2x", &byte);
+        out[i] = (unsigned char) byte;
+    }
+}
+
+/*
+ * Test SHA-256 against the FIPS 180-2 vectors on every backend
+ */
+int test_sha256_vectors() {
+    const char *messages[] = {
+        "",
+        "abc",
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+    };
+    const char *digests[] = {
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+    };
+    unsigned char expected[RKE_SHA256_DIGEST_SIZE];
+    unsigned char digest[RKE_SHA256_DIGEST_SIZE];
+    
+    printf("Testing SHA-256 vectors...\n");
+    
+    for (int b = 0; b < 3; b++) {
+        if (rke_sha256_force_backend(backend_names[b]) != 0) {
+            printf("Backend %s not supported, skipping\n", backend_names[b]);
+            continue;
+        }
+        
+        for (int m = 0; m < 3; m++) {
+            from_hex(digests[m], expected);
+            rke_sha256((const unsigned char *) messages[m], strlen(messages[m]), digest);
+            ASSERT(memcmp(digest, expected, RKE_SHA256_DIGEST_SIZE) == 0);
+        }
+    }
+    
+    // Unknown backend is rejected
+    ASSERT(rke_sha256_force_backend("nonexistent") != 0);
+    rke_sha256_force_backend(NULL);
+    
+    printf("SHA-256 vector tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test incremental hashing with uneven update sizes
+ */
+int test_sha256_streaming() {
+    unsigned char chunk[997];
+    unsigned char expected[RKE_SHA256_DIGEST_SIZE];
+    unsigned char digest[RKE_SHA256_DIGEST_SIZE];
+    unsigned char oneshot[RKE_SHA256_DIGEST_SIZE];
+    struct rke_sha256_ctx_t ctx;
+    size_t remaining;
+    
+    printf("Testing streaming SHA-256...\n");
+    
+    // One million 'a' characters (FIPS 180-2), fed in 997-byte pieces
+    from_hex("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", expected);
+    memset(chunk, 'a', sizeof(chunk));
+    
+    for (int b = 0; b < 3; b++) {
+        if (rke_sha256_force_backend(backend_names[b]) != 0) {
+            continue;
+        }
+        
+        rke_sha256_init(&ctx);
+        for (remaining = 1000000; remaining > 0; ) {
+            size_t n = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+            rke_sha256_update(&ctx, chunk, n);
+            remaining -= n;
+        }
+        rke_sha256_final(&ctx, digest);
+        ASSERT(memcmp(digest, expected, RKE_SHA256_DIGEST_SIZE) == 0);
+    }
+    
+    // Byte-at-a-time updates match the one-shot hash, including sizes over 512 bytes
+    rke_sha256(chunk, sizeof(chunk), oneshot);
+    rke_sha256_init(&ctx);
+    for (size_t i = 0; i < sizeof(chunk); i++) {
+        rke_sha256_update(&ctx, &chunk[i], 1);
+    }
+    rke_sha256_final(&ctx, digest);
+    ASSERT(memcmp(digest, oneshot, RKE_SHA256_DIGEST_SIZE) == 0);
+    
+    rke_sha256_force_backend(NULL);
+    printf("Streaming SHA-256 tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that every backend agrees with the scalar one-shot hash, single and multi-buffer
+ */
+int test_sha256_multi_buffer() {
+    unsigned char message[11][300];
+    unsigned char prefix[11][RKE_CHECKSUM_HEADER_SIZE];
+    unsigned char joined[RKE_CHECKSUM_HEADER_SIZE + 300];
+    unsigned char expected[11][RKE_SHA256_DIGEST_SIZE];
+    unsigned char digest[11][RKE_SHA256_DIGEST_SIZE];
+    struct rke_sha256_lane_t lanes[11];
+    size_t lengths[] = {0, 1, 50, 51, 55, 59, 64, 123, 256, 300};
+    int mismatches;
+    
+    printf("Testing SHA-256 multi-buffer hashing...\n");
+    
+    for (int lane = 0; lane < 11; lane++) {
+        for (int i = 0; i < 300; i++) {
+            message[lane][i] = (unsigned char)(lane * 31 + i * 7);
+        }
+        for (int i = 0; i < RKE_CHECKSUM_HEADER_SIZE; i++) {
+            prefix[lane][i] = (unsigned char)(lane + i);
+        }
+        lanes[lane].prefix = prefix[lane];
+        lanes[lane].body = message[lane];
+        lanes[lane].digest = digest[lane];
+    }
+    
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        // Reference: scalar one-shot over the joined message
+        ASSERT(rke_sha256_force_backend("scalar") == 0);
+        for (int lane = 0; lane < 11; lane++) {
+            memcpy(joined, prefix[lane], RKE_CHECKSUM_HEADER_SIZE);
+            memcpy(joined + RKE_CHECKSUM_HEADER_SIZE, message[lane], lengths[l]);
+            rke_sha256(joined, RKE_CHECKSUM_HEADER_SIZE + lengths[l], expected[lane]);
+        }
+        
+        // 11 lanes: one full group of eight plus a partial group
+        for (int b = 0; b < 3; b++) {
+            if (rke_sha256_force_backend(backend_names[b]) != 0) {
+                continue;
+            }
+            
+            memset(digest, 0, sizeof(digest));
+            rke_sha256_multi(lanes, 11, RKE_CHECKSUM_HEADER_SIZE, lengths[l]);
+            
+            mismatches = 0;
+            for (int lane = 0; lane < 11; lane++) {
+                if (memcmp(digest[lane], expected[lane], RKE_SHA256_DIGEST_SIZE) != 0) {
+                    mismatches++;
+                }
+            }
+            ASSERT(mismatches == 0);
+        }
+    }
+    
+    rke_sha256_force_backend(NULL);
+    printf("SHA-256 multi-buffer tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that batched fragment checksums match single fragment checksums
+ */
+int test_batch_checksums() {
+    struct rke_fragment_t fragments[20];
+    unsigned char expected[20][RKE_CHECKSUM_SIZE];
+    
+    printf("Testing batched fragment checksums...\n");
+    
+    for (int i = 0; i < 20; i++) {
+        memset(&fragments[i], 0, sizeof(struct rke_fragment_t));
+        fragments[i].fragment_id = (uint8_t)(i + 1);
+        fragments[i].total_fragments = 20;
+        fragments[i].threshold = 5;
+        // Two different sizes force separate multi-buffer runs
+        fragments[i].fragment_size = (i < 12) ? 256 : 32;
+        for (int j = 0; j < fragments[i].fragment_size; j++) {
+            fragments[i].data[j] = (unsigned char)(i ^ (j * 3));
+        }
+        
+        ASSERT(rke_calculate_checksum(&fragments[i]) == RKE_SUCCESS);
+        memcpy(expected[i], fragments[i].checksum, RKE_CHECKSUM_SIZE);
+        memset(fragments[i].checksum, 0, RKE_CHECKSUM_SIZE);
+    }
+    
+    ASSERT(rke_calculate_checksums(fragments, 20) == RKE_SUCCESS);
+    for (int i = 0; i < 20; i++) {
+        ASSERT(memcmp(fragments[i].checksum, expected[i], RKE_CHECKSUM_SIZE) == 0);
+        ASSERT(rke_verify_checksum(&fragments[i]) == RKE_SUCCESS);
+    }
+    
+    ASSERT(rke_calculate_checksums(NULL, 20) == RKE_ERROR_INVALID_PARAM);
+    
+    printf("Batched checksum tests passed!\n");
+    return 0;
+}
+
+int test_batch_verification() {
+    struct rke_fragment_t fragments[20];
+    int bad_index = -1;
+    
+    printf("Testing batched checksum verification...\n");
+    
+    for (int i = 0; i < 20; i++) {
+        memset(&fragments[i], 0, sizeof(struct rke_fragment_t));
+        fragments[i].fragment_id = (uint8_t)(i + 1);
+        fragments[i].total_fragments = 20;
+        fragments[i].threshold = 5;
+        fragments[i].fragment_size = (i < 9) ? 256 : 48;
+        for (int j = 0; j < fragments[i].fragment_size; j++) {
+            fragments[i].data[j] = (unsigned char)(i * 7 + j);
+        }
+    }
+    ASSERT(rke_calculate_checksums(fragments, 20) == RKE_SUCCESS);
+    
+    ASSERT(rke_verify_checksums(fragments, 20, &bad_index) == RKE_SUCCESS);
+    ASSERT(rke_verify_checksums(fragments, 0, NULL) == RKE_SUCCESS);
+    
+    // Corrupt a payload byte in the second size run
+    fragments[13].data[5] ^= 0x01;
+    ASSERT(rke_verify_checksums(fragments, 20, &bad_index) == RKE_ERROR_FRAGMENT_CORRUPT);
+    ASSERT(bad_index == 13);
+    ASSERT(rke_verify_checksum(&fragments[13]) == RKE_ERROR_FRAGMENT_CORRUPT);
+    fragments[13].data[5] ^= 0x01;
+    
+    // The header fields are covered as well
+    fragments[2].threshold = 6;
+    ASSERT(rke_verify_checksums(fragments, 20, &bad_index) == RKE_ERROR_FRAGMENT_CORRUPT);
+    ASSERT(bad_index == 2);
+    fragments[2].threshold = 5;
+    
+    fragments[7].checksum[RKE_CHECKSUM_SIZE - 1] ^= 0x80;
+    ASSERT(rke_verify_checksums(fragments, 20, NULL) == RKE_ERROR_FRAGMENT_CORRUPT);
+    fragments[7].checksum[RKE_CHECKSUM_SIZE - 1] ^= 0x80;
+    ASSERT(rke_verify_checksums(fragments, 20, NULL) == RKE_SUCCESS);
+    
+    ASSERT(rke_verify_checksums(NULL, 20, NULL) == RKE_ERROR_INVALID_PARAM);
+    ASSERT(rke_verify_checksums(fragments, RKE_MAX_FRAGMENTS + 1, NULL) == RKE_ERROR_INVALID_PARAM);
+    ASSERT(rke_verify_checksum(NULL) == RKE_ERROR_INVALID_PARAM);
+    
+    printf("Batched verification tests passed!\n");
+    return 0;
+}
+
+/*
+ * Main test function
+ */
+int main() {
+    printf("RKE Crypto Tests\n");
+    printf("================\n");
+    
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    
+    // Run all tests
+    TEST_FUNCTION(test_sha256_vectors);
+    TEST_FUNCTION(test_sha256_streaming);
+    TEST_FUNCTION(test_sha256_multi_buffer);
+    TEST_FUNCTION(test_batch_checksums);
+    TEST_FUNCTION(test_batch_verification);
+    
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+    
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
@@ -0,0 +1,211 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_drbg.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for the per-thread random generator
+#
+# ====================================================*/
+
+// fork() and waitpid() are POSIX, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "../src/rke/rke.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "../src/common/drbg.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_drbg",
+    .coin_id = 1
+};
+
+#define BULK_SIZE (256 * 1024 + 37)
+#define SAMPLE_SIZE 32
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+/*
+ * Test the ChaCha20 block function against RFC 8439 section 2.3.2
+ */
+int test_chacha20_vector() {
+    static const unsigned char expected[DRBG_BLOCK_SIZE] = {
+        0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+        0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+        0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+        0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+    };
+    const uint32_t nonce[3] = { 0x09000000, 0x4a000000, 0x00000000 };
+    uint32_t key[8];
+    unsigned char out[DRBG_BLOCK_SIZE];
+
+    printf("Testing ChaCha20 block function...\n");
+
+    // Key bytes 00 01 02 ... 1f as little-endian words
+    for (int i = 0; i < 8; i++) {
+        key[i] = (uint32_t)(4 * i) | ((uint32_t)(4 * i + 1) << 8) |
+                 ((uint32_t)(4 * i + 2) << 16) | ((uint32_t)(4 * i + 3) << 24);
+    }
+
+    drbg_chacha20_block(key, 1, nonce, out);
+    ASSERT(memcmp(out, expected, sizeof(expected)) == 0);
+
+    printf("ChaCha20 block tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that successive requests of every size produce fresh output
+ */
+int test_random_bytes() {
+    unsigned char a[SAMPLE_SIZE], b[SAMPLE_SIZE], zero[SAMPLE_SIZE];
+    unsigned char *bulk;
+    size_t counts[256] = { 0 };
+    size_t min = (size_t)-1, max = 0;
+
+    printf("Testing random byte generation...\n");
+
+    memset(zero, 0, sizeof(zero));
+    ASSERT(secure_random_bytes(a, sizeof(a)) == 0);
+    ASSERT(secure_random_bytes(b, sizeof(b)) == 0);
+    ASSERT(memcmp(a, b, sizeof(a)) != 0);
+    ASSERT(memcmp(a, zero, sizeof(a)) != 0);
+    ASSERT(drbg_random_bytes(NULL, 0) == 0);
+    ASSERT(drbg_random_bytes(NULL, 1) == -1);
+
+    // Requests that straddle the buffer boundary and the bulk path
+    bulk = (unsigned char *) malloc(BULK_SIZE);
+    ASSERT(bulk != NULL);
+    for (size_t size = 1; size < 3 * DRBG_BUFFER_SIZE; size = size * 2 + 5) {
+        memset(bulk, 0, size + SAMPLE_SIZE);
+        ASSERT(drbg_random_bytes(bulk, size) == 0);
+        ASSERT(size < SAMPLE_SIZE || memcmp(bulk + size - SAMPLE_SIZE, zero, SAMPLE_SIZE) != 0);
+        ASSERT(memcmp(bulk + size, zero, SAMPLE_SIZE) == 0);
+    }
+
+    // A bulk fill is roughly uniform (expected 1024 per value, 12 sigma margin)
+    ASSERT(drbg_random_bytes(bulk, BULK_SIZE) == 0);
+    for (size_t i = 0; i < BULK_SIZE; i++) {
+        counts[bulk[i]]++;
+    }
+    for (int v = 0; v < 256; v++) {
+        min = (counts[v] < min) ? counts[v] : min;
+        max = (counts[v] > max) ? counts[v] : max;
+    }
+    ASSERT(min > 640 && max < 1410);
+
+    // The bytes a bulk run takes as its next key are replaced, not left wiped
+    ASSERT(drbg_reseed() == 0);
+    ASSERT(drbg_random_bytes(bulk, 2 * DRBG_BUFFER_SIZE) == 0);
+    ASSERT(memcmp(bulk, zero, SAMPLE_SIZE) != 0);
+    free(bulk);
+
+    printf("Random byte generation tests passed!\n");
+    return 0;
+}
+
+static void *sample_thread(void *ptr) {
+    if (secure_random_bytes((unsigned char *)ptr, SAMPLE_SIZE) != 0) {
+        memset(ptr, 0, SAMPLE_SIZE);
+    }
+    return NULL;
+}
+
+/*
+ * Test that threads and forked children get independent streams
+ */
+int test_independent_streams() {
+    unsigned char first[SAMPLE_SIZE], second[SAMPLE_SIZE], parent[SAMPLE_SIZE], child[SAMPLE_SIZE];
+    pthread_t thread;
+    int fds[2], status;
+    pid_t pid;
+
+    printf("Testing independent streams...\n");
+
+    ASSERT(pthread_create(&thread, NULL, sample_thread, first) == 0);
+    pthread_join(thread, NULL);
+    ASSERT(pthread_create(&thread, NULL, sample_thread, second) == 0);
+    pthread_join(thread, NULL);
+    ASSERT(memcmp(first, second, SAMPLE_SIZE) != 0);
+
+    // Without a reseed the child would continue the parent's buffered stream
+    ASSERT(secure_random_bytes(parent, 1) == 0);
+    ASSERT(pipe(fds) == 0);
+    pid = fork();
+    ASSERT(pid >= 0);
+    if (pid == 0) {
+        close(fds[0]);
+        if (secure_random_bytes(child, SAMPLE_SIZE) != 0 || write(fds[1], child, SAMPLE_SIZE) != SAMPLE_SIZE) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    ASSERT(secure_random_bytes(parent, SAMPLE_SIZE) == 0);
+    ASSERT(read(fds[0], child, SAMPLE_SIZE) == SAMPLE_SIZE);
+    close(fds[0]);
+    ASSERT(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    ASSERT(memcmp(parent, child, SAMPLE_SIZE) != 0);
+
+    printf("Independent stream tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Random Generator Tests\n");
+    printf("==========================\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+
+    // Run all tests
+    TEST_FUNCTION(test_chacha20_vector);
+    TEST_FUNCTION(test_random_bytes);
+    TEST_FUNCTION(test_independent_streams);
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
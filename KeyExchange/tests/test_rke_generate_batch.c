@@ -0,0 +1,205 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_generate_batch.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for the RKE generate batch command
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_cache.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "test_helpers.h"
+#include "../src/common/protocol.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_generate_batch",
+    .coin_id = 1
+};
+
+#define BATCH_ROLLBACK_KEYS (RKE_MAX_BATCH_KEYS + 4)
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Shared fragment buffers
+static struct rke_fragment_t stored[RKE_MAX_FRAGMENTS];
+static struct rke_fragment_t loaded[RKE_MAX_FRAGMENTS];
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+/*
+ * Helper function to fill a generate batch request for BATCH_ROLLBACK_KEYS new key ids
+ */
+static void fill_generate_batch(unsigned char *payload, size_t size) {
+    payload[0] = RKE_KEY_TYPE_SYMMETRIC;
+    payload[1] = 5;
+    payload[2] = 3;
+    payload[3] = 0;
+    payload[4] = BATCH_ROLLBACK_KEYS;
+    for (int k = 0; k < BATCH_ROLLBACK_KEYS; k++) {
+        rke_generate_key(payload + 5 + (size_t)k * RKE_KEY_ID_SIZE, RKE_KEY_ID_SIZE);
+    }
+    payload[size - 2] = 0x3E;
+    payload[size - 1] = 0x3E;
+}
+
+/*
+ * Test that a generate batch that fails part way leaves none of its keys stored
+ */
+int test_generate_batch_rollback() {
+    unsigned char payload[5 + BATCH_ROLLBACK_KEYS * RKE_KEY_ID_SIZE + 2];
+    unsigned char *key_ids = payload + 5;
+    struct rke_key_metadata_t metadata;
+    char path[1000], temp[1024];
+    conn_info_t ci;
+    int stored_keys = 0;
+
+    printf("Testing generate batch rollback...\n");
+
+    fill_generate_batch(payload, sizeof(payload));
+
+    // A directory in place of the last key's temporary container makes its store fail after a whole
+    // chunk is stored
+    ASSERT(rke_container_path(key_ids + (BATCH_ROLLBACK_KEYS - 1) * RKE_KEY_ID_SIZE, path, sizeof(path)) == RKE_SUCCESS);
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    ASSERT(create_directory_recursive(temp) == 0);
+
+    memset(&ci, 0, sizeof(ci));
+    ci.body = payload;
+    ci.body_size = sizeof(payload);
+    cmd_rke_generate_batch(&ci);
+    ASSERT(ci.command_status == ERROR_FILESYSTEM);
+    ASSERT(ci.output == NULL);
+
+    for (int k = 0; k < BATCH_ROLLBACK_KEYS - 1; k++) {
+        stored_keys += (rke_load_metadata(&metadata, key_ids + (size_t)k * RKE_KEY_ID_SIZE) == RKE_SUCCESS);
+        stored_keys += (rke_count_fragments(key_ids + (size_t)k * RKE_KEY_ID_SIZE) > 0);
+    }
+    ASSERT(stored_keys == 0);
+
+    // Once the container can be written again the same request stores every key
+    ASSERT(rmdir(temp) == 0);
+    memset(&ci, 0, sizeof(ci));
+    ci.body = payload;
+    ci.body_size = sizeof(payload);
+    cmd_rke_generate_batch(&ci);
+    ASSERT(ci.command_status == STATUS_SUCCESS);
+    release_output(&ci);
+    for (int k = 0; k < BATCH_ROLLBACK_KEYS; k++) {
+        stored_keys += (rke_count_fragments(key_ids + (size_t)k * RKE_KEY_ID_SIZE) == 5);
+    }
+    ASSERT(stored_keys == BATCH_ROLLBACK_KEYS);
+
+    printf("Generate batch rollback tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that a batch naming an already stored key fails and leaves that key as it was
+ */
+int test_generate_batch_existing_key() {
+    static struct rke_ctx_t ctx;
+    unsigned char payload[5 + BATCH_ROLLBACK_KEYS * RKE_KEY_ID_SIZE + 2];
+    unsigned char *key_ids = payload + 5;
+    unsigned char secret[32], rebuilt[32];
+    struct rke_key_metadata_t metadata, loaded_metadata;
+    conn_info_t ci;
+    int stored_keys = 0;
+
+    printf("Testing generate batch over a stored key...\n");
+
+    rke_ctx_init(&ctx);
+    make_key(&metadata, 5, 3);
+    metadata.key_size = sizeof(secret);
+    ASSERT(rke_generate_key(secret, sizeof(secret)) == RKE_SUCCESS);
+    ASSERT(rke_split_key(&ctx, secret, sizeof(secret), &metadata, stored) == RKE_SUCCESS);
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 5) == RKE_SUCCESS);
+
+    // The stored key comes last, after a whole chunk of new keys is stored
+    fill_generate_batch(payload, sizeof(payload));
+    memcpy(key_ids + (BATCH_ROLLBACK_KEYS - 1) * RKE_KEY_ID_SIZE, metadata.key_id, RKE_KEY_ID_SIZE);
+
+    memset(&ci, 0, sizeof(ci));
+    ci.body = payload;
+    ci.body_size = sizeof(payload);
+    cmd_rke_generate_batch(&ci);
+    ASSERT(ci.command_status == ERROR_INVALID_PARAMETER);
+    ASSERT(ci.output == NULL);
+
+    for (int k = 0; k < BATCH_ROLLBACK_KEYS - 1; k++) {
+        stored_keys += (rke_count_fragments(key_ids + (size_t)k * RKE_KEY_ID_SIZE) > 0);
+    }
+    ASSERT(stored_keys == 0);
+
+    // The original key still reconstructs
+    rke_cache_clear();
+    ASSERT(rke_load_fragments(metadata.key_id, &loaded_metadata, loaded, 5) == 5);
+    ASSERT(memcmp(&loaded_metadata, &metadata, sizeof(metadata)) == 0);
+    ASSERT(rke_reconstruct_key(&ctx, rebuilt, sizeof(rebuilt), &loaded_metadata, &loaded[2], 3) == RKE_SUCCESS);
+    ASSERT(memcmp(rebuilt, secret, sizeof(secret)) == 0);
+    rke_ctx_cleanup(&ctx);
+
+    printf("Generate batch over a stored key tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Generate Batch Tests\n");
+    printf("========================\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    if (test_setup_storage() != 0) {
+        printf("Can't create test directory %s\n", config.cwd);
+        return 1;
+    }
+
+    // Run all tests
+    TEST_FUNCTION(test_generate_batch_rollback);
+    TEST_FUNCTION(test_generate_batch_existing_key);
+
+    test_teardown_storage();
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
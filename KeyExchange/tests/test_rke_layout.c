@@ -0,0 +1,440 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_layout.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for the fragment wire form, container slots and key sizes
+#
+# ====================================================*/
+
+// pread/pwrite are POSIX.1-2008, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_cache.h"
+#include "../src/rke/rke_container.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "test_helpers.h"
+#include "../src/common/protocol.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_layout",
+    .coin_id = 1
+};
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Shared fragment buffers
+static struct rke_fragment_t stored[RKE_MAX_FRAGMENTS];
+static struct rke_fragment_t loaded[RKE_MAX_FRAGMENTS];
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+/*
+ * Helper function to create mock connection info
+ */
+static conn_info_t *create_mock_connection(unsigned char *body, uint32_t body_size) {
+    conn_info_t *ci = (conn_info_t *) calloc(1, sizeof(conn_info_t));
+
+    if (ci != NULL) {
+        ci->body = body;
+        ci->body_size = body_size;
+        ci->command_status = -999;
+    }
+    return ci;
+}
+
+static void cleanup_mock_connection(conn_info_t *ci) {
+    if (ci != NULL) {
+        release_output(ci);
+        free(ci);
+    }
+}
+
+/*
+ * Test the fragment layout and unpacking of its wire form
+ */
+int test_fragment_layout() {
+    struct rke_fragment_t fragment, unpacked;
+    unsigned char record[sizeof(struct rke_fragment_t)];
+
+    printf("Testing fragment layout...\n");
+
+    // One cache line of header, then the payload on its own line
+    ASSERT(offsetof(struct rke_fragment_t, data) == RKE_FRAGMENT_HEADER_SIZE);
+    ASSERT(sizeof(struct rke_fragment_t) == 320);
+    ASSERT(RKE_FRAGMENT_WIRE_SIZE(1) == 128);
+    ASSERT(RKE_FRAGMENT_WIRE_SIZE(64) == 128);
+    ASSERT(RKE_FRAGMENT_WIRE_SIZE(65) == 192);
+    ASSERT(RKE_FRAGMENT_WIRE_SIZE(RKE_FRAGMENT_DATA_SIZE) == sizeof(struct rke_fragment_t));
+
+    // Only the wire bytes are read back, the rest of the payload is zeroed
+    memset(&fragment, 0, sizeof(fragment));
+    fragment.fragment_id = 2;
+    fragment.total_fragments = 3;
+    fragment.threshold = 2;
+    fragment.fragment_size = 40;
+    for (int i = 0; i < 40; i++) {
+        fragment.data[i] = (unsigned char)(i + 1);
+    }
+    rke_calculate_checksum(&fragment);
+    memcpy(record, &fragment, sizeof(record));
+    memset(record + RKE_FRAGMENT_WIRE_SIZE(40), 0xAA, sizeof(record) - RKE_FRAGMENT_WIRE_SIZE(40));
+
+    memset(&unpacked, 0xCC, sizeof(unpacked));
+    ASSERT(rke_fragment_unpack(&unpacked, record, sizeof(record)) == (int)RKE_FRAGMENT_WIRE_SIZE(40));
+    ASSERT(memcmp(&unpacked, &fragment, sizeof(fragment)) == 0);
+    ASSERT(rke_verify_checksum(&unpacked) == RKE_SUCCESS);
+
+    // Records shorter than their wire form or with oversized payloads are corrupt
+    ASSERT(rke_fragment_unpack(&unpacked, record, RKE_FRAGMENT_HEADER_SIZE - 1) == RKE_ERROR_FRAGMENT_CORRUPT);
+    ASSERT(rke_fragment_unpack(&unpacked, record, RKE_FRAGMENT_WIRE_SIZE(40) - 1) == RKE_ERROR_FRAGMENT_CORRUPT);
+    fragment.fragment_size = RKE_FRAGMENT_DATA_SIZE + 1;
+    memcpy(record, &fragment, RKE_FRAGMENT_HEADER_SIZE);
+    ASSERT(rke_fragment_unpack(&unpacked, record, sizeof(record)) == RKE_ERROR_FRAGMENT_CORRUPT);
+
+    printf("Fragment layout tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that containers size their slots to the fragments they hold
+ */
+int test_container_slot_size() {
+    struct rke_key_metadata_t metadata;
+    struct rke_fragment_t large;
+    char path[4096];
+    struct stat st;
+
+    printf("Testing container slot size...\n");
+
+    make_key(&metadata, 8, 3);
+    for (int i = 0; i < 4; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), 8, 3, 0);
+        stored[i].fragment_size = 32;
+        memset(stored[i].data + 32, 0, RKE_FRAGMENT_DATA_SIZE - 32);
+        rke_calculate_checksum(&stored[i]);
+    }
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 4) == RKE_SUCCESS);
+
+    // A header line and a payload line per fragment
+    ASSERT(rke_container_path(metadata.key_id, path, sizeof(path)) == RKE_SUCCESS);
+    ASSERT(stat(path, &st) == 0);
+    ASSERT(st.st_size == (off_t)(RKE_CONTAINER_HEADER_SIZE + 4 * RKE_FRAGMENT_WIRE_SIZE(32)));
+
+    memset(loaded, 0xCC, sizeof(loaded));
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 8) == 4);
+    ASSERT(memcmp(loaded, stored, 4 * sizeof(struct rke_fragment_t)) == 0);
+    ASSERT(rke_load_fragment(&loaded[0], metadata.key_id, 3) == RKE_SUCCESS);
+    ASSERT(memcmp(&loaded[0], &stored[2], sizeof(struct rke_fragment_t)) == 0);
+
+    // The slots stay the same size while the container holds fragments
+    make_fragment(&large, 5, 8, 3, 0);
+    ASSERT(rke_store_fragment(&large, metadata.key_id) == RKE_ERROR_INVALID_PARAM);
+    ASSERT(rke_count_fragments(metadata.key_id) == 4);
+
+    printf("Container slot size tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that a container of any other layout version is rejected rather than read
+ */
+int test_container_version() {
+    struct rke_key_metadata_t metadata, loaded_metadata;
+    struct rke_container_header_t header;
+    char path[4096];
+    int fd;
+
+    printf("Testing container version...\n");
+
+    make_key(&metadata, 6, 2);
+    ASSERT(rke_store_metadata(&metadata) == RKE_SUCCESS);
+    make_fragment(&stored[0], 1, 6, 2, 0);
+    ASSERT(rke_store_fragment(&stored[0], metadata.key_id) == RKE_SUCCESS);
+    ASSERT(rke_container_path(metadata.key_id, path, sizeof(path)) == RKE_SUCCESS);
+
+    // Rewrite the header as version 1, which never shipped
+    fd = open(path, O_RDWR);
+    ASSERT(fd >= 0);
+    ASSERT(pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header));
+    header.version = 1;
+    ASSERT(rke_container_check_header(&header) == RKE_ERROR_FRAGMENT_CORRUPT);
+    ASSERT(pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header));
+    close(fd);
+    rke_cache_clear();
+
+    ASSERT(rke_load_metadata(&loaded_metadata, metadata.key_id) != RKE_SUCCESS);
+    ASSERT(rke_load_fragments(metadata.key_id, &loaded_metadata, loaded, 6) < 0);
+    make_fragment(&stored[1], 2, 6, 2, 0);
+    ASSERT(rke_store_fragment(&stored[1], metadata.key_id) == RKE_ERROR_FRAGMENT_CORRUPT);
+
+    printf("Container version tests passed!\n");
+    return 0;
+}
+
+/*
+ * Helper function to run a key_id-only command (query, reconstruct) for a key
+ */
+static conn_info_t *run_key_command(void (*command)(conn_info_t *), const unsigned char *key_id,
+                                    unsigned char *payload) {
+    conn_info_t *ci;
+
+    memcpy(payload, key_id, 16);
+    payload[16] = 0xFF;
+    payload[17] = 0xFF;
+    ci = create_mock_connection(payload, 18);
+    if (ci != NULL) {
+        command(ci);
+    }
+    return ci;
+}
+
+/*
+ * Test that keys of a requested size are stored, sent and reconstructed at that size
+ */
+int test_key_sizes() {
+    printf("Testing key sizes...\n");
+
+    // 16-byte key_id + key_type + total + threshold + 2-byte key_size + 2-byte EOF
+    unsigned char payload[23];
+    for (int i = 0; i < 16; i++) {
+        payload[i] = (unsigned char)(i + 230);
+    }
+    payload[16] = RKE_KEY_TYPE_SYMMETRIC;
+    payload[17] = 5;  // total_fragments
+    payload[18] = 3;  // threshold
+    payload[19] = 0;  // key_size (32)
+    payload[20] = 32;
+    payload[21] = 0xFF;
+    payload[22] = 0xFF;
+
+    conn_info_t *ci = create_mock_connection(payload, 23);
+    ASSERT(ci != NULL);
+    cmd_rke_generate(ci);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    cleanup_mock_connection(ci);
+
+    // Five slots of one header line and one payload line each
+    char path[4096];
+    struct stat st;
+    ASSERT(RKE_FRAGMENT_WIRE_SIZE(32) == 128);
+    ASSERT(rke_container_path(payload, path, sizeof(path)) == RKE_SUCCESS);
+    ASSERT(stat(path, &st) == 0);
+    ASSERT(st.st_size == (off_t)(4096 + 5 * RKE_FRAGMENT_WIRE_SIZE(32)));
+
+    unsigned char key_payload[18];
+    ci = run_key_command(cmd_rke_query, payload, key_payload);
+    ASSERT(ci != NULL && ci->command_status == STATUS_SUCCESS);
+    ASSERT(((struct rke_key_metadata_t *)ci->output)->key_size == 32);
+    cleanup_mock_connection(ci);
+
+    // Fragments are sent as their wire form only
+    unsigned char exchange_payload[19];
+    struct rke_fragment_t fragment;
+    memcpy(exchange_payload, payload, 16);
+    exchange_payload[16] = 2;
+    exchange_payload[17] = 0xFF;
+    exchange_payload[18] = 0xFF;
+    ci = create_mock_connection(exchange_payload, 19);
+    ASSERT(ci != NULL);
+    cmd_rke_exchange(ci);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == RKE_FRAGMENT_WIRE_SIZE(32));
+    ASSERT(rke_fragment_unpack(&fragment, ci->output, ci->output_size) == (int)ci->output_size);
+    ASSERT(fragment.fragment_id == 2 && fragment.fragment_size == 32);
+    ASSERT(rke_verify_checksum(&fragment) == RKE_SUCCESS);
+    cleanup_mock_connection(ci);
+
+    ci = run_key_command(cmd_rke_reconstruct, payload, key_payload);
+    ASSERT(ci != NULL && ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == 32);
+    cleanup_mock_connection(ci);
+
+    // Key sizes outside 1..RKE_MAX_KEY_SIZE are refused
+    payload[20] = 0;
+    ci = create_mock_connection(payload, 23);
+    ASSERT(ci != NULL);
+    cmd_rke_generate(ci);
+    ASSERT(ci->command_status == ERROR_INVALID_PARAMETER);
+    cleanup_mock_connection(ci);
+
+    payload[19] = 1;  // 257
+    payload[20] = 1;
+    ci = create_mock_connection(payload, 23);
+    ASSERT(ci != NULL);
+    cmd_rke_generate(ci);
+    ASSERT(ci->command_status == ERROR_INVALID_PARAMETER);
+    cleanup_mock_connection(ci);
+
+    // Batches carry the key size after the key ids
+    unsigned char batch_payload[9 + 2 * 16];
+    batch_payload[0] = RKE_KEY_TYPE_SYMMETRIC;
+    batch_payload[1] = 4;  // total_fragments
+    batch_payload[2] = 2;  // threshold
+    batch_payload[3] = 0;  // count (2)
+    batch_payload[4] = 2;
+    for (int i = 0; i < 2 * 16; i++) {
+        batch_payload[5 + i] = (unsigned char)(i + 170);
+    }
+    batch_payload[37] = 0;  // key_size (16)
+    batch_payload[38] = 16;
+    batch_payload[39] = 0xFF;
+    batch_payload[40] = 0xFF;
+
+    ci = create_mock_connection(batch_payload, sizeof(batch_payload));
+    ASSERT(ci != NULL);
+    cmd_rke_generate_batch(ci);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    cleanup_mock_connection(ci);
+
+    ci = run_key_command(cmd_rke_reconstruct, batch_payload + 5 + 16, key_payload);
+    ASSERT(ci != NULL && ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == 16);
+    cleanup_mock_connection(ci);
+
+    printf("Key size tests passed!\n");
+    return 0;
+}
+
+/*
+ * Helper function to run a generate request for a key of key_size bytes
+ */
+static int run_generate(const unsigned char *key_id, uint8_t total, uint8_t threshold, uint16_t key_size) {
+    unsigned char payload[23];
+    conn_info_t *ci;
+    int status;
+
+    memcpy(payload, key_id, RKE_KEY_ID_SIZE);
+    payload[16] = RKE_KEY_TYPE_SYMMETRIC;
+    payload[17] = total;
+    payload[18] = threshold;
+    payload[19] = (unsigned char)(key_size >> 8);
+    payload[20] = (unsigned char)key_size;
+    payload[21] = 0xFF;
+    payload[22] = 0xFF;
+
+    ci = create_mock_connection(payload, sizeof(payload));
+    if (ci == NULL) {
+        return ERROR_MEMORY_ALLOC;
+    }
+    cmd_rke_generate(ci);
+    status = ci->command_status;
+    cleanup_mock_connection(ci);
+    return status;
+}
+
+/*
+ * Test that generating an existing key_id again replaces the key, whatever its size
+ */
+int test_key_regenerate() {
+    unsigned char key_id[RKE_KEY_ID_SIZE], key_payload[18];
+    char path[4096];
+    struct stat st;
+    conn_info_t *ci;
+
+    printf("Testing key regeneration...\n");
+
+    rke_generate_key(key_id, RKE_KEY_ID_SIZE);
+    ASSERT(rke_container_path(key_id, path, sizeof(path)) == RKE_SUCCESS);
+
+    ASSERT(run_generate(key_id, 8, 3, 32) == STATUS_SUCCESS);
+    ASSERT(stat(path, &st) == 0);
+    ASSERT(st.st_size == (off_t)(RKE_CONTAINER_HEADER_SIZE + 8 * RKE_FRAGMENT_WIRE_SIZE(32)));
+
+    // Larger fragments and fewer of them: nothing of the old key is left
+    ASSERT(run_generate(key_id, 5, 3, 256) == STATUS_SUCCESS);
+    ASSERT(stat(path, &st) == 0);
+    ASSERT(st.st_size == (off_t)(RKE_CONTAINER_HEADER_SIZE + 5 * RKE_FRAGMENT_WIRE_SIZE(256)));
+    ASSERT(rke_count_fragments(key_id) == 5);
+    ASSERT(!rke_fragment_exists(key_id, 8));
+
+    ci = run_key_command(cmd_rke_query, key_id, key_payload);
+    ASSERT(ci != NULL && ci->command_status == STATUS_SUCCESS);
+    ASSERT(((struct rke_key_metadata_t *)ci->output)->key_size == 256);
+    ASSERT(((struct rke_key_metadata_t *)ci->output)->total_fragments == 5);
+    cleanup_mock_connection(ci);
+
+    ci = run_key_command(cmd_rke_reconstruct, key_id, key_payload);
+    ASSERT(ci != NULL && ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == 256);
+    cleanup_mock_connection(ci);
+
+    // And back down again
+    ASSERT(run_generate(key_id, 4, 2, 32) == STATUS_SUCCESS);
+    ASSERT(rke_count_fragments(key_id) == 4);
+    ci = run_key_command(cmd_rke_reconstruct, key_id, key_payload);
+    ASSERT(ci != NULL && ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == 32);
+    cleanup_mock_connection(ci);
+
+    printf("Key regeneration tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Layout Tests\n");
+    printf("================\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    if (test_setup_storage() != 0) {
+        printf("Can't create test directory %s\n", config.cwd);
+        return 1;
+    }
+
+    // Run all tests
+    TEST_FUNCTION(test_fragment_layout);
+    TEST_FUNCTION(test_container_slot_size);
+    TEST_FUNCTION(test_container_version);
+    TEST_FUNCTION(test_key_sizes);
+    TEST_FUNCTION(test_key_regenerate);
+
+    test_teardown_storage();
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
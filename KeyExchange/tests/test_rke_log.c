@@ -0,0 +1,278 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_log.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for the asynchronous logging backend
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_log",
+    .coin_id = 1
+};
+
+#define LOG_THREADS 4
+#define MESSAGES_PER_THREAD 1000
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Arguments evaluated by logging calls
+static int evaluations = 0;
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+static int evaluate(void) {
+    return ++evaluations;
+}
+
+/*
+ * Test that messages below the active level skip argument evaluation
+ */
+int test_level_filter() {
+    struct log_stats_t before, after;
+    FILE *stream = tmpfile();
+
+    printf("Testing level filter...\n");
+
+    ASSERT(stream != NULL);
+    log_set_stream(stream);
+    log_get_stats(&before);
+
+    current_log_level = LOG_LEVEL_WARN;
+    evaluations = 0;
+    debug("hidden %d", evaluate());
+    info("hidden %d", evaluate());
+    ASSERT(evaluations == 0);
+    warn("shown %d", evaluate());
+    error("shown %d", evaluate());
+    ASSERT(evaluations == 2);
+    current_log_level = LOG_LEVEL_DEBUG;
+
+    // Levels below RKE_MIN_LOG_LEVEL are not compiled in at all
+    evaluations = 0;
+    debug("compiled %d", evaluate());
+    ASSERT(evaluations == (RKE_MIN_LOG_LEVEL <= LOG_LEVEL_DEBUG));
+    ASSERT(LOG_ENABLED(LOG_LEVEL_ERROR));
+
+    // errno survives a logging call
+    errno = ENOENT;
+    warn("errno check");
+    ASSERT(errno == ENOENT);
+
+    log_flush();
+    log_get_stats(&after);
+    ASSERT(after.written - before.written == 3 + (uint64_t)evaluations);
+
+    log_set_stream(NULL);
+    fclose(stream);
+
+    printf("Level filter tests passed!\n");
+    return 0;
+}
+
+static void *log_thread(void *ptr) {
+    int id = *(int *)ptr;
+
+    for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+        info("thread %d message %d payload %s end", id, i, "0123456789abcdef0123456789abcdef");
+    }
+
+    return NULL;
+}
+
+/*
+ * Test that concurrent writers and exited threads produce whole, ordered lines
+ */
+int test_concurrent_lines() {
+    pthread_t threads[LOG_THREADS];
+    int ids[LOG_THREADS], last[LOG_THREADS];
+    struct log_stats_t before, after;
+    char line[1024];
+    FILE *stream = tmpfile();
+    int lines = 0, malformed = 0, disordered = 0;
+
+    printf("Testing concurrent lines...\n");
+
+    ASSERT(stream != NULL);
+    log_set_stream(stream);
+    log_get_stats(&before);
+
+    for (int t = 0; t < LOG_THREADS; t++) {
+        ids[t] = t;
+        last[t] = -1;
+        ASSERT(pthread_create(&threads[t], NULL, log_thread, &ids[t]) == 0);
+    }
+    for (int t = 0; t < LOG_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // The writers have exited; their rings are still drained
+    log_flush();
+    log_get_stats(&after);
+    log_set_stream(NULL);
+    ASSERT(after.written - before.written + after.dropped - before.dropped == LOG_THREADS * MESSAGES_PER_THREAD);
+    printf("  %d written, %d dropped\n", (int)(after.written - before.written), (int)(after.dropped - before.dropped));
+
+    rewind(stream);
+    while (fgets(line, sizeof(line), stream) != NULL) {
+        char *body = strstr(line, "[INFO] thread ");
+        int id, index;
+
+        if (strncmp(line, "[log] ", 6) == 0) {
+            continue;
+        }
+        if (line[0] != '[' || strstr(line, "test_rke_log.c:") == NULL || body == NULL ||
+            sscanf(body, "[INFO] thread %d message %d", &id, &index) != 2 ||
+            id < 0 || id >= LOG_THREADS || strcmp(line + strlen(line) - 5, " end\n") != 0) {
+            malformed++;
+            continue;
+        }
+        disordered += (index <= last[id]);
+        last[id] = index;
+        lines++;
+    }
+    fclose(stream);
+
+    ASSERT(malformed == 0);
+    ASSERT(disordered == 0);
+    ASSERT(lines == (int)(after.written - before.written));
+
+    printf("Concurrent line tests passed!\n");
+    return 0;
+}
+
+static void *warn_thread(void *ptr) {
+    int id = *(int *)ptr;
+
+    for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+        warn("thread %d warning %d", id, i);
+    }
+
+    return NULL;
+}
+
+/*
+ * Test that warnings outrunning the drain are written, not dropped
+ */
+int test_full_ring_warnings() {
+    pthread_t threads[LOG_THREADS];
+    int ids[LOG_THREADS];
+    struct log_stats_t before, after;
+    FILE *stream = tmpfile();
+
+    printf("Testing full ring warnings...\n");
+
+    ASSERT(stream != NULL);
+    log_set_stream(stream);
+    log_get_stats(&before);
+
+    // Each thread logs more than its ring holds
+    ASSERT(MESSAGES_PER_THREAD > LOG_RING_SLOTS);
+    for (int t = 0; t < LOG_THREADS; t++) {
+        ids[t] = t;
+        ASSERT(pthread_create(&threads[t], NULL, warn_thread, &ids[t]) == 0);
+    }
+    for (int t = 0; t < LOG_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    log_flush();
+    log_get_stats(&after);
+    log_set_stream(NULL);
+    fclose(stream);
+
+    ASSERT(after.dropped == before.dropped);
+    ASSERT(after.written - before.written == LOG_THREADS * MESSAGES_PER_THREAD);
+
+    printf("Full ring warning tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that an oversized message is truncated to one line
+ */
+int test_long_message() {
+    char text[LOG_TEXT_SIZE * 2], line[1024];
+    FILE *stream = tmpfile();
+
+    printf("Testing long message...\n");
+
+    ASSERT(stream != NULL);
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = 0;
+
+    log_set_stream(stream);
+    info("%s", text);
+    info("after");
+    log_set_stream(NULL);
+
+    rewind(stream);
+    ASSERT(fgets(line, sizeof(line), stream) != NULL);
+    ASSERT(strstr(line, "[INFO] xxx") != NULL);
+    ASSERT(line[strlen(line) - 1] == '\n');
+    ASSERT(strlen(strstr(line, "[INFO] ")) == strlen("[INFO] ") + LOG_TEXT_SIZE - 1 + 1);
+    ASSERT(fgets(line, sizeof(line), stream) != NULL);
+    ASSERT(strstr(line, "[INFO] after") != NULL);
+    fclose(stream);
+
+    printf("Long message tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Logging Tests\n");
+    printf("=================\n");
+
+    // Run all tests
+    TEST_FUNCTION(test_level_filter);
+    TEST_FUNCTION(test_concurrent_lines);
+    TEST_FUNCTION(test_full_ring_warnings);
+    TEST_FUNCTION(test_long_message);
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
@@ -0,0 +1,360 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_mmap.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for mapped fragment serving
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_mmap.h"
+#include "../src/rke/rke_worker.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "test_helpers.h"
+#include "../src/common/protocol.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_mmap",
+    .coin_id = 1
+};
+
+#define EVICTION_KEYS 40
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Shared fragment buffer
+static struct rke_fragment_t stored[RKE_MAX_FRAGMENTS];
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+/*
+ * Helper function to run an exchange request for one fragment
+ */
+static conn_info_t *run_exchange(unsigned char *payload, const unsigned char *key_id, uint8_t fragment_id) {
+    conn_info_t *ci = (conn_info_t *) calloc(1, sizeof(conn_info_t));
+
+    if (ci == NULL) {
+        return NULL;
+    }
+
+    memcpy(payload, key_id, RKE_KEY_ID_SIZE);
+    payload[RKE_KEY_ID_SIZE] = fragment_id;
+    payload[RKE_KEY_ID_SIZE + 1] = 0x3E;
+    payload[RKE_KEY_ID_SIZE + 2] = 0x3E;
+    ci->body = payload;
+    ci->body_size = RKE_KEY_ID_SIZE + 3;
+    ci->command_status = -999;
+
+    cmd_rke_exchange(ci);
+    return ci;
+}
+
+static void cleanup_exchange(conn_info_t *ci) {
+    release_output(ci);
+    free(ci);
+}
+
+/*
+ * Test that exchange responses point into the mapped container
+ */
+int test_mapped_exchange() {
+    struct rke_key_metadata_t metadata;
+    struct rke_mmap_stats_t stats;
+    unsigned char payload[RKE_KEY_ID_SIZE + 3];
+    conn_info_t *ci;
+
+    printf("Testing mapped exchange...\n");
+
+    make_key(&metadata, 10, 3);
+    for (int i = 0; i < 10; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), 10, 3, 0);
+    }
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 10) == RKE_SUCCESS);
+    ASSERT(rke_mmap_enabled());
+
+    ci = run_exchange(payload, metadata.key_id, 4);
+    ASSERT(ci != NULL);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == sizeof(struct rke_fragment_t));
+    ASSERT(ci->output_release != NULL);
+    ASSERT(memcmp(ci->output, &stored[3], sizeof(struct rke_fragment_t)) == 0);
+    cleanup_exchange(ci);
+
+    // The second request reuses the mapping
+    ci = run_exchange(payload, metadata.key_id, 7);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(memcmp(ci->output, &stored[6], sizeof(struct rke_fragment_t)) == 0);
+    cleanup_exchange(ci);
+    rke_mmap_get_stats(&stats);
+    ASSERT(stats.misses == 1);
+    ASSERT(stats.hits == 1);
+    ASSERT(stats.mappings == 1);
+
+    // Missing fragments and unknown keys are still parameter errors
+    ci = run_exchange(payload, metadata.key_id, 11);
+    ASSERT(ci->command_status == ERROR_INVALID_PARAMETER);
+    ASSERT(ci->output == NULL);
+    cleanup_exchange(ci);
+    ci = run_exchange(payload, metadata.key_id, 0);
+    ASSERT(ci->command_status == ERROR_INVALID_PARAMETER);
+    cleanup_exchange(ci);
+    make_key(&metadata, 10, 3);
+    ci = run_exchange(payload, metadata.key_id, 1);
+    ASSERT(ci->command_status == ERROR_INVALID_PARAMETER);
+    cleanup_exchange(ci);
+
+    printf("Mapped exchange tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that disabling the cache falls back to copied responses
+ */
+int test_copied_exchange() {
+    struct rke_key_metadata_t metadata;
+    unsigned char payload[RKE_KEY_ID_SIZE + 3];
+    conn_info_t *ci, probe;
+
+    printf("Testing copied exchange...\n");
+
+    make_key(&metadata, 5, 3);
+    for (int i = 0; i < 5; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), 5, 3, 0);
+    }
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 5) == RKE_SUCCESS);
+
+    ASSERT(rke_mmap_set_capacity(0) == RKE_SUCCESS);
+    ASSERT(!rke_mmap_enabled());
+
+    // The copy comes from the worker's output arena, not from a mapping
+    memset(&probe, 0, sizeof(probe));
+    ASSERT(rke_alloc_output(&probe, 1) != NULL);
+    ci = run_exchange(payload, metadata.key_id, 2);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_release == probe.output_release);
+    release_output(&probe);
+    ASSERT(memcmp(ci->output, &stored[1], sizeof(struct rke_fragment_t)) == 0);
+    cleanup_exchange(ci);
+
+    ASSERT(rke_mmap_set_capacity(RKE_MMAP_DEFAULT_CAPACITY) == RKE_SUCCESS);
+    ASSERT(rke_mmap_enabled());
+
+    printf("Copied exchange tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that a rewrite drops the cached mapping but not the bytes a response still holds
+ */
+int test_mmap_invalidation() {
+    struct rke_key_metadata_t metadata;
+    struct rke_fragment_t updated;
+    const struct rke_fragment_t *old_fragment, *new_fragment;
+    struct rke_mmap_ref_t *old_ref, *new_ref;
+
+    printf("Testing mapping invalidation...\n");
+
+    make_key(&metadata, 5, 3);
+    for (int i = 0; i < 5; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), 5, 3, 0);
+    }
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 5) == RKE_SUCCESS);
+
+    ASSERT(rke_mmap_fragment(metadata.key_id, 1, &old_fragment, &old_ref) == RKE_SUCCESS);
+    ASSERT(memcmp(old_fragment, &stored[0], sizeof(struct rke_fragment_t)) == 0);
+
+    make_fragment(&updated, 1, 5, 3, 99);
+    ASSERT(rke_store_fragment(&updated, metadata.key_id) == RKE_SUCCESS);
+
+    ASSERT(rke_mmap_fragment(metadata.key_id, 1, &new_fragment, &new_ref) == RKE_SUCCESS);
+    ASSERT(memcmp(new_fragment, &updated, sizeof(struct rke_fragment_t)) == 0);
+    ASSERT(memcmp(old_fragment, &stored[0], sizeof(struct rke_fragment_t)) == 0);
+    rke_mmap_release(old_ref);
+    rke_mmap_release(new_ref);
+
+    ASSERT(rke_delete_fragment(metadata.key_id, 1) == RKE_SUCCESS);
+    ASSERT(rke_mmap_fragment(metadata.key_id, 1, &new_fragment, &new_ref) == RKE_ERROR_STORAGE_FAIL);
+
+    printf("Mapping invalidation tests passed!\n");
+    return 0;
+}
+
+/*
+ * Helper function to run a reconstruct request; returns the command status
+ */
+static int run_reconstruct(const unsigned char *key_id, unsigned char *key) {
+    unsigned char payload[RKE_KEY_ID_SIZE + 2];
+    conn_info_t ci;
+    int status;
+
+    memcpy(payload, key_id, RKE_KEY_ID_SIZE);
+    payload[RKE_KEY_ID_SIZE] = 0x3E;
+    payload[RKE_KEY_ID_SIZE + 1] = 0x3E;
+    memset(&ci, 0, sizeof(ci));
+    ci.body = payload;
+    ci.body_size = sizeof(payload);
+
+    cmd_rke_reconstruct(&ci);
+    status = ci.command_status;
+    if (status == STATUS_SUCCESS && ci.output_size == RKE_MAX_KEY_SIZE) {
+        memcpy(key, ci.output, RKE_MAX_KEY_SIZE);
+    }
+    release_output(&ci);
+    return status;
+}
+
+/*
+ * Test reconstruction of a sparse key from the mapped and the read container
+ */
+int test_mapped_reconstruct() {
+    struct rke_ctx_t ctx;
+    struct rke_key_metadata_t metadata;
+    struct rke_fragment_t split[7];
+    unsigned char key[RKE_MAX_KEY_SIZE], result[RKE_MAX_KEY_SIZE];
+    static const int kept[] = { 2, 4, 5, 7 };
+
+    printf("Testing mapped reconstruct...\n");
+
+    // Only fragments 2, 4, 5 and 7 of 7 are stored; the first three of them are used
+    rke_ctx_init(&ctx);
+    make_key(&metadata, 7, 3);
+    ASSERT(rke_generate_key(key, RKE_MAX_KEY_SIZE) == RKE_SUCCESS);
+    ASSERT(rke_split_key(&ctx, key, RKE_MAX_KEY_SIZE, &metadata, split) == RKE_SUCCESS);
+    rke_ctx_cleanup(&ctx);
+    for (int i = 0; i < 4; i++) {
+        memcpy(&stored[i], &split[kept[i] - 1], sizeof(struct rke_fragment_t));
+    }
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 4) == RKE_SUCCESS);
+
+    ASSERT(rke_mmap_enabled());
+    memset(result, 0, sizeof(result));
+    ASSERT(run_reconstruct(metadata.key_id, result) == STATUS_SUCCESS);
+    ASSERT(memcmp(result, key, RKE_MAX_KEY_SIZE) == 0);
+
+    ASSERT(rke_mmap_set_capacity(0) == RKE_SUCCESS);
+    memset(result, 0, sizeof(result));
+    ASSERT(run_reconstruct(metadata.key_id, result) == STATUS_SUCCESS);
+    ASSERT(memcmp(result, key, RKE_MAX_KEY_SIZE) == 0);
+    ASSERT(rke_mmap_set_capacity(RKE_MMAP_DEFAULT_CAPACITY) == RKE_SUCCESS);
+
+    // A corrupt fragment among the first threshold fails the batch check
+    stored[1].data[0] ^= 0x01;
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 4) == RKE_SUCCESS);
+    ASSERT(run_reconstruct(metadata.key_id, result) == ERROR_KEY_GENERATION);
+
+    // Fewer than threshold fragments
+    ASSERT(rke_delete_fragment(metadata.key_id, 2) == RKE_SUCCESS);
+    ASSERT(rke_delete_fragment(metadata.key_id, 4) == RKE_SUCCESS);
+    ASSERT(run_reconstruct(metadata.key_id, result) == ERROR_INVALID_PARAMETER);
+
+    printf("Mapped reconstruct tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that the cache stays within its capacity
+ */
+int test_mmap_eviction() {
+    static struct rke_key_metadata_t keys[EVICTION_KEYS];
+    const struct rke_fragment_t *fragment;
+    struct rke_mmap_ref_t *ref;
+    struct rke_mmap_stats_t stats;
+    int served = 0;
+
+    printf("Testing mapping eviction...\n");
+
+    ASSERT(rke_mmap_set_capacity(RKE_MMAP_SHARDS) == RKE_SUCCESS);
+    for (int i = 0; i < 3; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), 3, 2, 0);
+    }
+
+    for (int k = 0; k < EVICTION_KEYS; k++) {
+        make_key(&keys[k], 3, 2);
+        ASSERT(rke_store_fragments(keys[k].key_id, &keys[k], stored, 3) == RKE_SUCCESS);
+    }
+
+    for (int round = 0; round < 2; round++) {
+        for (int k = 0; k < EVICTION_KEYS; k++) {
+            if (rke_mmap_fragment(keys[k].key_id, 2, &fragment, &ref) == RKE_SUCCESS) {
+                served += (memcmp(fragment, &stored[1], sizeof(struct rke_fragment_t)) == 0);
+                rke_mmap_release(ref);
+            }
+        }
+    }
+    ASSERT(served == 2 * EVICTION_KEYS);
+
+    rke_mmap_get_stats(&stats);
+    ASSERT(stats.capacity == RKE_MMAP_SHARDS);
+    ASSERT(stats.mappings <= RKE_MMAP_SHARDS);
+    ASSERT(stats.evictions > 0);
+    ASSERT(stats.hits + stats.misses == 2 * EVICTION_KEYS);
+
+    ASSERT(rke_mmap_set_capacity(RKE_MMAP_DEFAULT_CAPACITY) == RKE_SUCCESS);
+
+    printf("Mapping eviction tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Mapped Serving Tests\n");
+    printf("========================\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    if (test_setup_storage() != 0) {
+        printf("Can't create test directory %s\n", config.cwd);
+        return 1;
+    }
+
+    // Run all tests
+    TEST_FUNCTION(test_mapped_exchange);
+    TEST_FUNCTION(test_copied_exchange);
+    TEST_FUNCTION(test_mmap_invalidation);
+    TEST_FUNCTION(test_mapped_reconstruct);
+    TEST_FUNCTION(test_mmap_eviction);
+
+    test_teardown_storage();
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
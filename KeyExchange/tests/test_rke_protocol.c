@@ -17,12 +17,13 @@
 #include "../src/rke/rke.h"
 #include "../src/common/log.h"
 #include "../src/common/utils.h"
+#include "test_helpers.h"
 #include "../src/common/protocol.h"
 
 // Define global variables
 int current_log_level = LOG_LEVEL_DEBUG;
 struct config_s config = {
-    .cwd = "/tmp/rke_test",
+    .cwd = "/tmp/rke_test_protocol",
     .coin_id = 1
 };
 
@@ -77,9 +78,7 @@ conn_info_t* create_mock_connection(unsigned char *body, uint32_t body_size) {
 void cleanup_mock_connection(conn_info_t *ci) {
     if (ci == NULL) return;
     
-    if (ci->output != NULL) {
-        free(ci->output);
-    }
+    release_output(ci);
     free(ci);
 }
 
@@ -139,6 +138,76 @@ int test_rke_generate_command() {
     return 0;
 }
 
+/*
+ * Test RKE Generate Batch command
+ */
+int test_rke_generate_batch_command() {
+    printf("Testing RKE Generate Batch command...\n");
+    
+    // 1-byte key_type + 1-byte total + 1-byte threshold + 2-byte count + 3 * 16-byte key_id + 2-byte EOF
+    unsigned char payload[5 + 3 * 16 + 2];
+    unsigned char query_payload[18];
+    
+    payload[0] = RKE_KEY_TYPE_SYMMETRIC;
+    payload[1] = 4;     // total_fragments
+    payload[2] = 2;     // threshold
+    payload[3] = 0;     // key_count (big-endian)
+    payload[4] = 3;
+    for (int i = 0; i < 3 * 16; i++) {
+        payload[5 + i] = (unsigned char)(i + 60);
+    }
+    payload[53] = 0xFF;
+    payload[54] = 0xFF;
+    
+    conn_info_t *ci = create_mock_connection(payload, sizeof(payload));
+    ASSERT(ci != NULL);
+    cmd_rke_generate_batch(ci);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == 1);
+    ASSERT(ci->output[0] == 0x01);
+    cleanup_mock_connection(ci);
+    
+    // Every key of the batch can be queried and reconstructed
+    for (int k = 0; k < 3; k++) {
+        memcpy(query_payload, payload + 5 + k * 16, 16);
+        query_payload[16] = 0xFF;
+        query_payload[17] = 0xFF;
+        
+        ci = create_mock_connection(query_payload, 18);
+        ASSERT(ci != NULL);
+        cmd_rke_query(ci);
+        ASSERT(ci->command_status == STATUS_SUCCESS);
+        ASSERT(((struct rke_key_metadata_t *)ci->output)->total_fragments == 4);
+        cleanup_mock_connection(ci);
+        
+        ci = create_mock_connection(query_payload, 18);
+        ASSERT(ci != NULL);
+        cmd_rke_reconstruct(ci);
+        ASSERT(ci->command_status == STATUS_SUCCESS);
+        cleanup_mock_connection(ci);
+    }
+    
+    // Key count does not match the packet length
+    payload[4] = 4;
+    ci = create_mock_connection(payload, sizeof(payload));
+    ASSERT(ci != NULL);
+    cmd_rke_generate_batch(ci);
+    ASSERT(ci->command_status == ERROR_INVALID_PACKET_LENGTH);
+    cleanup_mock_connection(ci);
+    
+    // Invalid threshold
+    payload[4] = 3;
+    payload[2] = 5;
+    ci = create_mock_connection(payload, sizeof(payload));
+    ASSERT(ci != NULL);
+    cmd_rke_generate_batch(ci);
+    ASSERT(ci->command_status == ERROR_INVALID_PARAMETER);
+    cleanup_mock_connection(ci);
+    
+    printf("RKE Generate Batch command tests passed!\n");
+    return 0;
+}
+
 /*
  * Test RKE Query command
  */
@@ -376,6 +445,16 @@ int test_protocol_flow() {
     
     cleanup_mock_connection(ci);
     
+    // Step 3: Reconstruct the key from the stored fragments
+    ci = create_mock_connection(query_payload, 18);
+    ASSERT(ci != NULL);
+    cmd_rke_reconstruct(ci);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == 256);
+    ASSERT(ci->output != NULL);
+    
+    cleanup_mock_connection(ci);
+    
     printf("Protocol flow tests passed!\n");
     return 0;
 }
@@ -389,15 +468,22 @@ int main() {
     
     // Set log level to reduce noise during testing
     current_log_level = LOG_LEVEL_ERROR;
+    if (test_setup_storage() != 0) {
+        printf("Can't create test directory %s\n", config.cwd);
+        return 1;
+    }
     
     // Run all tests
     TEST_FUNCTION(test_rke_generate_command);
     TEST_FUNCTION(test_rke_query_command);
+    TEST_FUNCTION(test_rke_generate_batch_command);
     TEST_FUNCTION(test_packet_validation);
     TEST_FUNCTION(test_error_conditions);
     TEST_FUNCTION(test_session_management);
     TEST_FUNCTION(test_protocol_flow);
     
+    test_teardown_storage();
+    
     // Print results
     printf("\n=== Test Results ===\n");
     printf("Total tests run: %d\n", tests_run);
@@ -0,0 +1,403 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_protocol_batch.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for RKE protocol commands operating on many fragments at once
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_cache.h"
+#include "../src/rke/rke_mmap.h"
+#include "../src/rke/rke_session.h"
+#include "../src/rke/rke_worker.h"
+#include "../src/common/aes.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "test_helpers.h"
+#include "../src/common/protocol.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_batch",
+    .coin_id = 1
+};
+
+#define MULTI_BODY_SIZE (RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE + RKE_SESSION_ID_SIZE + 2)
+#define PLAIN_BODY_SIZE (MULTI_BODY_SIZE - RKE_SESSION_ID_SIZE)
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Shared fragment buffers
+static struct rke_fragment_t stored[RKE_MAX_FRAGMENTS];
+static struct rke_fragment_t returned[RKE_MAX_FRAGMENTS];
+
+// Session the exchanges run in
+static struct rke_session_t session;
+static const unsigned char peer_id[RKE_KEY_ID_SIZE] = {0x42};
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+/*
+ * Helper function to store a key holding only the odd fragment ids up to total
+ */
+static int store_odd_fragments(struct rke_key_metadata_t *metadata, uint8_t total) {
+    int count = 0;
+
+    make_key(metadata, total, 2);
+    for (int id = 1; id <= total; id += 2) {
+        make_fragment(&stored[count++], (uint8_t)id, total, 2, 0);
+    }
+
+    return rke_store_fragments(metadata->key_id, metadata, stored, count);
+}
+
+/*
+ * Helper function to run an exchange multi request for the fragment ids in the bitmap
+ * Without a session_id the request takes its plaintext form
+ */
+static conn_info_t *run_exchange_multi(unsigned char *payload, const unsigned char *key_id,
+                                       const unsigned char *bitmap, const unsigned char *session_id) {
+    conn_info_t *ci = (conn_info_t *) calloc(1, sizeof(conn_info_t));
+
+    if (ci == NULL) {
+        return NULL;
+    }
+
+    memcpy(payload, key_id, RKE_KEY_ID_SIZE);
+    memcpy(payload + RKE_KEY_ID_SIZE, bitmap, RKE_FRAGMENT_BITMAP_SIZE);
+    ci->body_size = PLAIN_BODY_SIZE;
+    if (session_id != NULL) {
+        memcpy(payload + RKE_KEY_ID_SIZE + RKE_FRAGMENT_BITMAP_SIZE, session_id, RKE_SESSION_ID_SIZE);
+        ci->body_size = MULTI_BODY_SIZE;
+    }
+    payload[ci->body_size - 2] = 0x3E;
+    payload[ci->body_size - 1] = 0x3E;
+    ci->body = payload;
+    ci->command_status = -999;
+    memset(ci->nonce, 0x5A, sizeof(ci->nonce));
+
+    cmd_rke_exchange_multi(ci);
+    return ci;
+}
+
+static void cleanup_exchange(conn_info_t *ci) {
+    release_output(ci);
+    free(ci);
+}
+
+/*
+ * Helper function to unpack the fragments of a response, decrypting them when a key is given;
+ * returns their count
+ */
+static int response_fragments(const conn_info_t *ci, const unsigned char *key) {
+    int count = (ci->output[0] << 8) | ci->output[1];
+    size_t offset = 2;
+    int length;
+
+    // Records are back to back, each only as long as its fragment's wire form
+    for (int i = 0; i < count; i++) {
+        length = rke_fragment_unpack(&returned[i], ci->output + offset, ci->output_size - offset);
+        if (length < 0) {
+            return length;
+        }
+        offset += (size_t)length;
+    }
+    if (offset != ci->output_size ||
+        (count > 0 && key != NULL && rke_decrypt_fragments(returned, count, key, ci->nonce) != RKE_SUCCESS)) {
+        return -1;
+    }
+    return count;
+}
+
+/*
+ * Test that a bitmap request returns the stored subset in ascending id order
+ */
+static int check_exchange_multi(void) {
+    struct rke_key_metadata_t metadata;
+    unsigned char payload[MULTI_BODY_SIZE];
+    unsigned char bitmap[RKE_FRAGMENT_BITMAP_SIZE] = {0};
+    conn_info_t *ci;
+
+    ASSERT(store_odd_fragments(&metadata, 255) == RKE_SUCCESS);
+
+    // Ids 1, 2 and 255 plus every id from 100 to 199; only the odd ones are stored
+    RKE_BITMAP_SET(bitmap, 1);
+    RKE_BITMAP_SET(bitmap, 2);
+    RKE_BITMAP_SET(bitmap, 255);
+    for (int id = 100; id < 200; id++) {
+        RKE_BITMAP_SET(bitmap, id);
+    }
+
+    ci = run_exchange_multi(payload, metadata.key_id, bitmap, session.session_id);
+    ASSERT(ci != NULL);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == 2 + 52 * sizeof(struct rke_fragment_t));
+    ASSERT(ci->output_release != NULL);
+    ASSERT(response_fragments(ci, session.session_key) == 52);
+    ASSERT(memcmp(&returned[0], &stored[0], sizeof(struct rke_fragment_t)) == 0);
+    ASSERT(returned[1].fragment_id == 101);
+    ASSERT(memcmp(&returned[1], &stored[50], sizeof(struct rke_fragment_t)) == 0);
+    ASSERT(returned[50].fragment_id == 199);
+    ASSERT(memcmp(&returned[51], &stored[127], sizeof(struct rke_fragment_t)) == 0);
+    cleanup_exchange(ci);
+
+    // Requesting only absent fragments is an empty success
+    memset(bitmap, 0, sizeof(bitmap));
+    RKE_BITMAP_SET(bitmap, 2);
+    ci = run_exchange_multi(payload, metadata.key_id, bitmap, session.session_id);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == 2);
+    ASSERT(response_fragments(ci, session.session_key) == 0);
+    cleanup_exchange(ci);
+
+    // Unknown keys are parameter errors
+    RKE_BITMAP_SET(bitmap, 1);
+    rke_generate_key(metadata.key_id, RKE_KEY_ID_SIZE);
+    ci = run_exchange_multi(payload, metadata.key_id, bitmap, session.session_id);
+    ASSERT(ci->command_status == ERROR_INVALID_PARAMETER);
+    ASSERT(ci->output == NULL);
+    cleanup_exchange(ci);
+
+    return 0;
+}
+
+/*
+ * Test exchange multi with mapped serving on and off
+ */
+int test_exchange_multi() {
+    printf("Testing exchange multi...\n");
+
+    ASSERT(rke_mmap_enabled());
+    ASSERT(check_exchange_multi() == 0);
+
+    ASSERT(rke_mmap_set_capacity(0) == RKE_SUCCESS);
+    ASSERT(!rke_mmap_enabled());
+    ASSERT(check_exchange_multi() == 0);
+    ASSERT(rke_mmap_set_capacity(RKE_MMAP_DEFAULT_CAPACITY) == RKE_SUCCESS);
+
+    printf("Exchange multi tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that the fragment set is encrypted with the session's key and refused for a dead session
+ */
+int test_exchange_multi_encrypted() {
+    struct rke_key_metadata_t metadata;
+    struct rke_session_t other;
+    unsigned char payload[MULTI_BODY_SIZE];
+    unsigned char bitmap[RKE_FRAGMENT_BITMAP_SIZE];
+    conn_info_t *ci;
+
+    printf("Testing encrypted exchange multi...\n");
+
+    ASSERT(store_odd_fragments(&metadata, 20) == RKE_SUCCESS);
+    memset(bitmap, 0xFF, sizeof(bitmap));
+
+    // The response is ciphertext whose checksums still hold; only the session key opens it
+    ci = run_exchange_multi(payload, metadata.key_id, bitmap, session.session_id);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(rke_fragment_unpack(&returned[0], ci->output + 2, ci->output_size - 2) > 0);
+    ASSERT(memcmp(returned[0].data, stored[0].data, RKE_FRAGMENT_DATA_SIZE) != 0);
+    ASSERT(rke_verify_checksums(returned, 1, NULL) == RKE_SUCCESS);
+    ASSERT(response_fragments(ci, session.session_key) == 10);
+    for (int i = 0; i < 10; i++) {
+        ASSERT(memcmp(&returned[i], &stored[i], sizeof(struct rke_fragment_t)) == 0);
+    }
+    cleanup_exchange(ci);
+
+    // Each session has its own key
+    ASSERT(rke_init_session(&other, peer_id, peer_id) == RKE_SUCCESS);
+    ASSERT(memcmp(other.session_key, session.session_key, RKE_SESSION_KEY_SIZE) != 0);
+    ci = run_exchange_multi(payload, metadata.key_id, bitmap, other.session_id);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(response_fragments(ci, session.session_key) == 10);
+    ASSERT(memcmp(returned[0].data, stored[0].data, RKE_FRAGMENT_DATA_SIZE) != 0);
+    cleanup_exchange(ci);
+
+    // Nothing is sent once the session is gone
+    rke_cleanup_session(&other);
+    ci = run_exchange_multi(payload, metadata.key_id, bitmap, other.session_id);
+    ASSERT(ci->command_status == ERROR_SESSION_EXPIRED);
+    ASSERT(ci->output == NULL);
+    cleanup_exchange(ci);
+
+    // Without a session_id the set goes out as stored, as cmd_rke_exchange sends a fragment
+    ci = run_exchange_multi(payload, metadata.key_id, bitmap, NULL);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(response_fragments(ci, NULL) == 10);
+    ASSERT(memcmp(&returned[9], &stored[9], sizeof(struct rke_fragment_t)) == 0);
+    cleanup_exchange(ci);
+
+    printf("Encrypted exchange multi tests passed!\n");
+    return 0;
+}
+
+/*
+ * Helper function to run a session open request for a key
+ */
+static conn_info_t *run_session_open(unsigned char *payload, const unsigned char *key_id) {
+    conn_info_t *ci = (conn_info_t *) calloc(1, sizeof(conn_info_t));
+
+    if (ci == NULL) {
+        return NULL;
+    }
+
+    memcpy(payload, key_id, RKE_KEY_ID_SIZE);
+    payload[RKE_KEY_ID_SIZE] = 0x3E;
+    payload[RKE_KEY_ID_SIZE + 1] = 0x3E;
+    ci->body = payload;
+    ci->body_size = RKE_KEY_ID_SIZE + 2;
+    memset(ci->nonce, 0xA5, sizeof(ci->nonce));
+
+    cmd_rke_session_open(ci);
+    return ci;
+}
+
+/*
+ * Test that a session opened over the wire hands its key to the holder of a stored key
+ */
+int test_session_open() {
+    static struct rke_ctx_t ctx;
+    unsigned char secret[32], request[RKE_KEY_ID_SIZE + 2], payload[MULTI_BODY_SIZE];
+    unsigned char bitmap[RKE_FRAGMENT_BITMAP_SIZE], session_key[RKE_SESSION_KEY_SIZE];
+    struct rke_key_metadata_t metadata;
+    struct rke_session_t opened;
+    conn_info_t *ci;
+
+    printf("Testing session open...\n");
+
+    // The peer generated the key, so it holds what the session key travels under
+    rke_ctx_init(&ctx);
+    make_key(&metadata, 5, 3);
+    metadata.key_size = sizeof(secret);
+    ASSERT(rke_generate_key(secret, sizeof(secret)) == RKE_SUCCESS);
+    ASSERT(rke_split_key(&ctx, secret, sizeof(secret), &metadata, stored) == RKE_SUCCESS);
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 5) == RKE_SUCCESS);
+    rke_ctx_cleanup(&ctx);
+
+    ci = run_session_open(request, metadata.key_id);
+    ASSERT(ci != NULL);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(ci->output_size == RKE_SESSION_ID_SIZE + RKE_SESSION_KEY_SIZE);
+    ASSERT(rke_session_lookup(ci->output, &opened) == RKE_SUCCESS);
+    memcpy(session_key, ci->output + RKE_SESSION_ID_SIZE, RKE_SESSION_KEY_SIZE);
+    ASSERT(memcmp(session_key, opened.session_key, RKE_SESSION_KEY_SIZE) != 0);
+    crypt_ctr(secret, session_key, RKE_SESSION_KEY_SIZE, ci->nonce);
+    ASSERT(memcmp(session_key, opened.session_key, RKE_SESSION_KEY_SIZE) == 0);
+    cleanup_exchange(ci);
+
+    // The delivered key opens an exchange multi in the new session
+    memset(bitmap, 0xFF, sizeof(bitmap));
+    ci = run_exchange_multi(payload, metadata.key_id, bitmap, opened.session_id);
+    ASSERT(ci->command_status == STATUS_SUCCESS);
+    ASSERT(response_fragments(ci, session_key) == 5);
+    ASSERT(memcmp(returned[4].data, stored[4].data, stored[4].fragment_size) == 0);
+    cleanup_exchange(ci);
+    rke_cleanup_session(&opened);
+
+    // Only a stored key can carry a session key
+    rke_generate_key(metadata.key_id, RKE_KEY_ID_SIZE);
+    ci = run_session_open(request, metadata.key_id);
+    ASSERT(ci->command_status == ERROR_FILESYSTEM);
+    ASSERT(ci->output == NULL);
+    cleanup_exchange(ci);
+
+    printf("Session open tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test exchange multi request validation
+ */
+int test_exchange_multi_validation() {
+    unsigned char payload[MULTI_BODY_SIZE + 1] = {0};
+    conn_info_t ci;
+
+    printf("Testing exchange multi validation...\n");
+
+    memset(&ci, 0, sizeof(ci));
+    ci.body = payload;
+    ci.body_size = MULTI_BODY_SIZE - 1;
+    cmd_rke_exchange_multi(&ci);
+    ASSERT(ci.command_status == ERROR_INVALID_PACKET_LENGTH);
+    ASSERT(ci.output == NULL);
+
+    ci.body_size = MULTI_BODY_SIZE + 1;
+    cmd_rke_exchange_multi(&ci);
+    ASSERT(ci.command_status == ERROR_INVALID_PACKET_LENGTH);
+
+    ci.body_size = PLAIN_BODY_SIZE - 1;
+    cmd_rke_exchange_multi(&ci);
+    ASSERT(ci.command_status == ERROR_INVALID_PACKET_LENGTH);
+
+    printf("Exchange multi validation tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Batch Protocol Tests\n");
+    printf("========================\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    if (test_setup_storage() != 0) {
+        printf("Can't create test directory %s\n", config.cwd);
+        return 1;
+    }
+    if (rke_init_session(&session, peer_id, peer_id) != RKE_SUCCESS) {
+        printf("Can't open a test session\n");
+        return 1;
+    }
+
+    // Run all tests
+    TEST_FUNCTION(test_exchange_multi);
+    TEST_FUNCTION(test_exchange_multi_encrypted);
+    TEST_FUNCTION(test_session_open);
+    TEST_FUNCTION(test_exchange_multi_validation);
+
+    rke_cleanup_session(&session);
+    test_teardown_storage();
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
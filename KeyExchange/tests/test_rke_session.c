@@ -0,0 +1,331 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_session.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for the RKE session table
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_session.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_session",
+    .coin_id = 1
+};
+
+#define CHURN_SESSIONS 20000
+#define THREAD_COUNT 4
+#define THREAD_SESSIONS 5000
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Session clock driven by the tests; starts off a wheel boundary
+static uint32_t fake_now = 1000037;
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+static uint32_t fake_clock(void) {
+    return __atomic_load_n(&fake_now, __ATOMIC_RELAXED);
+}
+
+/*
+ * Helper function to build a session with a random id expiring timeout seconds from now
+ */
+static void make_session(struct rke_session_t *session, uint32_t timeout) {
+    memset(session, 0, sizeof(*session));
+    rke_generate_key(session->session_id, RKE_SESSION_ID_SIZE);
+    session->state = RKE_SESSION_STATE_INIT;
+    session->timeout = rke_session_now() + timeout;
+}
+
+/*
+ * Test the session lifecycle through rke_init_session and rke_cleanup_session
+ */
+int test_session_lifecycle() {
+    struct rke_session_t session, found, copy;
+    struct rke_session_stats_t stats;
+    unsigned char sender_id[RKE_KEY_ID_SIZE], receiver_id[RKE_KEY_ID_SIZE];
+
+    printf("Testing session lifecycle...\n");
+
+    memset(sender_id, 0x11, sizeof(sender_id));
+    memset(receiver_id, 0x22, sizeof(receiver_id));
+    ASSERT(rke_init_session(&session, sender_id, receiver_id) == RKE_SUCCESS);
+    ASSERT(session.timeout - rke_session_now() + 1 >= RKE_SESSION_DEFAULT_TIMEOUT &&
+           session.timeout - rke_session_now() <= RKE_SESSION_DEFAULT_TIMEOUT);
+
+    ASSERT(rke_session_lookup(session.session_id, &found) == RKE_SUCCESS);
+    ASSERT(memcmp(&found, &session, sizeof(found)) == 0);
+
+    ASSERT(rke_session_set_state(session.session_id, RKE_SESSION_STATE_ACTIVE) == RKE_SUCCESS);
+    ASSERT(rke_session_lookup(session.session_id, &found) == RKE_SUCCESS);
+    ASSERT(found.state == RKE_SESSION_STATE_ACTIVE);
+    ASSERT(rke_session_set_state(session.session_id, RKE_SESSION_STATE_EXPIRED) == RKE_ERROR_INVALID_PARAM);
+
+    // A session id is registered once
+    ASSERT(rke_session_insert(&session) == RKE_ERROR_INVALID_PARAM);
+
+    memcpy(&copy, &session, sizeof(copy));
+    rke_cleanup_session(&session);
+    ASSERT(rke_session_lookup(copy.session_id, &found) == RKE_ERROR_SESSION_EXPIRED);
+    ASSERT(rke_session_set_state(copy.session_id, RKE_SESSION_STATE_COMPLETE) == RKE_ERROR_SESSION_EXPIRED);
+    ASSERT(rke_session_remove(copy.session_id) == RKE_ERROR_SESSION_EXPIRED);
+
+    rke_session_get_stats(&stats);
+    ASSERT(stats.opened == 1);
+    ASSERT(stats.closed == 1);
+    ASSERT(stats.active == 0);
+    ASSERT(stats.capacity == RKE_SESSION_DEFAULT_CAPACITY);
+
+    // Timeouts must lie within the wheel
+    make_session(&session, 0);
+    ASSERT(rke_session_insert(&session) == RKE_ERROR_INVALID_PARAM);
+    make_session(&session, RKE_SESSION_MAX_TIMEOUT + 1);
+    ASSERT(rke_session_insert(&session) == RKE_ERROR_INVALID_PARAM);
+    make_session(&session, RKE_SESSION_MAX_TIMEOUT);
+    ASSERT(rke_session_insert(&session) == RKE_SUCCESS);
+    ASSERT(rke_session_remove(session.session_id) == RKE_SUCCESS);
+
+    printf("Session lifecycle tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that every wheel level expires its sessions exactly on time
+ */
+int test_session_expiry() {
+    static const uint32_t timeouts[] = { 1, 2, 63, 64, 65, 127, 4095, 4096, 4097, 5000, 100000,
+                                         RKE_SESSION_MAX_TIMEOUT };
+    struct rke_session_t sessions[sizeof(timeouts) / sizeof(timeouts[0])], found;
+    struct rke_session_stats_t stats;
+    int count = (int)(sizeof(timeouts) / sizeof(timeouts[0]));
+    uint32_t start;
+
+    printf("Testing session expiry...\n");
+
+    rke_session_set_clock(fake_clock);
+    start = rke_session_now();
+    for (int i = 0; i < count; i++) {
+        make_session(&sessions[i], timeouts[i]);
+        ASSERT(rke_session_insert(&sessions[i]) == RKE_SUCCESS);
+    }
+
+    for (int i = 0; i < count; i++) {
+        __atomic_store_n(&fake_now, start + timeouts[i] - 1, __ATOMIC_RELAXED);
+        ASSERT(rke_session_lookup(sessions[i].session_id, &found) == RKE_SUCCESS);
+
+        __atomic_store_n(&fake_now, start + timeouts[i], __ATOMIC_RELAXED);
+        ASSERT(rke_session_lookup(sessions[i].session_id, &found) == RKE_ERROR_SESSION_EXPIRED);
+        if (i + 1 < count) {
+            ASSERT(rke_session_lookup(sessions[i + 1].session_id, &found) == RKE_SUCCESS);
+        }
+    }
+
+    rke_session_get_stats(&stats);
+    ASSERT(stats.expired == (uint64_t)count);
+    ASSERT(stats.active == 0);
+
+    printf("Session expiry tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test expiry under churn against a reference count of live sessions
+ */
+int test_session_churn() {
+    static struct rke_session_t sessions[CHURN_SESSIONS];
+    struct rke_session_stats_t base, stats;
+    struct rke_session_t found;
+    uint32_t start = rke_session_now(), now = start;
+    int removed = 0, live, consistent = 1;
+
+    printf("Testing session churn...\n");
+
+    rke_session_get_stats(&base);
+    for (int i = 0; i < CHURN_SESSIONS; i++) {
+        make_session(&sessions[i], 1 + (uint32_t)(rand() % 10000));
+        ASSERT(rke_session_insert(&sessions[i]) == RKE_SUCCESS);
+    }
+
+    // Remove every third session by hand, then step the clock past every expiry
+    for (int i = 0; i < CHURN_SESSIONS; i += 3) {
+        ASSERT(rke_session_remove(sessions[i].session_id) == RKE_SUCCESS);
+        removed++;
+    }
+
+    while (now <= start + 10000) {
+        now += 1 + (uint32_t)(rand() % 700);
+        __atomic_store_n(&fake_now, now, __ATOMIC_RELAXED);
+        rke_session_expire();
+
+        live = 0;
+        for (int i = 0; i < CHURN_SESSIONS; i++) {
+            int expected = (i % 3 != 0) && sessions[i].timeout > now;
+
+            live += expected;
+            if (i % 97 == 0) {
+                consistent &= ((rke_session_lookup(sessions[i].session_id, &found) == RKE_SUCCESS) == expected);
+            }
+        }
+        rke_session_get_stats(&stats);
+        consistent &= (stats.active == (size_t)live);
+    }
+    ASSERT(consistent);
+
+    rke_session_get_stats(&stats);
+    ASSERT(stats.active == 0);
+    ASSERT(stats.closed - base.closed == (uint64_t)removed);
+    ASSERT(stats.expired - base.expired == (uint64_t)(CHURN_SESSIONS - removed));
+
+    rke_session_set_clock(NULL);
+    printf("Session churn tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that a full table refuses new sessions
+ */
+int test_session_capacity() {
+    struct rke_session_t session;
+    struct rke_session_stats_t stats;
+    int accepted = 0, refused = 0;
+
+    printf("Testing session capacity...\n");
+
+    ASSERT(rke_session_set_capacity(RKE_SESSION_SHARDS * 2) == RKE_SUCCESS);
+    for (int i = 0; i < RKE_SESSION_SHARDS * 8; i++) {
+        int rv;
+
+        make_session(&session, 60);
+        rv = rke_session_insert(&session);
+        accepted += (rv == RKE_SUCCESS);
+        refused += (rv == RKE_ERROR_SESSION_LIMIT);
+    }
+    ASSERT(accepted + refused == RKE_SESSION_SHARDS * 8);
+    ASSERT(refused > 0);
+
+    rke_session_get_stats(&stats);
+    ASSERT(stats.capacity == RKE_SESSION_SHARDS * 2);
+    ASSERT(stats.active == (size_t)accepted);
+    ASSERT(stats.active <= RKE_SESSION_SHARDS * 2);
+    ASSERT(stats.rejected == (uint64_t)refused);
+
+    ASSERT(rke_session_set_capacity(0) == RKE_SUCCESS);
+    make_session(&session, 60);
+    ASSERT(rke_session_insert(&session) == RKE_ERROR_SESSION_LIMIT);
+
+    ASSERT(rke_session_set_capacity(RKE_SESSION_DEFAULT_CAPACITY) == RKE_SUCCESS);
+
+    printf("Session capacity tests passed!\n");
+    return 0;
+}
+
+static void *session_worker(void *arg) {
+    struct rke_session_t session, found;
+    long failures = 0;
+
+    (void)arg;
+    for (int i = 0; i < THREAD_SESSIONS; i++) {
+        make_session(&session, 600);
+        failures += (rke_session_insert(&session) != RKE_SUCCESS);
+        failures += (rke_session_set_state(session.session_id, RKE_SESSION_STATE_ACTIVE) != RKE_SUCCESS);
+        failures += (rke_session_lookup(session.session_id, &found) != RKE_SUCCESS ||
+                     found.state != RKE_SESSION_STATE_ACTIVE);
+        failures += (rke_session_remove(session.session_id) != RKE_SUCCESS);
+    }
+
+    return (void *)failures;
+}
+
+/*
+ * Test concurrent opens, state changes and closes
+ */
+int test_session_threads() {
+    pthread_t threads[THREAD_COUNT];
+    struct rke_session_stats_t stats;
+    long failures = 0;
+
+    printf("Testing concurrent sessions...\n");
+
+    ASSERT(rke_session_set_capacity(RKE_SESSION_DEFAULT_CAPACITY) == RKE_SUCCESS);
+    for (int t = 0; t < THREAD_COUNT; t++) {
+        ASSERT(pthread_create(&threads[t], NULL, session_worker, NULL) == 0);
+    }
+    for (int t = 0; t < THREAD_COUNT; t++) {
+        void *result;
+
+        pthread_join(threads[t], &result);
+        failures += (long)result;
+    }
+    ASSERT(failures == 0);
+
+    rke_session_get_stats(&stats);
+    ASSERT(stats.opened == THREAD_COUNT * THREAD_SESSIONS);
+    ASSERT(stats.closed == THREAD_COUNT * THREAD_SESSIONS);
+    ASSERT(stats.active == 0);
+
+    printf("Concurrent session tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Session Table Tests\n");
+    printf("=======================\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    srand(7);
+
+    // Run all tests
+    TEST_FUNCTION(test_session_lifecycle);
+    TEST_FUNCTION(test_session_expiry);
+    TEST_FUNCTION(test_session_churn);
+    TEST_FUNCTION(test_session_capacity);
+    TEST_FUNCTION(test_session_threads);
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
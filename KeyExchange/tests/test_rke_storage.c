@@ -0,0 +1,494 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_storage.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for RKE fragment container storage
+#
+# ====================================================*/
+
+// pread/pwrite are POSIX.1-2008, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_cache.h"
+#include "../src/rke/rke_container.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "test_helpers.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_storage",
+    .coin_id = 1
+};
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Shared fragment buffers
+static struct rke_fragment_t stored[RKE_MAX_FRAGMENTS];
+static struct rke_fragment_t loaded[RKE_MAX_FRAGMENTS];
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+/*
+ * Test storing and loading a full key set through one container
+ */
+int test_container_roundtrip() {
+    struct rke_key_metadata_t metadata, loaded_metadata;
+    char path[4096];
+    struct stat st;
+    int count;
+
+    printf("Testing container round trip...\n");
+
+    make_key(&metadata, RKE_MAX_FRAGMENTS, 5);
+    for (int i = 0; i < RKE_MAX_FRAGMENTS; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), RKE_MAX_FRAGMENTS, 5, 0);
+    }
+
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, RKE_MAX_FRAGMENTS) == RKE_SUCCESS);
+
+    // Everything lives in a single file
+    ASSERT(rke_container_path(metadata.key_id, path, sizeof(path)) == RKE_SUCCESS);
+    ASSERT(stat(path, &st) == 0);
+    ASSERT(st.st_size >= (off_t)(RKE_MAX_FRAGMENTS * sizeof(struct rke_fragment_t)));
+
+    memset(loaded, 0, sizeof(loaded));
+    count = rke_load_fragments(metadata.key_id, &loaded_metadata, loaded, RKE_MAX_FRAGMENTS);
+    ASSERT(count == RKE_MAX_FRAGMENTS);
+    ASSERT(memcmp(&loaded_metadata, &metadata, sizeof(metadata)) == 0);
+    ASSERT(memcmp(loaded, stored, sizeof(stored)) == 0);
+
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 5) == 5);
+    ASSERT(loaded[4].fragment_id == 5);
+
+    ASSERT(rke_load_metadata(&loaded_metadata, metadata.key_id) == RKE_SUCCESS);
+    ASSERT(loaded_metadata.threshold == 5);
+    ASSERT(rke_count_fragments(metadata.key_id) == RKE_MAX_FRAGMENTS);
+
+    printf("Container round trip tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test sparse containers built one fragment at a time
+ */
+int test_container_sparse() {
+    struct rke_key_metadata_t metadata, loaded_metadata;
+    const uint8_t ids[] = {2, 3, 5, 9, 200};
+
+    printf("Testing sparse containers...\n");
+
+    make_key(&metadata, 200, 3);
+
+    // Fragments may arrive before the metadata
+    for (int i = 0; i < 5; i++) {
+        make_fragment(&stored[i], ids[i], 200, 3, 0);
+        ASSERT(rke_store_fragment(&stored[i], metadata.key_id) == RKE_SUCCESS);
+    }
+    ASSERT(rke_load_metadata(&loaded_metadata, metadata.key_id) != RKE_SUCCESS);
+    ASSERT(rke_store_metadata(&metadata) == RKE_SUCCESS);
+    ASSERT(rke_load_metadata(&loaded_metadata, metadata.key_id) == RKE_SUCCESS);
+
+    ASSERT(rke_count_fragments(metadata.key_id) == 5);
+    ASSERT(rke_fragment_exists(metadata.key_id, 9) == 1);
+    ASSERT(rke_fragment_exists(metadata.key_id, 4) == 0);
+    ASSERT(rke_fragment_exists(metadata.key_id, 255) == 0);
+
+    // Holes are skipped and the results are compacted
+    memset(loaded, 0, sizeof(loaded));
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 3) == 3);
+    ASSERT(loaded[0].fragment_id == 2 && loaded[1].fragment_id == 3 && loaded[2].fragment_id == 5);
+    ASSERT(memcmp(&loaded[2], &stored[2], sizeof(struct rke_fragment_t)) == 0);
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 50) == 5);
+    ASSERT(memcmp(&loaded[4], &stored[4], sizeof(struct rke_fragment_t)) == 0);
+
+    ASSERT(rke_load_fragment(&loaded[0], metadata.key_id, 9) == RKE_SUCCESS);
+    ASSERT(memcmp(&loaded[0], &stored[3], sizeof(struct rke_fragment_t)) == 0);
+    ASSERT(rke_load_fragment(&loaded[0], metadata.key_id, 4) != RKE_SUCCESS);
+
+    // Overwriting a slot keeps the others
+    stored[1].data[0] ^= 0xff;
+    ASSERT(rke_store_fragment(&stored[1], metadata.key_id) == RKE_SUCCESS);
+    ASSERT(rke_load_fragment(&loaded[0], metadata.key_id, 3) == RKE_SUCCESS);
+    ASSERT(loaded[0].data[0] == stored[1].data[0]);
+    ASSERT(rke_count_fragments(metadata.key_id) == 5);
+
+    printf("Sparse container tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test error handling for missing and damaged containers
+ */
+int test_container_errors() {
+    struct rke_key_metadata_t metadata, other;
+    char path[4096];
+    int fd;
+
+    printf("Testing container errors...\n");
+
+    make_key(&metadata, 10, 3);
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 10) == RKE_ERROR_STORAGE_FAIL);
+    ASSERT(rke_count_fragments(metadata.key_id) == 0);
+    ASSERT(rke_fragment_exists(metadata.key_id, 1) == 0);
+
+    ASSERT(rke_store_fragments(NULL, NULL, stored, 1) == RKE_ERROR_INVALID_PARAM);
+    ASSERT(rke_store_fragments(metadata.key_id, NULL, NULL, 1) == RKE_ERROR_INVALID_PARAM);
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 0) == RKE_ERROR_INVALID_PARAM);
+
+    make_key(&other, 10, 3);
+    ASSERT(rke_store_fragments(metadata.key_id, &other, NULL, 0) == RKE_ERROR_INVALID_PARAM);
+
+    make_fragment(&stored[0], 0, 10, 3, 0);
+    ASSERT(rke_store_fragments(metadata.key_id, NULL, stored, 1) == RKE_ERROR_INVALID_PARAM);
+
+    // A damaged header is reported as corruption
+    make_fragment(&stored[0], 1, 10, 3, 0);
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 1) == RKE_SUCCESS);
+    ASSERT(rke_container_path(metadata.key_id, path, sizeof(path)) == RKE_SUCCESS);
+    fd = open(path, O_WRONLY);
+    ASSERT(fd >= 0);
+    ASSERT(pwrite(fd, "XXXX", 4, 0) == 4);
+    close(fd);
+    // Out-of-band damage is only seen once the cached header is gone
+    rke_cache_clear();
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 10) == RKE_ERROR_FRAGMENT_CORRUPT);
+    ASSERT(rke_load_metadata(&other, metadata.key_id) == RKE_ERROR_FRAGMENT_CORRUPT);
+    ASSERT(rke_store_fragment(&stored[0], metadata.key_id) == RKE_ERROR_FRAGMENT_CORRUPT);
+
+    printf("Container error tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test the persistent presence bitmap and its in-memory cache
+ */
+int test_presence_bitmap() {
+    struct rke_key_metadata_t metadata;
+    unsigned char bitmap[RKE_FRAGMENT_BITMAP_SIZE], expected[RKE_FRAGMENT_BITMAP_SIZE];
+    const uint8_t ids[] = {1, 8, 9, 64, 255};
+    char path[4096];
+
+    printf("Testing presence bitmap...\n");
+
+    make_key(&metadata, 255, 3);
+    memset(expected, 0, sizeof(expected));
+    for (int i = 0; i < 5; i++) {
+        make_fragment(&stored[i], ids[i], 255, 3, 0);
+        RKE_BITMAP_SET(expected, ids[i]);
+    }
+    ASSERT(expected[0] == 0x81 && expected[1] == 0x01 && expected[31] == 0x40);
+
+    ASSERT(rke_fragment_bitmap(metadata.key_id, bitmap) == RKE_ERROR_STORAGE_FAIL);
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 5) == RKE_SUCCESS);
+    ASSERT(rke_fragment_bitmap(metadata.key_id, bitmap) == RKE_SUCCESS);
+    ASSERT(memcmp(bitmap, expected, sizeof(expected)) == 0);
+    ASSERT(rke_count_fragments(metadata.key_id) == 5);
+    ASSERT(rke_bitmap_count(expected) == 5);
+
+    // The bitmap is persisted in the container header
+    rke_cache_clear();
+    ASSERT(rke_cache_lookup(metadata.key_id, bitmap) == RKE_CACHE_MISS);
+    ASSERT(rke_fragment_bitmap(metadata.key_id, bitmap) == RKE_SUCCESS);
+    ASSERT(memcmp(bitmap, expected, sizeof(expected)) == 0);
+    ASSERT(rke_cache_lookup(metadata.key_id, bitmap) == RKE_CACHE_HIT);
+
+    // Deletion clears the bit on disk and in the cache
+    ASSERT(rke_delete_fragment(metadata.key_id, 64) == RKE_SUCCESS);
+    ASSERT(rke_fragment_exists(metadata.key_id, 64) == 0);
+    ASSERT(rke_count_fragments(metadata.key_id) == 4);
+    ASSERT(rke_load_fragment(&loaded[0], metadata.key_id, 64) != RKE_SUCCESS);
+    rke_cache_clear();
+    ASSERT(rke_count_fragments(metadata.key_id) == 4);
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 10) == 4);
+    ASSERT(loaded[3].fragment_id == 255);
+
+    // Cached answers need no filesystem access at all
+    ASSERT(rke_container_path(metadata.key_id, path, sizeof(path)) == RKE_SUCCESS);
+    ASSERT(unlink(path) == 0);
+    ASSERT(rke_fragment_exists(metadata.key_id, 255) == 1);
+    rke_cache_clear();
+    ASSERT(rke_fragment_exists(metadata.key_id, 255) == 0);
+    ASSERT(rke_cache_lookup(metadata.key_id, bitmap) == RKE_CACHE_ABSENT);
+    ASSERT(rke_delete_fragment(metadata.key_id, 1) == RKE_ERROR_STORAGE_FAIL);
+
+    // A write after a negative lookup replaces the cached absence
+    ASSERT(rke_store_fragment(&stored[0], metadata.key_id) == RKE_SUCCESS);
+    ASSERT(rke_fragment_exists(metadata.key_id, 1) == 1);
+    ASSERT(rke_count_fragments(metadata.key_id) == 1);
+
+    printf("Presence bitmap tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test the metadata cache: write-through, hit/miss counters, LRU eviction and capacity
+ */
+int test_metadata_cache() {
+    struct rke_key_metadata_t keys[40], loaded_metadata;
+    struct rke_cache_stats_t stats;
+    unsigned char bitmap[RKE_FRAGMENT_BITMAP_SIZE];
+    uint64_t generation;
+    char path[4096];
+
+    printf("Testing metadata cache...\n");
+
+    ASSERT(rke_cache_set_capacity(RKE_CACHE_SHARDS * 2) == RKE_SUCCESS);
+    rke_cache_get_stats(&stats);
+    ASSERT(stats.capacity == RKE_CACHE_SHARDS * 2 && stats.entries == 0);
+
+    // Stored metadata is served from the cache, even with the container gone
+    make_key(&keys[0], 10, 3);
+    ASSERT(rke_store_metadata(&keys[0]) == RKE_SUCCESS);
+    ASSERT(rke_container_path(keys[0].key_id, path, sizeof(path)) == RKE_SUCCESS);
+    ASSERT(unlink(path) == 0);
+    ASSERT(rke_load_metadata(&loaded_metadata, keys[0].key_id) == RKE_SUCCESS);
+    ASSERT(memcmp(&loaded_metadata, &keys[0], sizeof(loaded_metadata)) == 0);
+    rke_cache_get_stats(&stats);
+    ASSERT(stats.hits == 1 && stats.misses == 0);
+
+    // A miss reads the header once, then hits
+    ASSERT(rke_store_metadata(&keys[0]) == RKE_SUCCESS);
+    rke_cache_clear();
+    ASSERT(rke_load_metadata(&loaded_metadata, keys[0].key_id) == RKE_SUCCESS);
+    ASSERT(rke_load_metadata(&loaded_metadata, keys[0].key_id) == RKE_SUCCESS);
+    ASSERT(rke_count_fragments(keys[0].key_id) == 0);
+    rke_cache_get_stats(&stats);
+    ASSERT(stats.misses == 1 && stats.hits == 2);
+
+    // Fragments stored before the metadata do not satisfy a metadata lookup
+    make_key(&keys[1], 10, 3);
+    make_fragment(&stored[0], 1, 10, 3, 0);
+    ASSERT(rke_store_fragment(&stored[0], keys[1].key_id) == RKE_SUCCESS);
+    ASSERT(rke_cache_lookup_metadata(keys[1].key_id, NULL) == RKE_CACHE_MISS);
+    ASSERT(rke_store_metadata(&keys[1]) == RKE_SUCCESS);
+    ASSERT(rke_cache_lookup_metadata(keys[1].key_id, &loaded_metadata) == RKE_CACHE_HIT);
+    ASSERT(loaded_metadata.total_fragments == 10);
+
+    // Reads that raced a writer do not overwrite what the writer cached
+    make_key(&keys[2], 10, 3);
+    generation = rke_cache_generation(keys[2].key_id);
+    ASSERT(rke_store_fragment(&stored[0], keys[2].key_id) == RKE_SUCCESS);
+    rke_cache_fill(keys[2].key_id, generation, NULL, NULL);
+    ASSERT(rke_cache_lookup(keys[2].key_id, bitmap) == RKE_CACHE_HIT && RKE_BITMAP_TEST(bitmap, 1));
+    generation = rke_cache_generation(keys[2].key_id);
+    memset(bitmap, 0, sizeof(bitmap));
+    rke_cache_fill(keys[2].key_id, generation, NULL, NULL);
+    rke_cache_fill(keys[2].key_id, generation - 1, bitmap, NULL);
+    ASSERT(rke_count_fragments(keys[2].key_id) == 1);
+
+    // Filling far past capacity evicts, and the oldest keys fall out first
+    for (int i = 2; i < 40; i++) {
+        make_key(&keys[i], 10, 3);
+        ASSERT(rke_store_metadata(&keys[i]) == RKE_SUCCESS);
+    }
+    rke_cache_get_stats(&stats);
+    ASSERT(stats.entries <= RKE_CACHE_SHARDS * 2);
+    ASSERT(stats.evictions > 0);
+    ASSERT(rke_cache_lookup_metadata(keys[39].key_id, NULL) == RKE_CACHE_HIT);
+    ASSERT(rke_load_metadata(&loaded_metadata, keys[0].key_id) == RKE_SUCCESS);
+
+    // Capacity 0 disables caching entirely
+    ASSERT(rke_cache_set_capacity(0) == RKE_SUCCESS);
+    ASSERT(rke_load_metadata(&loaded_metadata, keys[5].key_id) == RKE_SUCCESS);
+    ASSERT(rke_cache_lookup_metadata(keys[5].key_id, NULL) == RKE_CACHE_MISS);
+    ASSERT(rke_count_fragments(keys[1].key_id) == 1);
+
+    ASSERT(rke_cache_set_capacity(RKE_CACHE_DEFAULT_CAPACITY) == RKE_SUCCESS);
+
+    printf("Metadata cache tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test the fan-out directory layout
+ */
+int test_fanout_layout() {
+    struct rke_key_metadata_t first, second, loaded_metadata;
+    char path[4096], expected_name[64];
+    const char *relative;
+    int slashes = 0;
+
+    printf("Testing fan-out layout...\n");
+
+    ASSERT(rke_storage_get_fanout() == RKE_DEFAULT_FANOUT_DEPTH);
+    ASSERT(rke_storage_set_fanout(-1) == RKE_ERROR_INVALID_PARAM);
+    ASSERT(rke_storage_set_fanout(RKE_MAX_FANOUT_DEPTH + 1) == RKE_ERROR_INVALID_PARAM);
+
+    // Keys sharing a long prefix get separate containers
+    make_key(&first, 10, 3);
+    memcpy(&second, &first, sizeof(second));
+    second.key_id[15] ^= 0x01;
+    second.threshold = 4;
+    ASSERT(rke_store_metadata(&first) == RKE_SUCCESS);
+    ASSERT(rke_store_metadata(&second) == RKE_SUCCESS);
+    rke_cache_clear();
+    ASSERT(rke_load_metadata(&loaded_metadata, first.key_id) == RKE_SUCCESS);
+    ASSERT(loaded_metadata.threshold == 3);
+    ASSERT(rke_load_metadata(&loaded_metadata, second.key_id) == RKE_SUCCESS);
+    ASSERT(loaded_metadata.threshold == 4);
+
+    for (int depth = 0; depth <= RKE_MAX_FANOUT_DEPTH; depth++) {
+        ASSERT(rke_storage_set_fanout(depth) == RKE_SUCCESS);
+        ASSERT(rke_container_path(first.key_id, path, sizeof(path)) == RKE_SUCCESS);
+
+        // {cwd}/RKE/ then depth two-digit levels, then the full key id
+        relative = path + strlen(config.cwd) + strlen("/RKE/");
+        slashes = 0;
+        for (const char *c = relative; *c; c++) {
+            slashes += (*c == '/');
+        }
+        ASSERT(slashes == depth);
+        ASSERT(depth == 0 || relative[2] == '/');
+        for (int i = 0; i < RKE_KEY_ID_SIZE; i++) {
+            snprintf(expected_name + i * 2, 3, "%02x", first.key_id[i]);
+        }
+        strcat(expected_name, ".rke");
+        ASSERT(strcmp(strrchr(path, '/') + 1, expected_name) == 0);
+
+        // Containers round-trip at every depth
+        make_fragment(&stored[0], 2, 10, 3, 0);
+        ASSERT(rke_store_fragments(first.key_id, &first, stored, 1) == RKE_SUCCESS);
+        rke_cache_clear();
+        ASSERT(rke_load_fragments(first.key_id, NULL, loaded, 10) == 1);
+    }
+
+    ASSERT(rke_storage_set_fanout(RKE_DEFAULT_FANOUT_DEPTH) == RKE_SUCCESS);
+
+    printf("Fan-out layout tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that both read backends return the same fragments
+ */
+int test_storage_backends() {
+    static const char *backends[] = {"posix", "uring"};
+    struct rke_key_metadata_t metadata, loaded_metadata, missing;
+    char path[4096];
+    int fd, spare;
+
+    printf("Testing storage backends...\n");
+
+    ASSERT(rke_storage_force_backend("bogus") == -1);
+
+    make_key(&missing, 10, 3);
+    make_key(&metadata, 20, 3);
+    for (int i = 0; i < 6; i++) {
+        make_fragment(&stored[i], (uint8_t)(3 * i + 2), 20, 3, 0);
+    }
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 6) == RKE_SUCCESS);
+
+    for (int b = 0; b < 2; b++) {
+        if (rke_storage_force_backend(backends[b]) != 0) {
+            printf("  %s backend not available, skipped\n", backends[b]);
+            continue;
+        }
+        ASSERT(strcmp(rke_storage_backend_name(), backends[b]) == 0);
+        spare = dup(0);
+        close(spare);
+
+        memset(loaded, 0, sizeof(loaded));
+        ASSERT(rke_load_fragments(metadata.key_id, &loaded_metadata, loaded, RKE_MAX_FRAGMENTS) == 6);
+        ASSERT(memcmp(loaded, stored, 6 * sizeof(struct rke_fragment_t)) == 0);
+        ASSERT(memcmp(&loaded_metadata, &metadata, sizeof(metadata)) == 0);
+        ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 2) == 2);
+        ASSERT(loaded[1].fragment_id == 5);
+
+        // Loads leave no descriptor open: the lowest free one is still the same
+        fd = dup(0);
+        close(fd);
+        ASSERT(fd == spare);
+
+        rke_cache_clear();
+        ASSERT(rke_load_fragments(missing.key_id, NULL, loaded, 10) == RKE_ERROR_STORAGE_FAIL);
+    }
+
+    // Both backends reject a damaged header
+    make_key(&metadata, 10, 3);
+    make_fragment(&stored[0], 1, 10, 3, 0);
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 1) == RKE_SUCCESS);
+    ASSERT(rke_container_path(metadata.key_id, path, sizeof(path)) == RKE_SUCCESS);
+    fd = open(path, O_WRONLY);
+    ASSERT(fd >= 0);
+    ASSERT(pwrite(fd, "XXXX", 4, 0) == 4);
+    close(fd);
+    for (int b = 0; b < 2; b++) {
+        if (rke_storage_force_backend(backends[b]) == 0) {
+            ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 10) == RKE_ERROR_FRAGMENT_CORRUPT);
+        }
+    }
+
+    ASSERT(rke_storage_force_backend(NULL) == 0);
+
+    printf("Storage backend tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Storage Tests\n");
+    printf("=================\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    if (test_setup_storage() != 0) {
+        printf("Can't create test directory %s\n", config.cwd);
+        return 1;
+    }
+
+    // Run all tests
+    TEST_FUNCTION(test_container_roundtrip);
+    TEST_FUNCTION(test_container_sparse);
+    TEST_FUNCTION(test_container_errors);
+    TEST_FUNCTION(test_presence_bitmap);
+    TEST_FUNCTION(test_metadata_cache);
+    TEST_FUNCTION(test_fanout_layout);
+    TEST_FUNCTION(test_storage_backends);
+
+    test_teardown_storage();
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
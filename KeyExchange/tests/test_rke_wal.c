@@ -0,0 +1,352 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_wal.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for the RKE storage write-ahead log
+#
+# ====================================================*/
+
+// pread/pwrite are POSIX.1-2008, not part of -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_cache.h"
+#include "../src/rke/rke_container.h"
+#include "../src/rke/rke_wal.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "test_helpers.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_wal",
+    .coin_id = 1
+};
+
+#define WAL_PATH "/tmp/rke_test_wal/RKE/rke.wal"
+#define WRITER_THREADS 8
+#define WRITES_PER_THREAD 20
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Shared fragment buffers
+static struct rke_fragment_t stored[RKE_MAX_FRAGMENTS];
+static struct rke_fragment_t loaded[RKE_MAX_FRAGMENTS];
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+static off_t file_size(const char *path) {
+    struct stat st;
+
+    return (stat(path, &st) == 0) ? st.st_size : -1;
+}
+
+/*
+ * Helper function to read a whole container into a buffer
+ */
+static ssize_t read_file(const char *path, unsigned char *buffer, size_t size) {
+    int fd = open(path, O_RDONLY);
+    ssize_t rv;
+
+    if (fd < 0) {
+        return -1;
+    }
+    rv = pread(fd, buffer, size, 0);
+    close(fd);
+    return rv;
+}
+
+static int write_file(const char *path, const unsigned char *buffer, size_t size, int flags) {
+    int fd = open(path, O_WRONLY | O_CREAT | flags, 0640);
+    ssize_t rv;
+
+    if (fd < 0) {
+        return -1;
+    }
+    rv = write(fd, buffer, size);
+    close(fd);
+    return (rv == (ssize_t)size) ? 0 : -1;
+}
+
+/*
+ * Test that a store goes through the log before it returns
+ */
+int test_wal_commit() {
+    struct rke_key_metadata_t metadata, loaded_metadata;
+    struct rke_wal_stats_t before, after;
+    struct rke_wal_write_t write;
+    off_t size;
+
+    printf("Testing WAL commit...\n");
+
+    make_key(&metadata, 10, 3);
+    for (int i = 0; i < 10; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), 10, 3, 0);
+    }
+
+    ASSERT(rke_store_metadata(&metadata) == RKE_SUCCESS);
+    ASSERT(rke_wal_is_open());
+    rke_wal_get_stats(&before);
+
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 10) == RKE_SUCCESS);
+    rke_wal_get_stats(&after);
+    ASSERT(after.records == before.records + 1);
+    ASSERT(after.syncs == before.syncs + 1);
+    ASSERT(file_size(WAL_PATH) > (off_t)(10 * sizeof(struct rke_fragment_t)));
+
+    rke_cache_clear();
+    ASSERT(rke_load_fragments(metadata.key_id, &loaded_metadata, loaded, 10) == 10);
+    ASSERT(memcmp(loaded, stored, 10 * sizeof(struct rke_fragment_t)) == 0);
+
+    ASSERT(rke_delete_fragment(metadata.key_id, 4) == RKE_SUCCESS);
+    ASSERT(rke_count_fragments(metadata.key_id) == 9);
+
+    // A fragment for a free slot logs that slot and the header, not the whole container
+    size = file_size(WAL_PATH);
+    ASSERT(rke_store_fragment(&stored[3], metadata.key_id) == RKE_SUCCESS);
+    ASSERT(file_size(WAL_PATH) - size < RKE_CONTAINER_HEADER_SIZE);
+    rke_cache_clear();
+    ASSERT(rke_load_fragments(metadata.key_id, &loaded_metadata, loaded, 10) == 10);
+    ASSERT(memcmp(loaded, stored, 10 * sizeof(struct rke_fragment_t)) == 0);
+
+    // Invalid input never reaches the log
+    write.offset = 0;
+    write.length = 0;
+    write.data = (const unsigned char *)"x";
+    ASSERT(rke_wal_commit(metadata.key_id, NULL, 1) == RKE_ERROR_INVALID_PARAM);
+    ASSERT(rke_wal_commit(metadata.key_id, &write, 1) == RKE_ERROR_INVALID_PARAM);
+
+    printf("WAL commit tests passed!\n");
+    return 0;
+}
+
+struct writer_arg_t {
+    struct rke_key_metadata_t keys[WRITES_PER_THREAD];
+    int failures;
+};
+
+static void *writer_thread(void *ptr) {
+    struct writer_arg_t *arg = (struct writer_arg_t *)ptr;
+    struct rke_fragment_t fragments[3];
+
+    for (int i = 0; i < 3; i++) {
+        make_fragment(&fragments[i], (uint8_t)(i + 1), 3, 2, 0);
+    }
+
+    for (int i = 0; i < WRITES_PER_THREAD; i++) {
+        make_key(&arg->keys[i], 3, 2);
+        if (rke_store_fragments(arg->keys[i].key_id, &arg->keys[i], fragments, 3) != RKE_SUCCESS) {
+            arg->failures++;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Test that concurrent writers share fdatasync calls
+ */
+int test_group_commit() {
+    static struct writer_arg_t args[WRITER_THREADS];
+    pthread_t threads[WRITER_THREADS];
+    struct rke_wal_stats_t before, after;
+    int failures = 0, verified = 0;
+
+    printf("Testing group commit...\n");
+
+    rke_wal_set_window(2000);
+    rke_wal_get_stats(&before);
+
+    memset(args, 0, sizeof(args));
+    for (int t = 0; t < WRITER_THREADS; t++) {
+        ASSERT(pthread_create(&threads[t], NULL, writer_thread, &args[t]) == 0);
+    }
+    for (int t = 0; t < WRITER_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        failures += args[t].failures;
+    }
+
+    rke_wal_get_stats(&after);
+    rke_wal_set_window(RKE_WAL_DEFAULT_WINDOW_US);
+
+    ASSERT(failures == 0);
+    ASSERT(after.records - before.records == WRITER_THREADS * WRITES_PER_THREAD);
+    ASSERT(after.syncs - before.syncs < after.records - before.records);
+    printf("  %d records in %d syncs\n", (int)(after.records - before.records), (int)(after.syncs - before.syncs));
+
+    rke_cache_clear();
+    for (int t = 0; t < WRITER_THREADS; t++) {
+        for (int i = 0; i < WRITES_PER_THREAD; i++) {
+            verified += (rke_load_fragments(args[t].keys[i].key_id, NULL, loaded, 3) == 3);
+        }
+    }
+    ASSERT(verified == WRITER_THREADS * WRITES_PER_THREAD);
+
+    printf("Group commit tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that reopening the log repairs containers a crash left behind
+ */
+int test_crash_recovery() {
+    static unsigned char old_image[1 << 17];
+    struct rke_key_metadata_t metadata, loaded_metadata;
+    struct rke_wal_stats_t stats;
+    char path[4096];
+    ssize_t old_length;
+
+    printf("Testing crash recovery...\n");
+
+    make_key(&metadata, 10, 3);
+    for (int i = 0; i < 10; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), 10, 3, 0);
+    }
+
+    // Version 1 is checkpointed, version 2 is only in the log
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 5) == RKE_SUCCESS);
+    ASSERT(rke_wal_checkpoint() == RKE_SUCCESS);
+    ASSERT(file_size(WAL_PATH) == 0);
+    ASSERT(rke_container_path(metadata.key_id, path, sizeof(path)) == RKE_SUCCESS);
+    old_length = read_file(path, old_image, sizeof(old_image));
+    ASSERT(old_length > 0);
+    ASSERT(rke_store_fragments(metadata.key_id, NULL, &stored[5], 5) == RKE_SUCCESS);
+
+    // Crash: the rename of version 2 never reached the disk and the last log write was torn
+    rke_wal_close();
+    ASSERT(!rke_wal_is_open());
+    ASSERT(write_file(path, old_image, (size_t)old_length, O_TRUNC) == 0);
+    ASSERT(write_file(WAL_PATH, (const unsigned char *)"RKEW\x40\x00\x00\x00torn", 12, O_APPEND) == 0);
+    rke_cache_clear();
+
+    // The first access replays the log
+    ASSERT(rke_load_fragments(metadata.key_id, &loaded_metadata, loaded, 10) == 10);
+    ASSERT(memcmp(loaded, stored, 10 * sizeof(struct rke_fragment_t)) == 0);
+    ASSERT(memcmp(&loaded_metadata, &metadata, sizeof(metadata)) == 0);
+    rke_wal_get_stats(&stats);
+    ASSERT(stats.replayed == 1);
+    ASSERT(file_size(WAL_PATH) == 0);
+
+    // A clean shutdown leaves nothing to replay
+    ASSERT(rke_store_fragments(metadata.key_id, NULL, stored, 1) == RKE_SUCCESS);
+    ASSERT(rke_wal_checkpoint() == RKE_SUCCESS);
+    rke_wal_close();
+    rke_cache_clear();
+    ASSERT(rke_count_fragments(metadata.key_id) == 10);
+    rke_wal_get_stats(&stats);
+    ASSERT(stats.replayed == 0);
+    ASSERT(stats.checkpoints == 0);
+
+    printf("Crash recovery tests passed!\n");
+    return 0;
+}
+
+/*
+ * Test that a store whose container write fails is reported and never comes back from the log
+ */
+int test_failed_apply() {
+    struct rke_key_metadata_t metadata;
+    char path[4096], temp[4100];
+
+    printf("Testing failed container write...\n");
+
+    make_key(&metadata, 10, 3);
+    for (int i = 0; i < 10; i++) {
+        make_fragment(&stored[i], (uint8_t)(i + 1), 10, 3, 7);
+    }
+
+    ASSERT(rke_store_fragments(metadata.key_id, &metadata, stored, 5) == RKE_SUCCESS);
+    ASSERT(rke_wal_checkpoint() == RKE_SUCCESS);
+
+    // A directory in place of the temporary container makes every rewrite of it fail
+    ASSERT(rke_container_path(metadata.key_id, path, sizeof(path)) == RKE_SUCCESS);
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    ASSERT(mkdir(temp, 0750) == 0);
+
+    // The failed update is reported, and neither the container nor a replay of the log has it
+    ASSERT(rke_replace_key(&metadata, &stored[5], 5) == RKE_ERROR_STORAGE_FAIL);
+    ASSERT(rke_count_fragments(metadata.key_id) == 5);
+    ASSERT(rmdir(temp) == 0);
+    rke_wal_close();
+    rke_cache_clear();
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 10) == 5);
+    ASSERT(memcmp(loaded, stored, 5 * sizeof(struct rke_fragment_t)) == 0);
+
+    // The next update builds on the container and survives a replay of the log
+    ASSERT(rke_store_fragments(metadata.key_id, NULL, &stored[5], 5) == RKE_SUCCESS);
+    ASSERT(rke_count_fragments(metadata.key_id) == 10);
+    ASSERT(file_size(WAL_PATH) > 0);
+    rke_wal_close();
+    rke_cache_clear();
+    ASSERT(rke_load_fragments(metadata.key_id, NULL, loaded, 10) == 10);
+    ASSERT(memcmp(loaded, stored, 10 * sizeof(struct rke_fragment_t)) == 0);
+    ASSERT(file_size(WAL_PATH) == 0);
+
+    printf("Failed container write tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE WAL Tests\n");
+    printf("=============\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+    if (test_setup_storage() != 0) {
+        printf("Can't create test directory %s\n", config.cwd);
+        return 1;
+    }
+
+    // Run all tests
+    TEST_FUNCTION(test_wal_commit);
+    TEST_FUNCTION(test_group_commit);
+    TEST_FUNCTION(test_crash_recovery);
+    TEST_FUNCTION(test_failed_apply);
+
+    test_teardown_storage();
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}
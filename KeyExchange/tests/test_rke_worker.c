@@ -0,0 +1,156 @@
+/* ====================================================
+#   Copyright (C) 2024 CloudCoinConsortium
+#
+#   Author        : RKE Implementation Team
+#   File Name     : test_rke_worker.c
+#   Last Modified : 2024-07-20
+#   Describe      : Unit tests for the per-thread worker state and its response arena
+#
+# ====================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "../src/rke/rke.h"
+#include "../src/rke/rke_worker.h"
+#include "../src/common/log.h"
+#include "../src/common/utils.h"
+#include "../src/common/protocol.h"
+
+// Define global variables
+int current_log_level = LOG_LEVEL_DEBUG;
+struct config_s config = {
+    .cwd = "/tmp/rke_test_worker",
+    .coin_id = 1
+};
+
+// Test counter
+static int tests_run = 0;
+static int tests_passed = 0;
+
+// Test macros
+#define ASSERT(condition) do { \
+    tests_run++; \
+    if (condition) { \
+        tests_passed++; \
+        printf("✓ Test %d passed\n", tests_run); \
+    } else { \
+        printf("✗ Test %d failed: %s\n", tests_run, #condition); \
+        return -1; \
+    } \
+} while(0)
+
+#define TEST_FUNCTION(name) \
+    printf("\n=== Testing %s ===\n", #name); \
+    if (name() != 0) { \
+        printf("Test function %s failed!\n", #name); \
+        return -1; \
+    }
+
+static void *alloc_and_exit(void *arg) {
+    conn_info_t *ci = (conn_info_t *)arg;
+
+    if (rke_alloc_output(ci, 64) != NULL) {
+        memset(ci->output, 0xA5, 64);
+    }
+    return NULL;
+}
+
+static void *release_elsewhere(void *arg) {
+    release_output((conn_info_t *)arg);
+    return NULL;
+}
+
+/*
+ * Test that responses come from the worker arena and that it rewinds once all are released
+ */
+int test_output_arena() {
+    conn_info_t first, second, third, big;
+    conn_info_t chunks[RKE_OUTPUT_ARENA_SIZE / 32768 + 1];
+    unsigned char *start;
+    pthread_t thread;
+    int from_arena = 0;
+
+    printf("Testing output arena...\n");
+
+    memset(&first, 0, sizeof(first));
+    memset(&second, 0, sizeof(second));
+    memset(&third, 0, sizeof(third));
+    memset(&big, 0, sizeof(big));
+
+    ASSERT(rke_alloc_output(&first, 1) != NULL);
+    ASSERT(first.output_size == 1);
+    ASSERT(first.output_release != NULL);
+    start = first.output;
+    release_output(&first);
+    ASSERT(first.output == NULL && first.output_release == NULL);
+
+    // Outstanding responses never overlap; the arena rewinds once they are all back
+    ASSERT(rke_alloc_output(&first, 10) == start);
+    ASSERT(rke_alloc_output(&second, 10) != NULL);
+    ASSERT(second.output >= first.output + 10);
+    release_output(&first);
+    ASSERT(rke_alloc_output(&third, 10) > second.output);
+    release_output(&second);
+    release_output(&third);
+    ASSERT(rke_alloc_output(&third, 10) == start);
+    release_output(&third);
+
+    // Oversized responses and a full arena fall back to malloc
+    ASSERT(rke_alloc_output(&big, RKE_OUTPUT_ARENA_SIZE + 1) != NULL);
+    ASSERT(big.output_release == NULL);
+    release_output(&big);
+    for (int i = 0; i < (int)(sizeof(chunks) / sizeof(chunks[0])); i++) {
+        memset(&chunks[i], 0, sizeof(chunks[i]));
+        ASSERT(rke_alloc_output(&chunks[i], 32768) != NULL);
+        from_arena += (chunks[i].output_release != NULL);
+    }
+    ASSERT(from_arena == RKE_OUTPUT_ARENA_SIZE / 32768);
+    for (int i = 0; i < (int)(sizeof(chunks) / sizeof(chunks[0])); i++) {
+        release_output(&chunks[i]);
+    }
+
+    // A release from another thread counts, as does one after the owning thread has exited
+    ASSERT(rke_alloc_output(&first, 10) == start);
+    ASSERT(pthread_create(&thread, NULL, release_elsewhere, &first) == 0);
+    pthread_join(thread, NULL);
+    ASSERT(rke_alloc_output(&first, 10) == start);
+    release_output(&first);
+
+    ASSERT(pthread_create(&thread, NULL, alloc_and_exit, &second) == 0);
+    pthread_join(thread, NULL);
+    ASSERT(second.output != NULL && second.output_release != NULL);
+    ASSERT(second.output[63] == 0xA5);
+    release_output(&second);
+
+    printf("Output arena tests passed!\n");
+    return 0;
+}
+
+int main() {
+    printf("RKE Worker Tests\n");
+    printf("================\n");
+
+    // Set log level to reduce noise during testing
+    current_log_level = LOG_LEVEL_ERROR;
+
+    // Run all tests
+    TEST_FUNCTION(test_output_arena);
+
+    // Print results
+    printf("\n=== Test Results ===\n");
+    printf("Total tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("✓ All tests passed!\n");
+        return 0;
+    } else {
+        printf("✗ Some tests failed!\n");
+        return 1;
+    }
+}